@@ -0,0 +1,254 @@
+/*
+ * DataService::process_data拆包/粘包的吞吐测试
+ * 1. 生成一段流水线的请求流(语料), 不同功能码和大小随机混合
+ * 2. 把同一段请求流按不同的方式切分后重放给process_data:
+ *    dribble(每次1字节)、every-offset(依次用1~260字节的固定块, 覆盖所有的帧内切分位置)、
+ *    mtu(1460字节)、burst(64KB)、random(1~1460随机)
+ * 3. 输出每种切分方式的bytes/s和frames/s, 并校验处理的帧数和语料一致
+ *
+ * 用法: bench_framing [-n 帧数] [-r 重复次数] [-p] [-f csv|json] [-o 语料输出文件] [-i 语料输入文件]
+ *   -p: 使用完整的process_session处理每一帧(默认使用空的帧处理方法, 只测拆包)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+#include "modbus_tcp_data.h"
+
+#define FRAMING_MTU 1460
+#define FRAMING_BURST 65536
+#define FRAMING_MAX_FRAME 260
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+struct FramingStats {
+  unsigned long frames;
+  unsigned long bytes;
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void on_frame(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len, void *arg)
+{
+  FramingStats *stats = (FramingStats *)arg;
+  stats->frames++;
+  stats->bytes += req_len;
+}
+
+static void noop_handler(ModbusTCP::DataSession *session, ModbusData *modbus_data, void *arg)
+{
+}
+
+static int build_frame(unsigned char *buf, unsigned short tid, unsigned int *seed)
+{
+  static const unsigned char fcs[] = {
+    MODBUS_FC_READ_COILS, MODBUS_FC_READ_HOLDING_REGS, MODBUS_FC_READ_INPUT_REGS, MODBUS_FC_WRITE_SINGLE_COIL,
+    MODBUS_FC_WRITE_SINGLE_REG, MODBUS_FC_WRITE_MULTIPLE_COILS, MODBUS_FC_WRITE_MULTIPLE_REGS, MODBUS_FC_WRITE_AND_READ_REGS
+  };
+  unsigned char func_code = fcs[rand_r(seed) % sizeof(fcs)];
+  unsigned char *pdu = buf + 7;
+  int pdu_len = 5;
+  int quantity;
+  pdu[0] = func_code;
+  ModbusTCP::HexData::bin16_to_8(rand_r(seed) % 512, pdu + 1);
+  switch (func_code) {
+    case MODBUS_FC_READ_COILS:
+      ModbusTCP::HexData::bin16_to_8(rand_r(seed) % 2000 + 1, pdu + 3);
+      break;
+    case MODBUS_FC_READ_HOLDING_REGS:
+    case MODBUS_FC_READ_INPUT_REGS:
+      ModbusTCP::HexData::bin16_to_8(rand_r(seed) % 125 + 1, pdu + 3);
+      break;
+    case MODBUS_FC_WRITE_SINGLE_COIL:
+      ModbusTCP::HexData::bin16_to_8(0xFF00, pdu + 3);
+      break;
+    case MODBUS_FC_WRITE_SINGLE_REG:
+      ModbusTCP::HexData::bin16_to_8(tid, pdu + 3);
+      break;
+    case MODBUS_FC_WRITE_MULTIPLE_COILS:
+      quantity = rand_r(seed) % 1968 + 1;
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = (quantity + 7) / 8;
+      memset(pdu + 6, 0xA5, pdu[5]);
+      pdu_len = 6 + pdu[5];
+      break;
+    case MODBUS_FC_WRITE_MULTIPLE_REGS:
+      quantity = rand_r(seed) % 123 + 1;
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = quantity * 2;
+      memset(pdu + 6, 0x5A, pdu[5]);
+      pdu_len = 6 + pdu[5];
+      break;
+    case MODBUS_FC_WRITE_AND_READ_REGS:
+      quantity = rand_r(seed) % 121 + 1;
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(rand_r(seed) % 512, pdu + 5);
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 7);
+      pdu[9] = quantity * 2;
+      memset(pdu + 10, 0x33, pdu[9]);
+      pdu_len = 10 + pdu[9];
+      break;
+  }
+  ModbusTCP::HexData::bin16_to_8(tid, buf);
+  ModbusTCP::HexData::bin16_to_8(0, buf + 2);
+  ModbusTCP::HexData::bin16_to_8(pdu_len + 1, buf + 4);
+  buf[6] = 1;
+  return 7 + pdu_len;
+}
+
+static void generate_corpus(std::vector<unsigned char> *corpus, int frame_count)
+{
+  unsigned int seed = 20220601;
+  unsigned char buf[FRAMING_MAX_FRAME];
+  corpus->clear();
+  for (int i = 0; i < frame_count; i++) {
+    int len = build_frame(buf, (unsigned short)i, &seed);
+    corpus->insert(corpus->end(), buf, buf + len);
+  }
+}
+
+// 统计语料的帧数, 同时检查语料本身的格式
+static int count_frames(const std::vector<unsigned char> &corpus)
+{
+  size_t offset = 0;
+  int count = 0;
+  while (offset + 7 <= corpus.size()) {
+    int len = ((int)corpus[offset + 4] << 8) + corpus[offset + 5];
+    if (len < 2 || len > 254) return -1;
+    offset += len + 6;
+    count++;
+  }
+  return offset == corpus.size() ? count : -1;
+}
+
+/* replay: 按切分方式把语料重放给一个新的DataService
+ * @param chunk: 固定的块大小, 为0时每块大小随机(1~MTU)
+ */
+static void replay(ModbusData *modbus_data, bool full, std::vector<unsigned char> &corpus, int chunk, FramingStats *stats)
+{
+  DataService service(modbus_data);
+  if (!full) service.set_session_handler(noop_handler, NULL);
+  unsigned int seed = 1;
+  size_t offset = 0;
+  size_t total = corpus.size();
+  unsigned char *data = &corpus[0];
+  while (offset < total) {
+    size_t n = chunk > 0 ? chunk : rand_r(&seed) % FRAMING_MTU + 1;
+    if (n > total - offset) n = total - offset;
+    service.process_data(data + offset, (int)n, on_frame, stats);
+    offset += n;
+  }
+}
+
+struct Pattern {
+  const char *name;
+  int chunk_min;
+  int chunk_max;
+};
+
+int main(int argc, char *argv[])
+{
+  int frame_count = 10000;
+  int repeat = 5;
+  bool full = false;
+  bool json = false;
+  const char *out_path = NULL;
+  const char *in_path = NULL;
+  for (int i = 1; i < argc; i++) {
+    bool has_val = i + 1 < argc;
+    if (strcmp(argv[i], "-n") == 0 && has_val) frame_count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && has_val) repeat = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-p") == 0) full = true;
+    else if (strcmp(argv[i], "-f") == 0 && has_val) json = strcmp(argv[++i], "json") == 0;
+    else if (strcmp(argv[i], "-o") == 0 && has_val) out_path = argv[++i];
+    else if (strcmp(argv[i], "-i") == 0 && has_val) in_path = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [-n frames] [-r repeat] [-p] [-f csv|json] [-o corpus_out] [-i corpus_in]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (repeat < 1) repeat = 1;
+
+  std::vector<unsigned char> corpus;
+  if (in_path != NULL) {
+    FILE *fp = fopen(in_path, "rb");
+    if (fp == NULL) {
+      fprintf(stderr, "open %s failed\n", in_path);
+      return -1;
+    }
+    unsigned char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) corpus.insert(corpus.end(), buf, buf + n);
+    fclose(fp);
+  }
+  else {
+    generate_corpus(&corpus, frame_count);
+  }
+  int expect_frames = count_frames(corpus);
+  if (expect_frames <= 0) {
+    fprintf(stderr, "invalid corpus\n");
+    return -1;
+  }
+  if (out_path != NULL) {
+    FILE *fp = fopen(out_path, "wb");
+    if (fp == NULL || fwrite(&corpus[0], 1, corpus.size(), fp) != corpus.size()) {
+      fprintf(stderr, "write %s failed\n", out_path);
+      if (fp != NULL) fclose(fp);
+      return -1;
+    }
+    fclose(fp);
+  }
+
+  ModbusData modbus_data(4096, 4096, 4096, 4096);
+  const Pattern patterns[] = {
+    {"dribble", 1, 1},
+    {"every-offset", 1, FRAMING_MAX_FRAME},
+    {"mtu", FRAMING_MTU, FRAMING_MTU},
+    {"burst", FRAMING_BURST, FRAMING_BURST},
+    {"random", 0, 0},
+  };
+
+  if (!json) printf("pattern,handler,corpus_bytes,corpus_frames,replays,bytes_per_sec,frames_per_sec,ns_per_frame,ok\n");
+  bool all_ok = true;
+  for (unsigned int p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+    const Pattern *pattern = &patterns[p];
+    FramingStats stats;
+    stats.frames = 0;
+    stats.bytes = 0;
+    int replays = 0;
+    bool ok = true;
+    uint64_t start = now_ns();
+    for (int r = 0; r < repeat; r++) {
+      // every-offset: 块大小从1到最大帧长, 每帧的每个切分位置都会出现
+      for (int chunk = pattern->chunk_min; chunk <= pattern->chunk_max; chunk++) {
+        unsigned long frames = stats.frames;
+        replay(&modbus_data, full, corpus, chunk, &stats);
+        if (stats.frames - frames != (unsigned long)expect_frames) ok = false;
+        replays++;
+      }
+    }
+    double secs = (now_ns() - start) / 1e9;
+    all_ok = all_ok && ok;
+    if (json) {
+      printf("{\"pattern\":\"%s\",\"handler\":\"%s\",\"corpus_bytes\":%lu,\"corpus_frames\":%d,\"replays\":%d,"
+        "\"bytes_per_sec\":%.0f,\"frames_per_sec\":%.0f,\"ns_per_frame\":%.1f,\"ok\":%s}\n",
+        pattern->name, full ? "process_session" : "noop", (unsigned long)corpus.size(), expect_frames, replays,
+        stats.bytes / secs, stats.frames / secs, secs * 1e9 / stats.frames, ok ? "true" : "false");
+    }
+    else {
+      printf("%s,%s,%lu,%d,%d,%.0f,%.0f,%.1f,%d\n",
+        pattern->name, full ? "process_session" : "noop", (unsigned long)corpus.size(), expect_frames, replays,
+        stats.bytes / secs, stats.frames / secs, secs * 1e9 / stats.frames, ok ? 1 : 0);
+    }
+    fflush(stdout);
+  }
+  return all_ok ? 0 : 1;
+}
@@ -0,0 +1,177 @@
+/*
+ * process_session的抖动测试(软实时模式)
+ * 锁定内存、预先申请内存池、切换到SCHED_FIFO后循环处理各个功能码的请求, 统计每个请求的耗时(ns),
+ * 输出最小值、平均值、百分位和最大值, 关注的是最大值(最坏情况)
+ * SCHED_FIFO和mlockall需要root或者CAP_SYS_NICE/CAP_IPC_LOCK, 没有权限时仍然运行, 但结果里会标明
+ *
+ * 用法: bench_jitter [-n 请求数] [-p 实时优先级] [-c 绑定的CPU] [-f csv|json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "modbus_tcp_data.h"
+#include "modbus_histogram.h"
+#include "modbus_rt.h"
+
+#define BENCH_DATA_COUNT 2000
+
+struct JitterCase {
+  unsigned char func_code;
+  int quantity;
+  int req_len;
+  unsigned char req[260];
+  ModbusHistogram latency;
+};
+
+// 每个功能码取协议允许的最大请求(最坏情况)和一个小请求
+static JitterCase CASES[] = {
+  {MODBUS_FC_READ_COILS, 16}, {MODBUS_FC_READ_COILS, 2000},
+  {MODBUS_FC_READ_DISCRETE_INPUTS, 16}, {MODBUS_FC_READ_DISCRETE_INPUTS, 2000},
+  {MODBUS_FC_READ_HOLDING_REGS, 10}, {MODBUS_FC_READ_HOLDING_REGS, 125},
+  {MODBUS_FC_READ_INPUT_REGS, 10}, {MODBUS_FC_READ_INPUT_REGS, 125},
+  {MODBUS_FC_WRITE_SINGLE_COIL, 1},
+  {MODBUS_FC_WRITE_SINGLE_REG, 1},
+  {MODBUS_FC_WRITE_MULTIPLE_COILS, 16}, {MODBUS_FC_WRITE_MULTIPLE_COILS, 1968},
+  {MODBUS_FC_WRITE_MULTIPLE_REGS, 10}, {MODBUS_FC_WRITE_MULTIPLE_REGS, 123},
+  {MODBUS_FC_MASK_WRITE_REG, 1},
+  {MODBUS_FC_WRITE_AND_READ_REGS, 10}, {MODBUS_FC_WRITE_AND_READ_REGS, 121},
+};
+#define CASE_COUNT (int)(sizeof(CASES) / sizeof(CASES[0]))
+
+static int build_request(unsigned char *buf, unsigned char func_code, int quantity)
+{
+  int pdu_len = 0;
+  unsigned char *pdu = buf + 7;
+  pdu[0] = func_code;
+  ModbusTCP::HexData::bin16_to_8(0, pdu + 1); // 起始地址
+  switch (func_code) {
+    case MODBUS_FC_READ_COILS:
+    case MODBUS_FC_READ_DISCRETE_INPUTS:
+    case MODBUS_FC_READ_HOLDING_REGS:
+    case MODBUS_FC_READ_INPUT_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu_len = 5;
+      break;
+    case MODBUS_FC_WRITE_SINGLE_COIL:
+      ModbusTCP::HexData::bin16_to_8(0xFF00, pdu + 3);
+      pdu_len = 5;
+      break;
+    case MODBUS_FC_WRITE_SINGLE_REG:
+      ModbusTCP::HexData::bin16_to_8(0x1234, pdu + 3);
+      pdu_len = 5;
+      break;
+    case MODBUS_FC_WRITE_MULTIPLE_COILS: {
+      int byte_size = (quantity + 7) / 8;
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = byte_size;
+      for (int i = 0; i < byte_size; i++) pdu[6 + i] = 0x55;
+      pdu_len = 6 + byte_size;
+      break;
+    }
+    case MODBUS_FC_WRITE_MULTIPLE_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = quantity * 2;
+      for (int i = 0; i < quantity; i++) ModbusTCP::HexData::bin16_to_8(i, pdu + 6 + i * 2);
+      pdu_len = 6 + quantity * 2;
+      break;
+    case MODBUS_FC_MASK_WRITE_REG:
+      ModbusTCP::HexData::bin16_to_8(0xF0F0, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(0x0505, pdu + 5);
+      pdu_len = 7;
+      break;
+    case MODBUS_FC_WRITE_AND_READ_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(1000, pdu + 5);
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 7);
+      pdu[9] = quantity * 2;
+      for (int i = 0; i < quantity; i++) ModbusTCP::HexData::bin16_to_8(i, pdu + 10 + i * 2);
+      pdu_len = 10 + quantity * 2;
+      break;
+  }
+  ModbusTCP::HexData::bin16_to_8(1, buf);
+  ModbusTCP::HexData::bin16_to_8(0, buf + 2);
+  ModbusTCP::HexData::bin16_to_8(pdu_len + 1, buf + 4);
+  buf[6] = 1;
+  return 7 + pdu_len;
+}
+
+static inline uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+  long iterations = 10000000;
+  int priority = 80;
+  int cpu = -1;
+  bool json = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) iterations = atol(argv[++i]);
+    else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) priority = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) cpu = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) json = strcmp(argv[++i], "json") == 0;
+    else {
+      fprintf(stderr, "usage: %s [-n requests] [-p priority] [-c cpu] [-f csv|json]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (iterations < 1) iterations = 1;
+
+  // 初始化: 所有内存在这里申请
+  ModbusBaseData modbus_data(BENCH_DATA_COUNT, BENCH_DATA_COUNT, BENCH_DATA_COUNT, BENCH_DATA_COUNT);
+  ModbusTCP::DataSession session(260, 260);
+  ModbusHistogram total;
+  for (int i = 0; i < CASE_COUNT; i++) {
+    CASES[i].req_len = build_request(CASES[i].req, CASES[i].func_code, CASES[i].quantity);
+  }
+  ModbusRT::reserve_sessions(1);
+  bool locked = ModbusRT::lock_memory() == 0;
+  bool realtime = ModbusRT::enter_realtime(priority, cpu) == 0;
+  ModbusRT::prefault_stack();
+
+  // 预热(统计等线程数据在第一次使用时申请), 然后禁止堆申请
+  for (int i = 0; i < CASE_COUNT * 100; i++) {
+    JitterCase *c = &CASES[i % CASE_COUNT];
+    session.set_request_data(c->req, c->req_len);
+    ModbusTCP::DataService<ModbusBaseData>::process_session(&session, &modbus_data);
+  }
+  ModbusRT::forbid_heap();
+
+  for (long n = 0; n < iterations; n++) {
+    JitterCase *c = &CASES[n % CASE_COUNT];
+    uint64_t start = now_ns();
+    session.set_request_data(c->req, c->req_len);
+    ModbusTCP::DataService<ModbusBaseData>::process_session(&session, &modbus_data);
+    uint64_t ns = now_ns() - start;
+    c->latency.record(ns);
+    total.record(ns);
+  }
+  ModbusRT::allow_heap();
+
+  if (json) {
+    printf("{\"requests\":%ld,\"mlock\":%d,\"sched_fifo\":%d,\"heap_violations\":%llu,\"min_ns\":%llu,\"mean_ns\":%.1f,"
+      "\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"p9999_ns\":%llu,\"max_ns\":%llu}\n",
+      iterations, locked, realtime, (unsigned long long)ModbusRT::get_heap_violations(),
+      (unsigned long long)total.get_min(), total.get_mean(), (unsigned long long)total.get_percentile(50),
+      (unsigned long long)total.get_percentile(99), (unsigned long long)total.get_percentile(99.9),
+      (unsigned long long)total.get_percentile(99.99), (unsigned long long)total.get_max());
+    return 0;
+  }
+  printf("requests=%ld, mlock=%s, sched_fifo=%s, heap_violations=%llu\n", iterations,
+    locked ? "yes" : "no", realtime ? "yes" : "no", (unsigned long long)ModbusRT::get_heap_violations());
+  printf("func_code,quantity,count,min_ns,mean_ns,p99_ns,p999_ns,max_ns\n");
+  for (int i = 0; i < CASE_COUNT; i++) {
+    const ModbusHistogram &h = CASES[i].latency;
+    printf("0x%02X,%d,%llu,%llu,%.1f,%llu,%llu,%llu\n", CASES[i].func_code, CASES[i].quantity,
+      (unsigned long long)h.get_count(), (unsigned long long)h.get_min(), h.get_mean(),
+      (unsigned long long)h.get_percentile(99), (unsigned long long)h.get_percentile(99.9), (unsigned long long)h.get_max());
+  }
+  printf("all,-,%llu,%llu,%.1f,%llu,%llu,%llu\n", (unsigned long long)total.get_count(), (unsigned long long)total.get_min(),
+    total.get_mean(), (unsigned long long)total.get_percentile(99), (unsigned long long)total.get_percentile(99.9),
+    (unsigned long long)total.get_max());
+  return 0;
+}
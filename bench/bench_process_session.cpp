@@ -0,0 +1,215 @@
+/*
+ * process_session的微基准测试
+ * 对16种DataService实例化的每个功能码、不同请求大小, 测量每个请求的耗时(ns)和堆分配(字节/次数)
+ * 输出为CSV(默认)或者JSON(每行一个对象), 方便对比不同BIT_T/REG_T组合和跟踪性能回退
+ *
+ * 用法: bench_process_session [-n 迭代次数] [-f csv|json] [-t 类型名过滤]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <chrono>
+#include "modbus_tcp_data.h"
+
+/************************* 堆分配统计 ***************************/
+
+static bool g_alloc_enabled = false;
+static unsigned long g_alloc_bytes = 0;
+static unsigned long g_alloc_count = 0;
+
+static void *counted_alloc(size_t size)
+{
+  if (g_alloc_enabled) {
+    g_alloc_bytes += size;
+    g_alloc_count++;
+  }
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t size) { return counted_alloc(size); }
+void *operator new[](size_t size) { return counted_alloc(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+
+/************************* 请求构造 ***************************/
+
+#define BENCH_DATA_COUNT 2000
+
+struct BenchCase {
+  unsigned char func_code;
+  int quantity;
+};
+
+// 每个功能码的请求大小, 包含协议允许的最大值
+static const BenchCase BENCH_CASES[] = {
+  {MODBUS_FC_READ_COILS, 1}, {MODBUS_FC_READ_COILS, 64}, {MODBUS_FC_READ_COILS, 512}, {MODBUS_FC_READ_COILS, 2000},
+  {MODBUS_FC_READ_DISCRETE_INPUTS, 1}, {MODBUS_FC_READ_DISCRETE_INPUTS, 64}, {MODBUS_FC_READ_DISCRETE_INPUTS, 512}, {MODBUS_FC_READ_DISCRETE_INPUTS, 2000},
+  {MODBUS_FC_READ_HOLDING_REGS, 1}, {MODBUS_FC_READ_HOLDING_REGS, 16}, {MODBUS_FC_READ_HOLDING_REGS, 64}, {MODBUS_FC_READ_HOLDING_REGS, 125},
+  {MODBUS_FC_READ_INPUT_REGS, 1}, {MODBUS_FC_READ_INPUT_REGS, 16}, {MODBUS_FC_READ_INPUT_REGS, 64}, {MODBUS_FC_READ_INPUT_REGS, 125},
+  {MODBUS_FC_WRITE_SINGLE_COIL, 1},
+  {MODBUS_FC_WRITE_SINGLE_REG, 1},
+  {MODBUS_FC_WRITE_MULTIPLE_COILS, 1}, {MODBUS_FC_WRITE_MULTIPLE_COILS, 64}, {MODBUS_FC_WRITE_MULTIPLE_COILS, 512}, {MODBUS_FC_WRITE_MULTIPLE_COILS, 1968},
+  {MODBUS_FC_WRITE_MULTIPLE_REGS, 1}, {MODBUS_FC_WRITE_MULTIPLE_REGS, 16}, {MODBUS_FC_WRITE_MULTIPLE_REGS, 64}, {MODBUS_FC_WRITE_MULTIPLE_REGS, 123},
+  {MODBUS_FC_MASK_WRITE_REG, 1},
+  {MODBUS_FC_WRITE_AND_READ_REGS, 1}, {MODBUS_FC_WRITE_AND_READ_REGS, 16}, {MODBUS_FC_WRITE_AND_READ_REGS, 64}, {MODBUS_FC_WRITE_AND_READ_REGS, 121},
+};
+
+static int build_request(unsigned char *buf, unsigned char func_code, int quantity)
+{
+  int pdu_len = 0;
+  unsigned char *pdu = buf + 7;
+  pdu[0] = func_code;
+  ModbusTCP::HexData::bin16_to_8(0, pdu + 1); // 起始地址
+  switch (func_code) {
+    case MODBUS_FC_READ_COILS:
+    case MODBUS_FC_READ_DISCRETE_INPUTS:
+    case MODBUS_FC_READ_HOLDING_REGS:
+    case MODBUS_FC_READ_INPUT_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu_len = 5;
+      break;
+    case MODBUS_FC_WRITE_SINGLE_COIL:
+      ModbusTCP::HexData::bin16_to_8(0xFF00, pdu + 3);
+      pdu_len = 5;
+      break;
+    case MODBUS_FC_WRITE_SINGLE_REG:
+      ModbusTCP::HexData::bin16_to_8(0x1234, pdu + 3);
+      pdu_len = 5;
+      break;
+    case MODBUS_FC_WRITE_MULTIPLE_COILS: {
+      int byte_size = (quantity + 7) / 8;
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = byte_size;
+      for (int i = 0; i < byte_size; i++) pdu[6 + i] = 0x55;
+      pdu_len = 6 + byte_size;
+      break;
+    }
+    case MODBUS_FC_WRITE_MULTIPLE_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = quantity * 2;
+      for (int i = 0; i < quantity; i++) ModbusTCP::HexData::bin16_to_8(i, pdu + 6 + i * 2);
+      pdu_len = 6 + quantity * 2;
+      break;
+    case MODBUS_FC_MASK_WRITE_REG:
+      ModbusTCP::HexData::bin16_to_8(0xF0F0, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(0x0505, pdu + 5);
+      pdu_len = 7;
+      break;
+    case MODBUS_FC_WRITE_AND_READ_REGS:
+      // 读和写的个数相同, 地址不同
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(1000, pdu + 5);
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 7);
+      pdu[9] = quantity * 2;
+      for (int i = 0; i < quantity; i++) ModbusTCP::HexData::bin16_to_8(i, pdu + 10 + i * 2);
+      pdu_len = 10 + quantity * 2;
+      break;
+  }
+  ModbusTCP::HexData::bin16_to_8(1, buf);    // 事务标识
+  ModbusTCP::HexData::bin16_to_8(0, buf + 2); // 协议标识
+  ModbusTCP::HexData::bin16_to_8(pdu_len + 1, buf + 4);
+  buf[6] = 1;
+  return 7 + pdu_len;
+}
+
+/************************* 测试 ***************************/
+
+struct BenchOptions {
+  long iterations;
+  bool json;
+  const char *filter;
+};
+
+template <class ModbusData>
+void bench_data(const char *bit_t, const char *reg_t, const BenchOptions *opts)
+{
+  if (opts->filter != NULL && strstr(bit_t, opts->filter) == NULL && strstr(reg_t, opts->filter) == NULL) return;
+
+  ModbusData modbus_data(BENCH_DATA_COUNT, BENCH_DATA_COUNT, BENCH_DATA_COUNT, BENCH_DATA_COUNT);
+  ModbusTCP::DataSession session(260, 260);
+  unsigned char req[260];
+
+  for (unsigned int i = 0; i < sizeof(BENCH_CASES) / sizeof(BENCH_CASES[0]); i++) {
+    const BenchCase *c = &BENCH_CASES[i];
+    int req_len = build_request(req, c->func_code, c->quantity);
+    session.set_request_data(req, req_len);
+    ModbusTCP::DataService<ModbusData>::process_session(&session, &modbus_data);
+    int exp = (session.get_response_data()[7] & 0x80) ? session.get_response_data()[8] : 0;
+
+    // 预热
+    long warmup = opts->iterations / 10 + 1;
+    for (long n = 0; n < warmup; n++) {
+      ModbusTCP::DataService<ModbusData>::process_session(&session, &modbus_data);
+    }
+
+    g_alloc_bytes = 0;
+    g_alloc_count = 0;
+    g_alloc_enabled = true;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long n = 0; n < opts->iterations; n++) {
+      ModbusTCP::DataService<ModbusData>::process_session(&session, &modbus_data);
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    g_alloc_enabled = false;
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / opts->iterations;
+    double bytes = (double)g_alloc_bytes / opts->iterations;
+    double allocs = (double)g_alloc_count / opts->iterations;
+    if (opts->json) {
+      printf("{\"bit_t\":\"%s\",\"reg_t\":\"%s\",\"func_code\":%d,\"quantity\":%d,\"request_bytes\":%d,\"iterations\":%ld,"
+        "\"ns_per_req\":%.1f,\"bytes_per_req\":%.1f,\"allocs_per_req\":%.2f,\"exception\":%d}\n",
+        bit_t, reg_t, c->func_code, c->quantity, req_len, opts->iterations, ns, bytes, allocs, exp);
+    }
+    else {
+      printf("%s,%s,0x%02X,%d,%d,%ld,%.1f,%.1f,%.2f,%d\n",
+        bit_t, reg_t, c->func_code, c->quantity, req_len, opts->iterations, ns, bytes, allocs, exp);
+    }
+    fflush(stdout);
+  }
+}
+
+#define BENCH_TYPE(BIT_T, REG_T, opts) bench_data<ModbusDataTemplate<BIT_T, REG_T>>(#BIT_T, #REG_T, opts)
+
+int main(int argc, char *argv[])
+{
+  BenchOptions opts;
+  opts.iterations = 20000;
+  opts.json = false;
+  opts.filter = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) opts.iterations = atol(argv[++i]);
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) opts.json = strcmp(argv[++i], "json") == 0;
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) opts.filter = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [-n iterations] [-f csv|json] [-t type_filter]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (opts.iterations < 1) opts.iterations = 1;
+
+  if (!opts.json) printf("bit_t,reg_t,func_code,quantity,request_bytes,iterations,ns_per_req,bytes_per_req,allocs_per_req,exception\n");
+
+  BENCH_TYPE(modbus_bit_base_data, modbus_reg_base_data, &opts);
+  BENCH_TYPE(modbus_bit_base_data, modbus_reg_base_ptr_data, &opts);
+  BENCH_TYPE(modbus_bit_base_data, modbus_reg_struct_data, &opts);
+  BENCH_TYPE(modbus_bit_base_data, modbus_reg_struct_ptr_data, &opts);
+
+  BENCH_TYPE(modbus_bit_base_ptr_data, modbus_reg_base_data, &opts);
+  BENCH_TYPE(modbus_bit_base_ptr_data, modbus_reg_base_ptr_data, &opts);
+  BENCH_TYPE(modbus_bit_base_ptr_data, modbus_reg_struct_data, &opts);
+  BENCH_TYPE(modbus_bit_base_ptr_data, modbus_reg_struct_ptr_data, &opts);
+
+  BENCH_TYPE(modbus_bit_struct_data, modbus_reg_base_data, &opts);
+  BENCH_TYPE(modbus_bit_struct_data, modbus_reg_base_ptr_data, &opts);
+  BENCH_TYPE(modbus_bit_struct_data, modbus_reg_struct_data, &opts);
+  BENCH_TYPE(modbus_bit_struct_data, modbus_reg_struct_ptr_data, &opts);
+
+  BENCH_TYPE(modbus_bit_struct_ptr_data, modbus_reg_base_data, &opts);
+  BENCH_TYPE(modbus_bit_struct_ptr_data, modbus_reg_base_ptr_data, &opts);
+  BENCH_TYPE(modbus_bit_struct_ptr_data, modbus_reg_struct_data, &opts);
+  BENCH_TYPE(modbus_bit_struct_ptr_data, modbus_reg_struct_ptr_data, &opts);
+  return 0;
+}
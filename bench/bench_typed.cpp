@@ -0,0 +1,90 @@
+/*
+ * 多寄存器类型的写入耗时
+ * 每个周期把N个float写入输入寄存器, 对比:
+ *   set_data: 应用程序自己拆成两个寄存器, 每个寄存器调用一次set_data
+ *   scalar:   ModbusTyped::encode_scalar转换后再write_input_registers
+ *   typed:    write_input_values(基本型数据结构直接SIMD转换到寄存器的存储)
+ * 输出每个周期的耗时(us)
+ *
+ * 用法: bench_typed [-n 值的个数] [-r 周期数] [-f csv|json]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "modbus_data.h"
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char *argv[])
+{
+  int count = 5000;
+  int rounds = 10000;
+  bool json = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) rounds = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) json = strcmp(argv[++i], "json") == 0;
+    else {
+      fprintf(stderr, "usage: %s [-n count] [-r rounds] [-f csv|json]\n", argv[0]);
+      return -1;
+    }
+  }
+  if (count < 1 || count > 32000) count = 5000;
+  if (rounds < 1) rounds = 1;
+
+  ModbusBaseData modbus_data(10, 10, 10, count * 2);
+  float *values = new float[count];
+  unsigned short *regs = new unsigned short[count * 2];
+  for (int i = 0; i < count; i++) values[i] = i * 0.25f;
+
+  // 每个周期改一下值, 防止被当成不变量
+  uint64_t start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    values[r % count] += 1.0f;
+    for (int i = 0; i < count; i++) {
+      uint32_t bits;
+      memcpy(&bits, &values[i], 4);
+      modbus_data.get_input_register_struct(i * 2)->set_data(bits >> 16);
+      modbus_data.get_input_register_struct(i * 2 + 1)->set_data(bits & 0xFFFF);
+    }
+  }
+  double set_data_us = (double)(now_ns() - start) / rounds / 1000;
+
+  start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    values[r % count] += 1.0f;
+    ModbusTyped::encode_scalar(values, count, 2, MODBUS_ORDER_ABCD, regs);
+    modbus_data.write_input_registers(0, regs, count * 2);
+  }
+  double scalar_us = (double)(now_ns() - start) / rounds / 1000;
+
+  start = now_ns();
+  for (int r = 0; r < rounds; r++) {
+    values[r % count] += 1.0f;
+    modbus_data.write_input_values(0, values, count);
+  }
+  double typed_us = (double)(now_ns() - start) / rounds / 1000;
+
+  float *check = new float[count];
+  modbus_data.read_input_values(0, count, check);
+  bool match = memcmp(check, values, count * sizeof(float)) == 0;
+  if (json) {
+    printf("{\"count\":%d,\"set_data_us\":%.2f,\"scalar_us\":%.2f,\"typed_us\":%.2f,\"speedup\":%.2f,\"match\":%d}\n",
+      count, set_data_us, scalar_us, typed_us, set_data_us / typed_us, match);
+  }
+  else {
+    printf("count,set_data_us,scalar_us,typed_us,speedup,match\n");
+    printf("%d,%.2f,%.2f,%.2f,%.2f,%d\n", count, set_data_us, scalar_us, typed_us, set_data_us / typed_us, match);
+  }
+  delete[] check;
+  delete[] regs;
+  delete[] values;
+  return 0;
+}
@@ -0,0 +1,482 @@
+/*
+ * Modbus TCP负载生成器
+ * 1. 开N个TCP连接, 按权重混合发送不同功能码的请求, 每个连接最多pipeline个请求在途
+ * 2. 闭环模式(默认): 收到回复马上发下一个, 测最大吞吐
+ * 3. 开环模式(-r): 按固定总速率调度请求, 延时从计划发送时间算起(不会因为服务器变慢而少算延时)
+ * 4. 延时用ModbusHistogram统计, 输出吞吐和p50/p90/p99/p99.9/max
+ *
+ * 用法: modbus_loadgen [-H host] [-p port] [-s] [-c conns] [-d depth] [-r rate] [-t seconds]
+ *                      [-m mix] [-f text|json]
+ *   -s: 在进程内启动一个ModbusTCP::Server(忽略-H/-p), 方便在本机复现
+ *   -m: 请求混合, 格式为 功能码/个数:权重, 逗号分隔, 默认 "3/10:8,6/1:1,16/10:1"
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <thread>
+#include <vector>
+#include <deque>
+#include "modbus_tcp_server.h"
+#include "modbus_histogram.h"
+
+#define LOADGEN_MAX_MIX 16
+#define LOADGEN_ADDR_SPACE 10000
+
+struct MixItem {
+  unsigned char func_code;
+  int quantity;
+  int weight;
+};
+
+struct Inflight {
+  unsigned short tid;
+  uint64_t start_ns;
+};
+
+struct Connection {
+  int fd;
+  unsigned short next_tid;
+  std::deque<Inflight> inflight;
+  std::deque<uint64_t> backlog;     // 开环模式下已到计划时间但还没发出的请求
+  unsigned char rx_buf[4096];
+  int rx_length;
+  std::vector<unsigned char> tx_buf;
+  size_t tx_offset;
+  bool want_write;
+};
+
+struct Options {
+  const char *host;
+  int port;
+  bool in_process;
+  int conns;
+  int depth;
+  double rate;
+  double seconds;
+  bool json;
+  MixItem mix[LOADGEN_MAX_MIX];
+  int mix_count;
+  int mix_total;
+};
+
+struct Stats {
+  uint64_t sent;
+  uint64_t completed;
+  uint64_t exceptions;
+  uint64_t errors;
+  ModbusHistogram latency;
+};
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int parse_mix(const char *str, Options *opts)
+{
+  opts->mix_count = 0;
+  opts->mix_total = 0;
+  const char *p = str;
+  while (*p != '\0' && opts->mix_count < LOADGEN_MAX_MIX) {
+    MixItem item;
+    char *end;
+    item.func_code = (unsigned char)strtol(p, &end, 0);
+    item.quantity = 1;
+    item.weight = 1;
+    if (*end == '/') item.quantity = (int)strtol(end + 1, &end, 0);
+    if (*end == ':') item.weight = (int)strtol(end + 1, &end, 0);
+    if (end == p || item.weight < 1 || item.quantity < 1) return -1;
+    opts->mix[opts->mix_count++] = item;
+    opts->mix_total += item.weight;
+    p = *end == ',' ? end + 1 : end;
+    if (*end != ',' && *end != '\0') return -1;
+  }
+  return opts->mix_count > 0 ? 0 : -1;
+}
+
+static int build_request(unsigned char *buf, unsigned short tid, const MixItem *item, int addr)
+{
+  unsigned char *pdu = buf + 7;
+  int quantity = item->quantity;
+  int pdu_len = 5;
+  pdu[0] = item->func_code;
+  ModbusTCP::HexData::bin16_to_8(addr, pdu + 1);
+  switch (item->func_code) {
+    case MODBUS_FC_WRITE_SINGLE_COIL:
+      ModbusTCP::HexData::bin16_to_8(0xFF00, pdu + 3);
+      break;
+    case MODBUS_FC_WRITE_SINGLE_REG:
+      ModbusTCP::HexData::bin16_to_8(tid, pdu + 3);
+      break;
+    case MODBUS_FC_WRITE_MULTIPLE_COILS: {
+      int byte_size = (quantity + 7) / 8;
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = byte_size;
+      memset(pdu + 6, 0x55, byte_size);
+      pdu_len = 6 + byte_size;
+      break;
+    }
+    case MODBUS_FC_WRITE_MULTIPLE_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      pdu[5] = quantity * 2;
+      for (int i = 0; i < quantity; i++) ModbusTCP::HexData::bin16_to_8(tid + i, pdu + 6 + i * 2);
+      pdu_len = 6 + quantity * 2;
+      break;
+    case MODBUS_FC_MASK_WRITE_REG:
+      ModbusTCP::HexData::bin16_to_8(0xFFF0, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(0x0005, pdu + 5);
+      pdu_len = 7;
+      break;
+    case MODBUS_FC_WRITE_AND_READ_REGS:
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      ModbusTCP::HexData::bin16_to_8(addr, pdu + 5);
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 7);
+      pdu[9] = quantity * 2;
+      for (int i = 0; i < quantity; i++) ModbusTCP::HexData::bin16_to_8(tid + i, pdu + 10 + i * 2);
+      pdu_len = 10 + quantity * 2;
+      break;
+    default:
+      // 读请求(0x01~0x04)
+      ModbusTCP::HexData::bin16_to_8(quantity, pdu + 3);
+      break;
+  }
+  ModbusTCP::HexData::bin16_to_8(tid, buf);
+  ModbusTCP::HexData::bin16_to_8(0, buf + 2);
+  ModbusTCP::HexData::bin16_to_8(pdu_len + 1, buf + 4);
+  buf[6] = 1;
+  return 7 + pdu_len;
+}
+
+static const MixItem *pick_mix(const Options *opts, unsigned int *seed)
+{
+  int r = rand_r(seed) % opts->mix_total;
+  for (int i = 0; i < opts->mix_count; i++) {
+    if (r < opts->mix[i].weight) return &opts->mix[i];
+    r -= opts->mix[i].weight;
+  }
+  return &opts->mix[0];
+}
+
+static int connect_to(const char *host, int port)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) return -1;
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+static void update_events(int epoll_fd, Connection *conn, bool want_write)
+{
+  if (conn->want_write == want_write) return;
+  struct epoll_event ev;
+  ev.events = want_write ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+  ev.data.ptr = conn;
+  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+  conn->want_write = want_write;
+}
+
+static int flush_conn(int epoll_fd, Connection *conn)
+{
+  while (conn->tx_offset < conn->tx_buf.size()) {
+    ssize_t n = send(conn->fd, &conn->tx_buf[conn->tx_offset], conn->tx_buf.size() - conn->tx_offset, MSG_NOSIGNAL);
+    if (n > 0) {
+      conn->tx_offset += n;
+      continue;
+    }
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      update_events(epoll_fd, conn, true);
+      return 0;
+    }
+    return -1;
+  }
+  conn->tx_buf.clear();
+  conn->tx_offset = 0;
+  update_events(epoll_fd, conn, false);
+  return 0;
+}
+
+static void send_request(Connection *conn, const Options *opts, uint64_t start_ns, unsigned int *seed, Stats *stats)
+{
+  unsigned char buf[260];
+  const MixItem *item = pick_mix(opts, seed);
+  unsigned short tid = conn->next_tid++;
+  int addr = rand_r(seed) % (LOADGEN_ADDR_SPACE - item->quantity);
+  int len = build_request(buf, tid, item, addr);
+  conn->tx_buf.insert(conn->tx_buf.end(), buf, buf + len);
+  Inflight inf;
+  inf.tid = tid;
+  inf.start_ns = start_ns;
+  conn->inflight.push_back(inf);
+  stats->sent++;
+}
+
+static int read_conn(Connection *conn, Stats *stats)
+{
+  while (1) {
+    ssize_t n = recv(conn->fd, conn->rx_buf + conn->rx_length, sizeof(conn->rx_buf) - conn->rx_length, 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+    if (n <= 0) return -1;
+    conn->rx_length += n;
+    uint64_t now = now_ns();
+    int offset = 0;
+    while (conn->rx_length - offset >= 7) {
+      unsigned char *frame = conn->rx_buf + offset;
+      int frame_len = ModbusTCP::HexData::bin8_to_u16(frame + 4) + 6;
+      if (frame_len < 8 || frame_len > 260) return -1;
+      if (conn->rx_length - offset < frame_len) break;
+      unsigned short tid = ModbusTCP::HexData::bin8_to_u16(frame);
+      // 服务器按顺序回复, 事务标识和最早在途的请求一致
+      if (conn->inflight.empty() || conn->inflight.front().tid != tid) {
+        stats->errors++;
+        return -1;
+      }
+      stats->latency.record(now - conn->inflight.front().start_ns);
+      conn->inflight.pop_front();
+      stats->completed++;
+      if (frame[7] & 0x80) stats->exceptions++;
+      offset += frame_len;
+    }
+    if (offset > 0) {
+      memmove(conn->rx_buf, conn->rx_buf + offset, conn->rx_length - offset);
+      conn->rx_length -= offset;
+    }
+  }
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-H host] [-p port] [-s] [-c conns] [-d depth] [-r rate] [-t seconds] [-m mix] [-f text|json]\n", name);
+  fprintf(stderr, "  mix: func_code/quantity:weight,... default \"3/10:8,6/1:1,16/10:1\"\n");
+}
+
+int main(int argc, char *argv[])
+{
+  Options opts;
+  opts.host = "127.0.0.1";
+  opts.port = 502;
+  opts.in_process = false;
+  opts.conns = 4;
+  opts.depth = 1;
+  opts.rate = 0;
+  opts.seconds = 5;
+  opts.json = false;
+  parse_mix("3/10:8,6/1:1,16/10:1", &opts);
+  for (int i = 1; i < argc; i++) {
+    bool has_val = i + 1 < argc;
+    if (strcmp(argv[i], "-H") == 0 && has_val) opts.host = argv[++i];
+    else if (strcmp(argv[i], "-p") == 0 && has_val) opts.port = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-s") == 0) opts.in_process = true;
+    else if (strcmp(argv[i], "-c") == 0 && has_val) opts.conns = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-d") == 0 && has_val) opts.depth = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && has_val) opts.rate = atof(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && has_val) opts.seconds = atof(argv[++i]);
+    else if (strcmp(argv[i], "-f") == 0 && has_val) opts.json = strcmp(argv[++i], "json") == 0;
+    else if (strcmp(argv[i], "-m") == 0 && has_val) {
+      if (parse_mix(argv[++i], &opts) != 0) {
+        fprintf(stderr, "invalid mix: %s\n", argv[i]);
+        return -1;
+      }
+    }
+    else {
+      usage(argv[0]);
+      return -1;
+    }
+  }
+  if (opts.conns < 1) opts.conns = 1;
+  if (opts.depth < 1) opts.depth = 1;
+
+  // 进程内服务器
+  ModbusBaseData *modbus_data = NULL;
+  ModbusTCP::Server<ModbusBaseData> *server = NULL;
+  std::thread *server_th = NULL;
+  if (opts.in_process) {
+    modbus_data = new ModbusBaseData(LOADGEN_ADDR_SPACE, LOADGEN_ADDR_SPACE, LOADGEN_ADDR_SPACE, LOADGEN_ADDR_SPACE);
+    server = new ModbusTCP::Server<ModbusBaseData>(modbus_data, 0, "127.0.0.1");
+    if (server->start() != 0) {
+      fprintf(stderr, "start in-process server failed\n");
+      return -1;
+    }
+    server_th = new std::thread(&ModbusTCP::Server<ModbusBaseData>::run, server);
+    opts.host = "127.0.0.1";
+    opts.port = server->get_port();
+  }
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Connection *> conns;
+  for (int i = 0; i < opts.conns; i++) {
+    Connection *conn = new Connection();
+    conn->fd = connect_to(opts.host, opts.port);
+    if (conn->fd < 0) {
+      fprintf(stderr, "connect %s:%d failed: %s\n", opts.host, opts.port, strerror(errno));
+      delete conn;
+      return -1;
+    }
+    conn->next_tid = 0;
+    conn->rx_length = 0;
+    conn->tx_offset = 0;
+    conn->want_write = false;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev);
+    conns.push_back(conn);
+  }
+
+  Stats stats;
+  stats.sent = 0;
+  stats.completed = 0;
+  stats.exceptions = 0;
+  stats.errors = 0;
+  unsigned int seed = 12345;
+  bool open_loop = opts.rate > 0;
+  uint64_t interval_ns = open_loop ? (uint64_t)(1e9 / opts.rate) : 0;
+  if (open_loop && interval_ns == 0) interval_ns = 1;
+  uint64_t start = now_ns();
+  uint64_t end = start + (uint64_t)(opts.seconds * 1e9);
+  uint64_t next_send = start;
+  int rr = 0;
+  bool failed = false;
+  // 开环模式用timerfd精确唤醒, 不忙等(忙等会抢走进程内服务器的CPU)
+  int timer_fd = -1;
+  if (open_loop) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+  }
+  struct epoll_event events[64];
+
+  uint64_t now = start;
+  while (now < end && !failed) {
+    if (open_loop) {
+      // 把已经到计划时间的请求分配给各个连接(轮转)
+      while (next_send <= now) {
+        conns[rr]->backlog.push_back(next_send);
+        rr = (rr + 1) % opts.conns;
+        next_send += interval_ns;
+      }
+    }
+    for (int i = 0; i < opts.conns; i++) {
+      Connection *conn = conns[i];
+      bool added = false;
+      while ((int)conn->inflight.size() < opts.depth) {
+        if (open_loop) {
+          if (conn->backlog.empty()) break;
+          send_request(conn, &opts, conn->backlog.front(), &seed, &stats);
+          conn->backlog.pop_front();
+        }
+        else {
+          send_request(conn, &opts, now_ns(), &seed, &stats);
+        }
+        added = true;
+      }
+      if (added && !conn->want_write && flush_conn(epoll_fd, conn) < 0) failed = true;
+    }
+    if (open_loop) {
+      struct itimerspec its;
+      memset(&its, 0, sizeof(its));
+      its.it_value.tv_sec = next_send / 1000000000ull;
+      its.it_value.tv_nsec = next_send % 1000000000ull;
+      timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    }
+    int n = epoll_wait(epoll_fd, events, 64, 100);
+    for (int i = 0; i < n; i++) {
+      Connection *conn = (Connection *)events[i].data.ptr;
+      if (conn == NULL) {
+        uint64_t expirations;
+        ssize_t ret = read(timer_fd, &expirations, sizeof(expirations));
+        (void)ret;
+        continue;
+      }
+      if ((events[i].events & EPOLLOUT) && flush_conn(epoll_fd, conn) < 0) failed = true;
+      if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && read_conn(conn, &stats) < 0) failed = true;
+    }
+    now = now_ns();
+  }
+  uint64_t elapsed = now_ns() - start;
+
+  // 等待在途的请求(最多1秒)
+  uint64_t drain_end = now_ns() + 1000000000ull;
+  while (!failed && now_ns() < drain_end) {
+    bool pending = false;
+    for (int i = 0; i < opts.conns; i++) {
+      if (!conns[i]->inflight.empty()) pending = true;
+    }
+    if (!pending) break;
+    int n = epoll_wait(epoll_fd, events, 64, 10);
+    for (int i = 0; i < n; i++) {
+      Connection *conn = (Connection *)events[i].data.ptr;
+      if (conn == NULL) continue;
+      if ((events[i].events & EPOLLOUT) && flush_conn(epoll_fd, conn) < 0) failed = true;
+      if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && read_conn(conn, &stats) < 0) failed = true;
+    }
+  }
+  uint64_t lost = stats.sent - stats.completed;
+
+  double secs = elapsed / 1e9;
+  double throughput = stats.completed / secs;
+  const ModbusHistogram &h = stats.latency;
+  if (opts.json) {
+    printf("{\"conns\":%d,\"depth\":%d,\"rate\":%.0f,\"seconds\":%.3f,\"sent\":%lu,\"completed\":%lu,\"exceptions\":%lu,"
+      "\"errors\":%lu,\"lost\":%lu,\"throughput\":%.1f,\"mean_us\":%.2f,\"p50_us\":%.2f,\"p90_us\":%.2f,\"p99_us\":%.2f,"
+      "\"p999_us\":%.2f,\"max_us\":%.2f}\n",
+      opts.conns, opts.depth, opts.rate, secs, (unsigned long)stats.sent, (unsigned long)stats.completed,
+      (unsigned long)stats.exceptions, (unsigned long)stats.errors, (unsigned long)lost, throughput,
+      h.get_mean() / 1e3, h.get_percentile(50) / 1e3, h.get_percentile(90) / 1e3, h.get_percentile(99) / 1e3,
+      h.get_percentile(99.9) / 1e3, h.get_max() / 1e3);
+  }
+  else {
+    printf("target:      %s:%d%s\n", opts.host, opts.port, opts.in_process ? " (in-process server)" : "");
+    printf("mode:        %s, conns=%d, depth=%d\n", open_loop ? "open-loop" : "closed-loop", opts.conns, opts.depth);
+    if (open_loop) printf("rate:        %.0f req/s\n", opts.rate);
+    printf("duration:    %.3f s\n", secs);
+    printf("requests:    sent=%lu, completed=%lu, exceptions=%lu, errors=%lu, lost=%lu\n",
+      (unsigned long)stats.sent, (unsigned long)stats.completed, (unsigned long)stats.exceptions,
+      (unsigned long)stats.errors, (unsigned long)lost);
+    printf("throughput:  %.1f req/s\n", throughput);
+    printf("latency(us): mean=%.2f p50=%.2f p90=%.2f p99=%.2f p99.9=%.2f max=%.2f\n",
+      h.get_mean() / 1e3, h.get_percentile(50) / 1e3, h.get_percentile(90) / 1e3, h.get_percentile(99) / 1e3,
+      h.get_percentile(99.9) / 1e3, h.get_max() / 1e3);
+  }
+
+  for (int i = 0; i < opts.conns; i++) {
+    close(conns[i]->fd);
+    delete conns[i];
+  }
+  if (timer_fd >= 0) close(timer_fd);
+  close(epoll_fd);
+  if (server != NULL) {
+    server->stop();
+    server_th->join();
+    delete server_th;
+    delete server;
+    delete modbus_data;
+  }
+  return failed ? -1 : 0;
+}
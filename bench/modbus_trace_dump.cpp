@@ -0,0 +1,149 @@
+/*
+ * Modbus TCP跟踪文件分析工具
+ * 1. 读取ModbusTrace写出的跟踪文件(每个线程一个), 按功能码和阶段统计耗时
+ * 2. tick按文件头里记录的tick/时间对换算成纳秒
+ * 3. -r输出原始记录(按开始时间排序), 方便和抓包对照
+ *
+ * 用法: modbus_trace_dump [-r] [-f text|json] file...
+ *   例: modbus_trace_dump /dev/shm/modbus_trace.*.bin
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "modbus_trace.h"
+#include "modbus_histogram.h"
+
+struct TraceEvent {
+  ModbusTraceRecord record;
+  double ticks_per_ns;
+  uint32_t thread_id;
+};
+
+static const char *phase_name(int phase)
+{
+  switch (phase) {
+    case TRACE_PHASE_FRAME: return "frame";
+    case TRACE_PHASE_DISPATCH: return "dispatch";
+    case TRACE_PHASE_HOOK: return "hook";
+    case TRACE_PHASE_ENCODE: return "encode";
+    default: return "unknown";
+  }
+}
+
+static int load_file(const char *path, std::vector<TraceEvent> *events)
+{
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    fprintf(stderr, "open %s failed\n", path);
+    return -1;
+  }
+  ModbusTraceHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != MODBUS_TRACE_MAGIC
+    || header.version != MODBUS_TRACE_VERSION || header.record_size != sizeof(ModbusTraceRecord) || header.capacity == 0) {
+    fprintf(stderr, "%s: not a modbus trace file\n", path);
+    fclose(fp);
+    return -1;
+  }
+  double ticks_per_ns = 1.0;
+  if (header.last_ns > header.base_ns && header.last_ticks > header.base_ticks) {
+    ticks_per_ns = (double)(header.last_ticks - header.base_ticks) / (header.last_ns - header.base_ns);
+  }
+  // 环形缓冲区只保留最新的capacity条
+  uint64_t count = header.write_index < header.capacity ? header.write_index : header.capacity;
+  std::vector<ModbusTraceRecord> records(header.capacity);
+  size_t n = fread(records.data(), sizeof(ModbusTraceRecord), header.capacity, fp);
+  fclose(fp);
+  if (n != header.capacity) {
+    fprintf(stderr, "%s: truncated\n", path);
+    return -1;
+  }
+  for (uint64_t i = header.write_index - count; i < header.write_index; i++) {
+    TraceEvent ev;
+    ev.record = records[i % header.capacity];
+    ev.ticks_per_ns = ticks_per_ns;
+    ev.thread_id = header.thread_id;
+    events->push_back(ev);
+  }
+  return (int)count;
+}
+
+static bool event_less(const TraceEvent &a, const TraceEvent &b)
+{
+  return a.record.start_ticks < b.record.start_ticks;
+}
+
+int main(int argc, char *argv[])
+{
+  bool raw = false;
+  bool json = false;
+  std::vector<const char *> paths;
+  for (int i = 1; i < argc; i++) {
+    bool has_val = i + 1 < argc;
+    if (strcmp(argv[i], "-r") == 0) raw = true;
+    else if (strcmp(argv[i], "-f") == 0 && has_val) json = strcmp(argv[++i], "json") == 0;
+    else if (argv[i][0] != '-') paths.push_back(argv[i]);
+    else {
+      paths.clear();
+      break;
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr, "usage: %s [-r] [-f text|json] file...\n", argv[0]);
+    return -1;
+  }
+
+  std::vector<TraceEvent> events;
+  for (int i = 0; i < (int)paths.size(); i++) {
+    load_file(paths[i], &events);
+  }
+  if (events.empty()) {
+    fprintf(stderr, "no trace records\n");
+    return -1;
+  }
+
+  if (raw) {
+    std::sort(events.begin(), events.end(), event_less);
+    printf("thread,start_ticks,duration_ns,transaction_id,func_code,addr,quantity,phase\n");
+    for (int i = 0; i < (int)events.size(); i++) {
+      const ModbusTraceRecord &rec = events[i].record;
+      printf("%u,%llu,%.0f,%u,0x%02X,%u,%u,%s\n", events[i].thread_id, (unsigned long long)rec.start_ticks,
+        rec.duration_ticks / events[i].ticks_per_ns, rec.transaction_id, rec.func_code, rec.addr, rec.quantity, phase_name(rec.phase));
+    }
+    return 0;
+  }
+
+  // key = 功能码 << 8 | 阶段
+  std::map<int, ModbusHistogram *> hists;
+  for (int i = 0; i < (int)events.size(); i++) {
+    const ModbusTraceRecord &rec = events[i].record;
+    int key = (rec.func_code << 8) | rec.phase;
+    if (hists.find(key) == hists.end()) hists[key] = new ModbusHistogram();
+    hists[key]->record((uint64_t)(rec.duration_ticks / events[i].ticks_per_ns + 0.5));
+  }
+
+  if (json) printf("[\n");
+  else printf("%-9s %-9s %10s %10s %10s %10s %10s\n", "func_code", "phase", "count", "mean_ns", "p50_ns", "p99_ns", "max_ns");
+  int index = 0;
+  for (std::map<int, ModbusHistogram *>::iterator it = hists.begin(); it != hists.end(); ++it, index++) {
+    int func_code = it->first >> 8;
+    int phase = it->first & 0xFF;
+    ModbusHistogram *hist = it->second;
+    if (json) {
+      printf("  {\"func_code\": %d, \"phase\": \"%s\", \"count\": %llu, \"mean_ns\": %.1f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}%s\n",
+        func_code, phase_name(phase), (unsigned long long)hist->get_count(), hist->get_mean(),
+        (unsigned long long)hist->get_percentile(50), (unsigned long long)hist->get_percentile(99),
+        (unsigned long long)hist->get_max(), index + 1 < (int)hists.size() ? "," : "");
+    }
+    else {
+      printf("0x%02X      %-9s %10llu %10.1f %10llu %10llu %10llu\n", func_code, phase_name(phase),
+        (unsigned long long)hist->get_count(), hist->get_mean(), (unsigned long long)hist->get_percentile(50),
+        (unsigned long long)hist->get_percentile(99), (unsigned long long)hist->get_max());
+    }
+    delete hist;
+  }
+  if (json) printf("]\n");
+  return 0;
+}
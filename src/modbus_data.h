@@ -12,6 +12,15 @@
 
 #include <functional>
 #include "modbus_data_type.h"
+#include "modbus_typed.h"
+
+class ModbusPersist;
+class ModbusWriteQueue;
+class ModbusFileBank;
+class ModbusShmExport;
+struct ModbusScale;
+class ModbusScaleTable;
+struct ModbusWriteRecord;
 
 #define MODBUS_FC_READ_COILS            0x01
 #define MODBUS_FC_READ_DISCRETE_INPUTS  0x02
@@ -19,15 +28,19 @@
 #define MODBUS_FC_READ_INPUT_REGS       0x04
 #define MODBUS_FC_WRITE_SINGLE_COIL     0x05
 #define MODBUS_FC_WRITE_SINGLE_REG      0x06
+#define MODBUS_FC_DIAGNOSTICS           0x08
 #define MODBUS_FC_WRITE_MULTIPLE_COILS  0x0F
 #define MODBUS_FC_WRITE_MULTIPLE_REGS   0x10
+#define MODBUS_FC_READ_FILE_RECORD      0x14
+#define MODBUS_FC_WRITE_FILE_RECORD     0x15
 #define MODBUS_FC_MASK_WRITE_REG        0x16
 #define MODBUS_FC_WRITE_AND_READ_REGS   0x17
 
 enum ModbusDataCode {
   MODBUS_DATA_NOT_CREATE = -1,     // ModbusData未创建
   MODBUS_NONE = 0x0,          // 正常
-  MODBUS_DATA_ILLEGAL_ADDR = 0x02  // 访问的寄存器地址非法
+  MODBUS_DATA_ILLEGAL_ADDR = 0x02, // 访问的寄存器地址非法
+  MODBUS_DATA_BUSY = 0x06          // 写队列已满(见set_write_queue)
 };
 
 typedef unsigned char uchar;
@@ -188,6 +201,229 @@ public:
    */
   REG_T* get_input_register_struct(int addr);
 
+  /********************** PERSIST *********************/
+
+  /* set_persist: 绑定持久化实例(见modbus_persist.h)
+   * 绑定后线圈状态寄存器和保持寄存器的写操作(写成功后的值)会追加到持久化日志
+   * @param persist: 持久化实例, 为NULL时解绑
+   */
+  void set_persist(ModbusPersist *persist);
+
+  /* restore_persist: 从绑定的持久化实例的快照和日志恢复线圈状态寄存器和保持寄存器
+   * 恢复时直接设置原始数据, 不会调用额外绑定的写方法
+   * :return: 成功返回0
+   */
+  int restore_persist(void);
+
+  /* checkpoint_persist: 把当前线圈状态寄存器和保持寄存器的数据生成快照, 并清空日志
+   * :return: 成功返回0
+   */
+  int checkpoint_persist(void);
+
+  /********************** SHM EXPORT *********************/
+
+  /* set_shm_export: 绑定共享内存导出(见modbus_shm_export.h), 按四种寄存器的起始地址和数量建立布局
+   * @param shm_export: 导出实例, 为NULL时解绑
+   * :return: 成功返回0, 建立布局失败返回-1
+   */
+  int set_shm_export(ModbusShmExport *shm_export);
+
+  /* publish_shm_export: 把四种寄存器的原始数据(不调用额外绑定的读方法)发布到共享内存
+   * 1. 只写入变化了的页, 一次调用对应一个代数, 监控工具可以读到整段一致的快照
+   * 2. 和写寄存器在同一个线程调用(比如控制循环每个周期末尾, 或者服务器线程定时调用)
+   * :return: 写入的页数, 没有绑定返回-1
+   */
+  int publish_shm_export(void);
+
+  /********************** WRITE MODE *********************/
+
+  /* set_write_through: 设置写入模式
+   * 1. 默认为false: 写入前和原始数据比较(不调用额外绑定的读方法), 只对值变化了的寄存器调用set,
+   *    基本型数据结构按整段比较, 持久化也只记录变化了的区间
+   * 2. 为true时不比较, 每次写入都对每个寄存器调用set, 用于额外绑定的写方法每次都要执行的场合(比如每次都要下发到设备)
+   * 3. 没有绑定原始数据的指针数据结构(data_ptr为NULL)的原始数据按0比较
+   * @param on: 是否总是写入
+   */
+  void set_write_through(bool on) { write_through_ = on; }
+
+  /********************** WRITE QUEUE *********************/
+
+  /* set_write_queue: 绑定写队列(见modbus_write_queue.h)
+   * 1. 绑定后write_coil_bits/write_holding_registers/mask_write_holding_register/write_and_read_holding_registers
+   *    只检查地址并把写请求放入队列, 队列满时返回MODBUS_DATA_BUSY(回复异常码0x06)
+   * 2. 写入的值和额外绑定的写方法、持久化都在drain_write_queue里执行, 之前读到的仍然是旧的值,
+   *    write_and_read_holding_registers读到的是写入之前的值
+   * 3. 控制线程自己要立即生效的写操作可以通过get_xxx_struct(addr)->set()直接写
+   * @param queue: 写队列, 为NULL时解绑(解绑前应先取完队列)
+   */
+  void set_write_queue(ModbusWriteQueue *queue);
+
+  /* drain_write_queue: 取出写队列中的写请求并执行(只能在一个线程调用, 一般在控制循环的周期边界)
+   * @param max_records: 最多处理的记录条数, 小于0表示取完为止
+   * :return: 处理的记录条数
+   */
+  int drain_write_queue(int max_records = -1);
+
+  /********************** FILE RECORD *********************/
+
+  /* add_file: 添加一个文件记录(0x14/0x15功能码访问), 见ModbusFileBank::add_file
+   * @param file_no: 文件号(1~65535)
+   * @param record_count: 记录数(1~10000), 一个记录是一个16位的寄存器
+   * @param path: 映射的磁盘文件路径, 为NULL时使用普通内存
+   * :return: 成功返回0
+   */
+  int add_file(int file_no, int record_count, const char *path = NULL);
+
+  /* check_file_records: 检查要访问的文件记录是否存在
+   * :return: 存在返回0, 否则返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int check_file_records(int file_no, int record_no, int quantity);
+
+  /* read_file_records: 读取文件记录
+   * @param file_no: 文件号
+   * @param record_no: 起始记录号
+   * @param quantity: 记录数
+   * @param regs: 存储读取到的记录的数组, 数组大小不能小于quantity
+   * :return: 成功返回0
+   */
+  int read_file_records(int file_no, int record_no, int quantity, ushort *regs);
+
+  /* write_file_records: 写入文件记录(不经过写队列和持久化, 需要掉电保存时使用映射到磁盘的文件)
+   * @param file_no: 文件号
+   * @param record_no: 起始记录号
+   * @param regs: 要写入的记录的数组, 数组大小不能小于quantity
+   * @param quantity: 记录数
+   * :return: 成功返回0
+   */
+  int write_file_records(int file_no, int record_no, ushort *regs, int quantity);
+
+  /* get_file_bank: 获取文件记录的存储(应用程序直接访问文件的内存、sync等), 没有添加过文件时返回NULL */
+  ModbusFileBank *get_file_bank(void) { return file_bank_; }
+
+  /********************** TYPED *********************/
+
+  /* write_holding_values: 把32位/64位的值(float/int32_t/uint32_t/double/int64_t/uint64_t)的数组写入保持寄存器
+   * 1. 每个值占用sizeof(T)/2个连续的寄存器, 按位拷贝, 不做数值转换
+   * 2. 基本型数据结构(modbus_reg_base_data)没有绑定持久化和写队列时直接转换到寄存器的存储,
+   *    其它情况分块转换后调用write_holding_registers, 额外绑定的写方法、持久化、写队列照常生效
+   * @param addr: 要写入的寄存器的起始地址
+   * @param values: 要写入的值的数组
+   * @param count: 值的个数
+   * @param order: 字节顺序, 见ModbusWordOrder, 默认为MODBUS_ORDER_ABCD
+   * :return: 成功返回0, 地址或字节顺序非法返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  template <typename T>
+  int write_holding_values(int addr, const T *values, int count, int order = MODBUS_ORDER_ABCD)
+  {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only 32-bit and 64-bit values are supported");
+    return _write_values(true, addr, values, count, sizeof(T) / 2, order);
+  }
+
+  /* write_input_values: 把32位/64位的值的数组写入输入寄存器(参数同write_holding_values) */
+  template <typename T>
+  int write_input_values(int addr, const T *values, int count, int order = MODBUS_ORDER_ABCD)
+  {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only 32-bit and 64-bit values are supported");
+    return _write_values(false, addr, values, count, sizeof(T) / 2, order);
+  }
+
+  /* read_holding_values: 从保持寄存器读取32位/64位的值的数组
+   * @param addr: 要读取的寄存器起始地址
+   * @param count: 值的个数(读取count * sizeof(T) / 2个寄存器)
+   * @param values: 存储读取到的值的数组, 数组大小不能小于count
+   * @param order: 字节顺序, 见ModbusWordOrder, 默认为MODBUS_ORDER_ABCD
+   * :return: 成功返回0, 地址或字节顺序非法返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  template <typename T>
+  int read_holding_values(int addr, int count, T *values, int order = MODBUS_ORDER_ABCD)
+  {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only 32-bit and 64-bit values are supported");
+    return _read_values(true, addr, count, values, sizeof(T) / 2, order);
+  }
+
+  /* read_input_values: 从输入寄存器读取32位/64位的值的数组(参数同read_holding_values) */
+  template <typename T>
+  int read_input_values(int addr, int count, T *values, int order = MODBUS_ORDER_ABCD)
+  {
+    static_assert(sizeof(T) == 4 || sizeof(T) == 8, "only 32-bit and 64-bit values are supported");
+    return _read_values(false, addr, count, values, sizeof(T) / 2, order);
+  }
+
+  /********************** SCALED *********************/
+
+  /* write_holding_scaled: 把工程量(float/double)数组按线性转换写入保持寄存器, 每个值占一个寄存器, 见ModbusScale
+   * 1. raw = round(value * gain + offset), 限幅到int16或uint16
+   * 2. 基本型数据结构没有绑定持久化和写队列时直接转换到寄存器的存储, 其它情况分块转换后调用write_holding_registers
+   * @param addr: 要写入的寄存器的起始地址
+   * @param values: 要写入的工程量数组
+   * @param count: 个数
+   * @param scale: 线性转换的参数
+   * :return: 成功返回0
+   */
+  int write_holding_scaled(int addr, const double *values, int count, const ModbusScale &scale);
+  int write_holding_scaled(int addr, const float *values, int count, const ModbusScale &scale);
+
+  /* write_input_scaled: 把工程量数组按线性转换写入输入寄存器(参数同write_holding_scaled) */
+  int write_input_scaled(int addr, const double *values, int count, const ModbusScale &scale);
+  int write_input_scaled(int addr, const float *values, int count, const ModbusScale &scale);
+
+  /* read_holding_scaled: 从保持寄存器读取并转换为工程量, value = (raw - offset) / gain
+   * @param addr: 要读取的寄存器起始地址
+   * @param count: 个数
+   * @param values: 存储转换后的工程量的数组, 数组大小不能小于count
+   * @param scale: 线性转换的参数
+   * :return: 成功返回0, 地址非法或者gain为0返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int read_holding_scaled(int addr, int count, double *values, const ModbusScale &scale);
+  int read_holding_scaled(int addr, int count, float *values, const ModbusScale &scale);
+
+  /* read_input_scaled: 从输入寄存器读取并转换为工程量(参数同read_holding_scaled) */
+  int read_input_scaled(int addr, int count, double *values, const ModbusScale &scale);
+  int read_input_scaled(int addr, int count, float *values, const ModbusScale &scale);
+
+  /* set_holding_scale: 给一段保持寄存器设置线性转换, 保存在寄存器的转换表里(见ModbusScaleTable)
+   * 1. 不带scale参数的write_holding_scaled/read_holding_scaled按这里设置的转换
+   * 2. 这段寄存器写入后(客户端的0x06/0x10/0x16/0x17、drain_write_queue、write_holding_scaled/values、
+   *    restore_persist)批量解码成工程量保存起来, read_holding_scaled直接读取解码后的值;
+   *    通过get_holding_register_struct(addr)->set()直接写入的不会解码
+   * @param addr: 起始地址
+   * @param count: 寄存器个数
+   * @param scale: 线性转换的参数
+   * :return: 成功返回0, 地址非法、gain为0或者和已经设置的区间重叠返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int set_holding_scale(int addr, int count, const ModbusScale &scale);
+
+  /* set_input_scale: 给一段输入寄存器设置线性转换, 不带scale参数的write_input_scaled/read_input_scaled按这里设置的转换
+   * (参数同set_holding_scale)
+   */
+  int set_input_scale(int addr, int count, const ModbusScale &scale);
+
+  /* write_holding_scaled: 把工程量数组按转换表发布到保持寄存器, 跨多个区间时每个区间按自己的转换批量转换
+   * @param addr: 要写入的寄存器的起始地址
+   * @param values: 要写入的工程量数组
+   * @param count: 个数
+   * :return: 成功返回0, 有寄存器不在set_holding_scale设置的区间内返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int write_holding_scaled(int addr, const double *values, int count);
+  int write_holding_scaled(int addr, const float *values, int count);
+
+  /* write_input_scaled: 把工程量数组按转换表发布到输入寄存器(参数同write_holding_scaled) */
+  int write_input_scaled(int addr, const double *values, int count);
+  int write_input_scaled(int addr, const float *values, int count);
+
+  /* read_holding_scaled: 读取保持寄存器解码后的工程量(写入时已经解码, 不再转换)
+   * @param addr: 要读取的寄存器起始地址
+   * @param count: 个数
+   * @param values: 存储工程量的数组, 数组大小不能小于count
+   * :return: 成功返回0, 有寄存器不在set_holding_scale设置的区间内返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int read_holding_scaled(int addr, int count, double *values);
+  int read_holding_scaled(int addr, int count, float *values);
+
+  /* read_input_scaled: 从输入寄存器读取并按转换表转换为工程量(参数同read_holding_scaled) */
+  int read_input_scaled(int addr, int count, double *values);
+  int read_input_scaled(int addr, int count, float *values);
+
   // /* bind_get_coil_bit: 给指定地址的线圈状态寄存器绑定额外的读方法 bind_get
   //  * @param addr: 寄存器地址
   //  * @param func: 要绑定的函数(函数指针或std::function)
@@ -348,6 +584,34 @@ private:
   template <typename SOURCES_T, typename PARAM_T>
   int _bind_data(int inx, int count, SOURCES_T *sources, PARAM_T param);
 
+  template <typename CELL_T, typename VAL_T>
+  static bool _is_raw(void);
+  template <typename CELL_T, typename VAL_T>
+  void _write_cells(CELL_T *cells, int inx, const VAL_T *vals, int quantity, int persist_type);
+  void _set_coil_bits(int inx, const uchar *bits, int quantity);
+  void _set_holding_registers(int inx, const ushort *regs, int quantity);
+  void _mask_holding_register(int inx, ushort and_mask, ushort or_mask);
+  void _apply_write_record(const ModbusWriteRecord *rec);
+  int _write_values(bool holding, int addr, const void *values, int count, int words, int order);
+  int _read_values(bool holding, int addr, int count, void *values, int words, int order);
+  template <typename T>
+  int _write_scaled(bool holding, int addr, const T *values, int count, const ModbusScale &scale);
+  template <typename T>
+  int _read_scaled(bool holding, int addr, int count, T *values, const ModbusScale &scale);
+  int _set_scale(bool holding, int addr, int count, const ModbusScale &scale);
+  template <typename T>
+  int _write_scaled_table(bool holding, int addr, const T *values, int count);
+  template <typename T>
+  int _read_scaled_table(bool holding, int addr, int count, T *values);
+  void _decode_holding_scale(int inx, int quantity);
+
+  template <typename CELL_T, typename VAL_T>
+  int _publish_cells(int type, CELL_T *cells, int count);
+
+  void _persist_range(unsigned char type, int inx, int quantity);
+  static void _persist_apply(void *arg, unsigned char type, int addr, const void *data, int count);
+  static int _persist_gather(void *arg, unsigned char type, void *data, int *start_addr);
+
 private:
   unsigned int coil_bit_start_addr_;    // 线圈状态寄存器起始地址
   unsigned int input_bit_start_addr_;   // 离散输入状态寄存器起始地址
@@ -365,6 +629,13 @@ private:
   uchar *input_bits_data_;
   ushort *holding_regs_data_;
   ushort *input_regs_data_;
+  ModbusPersist *persist_; // 持久化实例
+  ModbusWriteQueue *write_queue_; // 写队列
+  ModbusFileBank *file_bank_;     // 文件记录
+  bool write_through_;            // 是否总是写入(不比较原始数据)
+  ModbusShmExport *shm_export_;   // 共享内存导出
+  ModbusScaleTable *holding_scales_; // 保持寄存器的转换表
+  ModbusScaleTable *input_scales_;   // 输入寄存器的转换表
 };
 
 /* Modbus数据寄存器的静态操作模板类 */
@@ -388,6 +659,9 @@ public:
   static int mask_write_holding_register(int addr, ushort and_mask, ushort or_mask);
   static int write_and_read_holding_registers(int w_addr, ushort *w_regs, int w_quantity, int r_addr, int r_quantity, ushort *r_regs);
 
+  static int read_file_records(int file_no, int record_no, int quantity, ushort *regs);
+  static int write_file_records(int file_no, int record_no, ushort *regs, int quantity);
+
   static BIT_T* get_coil_bit_struct(int addr);
   static BIT_T* get_input_bit_struct(int addr);
   static REG_T* get_holding_register_struct(int addr);
@@ -532,4 +806,9 @@ typedef StaticModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_struct_p
 // StaticModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_struct_data>
 
 
+// 头文件模式: 模板的实现也在头文件中, 任意BIT_T/REG_T组合都可以使用, 寄存器的读写可以内联
+#ifdef MODBUS_HEADER_ONLY
+#include "modbus_data_impl.h"
+#endif
+
 #endif // _MODBUS_DATA_H_
\ No newline at end of file
@@ -0,0 +1,1045 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+/* modbus_data.h中模板类的实现
+ * 1. 默认由modbus_data.cpp包含并特化常用的组合, 编译进静态库
+ * 2. 定义MODBUS_HEADER_ONLY时由modbus_data.h包含, 任意BIT_T/REG_T组合都可以直接使用,
+ *    寄存器的读写可以内联到功能码处理中
+ */
+
+#ifndef _MODBUS_DATA_IMPL_H_
+#define _MODBUS_DATA_IMPL_H_
+
+#include <cstdlib>
+#include <type_traits>
+#include "modbus_data.h"
+#include "modbus_persist.h"
+#include "modbus_heatmap.h"
+#include "modbus_write_queue.h"
+#include "modbus_file_bank.h"
+#include "modbus_scale.h"
+#include "modbus_diff.h"
+#include "modbus_shm_export.h"
+
+template <typename BIT_T, typename REG_T>
+ModbusDataTemplate<BIT_T, REG_T>* StaticModbusDataTemplate<BIT_T, REG_T>::modbus_data_ = NULL;
+
+/**************** ModbusDataTemplate *****************/
+
+template <typename BIT_T, typename REG_T>
+ModbusDataTemplate<BIT_T, REG_T>::ModbusDataTemplate(unsigned int coil_bit_count, unsigned int input_bit_count,
+    unsigned int holding_reg_count, unsigned int input_reg_count, 
+    unsigned int coil_bit_start_addr, unsigned int input_bit_start_addr,
+    unsigned int holding_reg_start_addr, unsigned int input_reg_start_addr)
+: coil_bit_start_addr_(coil_bit_start_addr), input_bit_start_addr_(input_bit_start_addr)
+, holding_reg_start_addr_(holding_reg_start_addr), input_reg_start_addr_(input_reg_start_addr)
+, coil_bit_count_(coil_bit_count), input_bit_count_(input_bit_count)
+, holding_reg_count_(holding_reg_count), input_reg_count_(input_reg_count)
+{
+  coil_bits_ = NULL;
+  input_bits_ = NULL;
+  holding_regs_ = NULL;
+  input_regs_ = NULL;
+  coil_bits_data_ = NULL;
+  input_bits_data_ = NULL;
+  holding_regs_data_ = NULL;
+  input_regs_data_ = NULL;
+  persist_ = NULL;
+  write_queue_ = NULL;
+  file_bank_ = NULL;
+  write_through_ = false;
+  shm_export_ = NULL;
+  holding_scales_ = NULL;
+  input_scales_ = NULL;
+
+  if (coil_bit_count_ > 0) {
+    coil_bits_ = new BIT_T[coil_bit_count_];
+    if (coil_bits_[0].is_ptr_struct()) {
+      coil_bits_data_ = new uchar[coil_bit_count_];
+      for (int i = 0; i < coil_bit_count_; i++) {
+        coil_bits_[i].bind_data(&coil_bits_data_[i]);
+      }
+    }
+  }
+
+  if (input_bit_count_ > 0) {
+    input_bits_ = new BIT_T[input_bit_count_];
+    if (input_bits_[0].is_ptr_struct()) {
+      input_bits_data_ = new uchar[input_bit_count_];
+      for (int i = 0; i < input_bit_count_; i++) {
+        input_bits_[i].bind_data(&input_bits_data_[i]);
+      }
+    }
+  }
+
+  if (holding_reg_count_ > 0) {
+    holding_regs_ = new REG_T[holding_reg_count_];
+    if (holding_regs_[0].is_ptr_struct()) {
+      holding_regs_data_ = new ushort[holding_reg_count_];
+      for (int i = 0; i < holding_reg_count_; i++) {
+        holding_regs_[i].bind_data(&holding_regs_data_[i]);
+      }
+    }
+  }
+
+  if (input_reg_count_ > 0) {
+    input_regs_ = new REG_T[input_reg_count_];
+    if (input_regs_[0].is_ptr_struct()) {
+      input_regs_data_ = new ushort[input_reg_count_];
+      for (int i = 0; i < input_reg_count_; i++) {
+        input_regs_[i].bind_data(&input_regs_data_[i]);
+      }
+    }
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+ModbusDataTemplate<BIT_T, REG_T>::~ModbusDataTemplate()
+{
+  if (coil_bits_ != NULL) {
+    delete[] coil_bits_;
+    coil_bits_ = NULL;
+  }
+  if (input_bits_ != NULL) {
+    delete[] input_bits_;
+    input_bits_ = NULL;
+  }
+  if (holding_regs_ != NULL) {
+    delete[] holding_regs_;
+    holding_regs_ = NULL;
+  }
+  if (input_regs_ != NULL) {
+    delete[] input_regs_;
+    input_regs_ = NULL;
+  }
+  
+  if (coil_bits_data_ != NULL) {
+    delete[] coil_bits_data_;
+    coil_bits_data_ = NULL;
+  }
+  if (input_bits_data_ != NULL) {
+    delete[] input_bits_data_;
+    input_bits_data_ = NULL;
+  }
+  if (holding_regs_data_ != NULL) {
+    delete[] holding_regs_data_;
+    holding_regs_data_ = NULL;
+  }
+  if (input_regs_data_ != NULL) {
+    delete[] input_regs_data_;
+    input_regs_data_ = NULL;
+  }
+  if (file_bank_ != NULL) {
+    delete file_bank_;
+    file_bank_ = NULL;
+  }
+  if (holding_scales_ != NULL) {
+    delete holding_scales_;
+    holding_scales_ = NULL;
+  }
+  if (input_scales_ != NULL) {
+    delete input_scales_;
+    input_scales_ = NULL;
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_coil_bits(int addr, int quantity, uchar *bits)
+{
+  int inx = addr - coil_bit_start_addr_;
+  if (inx < 0 || inx + quantity > coil_bit_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_COIL_BITS, HEAT_READ, addr, quantity);
+  for (int i = 0; i < quantity; i++) {
+    bits[i] = coil_bits_[inx + i].get();
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_input_bits(int addr, int quantity, uchar *bits)
+{
+  int inx = addr - input_bit_start_addr_;
+  if (inx < 0 || inx + quantity > input_bit_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_INPUT_BITS, HEAT_READ, addr, quantity);
+  for (int i = 0; i < quantity; i++) {
+    bits[i] = input_bits_[inx + i].get();
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_holding_registers(int addr, int quantity, ushort *regs)
+{
+  int inx = addr - holding_reg_start_addr_;
+  if (inx < 0 || inx + quantity > holding_reg_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_HOLDING_REGS, HEAT_READ, addr, quantity);
+  for (int i = 0; i < quantity; i++) {
+    regs[i] = holding_regs_[inx + i].get();
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_input_registers(int addr, int quantity, ushort *regs)
+{
+  int inx = addr - input_reg_start_addr_;
+  if (inx < 0 || inx + quantity > input_reg_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_INPUT_REGS, HEAT_READ, addr, quantity);
+  for (int i = 0; i < quantity; i++) {
+    regs[i] = input_regs_[inx + i].get();
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_coil_bits(int addr, uchar *bits, int quantity)
+{
+  int inx = addr - coil_bit_start_addr_;
+  if (inx < 0 || inx + quantity > coil_bit_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_COIL_BITS, HEAT_WRITE, addr, quantity);
+  if (write_queue_ != NULL)
+    return write_queue_->push_coil_bits(addr, bits, quantity) == 0 ? MODBUS_NONE : MODBUS_DATA_BUSY;
+  _set_coil_bits(inx, bits, quantity);
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_input_bits(int addr, uchar *bits, int quantity)
+{
+  int inx = addr - input_bit_start_addr_;
+  if (inx < 0 || inx + quantity > input_bit_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_INPUT_BITS, HEAT_WRITE, addr, quantity);
+  _write_cells(input_bits_, inx, bits, quantity, -1);
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_holding_registers(int addr, ushort *regs, int quantity)
+{
+  int inx = addr - holding_reg_start_addr_;
+  if (inx < 0 || inx + quantity > holding_reg_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_HOLDING_REGS, HEAT_WRITE, addr, quantity);
+  if (write_queue_ != NULL)
+    return write_queue_->push_holding_registers(addr, regs, quantity) == 0 ? MODBUS_NONE : MODBUS_DATA_BUSY;
+  _set_holding_registers(inx, regs, quantity);
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_input_registers(int addr, ushort *regs, int quantity)
+{
+  int inx = addr - input_reg_start_addr_;
+  if (inx < 0 || inx + quantity > input_reg_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_INPUT_REGS, HEAT_WRITE, addr, quantity);
+  _write_cells(input_regs_, inx, regs, quantity, -1);
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::mask_write_holding_register(int addr, ushort and_mask, ushort or_mask)
+{
+  int inx = addr - holding_reg_start_addr_;
+  if (inx < 0 || inx + 1 > holding_reg_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_HOLDING_REGS, HEAT_WRITE, addr, 1);
+  if (write_queue_ != NULL)
+    return write_queue_->push_mask_holding_register(addr, and_mask, or_mask) == 0 ? MODBUS_NONE : MODBUS_DATA_BUSY;
+  _mask_holding_register(inx, and_mask, or_mask);
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_and_read_holding_registers(int w_addr, ushort *w_regs, int w_quantity, int r_addr, int r_quantity, ushort *r_regs)
+{
+  int w_inx = w_addr - holding_reg_start_addr_;
+  int r_inx = r_addr - holding_reg_start_addr_;
+  if (w_inx < 0 || w_inx + w_quantity > holding_reg_count_
+    || r_inx < 0 || r_inx + r_quantity > holding_reg_count_)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  MODBUS_HEATMAP_ACCESS(HEAT_HOLDING_REGS, HEAT_WRITE, w_addr, w_quantity);
+  MODBUS_HEATMAP_ACCESS(HEAT_HOLDING_REGS, HEAT_READ, r_addr, r_quantity);
+  if (write_queue_ != NULL) {
+    if (write_queue_->push_holding_registers(w_addr, w_regs, w_quantity) != 0)
+      return MODBUS_DATA_BUSY;
+  }
+  else {
+    _set_holding_registers(w_inx, w_regs, w_quantity);
+  }
+  for (int i = 0; i < r_quantity; i++) {
+    r_regs[i] = holding_regs_[r_inx + i].get();
+  }
+  return MODBUS_NONE;
+}
+
+/* 线圈写入的值非0为ON */
+static inline uchar _modbus_cell_value(uchar val) { return val ? ON : OFF; }
+static inline ushort _modbus_cell_value(ushort val) { return val; }
+
+template <typename BIT_T, typename REG_T>
+template <typename CELL_T, typename VAL_T>
+bool ModbusDataTemplate<BIT_T, REG_T>::_is_raw(void)
+{
+  // 基本型数据结构只有一个原始数据成员, 数组就是连续的原始数据
+  return std::is_same<CELL_T, modbus_base_data<VAL_T>>::value && sizeof(CELL_T) == sizeof(VAL_T);
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename CELL_T, typename VAL_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_write_cells(CELL_T *cells, int inx, const VAL_T *vals, int quantity, int persist_type)
+{
+  bool persist = persist_ != NULL && persist_type >= 0;
+  if (write_through_) {
+    for (int i = 0; i < quantity; i++) cells[inx + i].set(_modbus_cell_value(vals[i]));
+    if (persist) _persist_range(persist_type, inx, quantity);
+    return;
+  }
+  if (_is_raw<CELL_T, VAL_T>()) {
+    // 整段比较, 只写入变化的区间
+    VAL_T *raw = (VAL_T *)(cells + inx);
+    int start = ModbusDiff::find_changed(raw, vals, quantity, 0);
+    while (start < quantity) {
+      int end = ModbusDiff::find_unchanged(raw, vals, quantity, start);
+      for (int i = start; i < end; i++) raw[i] = _modbus_cell_value(vals[i]);
+      if (persist) _persist_range(persist_type, inx + start, end - start);
+      start = ModbusDiff::find_changed(raw, vals, quantity, end);
+    }
+    return;
+  }
+  // 逐个和原始数据比较(不调用额外绑定的读方法), 只对变化的寄存器调用set, 连续变化的区间一起持久化
+  int start = -1;
+  for (int i = 0; i <= quantity; i++) {
+    if (i < quantity) {
+      CELL_T &cell = cells[inx + i];
+      VAL_T val = _modbus_cell_value(vals[i]);
+      if (cell.get_data() != val) {
+        cell.set(val);
+        if (start < 0) start = i;
+        continue;
+      }
+    }
+    if (start >= 0) {
+      if (persist) _persist_range(persist_type, inx + start, i - start);
+      start = -1;
+    }
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_set_coil_bits(int inx, const uchar *bits, int quantity)
+{
+  _write_cells(coil_bits_, inx, bits, quantity, PERSIST_COIL_BITS);
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_set_holding_registers(int inx, const ushort *regs, int quantity)
+{
+  _write_cells(holding_regs_, inx, regs, quantity, PERSIST_HOLDING_REGS);
+  _decode_holding_scale(inx, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_mask_holding_register(int inx, ushort and_mask, ushort or_mask)
+{
+  // 掩码基于原始数据计算, 不调用额外绑定的读方法
+  ushort old_val = holding_regs_[inx].get_data();
+  ushort new_val = (old_val & and_mask) | (or_mask & ~and_mask);
+  _write_cells(holding_regs_, inx, &new_val, 1, PERSIST_HOLDING_REGS);
+  _decode_holding_scale(inx, 1);
+}
+
+template <typename BIT_T, typename REG_T>
+BIT_T* ModbusDataTemplate<BIT_T, REG_T>::get_coil_bit_struct(int addr)
+{
+  int inx = addr - coil_bit_start_addr_;
+  if (inx < 0 || inx >= coil_bit_count_)
+    return NULL;
+  return &coil_bits_[inx];
+}
+
+template <typename BIT_T, typename REG_T>
+BIT_T* ModbusDataTemplate<BIT_T, REG_T>::get_input_bit_struct(int addr)
+{
+  int inx = addr - input_bit_start_addr_;
+  if (inx < 0 || inx >= input_bit_count_)
+    return NULL;
+  return &input_bits_[inx];
+}
+
+template <typename BIT_T, typename REG_T>
+REG_T* ModbusDataTemplate<BIT_T, REG_T>::get_holding_register_struct(int addr)
+{
+  int inx = addr - holding_reg_start_addr_;
+  if (inx < 0 || inx >= holding_reg_count_)
+    return NULL;
+  return &holding_regs_[inx];
+}
+
+template <typename BIT_T, typename REG_T>
+REG_T* ModbusDataTemplate<BIT_T, REG_T>::get_input_register_struct(int addr)
+{
+  int inx = addr - input_reg_start_addr_;
+  if (inx < 0 || inx >= input_reg_count_)
+    return NULL;
+  return &input_regs_[inx];
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename SOURCES_T, typename PARAM_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_bind_get(int inx, int count, SOURCES_T *sources, PARAM_T param)
+{
+  if (inx < 0 || inx >= count)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  return sources[inx].bind_get(param);
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename SOURCES_T, typename PARAM_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_bind_set(int inx, int count, SOURCES_T *sources, PARAM_T param)
+{
+  if (inx < 0 || inx >= count)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  return sources[inx].bind_set(param);
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename SOURCES_T, typename PARAM_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_bind_data(int inx, int count, SOURCES_T *sources, PARAM_T param)
+{
+  if (inx < 0 || inx >= count)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  return sources[inx].bind_data(param);
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::set_persist(ModbusPersist *persist)
+{
+  persist_ = persist;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::restore_persist(void)
+{
+  if (persist_ == NULL) return PERSIST_NOT_OPEN;
+  return persist_->restore(_persist_apply, this);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::checkpoint_persist(void)
+{
+  if (persist_ == NULL) return PERSIST_NOT_OPEN;
+  return persist_->checkpoint(_persist_gather, this);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::set_shm_export(ModbusShmExport *shm_export)
+{
+  shm_export_ = NULL;
+  if (shm_export == NULL) return 0;
+  int start_addrs[MODBUS_SHM_TABLES] = {
+    (int)coil_bit_start_addr_, (int)input_bit_start_addr_, (int)holding_reg_start_addr_, (int)input_reg_start_addr_ };
+  int counts[MODBUS_SHM_TABLES] = {
+    (int)coil_bit_count_, (int)input_bit_count_, (int)holding_reg_count_, (int)input_reg_count_ };
+  if (shm_export->open(start_addrs, counts) != 0) return -1;
+  shm_export_ = shm_export;
+  return 0;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::publish_shm_export(void)
+{
+  if (shm_export_ == NULL) return -1;
+  int pages = _publish_cells<BIT_T, uchar>(SHM_COIL_BITS, coil_bits_, coil_bit_count_)
+    + _publish_cells<BIT_T, uchar>(SHM_INPUT_BITS, input_bits_, input_bit_count_)
+    + _publish_cells<REG_T, ushort>(SHM_HOLDING_REGS, holding_regs_, holding_reg_count_)
+    + _publish_cells<REG_T, ushort>(SHM_INPUT_REGS, input_regs_, input_reg_count_);
+  shm_export_->commit();
+  return pages;
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename CELL_T, typename VAL_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_publish_cells(int type, CELL_T *cells, int count)
+{
+  if (count <= 0) return 0;
+  // 基本型数据结构直接发布连续的原始数据, 其它的按页收集原始数据
+  if (_is_raw<CELL_T, VAL_T>()) return shm_export_->publish(type, 0, (const VAL_T *)cells, count);
+  VAL_T tmp[MODBUS_SHM_PAGE_BYTES / sizeof(VAL_T)];
+  int per_page = MODBUS_SHM_PAGE_BYTES / sizeof(VAL_T);
+  int pages = 0;
+  for (int i = 0; i < count; i += per_page) {
+    int n = count - i < per_page ? count - i : per_page;
+    for (int j = 0; j < n; j++) tmp[j] = cells[i + j].get_data();
+    pages += shm_export_->publish(type, i, tmp, n);
+  }
+  return pages;
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::set_write_queue(ModbusWriteQueue *queue)
+{
+  write_queue_ = queue;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::add_file(int file_no, int record_count, const char *path)
+{
+  if (file_bank_ == NULL) file_bank_ = new ModbusFileBank();
+  return file_bank_->add_file(file_no, record_count, path);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::check_file_records(int file_no, int record_no, int quantity)
+{
+  if (file_bank_ == NULL) return MODBUS_DATA_ILLEGAL_ADDR;
+  return file_bank_->check(file_no, record_no, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_file_records(int file_no, int record_no, int quantity, ushort *regs)
+{
+  if (file_bank_ == NULL) return MODBUS_DATA_ILLEGAL_ADDR;
+  return file_bank_->read(file_no, record_no, quantity, regs);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_file_records(int file_no, int record_no, ushort *regs, int quantity)
+{
+  if (file_bank_ == NULL) return MODBUS_DATA_ILLEGAL_ADDR;
+  return file_bank_->write(file_no, record_no, regs, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::drain_write_queue(int max_records)
+{
+  if (write_queue_ == NULL) return 0;
+  ModbusWriteRecord rec;
+  int count = 0;
+  while ((max_records < 0 || count < max_records) && write_queue_->pop(&rec)) {
+    _apply_write_record(&rec);
+    count++;
+  }
+  return count;
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_apply_write_record(const ModbusWriteRecord *rec)
+{
+  // 入队时已经检查过地址, 这里再检查一次防止队列在绑定前后被其它实例使用
+  if (rec->type == WRITE_QUEUE_COIL_BITS) {
+    int inx = rec->addr - coil_bit_start_addr_;
+    if (inx < 0 || inx + rec->quantity > coil_bit_count_) return;
+    uchar bits[MODBUS_WRITE_QUEUE_MAX_BITS];
+    for (int i = 0; i < rec->quantity; i++) bits[i] = rec->get_bit(i);
+    _set_coil_bits(inx, bits, rec->quantity);
+  }
+  else {
+    int inx = rec->addr - holding_reg_start_addr_;
+    if (inx < 0 || inx + rec->quantity > holding_reg_count_) return;
+    if (rec->type == WRITE_QUEUE_HOLDING_REGS)
+      _set_holding_registers(inx, rec->regs, rec->quantity);
+    else if (rec->type == WRITE_QUEUE_MASK_HOLDING_REG)
+      _mask_holding_register(inx, rec->regs[0], rec->regs[1]);
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_write_values(bool holding, int addr, const void *values, int count, int words, int order)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  int quantity = count * words;
+  if (count < 0 || inx < 0 || inx + quantity > (holding ? holding_reg_count_ : input_reg_count_)
+    || order < MODBUS_ORDER_ABCD || order > MODBUS_ORDER_CDAB)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  // 基本型数据结构只有一个ushort成员, 寄存器数组就是连续的寄存器值, 直接转换过去
+  if (_is_raw<REG_T, ushort>()
+    && (!holding || (persist_ == NULL && write_queue_ == NULL))) {
+    MODBUS_HEATMAP_ACCESS(holding ? HEAT_HOLDING_REGS : HEAT_INPUT_REGS, HEAT_WRITE, addr, quantity);
+    ModbusTyped::encode(values, count, words, order, (ushort *)((holding ? holding_regs_ : input_regs_) + inx));
+    if (holding) _decode_holding_scale(inx, quantity);
+    return MODBUS_NONE;
+  }
+  // 其它数据结构分块转换后按普通的寄存器写入, 分块不会把一个值拆开
+  ushort tmp[256];
+  int step = 256 / words;
+  const unsigned char *src = (const unsigned char *)values;
+  for (int i = 0; i < count; i += step) {
+    int n = count - i < step ? count - i : step;
+    ModbusTyped::encode(src + i * words * 2, n, words, order, tmp);
+    int ret = holding ? write_holding_registers(addr + i * words, tmp, n * words)
+                      : write_input_registers(addr + i * words, tmp, n * words);
+    if (ret != MODBUS_NONE) return ret;
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_read_values(bool holding, int addr, int count, void *values, int words, int order)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  int quantity = count * words;
+  if (count < 0 || inx < 0 || inx + quantity > (holding ? holding_reg_count_ : input_reg_count_)
+    || order < MODBUS_ORDER_ABCD || order > MODBUS_ORDER_CDAB)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  if (_is_raw<REG_T, ushort>()) {
+    MODBUS_HEATMAP_ACCESS(holding ? HEAT_HOLDING_REGS : HEAT_INPUT_REGS, HEAT_READ, addr, quantity);
+    ModbusTyped::decode((const ushort *)((holding ? holding_regs_ : input_regs_) + inx), count, words, order, values);
+    return MODBUS_NONE;
+  }
+  ushort tmp[256];
+  int step = 256 / words;
+  unsigned char *dst = (unsigned char *)values;
+  for (int i = 0; i < count; i += step) {
+    int n = count - i < step ? count - i : step;
+    int ret = holding ? read_holding_registers(addr + i * words, n * words, tmp)
+                      : read_input_registers(addr + i * words, n * words, tmp);
+    if (ret != MODBUS_NONE) return ret;
+    ModbusTyped::decode(tmp, n, words, order, dst + i * words * 2);
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_holding_scaled(int addr, const double *values, int count, const ModbusScale &scale)
+{
+  return _write_scaled(true, addr, values, count, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_holding_scaled(int addr, const float *values, int count, const ModbusScale &scale)
+{
+  return _write_scaled(true, addr, values, count, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_input_scaled(int addr, const double *values, int count, const ModbusScale &scale)
+{
+  return _write_scaled(false, addr, values, count, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_input_scaled(int addr, const float *values, int count, const ModbusScale &scale)
+{
+  return _write_scaled(false, addr, values, count, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_holding_scaled(int addr, int count, double *values, const ModbusScale &scale)
+{
+  return _read_scaled(true, addr, count, values, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_holding_scaled(int addr, int count, float *values, const ModbusScale &scale)
+{
+  return _read_scaled(true, addr, count, values, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_input_scaled(int addr, int count, double *values, const ModbusScale &scale)
+{
+  return _read_scaled(false, addr, count, values, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_input_scaled(int addr, int count, float *values, const ModbusScale &scale)
+{
+  return _read_scaled(false, addr, count, values, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename T>
+int ModbusDataTemplate<BIT_T, REG_T>::_write_scaled(bool holding, int addr, const T *values, int count, const ModbusScale &scale)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  if (count < 0 || inx < 0 || inx + count > (holding ? holding_reg_count_ : input_reg_count_))
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  // 和_write_values一样, 基本型数据结构直接转换到寄存器的存储
+  if (_is_raw<REG_T, ushort>()
+    && (!holding || (persist_ == NULL && write_queue_ == NULL))) {
+    MODBUS_HEATMAP_ACCESS(holding ? HEAT_HOLDING_REGS : HEAT_INPUT_REGS, HEAT_WRITE, addr, count);
+    scale.encode(values, count, (ushort *)((holding ? holding_regs_ : input_regs_) + inx));
+    if (holding) _decode_holding_scale(inx, count);
+    return MODBUS_NONE;
+  }
+  ushort tmp[256];
+  for (int i = 0; i < count; i += 256) {
+    int n = count - i < 256 ? count - i : 256;
+    scale.encode(values + i, n, tmp);
+    int ret = holding ? write_holding_registers(addr + i, tmp, n) : write_input_registers(addr + i, tmp, n);
+    if (ret != MODBUS_NONE) return ret;
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename T>
+int ModbusDataTemplate<BIT_T, REG_T>::_read_scaled(bool holding, int addr, int count, T *values, const ModbusScale &scale)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  if (count < 0 || inx < 0 || inx + count > (holding ? holding_reg_count_ : input_reg_count_) || scale.gain == 0)
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  if (_is_raw<REG_T, ushort>()) {
+    MODBUS_HEATMAP_ACCESS(holding ? HEAT_HOLDING_REGS : HEAT_INPUT_REGS, HEAT_READ, addr, count);
+    return scale.decode((const ushort *)((holding ? holding_regs_ : input_regs_) + inx), count, values) == 0
+      ? MODBUS_NONE : MODBUS_DATA_ILLEGAL_ADDR;
+  }
+  ushort tmp[256];
+  for (int i = 0; i < count; i += 256) {
+    int n = count - i < 256 ? count - i : 256;
+    int ret = holding ? read_holding_registers(addr + i, n, tmp) : read_input_registers(addr + i, n, tmp);
+    if (ret != MODBUS_NONE) return ret;
+    if (scale.decode(tmp, n, values + i) != 0) return MODBUS_DATA_ILLEGAL_ADDR;
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::set_holding_scale(int addr, int count, const ModbusScale &scale)
+{
+  return _set_scale(true, addr, count, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::set_input_scale(int addr, int count, const ModbusScale &scale)
+{
+  return _set_scale(false, addr, count, scale);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_holding_scaled(int addr, const double *values, int count)
+{
+  return _write_scaled_table(true, addr, values, count);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_holding_scaled(int addr, const float *values, int count)
+{
+  return _write_scaled_table(true, addr, values, count);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_input_scaled(int addr, const double *values, int count)
+{
+  return _write_scaled_table(false, addr, values, count);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::write_input_scaled(int addr, const float *values, int count)
+{
+  return _write_scaled_table(false, addr, values, count);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_holding_scaled(int addr, int count, double *values)
+{
+  return _read_scaled_table(true, addr, count, values);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_holding_scaled(int addr, int count, float *values)
+{
+  return _read_scaled_table(true, addr, count, values);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_input_scaled(int addr, int count, double *values)
+{
+  return _read_scaled_table(false, addr, count, values);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::read_input_scaled(int addr, int count, float *values)
+{
+  return _read_scaled_table(false, addr, count, values);
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_set_scale(bool holding, int addr, int count, const ModbusScale &scale)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  if (count < 1 || inx < 0 || inx + count > (holding ? holding_reg_count_ : input_reg_count_))
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  ModbusScaleTable *&table = holding ? holding_scales_ : input_scales_;
+  if (table == NULL) table = new ModbusScaleTable();
+  if (table->add(inx, count, scale) != 0) return MODBUS_DATA_ILLEGAL_ADDR;
+  // 按寄存器当前的值初始化解码后的工程量
+  if (holding) _decode_holding_scale(inx, count);
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename T>
+int ModbusDataTemplate<BIT_T, REG_T>::_write_scaled_table(bool holding, int addr, const T *values, int count)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  ModbusScaleTable *table = holding ? holding_scales_ : input_scales_;
+  if (table == NULL || count < 0 || !table->covers(inx, count))
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  // 每个区间按自己的转换整段转换, 写入方式同_write_scaled(保持寄存器写入后会解码)
+  for (int i = 0; i < count; ) {
+    ModbusScaleTable::Range *range = table->find(inx + i);
+    int n = range->inx + range->count - (inx + i);
+    if (n > count - i) n = count - i;
+    int ret = _write_scaled(holding, addr + i, values + i, n, range->scale);
+    if (ret != MODBUS_NONE) return ret;
+    i += n;
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+template <typename T>
+int ModbusDataTemplate<BIT_T, REG_T>::_read_scaled_table(bool holding, int addr, int count, T *values)
+{
+  int inx = addr - (holding ? holding_reg_start_addr_ : input_reg_start_addr_);
+  ModbusScaleTable *table = holding ? holding_scales_ : input_scales_;
+  if (table == NULL || count < 0 || !table->covers(inx, count))
+    return MODBUS_DATA_ILLEGAL_ADDR;
+  for (int i = 0; i < count; ) {
+    ModbusScaleTable::Range *range = table->find(inx + i);
+    int off = inx + i - range->inx;
+    int n = range->count - off;
+    if (n > count - i) n = count - i;
+    if (holding) {
+      // 保持寄存器读取写入时解码好的值
+      MODBUS_HEATMAP_ACCESS(HEAT_HOLDING_REGS, HEAT_READ, addr + i, n);
+      for (int j = 0; j < n; j++) values[i + j] = (T)range->values[off + j];
+    }
+    else {
+      int ret = _read_scaled(false, addr + i, n, values + i, range->scale);
+      if (ret != MODBUS_NONE) return ret;
+    }
+    i += n;
+  }
+  return MODBUS_NONE;
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_decode_holding_scale(int inx, int quantity)
+{
+  if (holding_scales_ == NULL) return;
+  // 基本型数据结构直接解码连续的原始数据, 其它的分块收集原始数据(不调用额外绑定的读方法)
+  if (_is_raw<REG_T, ushort>()) {
+    holding_scales_->decode(inx, (const ushort *)(holding_regs_ + inx), quantity);
+    return;
+  }
+  ushort tmp[256];
+  while (quantity > 0) {
+    int n = quantity > 256 ? 256 : quantity;
+    for (int i = 0; i < n; i++) tmp[i] = holding_regs_[inx + i].get_data();
+    holding_scales_->decode(inx, tmp, n);
+    inx += n;
+    quantity -= n;
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_persist_range(unsigned char type, int inx, int quantity)
+{
+  // 记录写入后的原始数据(额外绑定的写方法可能拒绝写入), 分块拷贝避免申请内存
+  unsigned short tmp[256];
+  while (quantity > 0) {
+    int n = quantity > 256 ? 256 : quantity;
+    if (type == PERSIST_COIL_BITS) {
+      unsigned char *bits = (unsigned char *)tmp;
+      for (int i = 0; i < n; i++) bits[i] = coil_bits_[inx + i].get_data();
+      persist_->append(type, coil_bit_start_addr_ + inx, bits, n);
+    }
+    else {
+      for (int i = 0; i < n; i++) tmp[i] = holding_regs_[inx + i].get_data();
+      persist_->append(type, holding_reg_start_addr_ + inx, tmp, n);
+    }
+    inx += n;
+    quantity -= n;
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+void ModbusDataTemplate<BIT_T, REG_T>::_persist_apply(void *arg, unsigned char type, int addr, const void *data, int count)
+{
+  ModbusDataTemplate<BIT_T, REG_T> *self = (ModbusDataTemplate<BIT_T, REG_T> *)arg;
+  if (type == PERSIST_COIL_BITS) {
+    const unsigned char *bits = (const unsigned char *)data;
+    int inx = addr - (int)self->coil_bit_start_addr_;
+    for (int i = 0; i < count; i++) {
+      if (inx + i >= 0 && inx + i < (int)self->coil_bit_count_)
+        self->coil_bits_[inx + i].set_data(bits[i] ? ON : OFF);
+    }
+  }
+  else if (type == PERSIST_HOLDING_REGS) {
+    const unsigned short *regs = (const unsigned short *)data;
+    int inx = addr - (int)self->holding_reg_start_addr_;
+    for (int i = 0; i < count; i++) {
+      if (inx + i >= 0 && inx + i < (int)self->holding_reg_count_)
+        self->holding_regs_[inx + i].set_data(regs[i]);
+    }
+    int lo = inx > 0 ? inx : 0;
+    int hi = inx + count < (int)self->holding_reg_count_ ? inx + count : (int)self->holding_reg_count_;
+    if (lo < hi) self->_decode_holding_scale(lo, hi - lo);
+  }
+}
+
+template <typename BIT_T, typename REG_T>
+int ModbusDataTemplate<BIT_T, REG_T>::_persist_gather(void *arg, unsigned char type, void *data, int *start_addr)
+{
+  ModbusDataTemplate<BIT_T, REG_T> *self = (ModbusDataTemplate<BIT_T, REG_T> *)arg;
+  if (type == PERSIST_COIL_BITS) {
+    *start_addr = self->coil_bit_start_addr_;
+    if (data != NULL) {
+      unsigned char *bits = (unsigned char *)data;
+      for (unsigned int i = 0; i < self->coil_bit_count_; i++) bits[i] = self->coil_bits_[i].get_data();
+    }
+    return self->coil_bit_count_;
+  }
+  else if (type == PERSIST_HOLDING_REGS) {
+    *start_addr = self->holding_reg_start_addr_;
+    if (data != NULL) {
+      unsigned short *regs = (unsigned short *)data;
+      for (unsigned int i = 0; i < self->holding_reg_count_; i++) regs[i] = self->holding_regs_[i].get_data();
+    }
+    return self->holding_reg_count_;
+  }
+  return 0;
+}
+
+/**************** StaticModbusDataTemplate *****************/
+
+template <typename BIT_T, typename REG_T>
+void StaticModbusDataTemplate<BIT_T, REG_T>::set_modbus_data(ModbusDataTemplate<BIT_T, REG_T>* modbus_data)
+{
+  modbus_data_ = modbus_data;
+}
+
+template <typename BIT_T, typename REG_T>
+ModbusDataTemplate<BIT_T, REG_T>* StaticModbusDataTemplate<BIT_T, REG_T>::get_modbus_data(void)
+{
+  return modbus_data_;
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::read_coil_bits(int addr, int quantity, uchar *bits)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->read_coil_bits(addr, quantity, bits);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::read_input_bits(int addr, int quantity, uchar *bits)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->read_input_bits(addr, quantity, bits);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::read_holding_registers(int addr, int quantity, ushort *regs)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->read_holding_registers(addr, quantity, regs);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::read_input_registers(int addr, int quantity, ushort *regs)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->read_input_registers(addr, quantity, regs);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::write_coil_bits(int addr, uchar *bits, int quantity)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->write_coil_bits(addr, bits, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::write_input_bits(int addr, uchar *bits, int quantity)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->write_input_bits(addr, bits, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::write_holding_registers(int addr, ushort *regs, int quantity)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->write_holding_registers(addr, regs, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::write_input_registers(int addr, ushort *regs, int quantity)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->write_input_registers(addr, regs, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::mask_write_holding_register(int addr, ushort and_mask, ushort or_mask)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->mask_write_holding_register(addr, and_mask, or_mask);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::write_and_read_holding_registers(int w_addr, ushort *w_regs, int w_quantity, int r_addr, int r_quantity, ushort *r_regs)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->write_and_read_holding_registers(w_addr, w_regs, w_quantity, r_addr, r_quantity, r_regs);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::read_file_records(int file_no, int record_no, int quantity, ushort *regs)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->read_file_records(file_no, record_no, quantity, regs);
+}
+
+template <typename BIT_T, typename REG_T>
+int StaticModbusDataTemplate<BIT_T, REG_T>::write_file_records(int file_no, int record_no, ushort *regs, int quantity)
+{
+  if (modbus_data_ == NULL) return MODBUS_DATA_NOT_CREATE;
+  return modbus_data_->write_file_records(file_no, record_no, regs, quantity);
+}
+
+template <typename BIT_T, typename REG_T>
+BIT_T* StaticModbusDataTemplate<BIT_T, REG_T>::get_coil_bit_struct(int addr)
+{
+  if (modbus_data_ == NULL) return NULL;
+  return modbus_data_->get_coil_bit_struct(addr);
+}
+
+template <typename BIT_T, typename REG_T>
+BIT_T* StaticModbusDataTemplate<BIT_T, REG_T>::get_input_bit_struct(int addr)
+{
+  if (modbus_data_ == NULL) return NULL;
+  return modbus_data_->get_input_bit_struct(addr);
+}
+
+template <typename BIT_T, typename REG_T>
+REG_T* StaticModbusDataTemplate<BIT_T, REG_T>::get_holding_register_struct(int addr)
+{
+  if (modbus_data_ == NULL) return NULL;
+  return modbus_data_->get_holding_register_struct(addr);
+}
+
+template <typename BIT_T, typename REG_T>
+REG_T* StaticModbusDataTemplate<BIT_T, REG_T>::get_input_register_struct(int addr)
+{
+  if (modbus_data_ == NULL) return NULL;
+  return modbus_data_->get_input_register_struct(addr);
+}
+
+#endif // _MODBUS_DATA_IMPL_H_
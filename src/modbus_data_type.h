@@ -12,6 +12,7 @@
 
 #include <stdio.h>
 #include <functional>
+#include "modbus_metrics.h"
 
 #ifndef ON
 #define ON 1
@@ -145,10 +146,18 @@ struct modbus_struct_data_op {
   }
 
   /* get: 数据的额外读操作 */
-  T get(T val) { return flags.has_get ? flags.is_std_get ? (*std_get)(val) : ptr_get(val) : val; }
+  T get(T val) {
+    if (!flags.has_get) return val;
+    MODBUS_METRICS_HOOK_CALL();
+    return flags.is_std_get ? (*std_get)(val) : ptr_get(val);
+  }
   
   /* set: 数据的额外写操作 */
-  int set(T val) { return flags.has_set ? flags.is_std_set ? (*std_set)(val) : ptr_set(val) : 0; }
+  int set(T val) {
+    if (!flags.has_set) return 0;
+    MODBUS_METRICS_HOOK_CALL();
+    return flags.is_std_set ? (*std_set)(val) : ptr_set(val);
+  }
 
   /* bind_get: 数据的额外读方法的绑定
    * 1. 函数指针作为绑定参数
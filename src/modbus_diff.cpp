@@ -0,0 +1,86 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "modbus_diff.h"
+
+#if defined(__SSE2__)
+/* 16字节里相等的字节的掩码(每个字节一位) */
+static inline unsigned int _equal_mask(const unsigned short *old_regs, const unsigned short *new_regs)
+{
+  __m128i a = _mm_loadu_si128((const __m128i *)old_regs);
+  __m128i b = _mm_loadu_si128((const __m128i *)new_regs);
+  return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi16(a, b));
+}
+
+static inline unsigned int _equal_mask(const unsigned char *old_bits, const unsigned char *new_bits)
+{
+  __m128i a = _mm_loadu_si128((const __m128i *)old_bits);
+  __m128i b = _mm_loadu_si128((const __m128i *)new_bits);
+  // 新值非0为1
+  b = _mm_andnot_si128(_mm_cmpeq_epi8(b, _mm_setzero_si128()), _mm_set1_epi8(1));
+  return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+#endif
+
+/* want_equal为false时找第一个不相等的位置, 为true时找第一个相等的位置 */
+static int _find(const unsigned short *old_regs, const unsigned short *new_regs, int count, int start, bool want_equal)
+{
+  int i = start < 0 ? 0 : start;
+#if defined(__SSE2__)
+  for (; i + 8 <= count; i += 8) {
+    unsigned int mask = _equal_mask(old_regs + i, new_regs + i);
+    if (!want_equal) mask = ~mask & 0xFFFF;
+    // 每个寄存器对应掩码的两位
+    if (mask != 0) return i + __builtin_ctz(mask) / 2;
+  }
+#endif
+  for (; i < count; i++) {
+    if ((old_regs[i] == new_regs[i]) == want_equal) return i;
+  }
+  return count;
+}
+
+static int _find(const unsigned char *old_bits, const unsigned char *new_bits, int count, int start, bool want_equal)
+{
+  int i = start < 0 ? 0 : start;
+#if defined(__SSE2__)
+  for (; i + 16 <= count; i += 16) {
+    unsigned int mask = _equal_mask(old_bits + i, new_bits + i);
+    if (!want_equal) mask = ~mask & 0xFFFF;
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < count; i++) {
+    if ((old_bits[i] == (new_bits[i] ? 1 : 0)) == want_equal) return i;
+  }
+  return count;
+}
+
+int ModbusDiff::find_changed(const unsigned short *old_regs, const unsigned short *new_regs, int count, int start)
+{
+  return _find(old_regs, new_regs, count, start, false);
+}
+
+int ModbusDiff::find_changed(const unsigned char *old_bits, const unsigned char *new_bits, int count, int start)
+{
+  return _find(old_bits, new_bits, count, start, false);
+}
+
+int ModbusDiff::find_unchanged(const unsigned short *old_regs, const unsigned short *new_regs, int count, int start)
+{
+  return _find(old_regs, new_regs, count, start, true);
+}
+
+int ModbusDiff::find_unchanged(const unsigned char *old_bits, const unsigned char *new_bits, int count, int start)
+{
+  return _find(old_bits, new_bits, count, start, true);
+}
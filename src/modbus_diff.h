@@ -0,0 +1,38 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_DIFF_H_
+#define _MODBUS_DIFF_H_
+
+/* ModbusDiff: 写入前找出寄存器里真正变化的区间
+ * 1. 在连续存储的原始数据上比较, 不调用额外绑定的读方法
+ * 2. x86上用SSE2每次比较16字节(8个寄存器或16个线圈), 其它平台逐个比较
+ * 3. 线圈的新值按非0为ON(1)比较, 原始数据里存的是0/1
+ */
+class ModbusDiff
+{
+public:
+  /* find_changed: 从start开始找第一个不相等的位置
+   * @param old_regs: 原始数据
+   * @param new_regs: 要写入的数据
+   * @param count: 个数
+   * @param start: 开始的位置
+   * :return: 第一个不相等的位置, 全部相等返回count
+   */
+  static int find_changed(const unsigned short *old_regs, const unsigned short *new_regs, int count, int start);
+  static int find_changed(const unsigned char *old_bits, const unsigned char *new_bits, int count, int start);
+
+  /* find_unchanged: 从start开始找第一个相等的位置(和find_changed一起找出变化的区间[changed, unchanged))
+   * :return: 第一个相等的位置, 全部不相等返回count
+   */
+  static int find_unchanged(const unsigned short *old_regs, const unsigned short *new_regs, int count, int start);
+  static int find_unchanged(const unsigned char *old_bits, const unsigned char *new_bits, int count, int start);
+};
+
+#endif // _MODBUS_DIFF_H_
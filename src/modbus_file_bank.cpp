@@ -0,0 +1,148 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "modbus_file_bank.h"
+#include "modbus_data.h"
+#include "modbus_log.h"
+
+ModbusFileBank::ModbusFileBank()
+{
+  files_ = NULL;
+  file_count_ = 0;
+  file_capacity_ = 0;
+}
+
+ModbusFileBank::~ModbusFileBank()
+{
+  for (int i = 0; i < file_count_; i++) {
+    if (files_[i].map_size > 0) munmap(files_[i].data, files_[i].map_size);
+    else delete[] files_[i].data;
+  }
+  if (files_ != NULL) delete[] files_;
+}
+
+ModbusFileBank::File *ModbusFileBank::_find(int file_no)
+{
+  int low = 0;
+  int high = file_count_ - 1;
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    if (files_[mid].file_no == file_no) return &files_[mid];
+    if (files_[mid].file_no < file_no) low = mid + 1;
+    else high = mid - 1;
+  }
+  return NULL;
+}
+
+int ModbusFileBank::add_file(int file_no, int record_count, const char *path)
+{
+  if (file_no < 1 || file_no > 0xFFFF || record_count < 1 || record_count > MODBUS_FILE_MAX_RECORDS) return -1;
+  if (_find(file_no) != NULL) return -1;
+
+  File file;
+  file.file_no = file_no;
+  file.record_count = record_count;
+  file.map_size = 0;
+  size_t size = (size_t)record_count * sizeof(unsigned short);
+  if (path != NULL) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      MODBUS_LOG_ERROR("open file record %d (%s) failed", file_no, path);
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd, size) != 0)) {
+      MODBUS_LOG_ERROR("resize file record %d (%s) failed", file_no, path);
+      close(fd);
+      return -1;
+    }
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    // 映射建立后文件描述符可以关闭
+    close(fd);
+    if (addr == MAP_FAILED) {
+      MODBUS_LOG_ERROR("mmap file record %d (%s) failed", file_no, path);
+      return -1;
+    }
+    file.data = (unsigned short *)addr;
+    file.map_size = size;
+  }
+  else {
+    file.data = new unsigned short[record_count];
+    memset(file.data, 0, size);
+  }
+
+  if (file_count_ == file_capacity_) {
+    int capacity = file_capacity_ > 0 ? file_capacity_ * 2 : 4;
+    File *files = new File[capacity];
+    if (files_ != NULL) {
+      memcpy(files, files_, file_count_ * sizeof(File));
+      delete[] files_;
+    }
+    files_ = files;
+    file_capacity_ = capacity;
+  }
+  int inx = file_count_;
+  while (inx > 0 && files_[inx - 1].file_no > file_no) {
+    files_[inx] = files_[inx - 1];
+    inx--;
+  }
+  files_[inx] = file;
+  file_count_++;
+  return 0;
+}
+
+unsigned short *ModbusFileBank::get_file(int file_no, int *record_count)
+{
+  File *file = _find(file_no);
+  if (file == NULL) return NULL;
+  if (record_count != NULL) *record_count = file->record_count;
+  return file->data;
+}
+
+unsigned short *ModbusFileBank::_range(int file_no, int record_no, int quantity)
+{
+  File *file = _find(file_no);
+  if (file == NULL || record_no < 0 || quantity < 0 || record_no + quantity > file->record_count) return NULL;
+  return file->data + record_no;
+}
+
+int ModbusFileBank::check(int file_no, int record_no, int quantity)
+{
+  return _range(file_no, record_no, quantity) != NULL ? MODBUS_NONE : MODBUS_DATA_ILLEGAL_ADDR;
+}
+
+int ModbusFileBank::read(int file_no, int record_no, int quantity, unsigned short *regs)
+{
+  unsigned short *data = _range(file_no, record_no, quantity);
+  if (data == NULL) return MODBUS_DATA_ILLEGAL_ADDR;
+  memcpy(regs, data, quantity * sizeof(unsigned short));
+  return MODBUS_NONE;
+}
+
+int ModbusFileBank::write(int file_no, int record_no, const unsigned short *regs, int quantity)
+{
+  unsigned short *data = _range(file_no, record_no, quantity);
+  if (data == NULL) return MODBUS_DATA_ILLEGAL_ADDR;
+  memcpy(data, regs, quantity * sizeof(unsigned short));
+  return MODBUS_NONE;
+}
+
+int ModbusFileBank::sync(void)
+{
+  int ret = 0;
+  for (int i = 0; i < file_count_; i++) {
+    if (files_[i].map_size > 0 && msync(files_[i].data, files_[i].map_size, MS_SYNC) != 0) ret = -1;
+  }
+  return ret;
+}
@@ -0,0 +1,92 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_FILE_BANK_H_
+#define _MODBUS_FILE_BANK_H_
+
+#include <stddef.h>
+
+#define MODBUS_FILE_MAX_RECORDS 10000 // 每个文件最多的记录数(记录号0x0000~0x270F)
+#define MODBUS_FILE_REF_TYPE    0x06  // 文件记录的引用类型(固定为6)
+
+/* ModbusFileBank: 文件记录(0x14/0x15功能码)的存储
+ * 1. 每个文件是一块连续的内存, 一个记录是16位的寄存器(本机字节序), 文件号1~65535, 记录号从0开始
+ * 2. 可以映射到磁盘上的文件(mmap, MAP_SHARED), 写入的配方/参数块掉电后仍然保留, 需要时调用sync刷到磁盘
+ * 3. 添加文件时申请内存, 读写时没有内存申请; 和寄存器一样, 多个线程同时读写需要调用者自己加锁
+ */
+class ModbusFileBank
+{
+public:
+  ModbusFileBank();
+  ~ModbusFileBank();
+
+  /* add_file: 添加一个文件
+   * @param file_no: 文件号(1~65535)
+   * @param record_count: 记录数(1~MODBUS_FILE_MAX_RECORDS)
+   * @param path: 映射的磁盘文件路径, 为NULL时使用普通内存(初始为0); 磁盘文件不够大时会扩展, 已有的内容保留
+   * :return: 成功返回0, 参数错误、文件号已存在或者映射失败返回-1
+   */
+  int add_file(int file_no, int record_count, const char *path = NULL);
+
+  /* get_file: 获取文件的内存, 应用程序可以直接读写
+   * @param file_no: 文件号
+   * @param record_count: 输出记录数, 可以为NULL
+   * :return: 文件的内存, 文件不存在返回NULL
+   */
+  unsigned short *get_file(int file_no, int *record_count = NULL);
+
+  /* check: 检查要访问的记录是否存在
+   * :return: 存在返回0, 否则返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int check(int file_no, int record_no, int quantity);
+
+  /* read: 读取记录
+   * @param file_no: 文件号
+   * @param record_no: 起始记录号
+   * @param quantity: 记录数
+   * @param regs: 存储读取到的记录的数组, 数组大小不能小于quantity
+   * :return: 成功返回0, 记录不存在返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int read(int file_no, int record_no, int quantity, unsigned short *regs);
+
+  /* write: 写入记录
+   * @param file_no: 文件号
+   * @param record_no: 起始记录号
+   * @param regs: 要写入的记录的数组, 数组大小不能小于quantity
+   * @param quantity: 记录数
+   * :return: 成功返回0, 记录不存在返回MODBUS_DATA_ILLEGAL_ADDR
+   */
+  int write(int file_no, int record_no, const unsigned short *regs, int quantity);
+
+  /* sync: 把映射到磁盘的文件刷到磁盘
+   * :return: 成功返回0, 失败返回-1
+   */
+  int sync(void);
+
+  /* get_file_count: 获取文件数 */
+  int get_file_count(void) { return file_count_; }
+
+private:
+  struct File {
+    int file_no;
+    int record_count;
+    unsigned short *data;
+    size_t map_size;  // 映射的大小, 为0表示普通内存
+  };
+
+  File *_find(int file_no);
+  unsigned short *_range(int file_no, int record_no, int quantity);
+
+private:
+  File *files_;       // 按文件号排序
+  int file_count_;
+  int file_capacity_;
+};
+
+#endif // _MODBUS_FILE_BANK_H_
@@ -0,0 +1,387 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include "modbus_heatmap.h"
+#include "modbus_rt.h"
+
+/* 一个线程里一个客户端的统计, 只有这个线程写; 导出时按seq检查(seqlock), 写入期间seq为奇数 */
+struct ModbusHeatmapClientShard {
+  std::atomic<uint32_t> seq;
+  std::atomic<uint64_t> requests[HEAT_TYPE_COUNT][HEAT_OP_COUNT];
+  std::atomic<uint64_t> cells[HEAT_TYPE_COUNT][HEAT_OP_COUNT];
+  std::atomic<int> range_count;
+  struct {
+    std::atomic<int> type;
+    std::atomic<int> op;
+    std::atomic<int> addr;
+    std::atomic<int> quantity;
+    std::atomic<uint64_t> count;
+  } ranges[MODBUS_HEATMAP_CLIENT_TOP];
+};
+
+struct ModbusHeatmapShard {
+  // 差分数组, 分片创建时申请: diff[addr] += n, diff[addr + quantity] -= n
+  std::atomic<uint64_t> *diff[HEAT_TYPE_COUNT][HEAT_OP_COUNT];
+  ModbusHeatmapClientShard *clients;  // MODBUS_HEATMAP_MAX_CLIENTS个客户端
+  unsigned int sample_countdown;
+  bool in_use;
+  ModbusHeatmapShard *next;
+};
+
+std::atomic<bool> ModbusHeatmap::enabled_(false);
+std::atomic<unsigned int> ModbusHeatmap::sample_interval_(1);
+thread_local ModbusHeatmapShard *ModbusHeatmap::tls_shard_ = NULL;
+thread_local int ModbusHeatmap::tls_client_ = -1;
+
+// 所有分片的链表, 分片不会释放, 线程退出后由新线程复用
+static std::mutex heat_mutex;
+static ModbusHeatmapShard *heat_shards = NULL;
+
+// 注册的客户端名字, 注册后不再修改
+static std::mutex heat_clients_mutex;
+static char heat_client_names[MODBUS_HEATMAP_MAX_CLIENTS][MODBUS_HEATMAP_NAME_SIZE];
+static int heat_client_count = 0;
+
+static const char *heat_type_names[HEAT_TYPE_COUNT] = {"coil_bits", "input_bits", "holding_regs", "input_regs"};
+static const char *heat_op_names[HEAT_OP_COUNT] = {"read", "write"};
+
+/* 线程退出时释放分片(计数保留, 给后面的线程复用) */
+struct ModbusHeatmapShardReleaser {
+  ~ModbusHeatmapShardReleaser() {
+    if (shard != NULL) {
+      std::lock_guard<std::mutex> guard(heat_mutex);
+      shard->in_use = false;
+    }
+  }
+  ModbusHeatmapShard *shard = NULL;
+};
+static thread_local ModbusHeatmapShardReleaser heat_releaser;
+
+template <typename T>
+static void heat_add(std::atomic<T> &counter, T val)
+{
+  // 单写者, relaxed读写即可
+  counter.store(counter.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+}
+
+static bool heat_range_greater(const ModbusHeatRange &a, const ModbusHeatRange &b)
+{
+  if (a.count != b.count) return a.count > b.count;
+  return a.quantity > b.quantity;
+}
+
+static void heat_clear_client(ModbusHeatmapClientShard *client)
+{
+  for (int t = 0; t < HEAT_TYPE_COUNT; t++) {
+    for (int o = 0; o < HEAT_OP_COUNT; o++) {
+      client->requests[t][o].store(0, std::memory_order_relaxed);
+      client->cells[t][o].store(0, std::memory_order_relaxed);
+    }
+  }
+  client->range_count.store(0, std::memory_order_relaxed);
+}
+
+void ModbusHeatmap::enable(unsigned int sample_interval, int threads)
+{
+  {
+    // 预先分配空闲的分片, 之后第一次统计的线程直接使用
+    std::lock_guard<std::mutex> guard(heat_mutex);
+    int free_count = 0;
+    for (ModbusHeatmapShard *shard = heat_shards; shard != NULL; shard = shard->next) {
+      if (!shard->in_use) free_count++;
+    }
+    for (; free_count < threads; free_count++) _new_shard();
+  }
+  sample_interval_.store(sample_interval > 0 ? sample_interval : 1, std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void ModbusHeatmap::disable(void)
+{
+  enabled_.store(false, std::memory_order_relaxed);
+}
+
+ModbusHeatmapShard *ModbusHeatmap::_new_shard(void)
+{
+  // 调用者持有heat_mutex
+  ModbusHeatmapShard *shard = new ModbusHeatmapShard();
+  for (int i = 0; i < HEAT_TYPE_COUNT; i++) {
+    for (int j = 0; j < HEAT_OP_COUNT; j++) {
+      std::atomic<uint64_t> *diff = new std::atomic<uint64_t>[MODBUS_HEATMAP_ADDR_COUNT + 1];
+      for (int a = 0; a <= MODBUS_HEATMAP_ADDR_COUNT; a++) diff[a].store(0, std::memory_order_relaxed);
+      shard->diff[i][j] = diff;
+    }
+  }
+  shard->clients = new ModbusHeatmapClientShard[MODBUS_HEATMAP_MAX_CLIENTS];
+  for (int i = 0; i < MODBUS_HEATMAP_MAX_CLIENTS; i++) {
+    shard->clients[i].seq.store(0, std::memory_order_relaxed);
+    heat_clear_client(&shard->clients[i]);
+  }
+  shard->in_use = false;
+  shard->next = heat_shards;
+  heat_shards = shard;
+  return shard;
+}
+
+ModbusHeatmapShard *ModbusHeatmap::_acquire_shard(void)
+{
+  std::lock_guard<std::mutex> guard(heat_mutex);
+  ModbusHeatmapShard *shard = heat_shards;
+  while (shard != NULL && shard->in_use) shard = shard->next;
+  if (shard == NULL) {
+    // 统计的线程比enable时预先分配的多
+    MODBUS_RT_HEAP_CHECK("ModbusHeatmap shard");
+    shard = _new_shard();
+  }
+  shard->in_use = true;
+  shard->sample_countdown = 1;
+  tls_shard_ = shard;
+  heat_releaser.shard = shard;
+  return shard;
+}
+
+void ModbusHeatmap::_record(int type, int op, int addr, int quantity)
+{
+  ModbusHeatmapShard *shard = tls_shard_ != NULL ? tls_shard_ : _acquire_shard();
+  if (--shard->sample_countdown > 0) return;
+  unsigned int weight = sample_interval_.load(std::memory_order_relaxed);
+  shard->sample_countdown = weight;
+  if (type < 0 || type >= HEAT_TYPE_COUNT || op < 0 || op >= HEAT_OP_COUNT) return;
+  if (addr < 0 || quantity <= 0 || addr + quantity > MODBUS_HEATMAP_ADDR_COUNT) return;
+
+  // 减法按2^64取模, 求前缀和时结果正确
+  std::atomic<uint64_t> *diff = shard->diff[type][op];
+  heat_add<uint64_t>(diff[addr], weight);
+  heat_add<uint64_t>(diff[addr + quantity], (uint64_t)0 - weight);
+
+  int client = tls_client_;
+  if (client < 0 || client >= MODBUS_HEATMAP_MAX_CLIENTS) return;
+  ModbusHeatmapClientShard &stats = shard->clients[client];
+  uint32_t seq = stats.seq.load(std::memory_order_relaxed);
+  stats.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  heat_add<uint64_t>(stats.requests[type][op], weight);
+  heat_add<uint64_t>(stats.cells[type][op], (uint64_t)weight * quantity);
+  // Space-Saving: 命中则累加, 有空位则加入, 否则替换计数最小的区间(新区间的计数从最小值开始)
+  int range_count = stats.range_count.load(std::memory_order_relaxed);
+  int min_inx = 0;
+  int inx = -1;
+  for (int i = 0; i < range_count; i++) {
+    if (stats.ranges[i].type.load(std::memory_order_relaxed) == type && stats.ranges[i].op.load(std::memory_order_relaxed) == op
+      && stats.ranges[i].addr.load(std::memory_order_relaxed) == addr && stats.ranges[i].quantity.load(std::memory_order_relaxed) == quantity) {
+      inx = i;
+      break;
+    }
+    if (stats.ranges[i].count.load(std::memory_order_relaxed) < stats.ranges[min_inx].count.load(std::memory_order_relaxed)) min_inx = i;
+  }
+  if (inx >= 0) {
+    heat_add<uint64_t>(stats.ranges[inx].count, weight);
+  }
+  else {
+    uint64_t base = 0;
+    inx = range_count;
+    if (range_count < MODBUS_HEATMAP_CLIENT_TOP) {
+      stats.range_count.store(range_count + 1, std::memory_order_relaxed);
+    }
+    else {
+      inx = min_inx;
+      base = stats.ranges[min_inx].count.load(std::memory_order_relaxed);
+    }
+    stats.ranges[inx].type.store(type, std::memory_order_relaxed);
+    stats.ranges[inx].op.store(op, std::memory_order_relaxed);
+    stats.ranges[inx].addr.store(addr, std::memory_order_relaxed);
+    stats.ranges[inx].quantity.store(quantity, std::memory_order_relaxed);
+    stats.ranges[inx].count.store(base + weight, std::memory_order_relaxed);
+  }
+  stats.seq.store(seq + 2, std::memory_order_release);
+}
+
+int ModbusHeatmap::register_client(const char *name)
+{
+  std::lock_guard<std::mutex> guard(heat_clients_mutex);
+  for (int i = 0; i < heat_client_count; i++) {
+    if (strncmp(heat_client_names[i], name, MODBUS_HEATMAP_NAME_SIZE - 1) == 0) return i;
+  }
+  if (heat_client_count >= MODBUS_HEATMAP_MAX_CLIENTS) return -1;
+  strncpy(heat_client_names[heat_client_count], name, MODBUS_HEATMAP_NAME_SIZE - 1);
+  heat_client_names[heat_client_count][MODBUS_HEATMAP_NAME_SIZE - 1] = '\0';
+  return heat_client_count++;
+}
+
+void ModbusHeatmap::reset(void)
+{
+  std::lock_guard<std::mutex> guard(heat_mutex);
+  for (ModbusHeatmapShard *shard = heat_shards; shard != NULL; shard = shard->next) {
+    for (int i = 0; i < HEAT_TYPE_COUNT; i++) {
+      for (int j = 0; j < HEAT_OP_COUNT; j++) {
+        std::atomic<uint64_t> *diff = shard->diff[i][j];
+        for (int a = 0; a <= MODBUS_HEATMAP_ADDR_COUNT; a++) diff[a].store(0, std::memory_order_relaxed);
+      }
+    }
+    for (int i = 0; i < MODBUS_HEATMAP_MAX_CLIENTS; i++) heat_clear_client(&shard->clients[i]);
+  }
+}
+
+void ModbusHeatmap::get_counts(int type, int op, uint64_t *counts)
+{
+  memset(counts, 0, sizeof(uint64_t) * MODBUS_HEATMAP_ADDR_COUNT);
+  if (type < 0 || type >= HEAT_TYPE_COUNT || op < 0 || op >= HEAT_OP_COUNT) return;
+  std::lock_guard<std::mutex> guard(heat_mutex);
+  for (ModbusHeatmapShard *shard = heat_shards; shard != NULL; shard = shard->next) {
+    std::atomic<uint64_t> *diff = shard->diff[type][op];
+    uint64_t sum = 0;
+    for (int a = 0; a < MODBUS_HEATMAP_ADDR_COUNT; a++) {
+      sum += diff[a].load(std::memory_order_relaxed);
+      counts[a] += sum;
+    }
+  }
+}
+
+void ModbusHeatmap::get_top_ranges(int k, std::vector<ModbusHeatRange> *ranges, int type, int op)
+{
+  ranges->clear();
+  if (k <= 0) return;
+  std::vector<uint64_t> counts(MODBUS_HEATMAP_ADDR_COUNT);
+  for (int t = 0; t < HEAT_TYPE_COUNT; t++) {
+    if (type >= 0 && type != t) continue;
+    for (int o = 0; o < HEAT_OP_COUNT; o++) {
+      if (op >= 0 && op != o) continue;
+      get_counts(t, o, counts.data());
+      int a = 0;
+      while (a < MODBUS_HEATMAP_ADDR_COUNT) {
+        if (counts[a] == 0) {
+          a++;
+          continue;
+        }
+        ModbusHeatRange range;
+        range.type = t;
+        range.op = o;
+        range.addr = a;
+        range.count = counts[a];
+        while (a < MODBUS_HEATMAP_ADDR_COUNT && counts[a] == range.count) a++;
+        range.quantity = a - range.addr;
+        ranges->push_back(range);
+      }
+    }
+  }
+  if ((int)ranges->size() > k) {
+    std::partial_sort(ranges->begin(), ranges->begin() + k, ranges->end(), heat_range_greater);
+    ranges->resize(k);
+  }
+  else {
+    std::sort(ranges->begin(), ranges->end(), heat_range_greater);
+  }
+}
+
+/* 读取一个线程里一个客户端的统计, 写入期间读到的不完整时重读 */
+static void heat_read_client(ModbusHeatmapClientShard *src, ModbusHeatClient *dst)
+{
+  while (true) {
+    uint32_t seq = src->seq.load(std::memory_order_acquire);
+    if ((seq & 1) == 0) {
+      for (int t = 0; t < HEAT_TYPE_COUNT; t++) {
+        for (int o = 0; o < HEAT_OP_COUNT; o++) {
+          dst->requests[t][o] = src->requests[t][o].load(std::memory_order_relaxed);
+          dst->cells[t][o] = src->cells[t][o].load(std::memory_order_relaxed);
+        }
+      }
+      int count = src->range_count.load(std::memory_order_relaxed);
+      dst->range_count = count < MODBUS_HEATMAP_CLIENT_TOP ? count : MODBUS_HEATMAP_CLIENT_TOP;
+      for (int i = 0; i < dst->range_count; i++) {
+        dst->ranges[i].type = src->ranges[i].type.load(std::memory_order_relaxed);
+        dst->ranges[i].op = src->ranges[i].op.load(std::memory_order_relaxed);
+        dst->ranges[i].addr = src->ranges[i].addr.load(std::memory_order_relaxed);
+        dst->ranges[i].quantity = src->ranges[i].quantity.load(std::memory_order_relaxed);
+        dst->ranges[i].count = src->ranges[i].count.load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (src->seq.load(std::memory_order_relaxed) == seq) return;
+    }
+    std::this_thread::yield();
+  }
+}
+
+void ModbusHeatmap::get_clients(std::vector<ModbusHeatClient> *clients)
+{
+  clients->clear();
+  int client_count;
+  {
+    std::lock_guard<std::mutex> guard(heat_clients_mutex);
+    client_count = heat_client_count;
+    clients->resize(client_count);
+    for (int i = 0; i < client_count; i++) {
+      ModbusHeatClient &stats = (*clients)[i];
+      memset(&stats, 0, sizeof(stats));
+      stats.id = i;
+      memcpy(stats.name, heat_client_names[i], MODBUS_HEATMAP_NAME_SIZE);
+    }
+  }
+  // 合并所有线程: 次数相加, 相同的区间计数相加后重新取访问最多的区间
+  std::vector<ModbusHeatRange> ranges;
+  std::lock_guard<std::mutex> guard(heat_mutex);
+  for (int i = 0; i < client_count; i++) {
+    ModbusHeatClient &stats = (*clients)[i];
+    ranges.clear();
+    for (ModbusHeatmapShard *shard = heat_shards; shard != NULL; shard = shard->next) {
+      ModbusHeatClient part;
+      heat_read_client(&shard->clients[i], &part);
+      for (int t = 0; t < HEAT_TYPE_COUNT; t++) {
+        for (int o = 0; o < HEAT_OP_COUNT; o++) {
+          stats.requests[t][o] += part.requests[t][o];
+          stats.cells[t][o] += part.cells[t][o];
+        }
+      }
+      for (int j = 0; j < part.range_count; j++) {
+        const ModbusHeatRange &range = part.ranges[j];
+        int k = 0;
+        while (k < (int)ranges.size() && !(ranges[k].type == range.type && ranges[k].op == range.op
+          && ranges[k].addr == range.addr && ranges[k].quantity == range.quantity)) k++;
+        if (k < (int)ranges.size()) ranges[k].count += range.count;
+        else ranges.push_back(range);
+      }
+    }
+    std::sort(ranges.begin(), ranges.end(), heat_range_greater);
+    stats.range_count = (int)ranges.size() < MODBUS_HEATMAP_CLIENT_TOP ? (int)ranges.size() : MODBUS_HEATMAP_CLIENT_TOP;
+    for (int j = 0; j < stats.range_count; j++) stats.ranges[j] = ranges[j];
+  }
+}
+
+void ModbusHeatmap::dump(FILE *fp, int k)
+{
+  std::vector<ModbusHeatRange> ranges;
+  get_top_ranges(k, &ranges);
+  fprintf(fp, "top %d ranges:\n", k);
+  for (int i = 0; i < (int)ranges.size(); i++) {
+    const ModbusHeatRange &range = ranges[i];
+    fprintf(fp, "  %-12s %-5s addr=%d quantity=%d count=%llu\n", heat_type_names[range.type], heat_op_names[range.op],
+      range.addr, range.quantity, (unsigned long long)range.count);
+  }
+  std::vector<ModbusHeatClient> clients;
+  get_clients(&clients);
+  for (int i = 0; i < (int)clients.size(); i++) {
+    const ModbusHeatClient &client = clients[i];
+    fprintf(fp, "client %d (%s):\n", client.id, client.name);
+    for (int t = 0; t < HEAT_TYPE_COUNT; t++) {
+      for (int o = 0; o < HEAT_OP_COUNT; o++) {
+        if (client.requests[t][o] == 0) continue;
+        fprintf(fp, "  %-12s %-5s requests=%llu cells=%llu\n", heat_type_names[t], heat_op_names[o],
+          (unsigned long long)client.requests[t][o], (unsigned long long)client.cells[t][o]);
+      }
+    }
+    for (int j = 0; j < client.range_count; j++) {
+      const ModbusHeatRange &range = client.ranges[j];
+      fprintf(fp, "  hot: %-12s %-5s addr=%d quantity=%d count=%llu\n", heat_type_names[range.type], heat_op_names[range.op],
+        range.addr, range.quantity, (unsigned long long)range.count);
+    }
+  }
+}
@@ -0,0 +1,152 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_HEATMAP_H_
+#define _MODBUS_HEATMAP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define MODBUS_HEATMAP_ADDR_COUNT   65536 // Modbus地址空间
+#define MODBUS_HEATMAP_MAX_CLIENTS  256   // 单独统计的客户端个数, 超过的只计入整体
+#define MODBUS_HEATMAP_CLIENT_TOP   16    // 每个客户端记录的访问最多的区间个数
+#define MODBUS_HEATMAP_NAME_SIZE    64
+
+enum ModbusHeatmapType {
+  HEAT_COIL_BITS = 0,       // 线圈状态
+  HEAT_INPUT_BITS = 1,      // 离散输入状态
+  HEAT_HOLDING_REGS = 2,    // 保持寄存器
+  HEAT_INPUT_REGS = 3,      // 输入寄存器
+  HEAT_TYPE_COUNT = 4
+};
+
+enum ModbusHeatmapOp {
+  HEAT_READ = 0,
+  HEAT_WRITE = 1,
+  HEAT_OP_COUNT = 2
+};
+
+/* ModbusHeatRange: 一段访问次数相同的连续地址 */
+struct ModbusHeatRange {
+  int type;         // ModbusHeatmapType
+  int op;           // ModbusHeatmapOp
+  int addr;         // 起始地址
+  int quantity;     // 个数
+  uint64_t count;   // 每个地址的访问次数(按采样间隔放大后的估计值)
+};
+
+/* ModbusHeatClient: 一个客户端的访问统计 */
+struct ModbusHeatClient {
+  int id;
+  char name[MODBUS_HEATMAP_NAME_SIZE];                 // 客户端名字(Server使用对方的IP)
+  uint64_t requests[HEAT_TYPE_COUNT][HEAT_OP_COUNT];   // 访问次数(估计值)
+  uint64_t cells[HEAT_TYPE_COUNT][HEAT_OP_COUNT];      // 访问的寄存器个数之和(估计值)
+  int range_count;
+  ModbusHeatRange ranges[MODBUS_HEATMAP_CLIENT_TOP];   // 访问最多的请求区间(按count从大到小)
+};
+
+struct ModbusHeatmapShard;
+
+/* ModbusHeatmap: 寄存器访问热度统计
+ * 1. ModbusDataTemplate的read_xxx/write_xxx里统计, 默认关闭, 关闭时只有一次原子读;
+ *    编译时定义MODBUS_DISABLE_HEATMAP可以完全去掉
+ * 2. 每个线程一份差分数组(按类型和读写各65537个64位计数器, 长时间运行也不会溢出), 一次访问不管个数多少
+ *    都只改两个计数器, 导出时再求前缀和并合并所有线程
+ * 3. 支持采样: 每N次访问统计一次, 统计时加N, 导出的是估计值
+ * 4. 客户端: Server在处理每个连接的数据前设置当前线程的客户端, 每个客户端用Space-Saving算法
+ *    记录访问最多的MODBUS_HEATMAP_CLIENT_TOP个请求区间; 同一个IP重连时计到同一个客户端;
+ *    客户端的统计也是每个线程一份(不加锁, 导出时用序号检查读到的是完整的一份), 导出时合并
+ * 5. 应用程序直接调用read_xxx/write_xxx(不在Server处理请求的过程中)也会计入整体, 但不属于任何客户端
+ * 6. 每个线程的数据(约4.3MB)在enable时预先分配, 统计时不申请内存; 超过预先分配的线程第一次统计时再申请
+ */
+class ModbusHeatmap
+{
+public:
+  /* enable: 开启统计
+   * @param sample_interval: 每多少次访问统计一次, 1表示每次都统计
+   * @param threads: 预先分配的线程数据的份数(之后第一次统计的线程数, 比如服务器的事件循环线程)
+   */
+  static void enable(unsigned int sample_interval = 1, int threads = 1);
+
+  /* disable: 关闭统计(已有的统计保留) */
+  static void disable(void);
+
+  /* is_enabled: 是否开启了统计 */
+  static bool is_enabled(void) { return enabled_.load(std::memory_order_relaxed); }
+
+  /* reset: 清空所有统计(包括客户端), 和访问同时进行时结果是近似的 */
+  static void reset(void);
+
+  /* on_access: 记录一次访问(由ModbusDataTemplate调用)
+   * @param type: 寄存器类型, 见ModbusHeatmapType
+   * @param op: 读/写, 见ModbusHeatmapOp
+   * @param addr: 起始地址
+   * @param quantity: 个数
+   */
+  static void on_access(int type, int op, int addr, int quantity)
+  {
+    if (!is_enabled()) return;
+    _record(type, op, addr, quantity);
+  }
+
+  /* register_client: 注册客户端, 同名的客户端返回同一个id
+   * @param name: 客户端名字
+   * :return: 客户端id, 超过MODBUS_HEATMAP_MAX_CLIENTS时返回-1
+   */
+  static int register_client(const char *name);
+
+  /* set_current_client: 设置当前线程正在处理的客户端, -1表示没有 */
+  static void set_current_client(int id) { tls_client_ = id; }
+
+  /* get_counts: 获取每个地址的访问次数(所有线程合并)
+   * @param type: 寄存器类型
+   * @param op: 读/写
+   * @param counts: MODBUS_HEATMAP_ADDR_COUNT个计数
+   */
+  static void get_counts(int type, int op, uint64_t *counts);
+
+  /* get_top_ranges: 获取访问最多的区间(访问次数相同的连续地址合并为一个区间)
+   * @param k: 最多获取的区间个数
+   * @param ranges: 区间, 按每个地址的访问次数从大到小排列
+   * @param type: 寄存器类型, 小于0表示所有类型
+   * @param op: 读/写, 小于0表示读和写
+   */
+  static void get_top_ranges(int k, std::vector<ModbusHeatRange> *ranges, int type = -1, int op = -1);
+
+  /* get_clients: 获取所有客户端的统计 */
+  static void get_clients(std::vector<ModbusHeatClient> *clients);
+
+  /* dump: 输出可读的统计(访问最多的k个区间和每个客户端)
+   * @param fp: 输出文件, 比如stdout
+   * @param k: 区间个数
+   */
+  static void dump(FILE *fp, int k = 10);
+
+private:
+  static void _record(int type, int op, int addr, int quantity);
+  static ModbusHeatmapShard *_acquire_shard(void);
+  static ModbusHeatmapShard *_new_shard(void);
+
+  static std::atomic<bool> enabled_;
+  static std::atomic<unsigned int> sample_interval_;
+  static thread_local ModbusHeatmapShard *tls_shard_;
+  static thread_local int tls_client_;
+};
+
+#ifndef MODBUS_DISABLE_HEATMAP
+#define MODBUS_HEATMAP_ACCESS(type, op, addr, quantity) ModbusHeatmap::on_access(type, op, addr, quantity)
+#define MODBUS_HEATMAP_SET_CLIENT(id) ModbusHeatmap::set_current_client(id)
+#else
+#define MODBUS_HEATMAP_ACCESS(type, op, addr, quantity)
+#define MODBUS_HEATMAP_SET_CLIENT(id)
+#endif
+
+#endif // _MODBUS_HEATMAP_H_
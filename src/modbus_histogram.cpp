@@ -0,0 +1,91 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include "modbus_histogram.h"
+
+ModbusHistogram::ModbusHistogram()
+{
+  reset();
+}
+
+void ModbusHistogram::reset(void)
+{
+  memset(counts_, 0, sizeof(counts_));
+  count_ = 0;
+  sum_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+}
+
+void ModbusHistogram::merge(const ModbusHistogram &other)
+{
+  for (int i = 0; i < MODBUS_HISTOGRAM_BUCKETS; i++) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  if (other.min_ < min_) min_ = other.min_;
+  if (other.max_ > max_) max_ = other.max_;
+}
+
+void ModbusHistogram::merge_raw(const uint64_t *counts, uint64_t sum, uint64_t min, uint64_t max)
+{
+  uint64_t count = 0;
+  for (int i = 0; i < MODBUS_HISTOGRAM_BUCKETS; i++) {
+    counts_[i] += counts[i];
+    count += counts[i];
+  }
+  if (count == 0) return;
+  count_ += count;
+  sum_ += sum;
+  if (min < min_) min_ = min;
+  if (max > max_) max_ = max;
+}
+
+uint64_t ModbusHistogram::_bucket_lower(int index)
+{
+  const int sub_count = 1 << MODBUS_HISTOGRAM_SUB_BITS;
+  const int half_count = sub_count >> 1;
+  if (index < sub_count) return index;
+  int shift = (index - sub_count) / half_count + 1;
+  uint64_t mantissa = (index - sub_count) % half_count + half_count;
+  return mantissa << shift;
+}
+
+uint64_t ModbusHistogram::_bucket_upper(int index)
+{
+  if (index >= MODBUS_HISTOGRAM_BUCKETS - 1) return UINT64_MAX;
+  return _bucket_lower(index + 1) - 1;
+}
+
+uint64_t ModbusHistogram::get_bucket(int index, uint64_t *lower, uint64_t *upper) const
+{
+  if (index < 0 || index >= MODBUS_HISTOGRAM_BUCKETS) return 0;
+  if (lower != NULL) *lower = _bucket_lower(index);
+  if (upper != NULL) *upper = _bucket_upper(index);
+  return counts_[index];
+}
+
+uint64_t ModbusHistogram::get_percentile(double percentile) const
+{
+  if (count_ == 0) return 0;
+  if (percentile >= 100) return max_;
+  uint64_t target = (uint64_t)(percentile / 100.0 * count_ + 0.5);
+  if (target < 1) target = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < MODBUS_HISTOGRAM_BUCKETS; i++) {
+    seen += counts_[i];
+    if (seen >= target) {
+      uint64_t upper = _bucket_upper(i);
+      return upper < max_ ? upper : max_;
+    }
+  }
+  return max_;
+}
@@ -0,0 +1,97 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_HISTOGRAM_H_
+#define _MODBUS_HISTOGRAM_H_
+
+#include <stdint.h>
+
+// 每个2的幂区间再线性细分为2^(SUB_BITS-1)个桶, 相对误差不超过1/2^(SUB_BITS-1)
+#define MODBUS_HISTOGRAM_SUB_BITS   7
+// 可以记录的最大值为2^MAX_BITS-1(单位纳秒时约18分钟), 更大的值记到最后一个桶
+#define MODBUS_HISTOGRAM_MAX_BITS   40
+#define MODBUS_HISTOGRAM_BUCKETS    ((1 << MODBUS_HISTOGRAM_SUB_BITS) + \
+  (MODBUS_HISTOGRAM_MAX_BITS - MODBUS_HISTOGRAM_SUB_BITS) * (1 << (MODBUS_HISTOGRAM_SUB_BITS - 1)))
+
+/* ModbusHistogram: 对数-线性分桶的直方图(类似HDR Histogram), 一般用来统计延时(纳秒)
+ * 1. record是O(1)的, 不分配内存
+ * 2. 多个直方图可以合并(比如每个线程/连接各自记录, 最后合并再计算百分位)
+ * 3. 非线程安全
+ */
+class ModbusHistogram
+{
+public:
+  ModbusHistogram();
+
+  /* record: 记录一个值 */
+  void record(uint64_t value)
+  {
+    counts_[get_bucket_index(value)]++;
+    count_++;
+    sum_ += value;
+    if (value < min_) min_ = value;
+    if (value > max_) max_ = value;
+  }
+
+  /* merge: 把另一个直方图的数据合并进来 */
+  void merge(const ModbusHistogram &other);
+
+  /* merge_raw: 合并按同样方式分桶的原始计数(比如原子计数器的拷贝)
+   * @param counts: 每个桶的计数, 个数为get_bucket_count()
+   * @param sum: 所有值的和
+   * @param min: 最小值
+   * @param max: 最大值
+   */
+  void merge_raw(const uint64_t *counts, uint64_t sum, uint64_t min, uint64_t max);
+
+  /* reset: 清空 */
+  void reset(void);
+
+  uint64_t get_count(void) const { return count_; }
+  uint64_t get_min(void) const { return count_ > 0 ? min_ : 0; }
+  uint64_t get_max(void) const { return max_; }
+  double get_mean(void) const { return count_ > 0 ? (double)sum_ / count_ : 0; }
+
+  /* get_percentile: 获取百分位的值
+   * @param percentile: 百分位(0~100), 比如99.9
+   * :return: 该百分位所在桶的上界(不超过最大值)
+   */
+  uint64_t get_percentile(double percentile) const;
+
+  /* get_bucket_count: 获取桶的个数 */
+  static int get_bucket_count(void) { return MODBUS_HISTOGRAM_BUCKETS; }
+
+  /* get_bucket: 获取某个桶的计数和数值范围[lower, upper] */
+  uint64_t get_bucket(int index, uint64_t *lower, uint64_t *upper) const;
+
+  /* get_bucket_index: 获取某个值所在的桶 */
+  static int get_bucket_index(uint64_t value)
+  {
+    const int sub_count = 1 << MODBUS_HISTOGRAM_SUB_BITS;
+    const int half_count = sub_count >> 1;
+    if (value < (uint64_t)sub_count) return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    if (msb >= MODBUS_HISTOGRAM_MAX_BITS) return MODBUS_HISTOGRAM_BUCKETS - 1;
+    int shift = msb - (MODBUS_HISTOGRAM_SUB_BITS - 1);
+    return sub_count + (shift - 1) * half_count + (int)(value >> shift) - half_count;
+  }
+
+private:
+  static uint64_t _bucket_lower(int index);
+  static uint64_t _bucket_upper(int index);
+
+private:
+  uint64_t counts_[MODBUS_HISTOGRAM_BUCKETS];
+  uint64_t count_;
+  uint64_t sum_;
+  uint64_t min_;
+  uint64_t max_;
+};
+
+#endif // _MODBUS_HISTOGRAM_H_
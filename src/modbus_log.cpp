@@ -0,0 +1,238 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+#include <thread>
+#include "modbus_log.h"
+
+#define LOG_IDLE_SLEEP_US 5000
+
+struct modbus_log_record {
+  std::atomic<uint64_t> seq;  // 环形缓冲区的序号(Vyukov有界队列)
+  uint64_t timestamp_ns;
+  int level;
+  int length;
+  char msg[MODBUS_LOG_MSG_SIZE];
+};
+
+/* 日志的全局状态, 进程退出时输出剩余的日志 */
+class ModbusLogState
+{
+public:
+  ModbusLogState()
+  {
+    for (uint64_t i = 0; i < MODBUS_LOG_RING_SIZE; i++) {
+      ring[i].seq.store(i, std::memory_order_relaxed);
+    }
+    head = 0;
+    tail.store(0, std::memory_order_relaxed);
+    dropped.store(0, std::memory_order_relaxed);
+    dropped_reported = 0;
+    sink = ModbusLog::stderr_sink;
+    sink_arg = NULL;
+    started.store(false, std::memory_order_relaxed);
+    stopped.store(false, std::memory_order_relaxed);
+    thread = NULL;
+  }
+  ~ModbusLogState() { ModbusLog::stop(); }
+
+  modbus_log_record ring[MODBUS_LOG_RING_SIZE];
+  uint64_t head;                        // 只有后台线程访问
+  std::atomic<uint64_t> tail;
+  std::atomic<uint64_t> dropped;
+  uint64_t dropped_reported;
+  ModbusLogSink sink;
+  void *sink_arg;
+  std::mutex sink_mutex;                // 保护sink的设置和调用
+  std::mutex start_mutex;
+  std::atomic<bool> started;
+  std::atomic<bool> stopped;
+  std::thread *thread;
+};
+
+static ModbusLogState log_state;
+
+std::atomic<int> ModbusLog::level_(MODBUS_LOG_LEVEL_INFO);
+
+static uint64_t log_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* 取出一条日志交给输出方法, 没有日志返回false(只在后台线程或者停止后调用) */
+static bool log_drain_one(void)
+{
+  modbus_log_record *rec = &log_state.ring[log_state.head & (MODBUS_LOG_RING_SIZE - 1)];
+  if (rec->seq.load(std::memory_order_acquire) != log_state.head + 1) return false;
+  {
+    std::lock_guard<std::mutex> guard(log_state.sink_mutex);
+    log_state.sink(log_state.sink_arg, rec->level, rec->timestamp_ns, rec->msg, rec->length);
+  }
+  rec->seq.store(log_state.head + MODBUS_LOG_RING_SIZE, std::memory_order_release);
+  log_state.head++;
+  return true;
+}
+
+static void log_report_dropped(void)
+{
+  uint64_t dropped = log_state.dropped.load(std::memory_order_relaxed);
+  if (dropped == log_state.dropped_reported) return;
+  char msg[64];
+  int length = snprintf(msg, sizeof(msg), "modbus log: dropped %lu messages", (unsigned long)(dropped - log_state.dropped_reported));
+  log_state.dropped_reported = dropped;
+  std::lock_guard<std::mutex> guard(log_state.sink_mutex);
+  log_state.sink(log_state.sink_arg, MODBUS_LOG_LEVEL_WARN, log_now_ns(), msg, length);
+}
+
+static void log_thread_loop(void)
+{
+  while (1) {
+    bool busy = false;
+    while (log_drain_one()) busy = true;
+    log_report_dropped();
+    if (!busy) {
+      if (log_state.stopped.load(std::memory_order_acquire)) break;
+      // 空闲时轮询, 写日志的一方不需要唤醒(不用系统调用)
+      usleep(LOG_IDLE_SLEEP_US);
+    }
+  }
+}
+
+static void log_start(void)
+{
+  std::lock_guard<std::mutex> guard(log_state.start_mutex);
+  if (log_state.started.load(std::memory_order_relaxed) || log_state.stopped.load(std::memory_order_relaxed)) return;
+  log_state.thread = new std::thread(log_thread_loop);
+  log_state.started.store(true, std::memory_order_release);
+}
+
+void ModbusLog::set_sink(ModbusLogSink sink, void *arg)
+{
+  std::lock_guard<std::mutex> guard(log_state.sink_mutex);
+  log_state.sink = sink != NULL ? sink : stderr_sink;
+  log_state.sink_arg = sink != NULL ? arg : NULL;
+}
+
+void ModbusLog::log(int level, const char *fmt, ...)
+{
+  if (log_state.stopped.load(std::memory_order_acquire)) {
+    // 已停止, 同步输出
+    char msg[MODBUS_LOG_MSG_SIZE];
+    va_list args;
+    va_start(args, fmt);
+    int length = vsnprintf(msg, sizeof(msg), fmt, args);
+    va_end(args);
+    if (length < 0) return;
+    if (length >= (int)sizeof(msg)) length = sizeof(msg) - 1;
+    std::lock_guard<std::mutex> guard(log_state.sink_mutex);
+    log_state.sink(log_state.sink_arg, level, log_now_ns(), msg, length);
+    return;
+  }
+  if (!log_state.started.load(std::memory_order_acquire)) log_start();
+
+  // 申请一个槽位, 缓冲区满时丢弃
+  uint64_t pos = log_state.tail.load(std::memory_order_relaxed);
+  modbus_log_record *rec;
+  while (1) {
+    rec = &log_state.ring[pos & (MODBUS_LOG_RING_SIZE - 1)];
+    uint64_t seq = rec->seq.load(std::memory_order_acquire);
+    int64_t diff = (int64_t)seq - (int64_t)pos;
+    if (diff == 0) {
+      if (log_state.tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    }
+    else if (diff < 0) {
+      log_state.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else {
+      pos = log_state.tail.load(std::memory_order_relaxed);
+    }
+  }
+  rec->timestamp_ns = log_now_ns();
+  rec->level = level;
+  va_list args;
+  va_start(args, fmt);
+  int length = vsnprintf(rec->msg, sizeof(rec->msg), fmt, args);
+  va_end(args);
+  if (length < 0) {
+    rec->msg[0] = '\0';
+    length = 0;
+  }
+  rec->length = length < (int)sizeof(rec->msg) ? length : sizeof(rec->msg) - 1;
+  rec->seq.store(pos + 1, std::memory_order_release);
+}
+
+void ModbusLog::flush(void)
+{
+  if (!log_state.started.load(std::memory_order_acquire)) return;
+  uint64_t tail = log_state.tail.load(std::memory_order_acquire);
+  while (!log_state.stopped.load(std::memory_order_acquire)) {
+    // 槽位被复用后序号会超过tail, 说明tail之前的日志都已经输出
+    modbus_log_record *rec = &log_state.ring[(tail - 1) & (MODBUS_LOG_RING_SIZE - 1)];
+    if (tail == 0 || rec->seq.load(std::memory_order_acquire) >= tail - 1 + MODBUS_LOG_RING_SIZE) break;
+    usleep(1000);
+  }
+}
+
+void ModbusLog::stop(void)
+{
+  std::lock_guard<std::mutex> guard(log_state.start_mutex);
+  if (log_state.stopped.exchange(true)) return;
+  if (log_state.thread != NULL) {
+    log_state.thread->join();
+    delete log_state.thread;
+    log_state.thread = NULL;
+  }
+  // 停止前刚写入的日志
+  while (log_drain_one());
+  log_report_dropped();
+}
+
+uint64_t ModbusLog::get_dropped_count(void)
+{
+  return log_state.dropped.load(std::memory_order_relaxed);
+}
+
+void ModbusLog::stderr_sink(void *arg, int level, uint64_t timestamp_ns, const char *msg, int length)
+{
+  (void)arg;
+  static const char *names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+  time_t sec = timestamp_ns / 1000000000ull;
+  struct tm tm;
+  localtime_r(&sec, &tm);
+  char ts[32];
+  strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", &tm);
+  fprintf(stderr, "[%s.%06lu][%s] %.*s\n", ts, (unsigned long)(timestamp_ns % 1000000000ull / 1000),
+    level >= 0 && level < 4 ? names[level] : "?", length, msg);
+}
+
+bool ModbusLogRateLimit::allow(int interval_ms, unsigned int burst, unsigned int *suppressed_out)
+{
+  uint64_t now = log_now_ns();
+  uint64_t start = period_start_ns.load(std::memory_order_relaxed);
+  if (now - start >= (uint64_t)interval_ms * 1000000ull) {
+    // 新的周期, 只有一个线程能成功切换
+    if (period_start_ns.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+  if (count.fetch_add(1, std::memory_order_relaxed) < burst) {
+    *suppressed_out = suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+  }
+  suppressed.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
@@ -0,0 +1,118 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_LOG_H_
+#define _MODBUS_LOG_H_
+
+#include <stdint.h>
+#include <atomic>
+
+enum ModbusLogLevel {
+  MODBUS_LOG_LEVEL_DEBUG = 0,
+  MODBUS_LOG_LEVEL_INFO = 1,
+  MODBUS_LOG_LEVEL_WARN = 2,
+  MODBUS_LOG_LEVEL_ERROR = 3,
+  MODBUS_LOG_LEVEL_OFF = 4
+};
+
+// 编译时去掉低于该等级的日志点
+#ifndef MODBUS_LOG_MIN_LEVEL
+#define MODBUS_LOG_MIN_LEVEL MODBUS_LOG_LEVEL_DEBUG
+#endif
+
+#define MODBUS_LOG_MSG_SIZE     232   // 单条日志的最大长度(超出截断)
+#define MODBUS_LOG_RING_SIZE    1024  // 环形缓冲区的日志条数(2的幂)
+
+/* ModbusLogSink: 日志的输出方法, 在后台线程调用
+ * @param arg: 设置时传入的参数
+ * @param level: 日志等级
+ * @param timestamp_ns: 日志产生的时间(CLOCK_REALTIME, 纳秒)
+ * @param msg: 日志内容(以'\0'结尾, 不带换行)
+ * @param length: 日志长度
+ */
+typedef void (*ModbusLogSink)(void *arg, int level, uint64_t timestamp_ns, const char *msg, int length);
+
+/* ModbusLog: 异步日志
+ * 1. 调用日志的线程只做格式化并写入无锁环形缓冲区(多写者单读者), 不会阻塞, 缓冲区满时丢弃并计数
+ * 2. 后台线程(第一次写日志时启动)把日志交给输出方法(默认输出到stderr)
+ * 3. 等级过滤在格式化之前, 被过滤的日志点只需要一次原子读
+ */
+class ModbusLog
+{
+public:
+  /* set_level: 设置日志等级, 默认MODBUS_LOG_LEVEL_INFO */
+  static void set_level(int level) { level_.store(level, std::memory_order_relaxed); }
+
+  /* get_level: 获取日志等级 */
+  static int get_level(void) { return level_.load(std::memory_order_relaxed); }
+
+  /* is_enabled: 某个等级的日志是否会输出 */
+  static bool is_enabled(int level) { return level >= level_.load(std::memory_order_relaxed); }
+
+  /* set_sink: 设置日志的输出方法
+   * @param sink: 输出方法, 为NULL时恢复默认(stderr)
+   * @param arg: 输出方法的参数
+   */
+  static void set_sink(ModbusLogSink sink, void *arg);
+
+  /* log: 写一条日志(printf格式) */
+  static void log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  /* flush: 等待缓冲区内的日志都交给输出方法 */
+  static void flush(void);
+
+  /* stop: 输出剩余的日志并停止后台线程, 之后的日志在调用线程同步输出 */
+  static void stop(void);
+
+  /* get_dropped_count: 因缓冲区满被丢弃的日志条数 */
+  static uint64_t get_dropped_count(void);
+
+  /* stderr_sink: 默认的输出方法 */
+  static void stderr_sink(void *arg, int level, uint64_t timestamp_ns, const char *msg, int length);
+
+private:
+  static std::atomic<int> level_;
+};
+
+/* ModbusLogRateLimit: 日志点的限速状态, 每个周期最多输出burst条, 被限速的条数在下一次输出时附带 */
+struct ModbusLogRateLimit {
+  std::atomic<uint64_t> period_start_ns;
+  std::atomic<unsigned int> count;
+  std::atomic<unsigned int> suppressed;
+
+  /* allow: 是否允许输出
+   * @param interval_ms: 周期(毫秒)
+   * @param burst: 每个周期最多输出的条数
+   * @param suppressed_out: 允许输出时, 返回之前被限速的条数
+   */
+  bool allow(int interval_ms, unsigned int burst, unsigned int *suppressed_out);
+};
+
+#define MODBUS_LOG(level, fmt, ...) do { \
+  if ((level) >= MODBUS_LOG_MIN_LEVEL && ModbusLog::is_enabled(level)) ModbusLog::log(level, fmt, ##__VA_ARGS__); \
+} while (0)
+
+/* MODBUS_LOG_RATELIMIT: 限速的日志点, 每interval_ms毫秒最多burst条 */
+#define MODBUS_LOG_RATELIMIT(level, interval_ms, burst, fmt, ...) do { \
+  if ((level) >= MODBUS_LOG_MIN_LEVEL && ModbusLog::is_enabled(level)) { \
+    static ModbusLogRateLimit modbus_log_rl_; \
+    unsigned int modbus_log_suppressed_; \
+    if (modbus_log_rl_.allow(interval_ms, burst, &modbus_log_suppressed_)) { \
+      if (modbus_log_suppressed_ > 0) ModbusLog::log(level, fmt " (suppressed %u)", ##__VA_ARGS__, modbus_log_suppressed_); \
+      else ModbusLog::log(level, fmt, ##__VA_ARGS__); \
+    } \
+  } \
+} while (0)
+
+#define MODBUS_LOG_DEBUG(fmt, ...) MODBUS_LOG(MODBUS_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define MODBUS_LOG_INFO(fmt, ...) MODBUS_LOG(MODBUS_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define MODBUS_LOG_WARN(fmt, ...) MODBUS_LOG(MODBUS_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define MODBUS_LOG_ERROR(fmt, ...) MODBUS_LOG(MODBUS_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+
+#endif // _MODBUS_LOG_H_
@@ -0,0 +1,289 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include <mutex>
+#include "modbus_metrics.h"
+
+thread_local ModbusMetricsShard *ModbusMetrics::tls_shard_ = NULL;
+std::atomic<unsigned int> ModbusMetrics::sample_interval_(MODBUS_METRICS_LATENCY_SAMPLE);
+std::atomic<int> ModbusMetrics::window_addr_(-1);
+
+// 所有分片的链表, 分片不会释放, 线程退出后由新线程复用
+static std::mutex metrics_mutex;
+static ModbusMetricsShard *metrics_shards = NULL;
+
+// tick和纳秒的换算基准: 第一次创建分片时的时间
+static uint64_t metrics_base_ticks = 0;
+static uint64_t metrics_base_ns = 0;
+
+// 诊断计数器清零时的基准值
+static ModbusMetricsCounters metrics_diag_base;
+
+// 映射到输入寄存器的统计数据, 按间隔刷新, 刷新用的缓冲区预先分配(都由metrics_window_mutex保护)
+static std::mutex metrics_window_mutex;
+static uint64_t metrics_window_last_ns = 0;
+static uint64_t metrics_window_last_requests = 0;
+static unsigned short metrics_window_regs[MODBUS_METRICS_WINDOW_REGS];
+static uint64_t metrics_window_counts[MODBUS_HISTOGRAM_BUCKETS];
+static ModbusHistogram metrics_window_latency;
+
+/* 线程退出时释放分片(计数保留, 给后面的线程复用) */
+struct ModbusMetricsShardReleaser {
+  ~ModbusMetricsShardReleaser() {
+    if (shard != NULL) {
+      std::lock_guard<std::mutex> guard(metrics_mutex);
+      shard->in_use = false;
+    }
+  }
+  ModbusMetricsShard *shard = NULL;
+};
+static thread_local ModbusMetricsShardReleaser metrics_releaser;
+
+/************************* ModbusMetricsSnapshot ***************************/
+
+void ModbusMetricsSnapshot::reset(void)
+{
+  memset(requests, 0, sizeof(requests));
+  memset(exceptions, 0, sizeof(exceptions));
+  memset(exception_codes, 0, sizeof(exception_codes));
+  memset(hook_calls, 0, sizeof(hook_calls));
+  bytes_in = 0;
+  bytes_out = 0;
+  frames_discarded = 0;
+  for (int i = 0; i < MODBUS_METRICS_LATENCY_SLOTS; i++) {
+    latency[i].reset();
+  }
+  ticks_per_ns = 1.0;
+}
+
+void ModbusMetricsSnapshot::merge(const ModbusMetricsSnapshot &other)
+{
+  for (int i = 0; i < MODBUS_METRICS_FC_COUNT; i++) {
+    requests[i] += other.requests[i];
+    exceptions[i] += other.exceptions[i];
+    hook_calls[i] += other.hook_calls[i];
+  }
+  for (int i = 0; i < MODBUS_METRICS_EXP_COUNT; i++) {
+    exception_codes[i] += other.exception_codes[i];
+  }
+  bytes_in += other.bytes_in;
+  bytes_out += other.bytes_out;
+  frames_discarded += other.frames_discarded;
+  for (int i = 0; i < MODBUS_METRICS_LATENCY_SLOTS; i++) {
+    latency[i].merge(other.latency[i]);
+  }
+  ticks_per_ns = other.ticks_per_ns;
+}
+
+uint64_t ModbusMetricsSnapshot::get_total_requests(void) const
+{
+  uint64_t total = 0;
+  for (int i = 0; i < MODBUS_METRICS_FC_COUNT; i++) total += requests[i];
+  return total;
+}
+
+uint64_t ModbusMetricsSnapshot::get_total_exceptions(void) const
+{
+  uint64_t total = 0;
+  for (int i = 0; i < MODBUS_METRICS_FC_COUNT; i++) total += exceptions[i];
+  return total;
+}
+
+const ModbusHistogram &ModbusMetricsSnapshot::get_latency(unsigned char func_code) const
+{
+  return latency[ModbusMetrics::get_latency_slot(func_code)];
+}
+
+double ModbusMetricsSnapshot::get_latency_ns(unsigned char func_code, double percentile) const
+{
+  return get_latency(func_code).get_percentile(percentile) / ticks_per_ns;
+}
+
+/************************* ModbusMetrics ***************************/
+
+uint64_t ModbusMetrics::_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+ModbusMetricsShard *ModbusMetrics::_acquire_shard(void)
+{
+  std::lock_guard<std::mutex> guard(metrics_mutex);
+  if (metrics_base_ns == 0) {
+    metrics_base_ticks = now_ticks();
+    metrics_base_ns = _now_ns();
+  }
+  ModbusMetricsShard *shard = metrics_shards;
+  while (shard != NULL && shard->in_use) shard = shard->next;
+  if (shard == NULL) {
+    void *mem = NULL;
+    if (posix_memalign(&mem, MODBUS_METRICS_CACHE_LINE, sizeof(ModbusMetricsShard)) != 0) throw std::bad_alloc();
+    // 计数器都是uint64_t的原子变量, 清零即为初始状态
+    memset(mem, 0, sizeof(ModbusMetricsShard));
+    shard = (ModbusMetricsShard *)mem;
+    for (int i = 0; i < MODBUS_METRICS_LATENCY_SLOTS; i++) {
+      shard->latency_min[i].store(UINT64_MAX, std::memory_order_relaxed);
+    }
+    shard->next = metrics_shards;
+    metrics_shards = shard;
+  }
+  shard->in_use = true;
+  shard->current_fc = 0;
+  // 每个线程的第一个请求就统计耗时
+  shard->sample_countdown = 1;
+  tls_shard_ = shard;
+  metrics_releaser.shard = shard;
+  return shard;
+}
+
+double ModbusMetrics::_ticks_per_ns(void)
+{
+  // 需要持有metrics_mutex
+  if (metrics_base_ns != 0) {
+    uint64_t ns = _now_ns() - metrics_base_ns;
+    uint64_t ticks = now_ticks() - metrics_base_ticks;
+    if (ns > 0 && ticks > 0) return (double)ticks / ns;
+  }
+  return 1.0;
+}
+
+void ModbusMetrics::snapshot(ModbusMetricsSnapshot *snap)
+{
+  snap->reset();
+  uint64_t *counts = new uint64_t[MODBUS_HISTOGRAM_BUCKETS];
+  std::lock_guard<std::mutex> guard(metrics_mutex);
+  for (ModbusMetricsShard *shard = metrics_shards; shard != NULL; shard = shard->next) {
+    for (int i = 0; i < MODBUS_METRICS_FC_COUNT; i++) {
+      snap->requests[i] += shard->requests[i].load(std::memory_order_relaxed);
+      snap->exceptions[i] += shard->exceptions[i].load(std::memory_order_relaxed);
+      snap->hook_calls[i] += shard->hook_calls[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < MODBUS_METRICS_EXP_COUNT; i++) {
+      snap->exception_codes[i] += shard->exception_codes[i].load(std::memory_order_relaxed);
+    }
+    snap->bytes_in += shard->bytes_in.load(std::memory_order_relaxed);
+    snap->bytes_out += shard->bytes_out.load(std::memory_order_relaxed);
+    snap->frames_discarded += shard->frames_discarded.load(std::memory_order_relaxed);
+    for (int i = 0; i < MODBUS_METRICS_LATENCY_SLOTS; i++) {
+      for (int j = 0; j < MODBUS_HISTOGRAM_BUCKETS; j++) {
+        counts[j] = shard->latency_counts[i][j].load(std::memory_order_relaxed);
+      }
+      snap->latency[i].merge_raw(counts, shard->latency_sum[i].load(std::memory_order_relaxed),
+        shard->latency_min[i].load(std::memory_order_relaxed), shard->latency_max[i].load(std::memory_order_relaxed));
+    }
+  }
+  snap->ticks_per_ns = _ticks_per_ns();
+  delete[] counts;
+}
+
+void ModbusMetrics::get_counters(ModbusMetricsCounters *counters)
+{
+  memset(counters, 0, sizeof(ModbusMetricsCounters));
+  std::lock_guard<std::mutex> guard(metrics_mutex);
+  for (ModbusMetricsShard *shard = metrics_shards; shard != NULL; shard = shard->next) {
+    for (int i = 0; i < MODBUS_METRICS_FC_COUNT; i++) {
+      counters->requests += shard->requests[i].load(std::memory_order_relaxed);
+      counters->exceptions += shard->exceptions[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < MODBUS_METRICS_EXP_COUNT; i++) {
+      counters->exception_codes[i] += shard->exception_codes[i].load(std::memory_order_relaxed);
+    }
+    counters->bytes_in += shard->bytes_in.load(std::memory_order_relaxed);
+    counters->bytes_out += shard->bytes_out.load(std::memory_order_relaxed);
+    counters->frames_discarded += shard->frames_discarded.load(std::memory_order_relaxed);
+  }
+}
+
+void ModbusMetrics::get_diagnostics(ModbusMetricsCounters *counters)
+{
+  get_counters(counters);
+  std::lock_guard<std::mutex> guard(metrics_mutex);
+  counters->requests -= metrics_diag_base.requests;
+  counters->exceptions -= metrics_diag_base.exceptions;
+  for (int i = 0; i < MODBUS_METRICS_EXP_COUNT; i++) {
+    counters->exception_codes[i] -= metrics_diag_base.exception_codes[i];
+  }
+  counters->bytes_in -= metrics_diag_base.bytes_in;
+  counters->bytes_out -= metrics_diag_base.bytes_out;
+  counters->frames_discarded -= metrics_diag_base.frames_discarded;
+}
+
+void ModbusMetrics::clear_diagnostics(void)
+{
+  ModbusMetricsCounters counters;
+  get_counters(&counters);
+  std::lock_guard<std::mutex> guard(metrics_mutex);
+  metrics_diag_base = counters;
+}
+
+static void metrics_set_u32(unsigned short *regs, uint64_t val)
+{
+  if (val > 0xFFFFFFFF) val = 0xFFFFFFFF;
+  regs[0] = (unsigned short)(val >> 16);
+  regs[1] = (unsigned short)val;
+}
+
+void ModbusMetrics::_refresh_window(uint64_t now)
+{
+  // 需要持有metrics_window_mutex, 只合并用到的计数器和所有功能码的耗时直方图
+  uint64_t requests = 0, exceptions = 0, frames_discarded = 0, bytes_out = 0;
+  double ticks_per_ns;
+  metrics_window_latency.reset();
+  {
+    std::lock_guard<std::mutex> guard(metrics_mutex);
+    for (ModbusMetricsShard *shard = metrics_shards; shard != NULL; shard = shard->next) {
+      for (int i = 0; i < MODBUS_METRICS_FC_COUNT; i++) {
+        requests += shard->requests[i].load(std::memory_order_relaxed);
+        exceptions += shard->exceptions[i].load(std::memory_order_relaxed);
+      }
+      frames_discarded += shard->frames_discarded.load(std::memory_order_relaxed);
+      bytes_out += shard->bytes_out.load(std::memory_order_relaxed);
+      for (int i = 0; i < MODBUS_METRICS_LATENCY_SLOTS; i++) {
+        for (int j = 0; j < MODBUS_HISTOGRAM_BUCKETS; j++) {
+          metrics_window_counts[j] = shard->latency_counts[i][j].load(std::memory_order_relaxed);
+        }
+        metrics_window_latency.merge_raw(metrics_window_counts, shard->latency_sum[i].load(std::memory_order_relaxed),
+          shard->latency_min[i].load(std::memory_order_relaxed), shard->latency_max[i].load(std::memory_order_relaxed));
+      }
+    }
+    ticks_per_ns = _ticks_per_ns();
+  }
+  uint64_t rate = 0;
+  if (metrics_window_last_ns != 0 && now > metrics_window_last_ns) {
+    rate = (requests - metrics_window_last_requests) * 1000000000ull / (now - metrics_window_last_ns);
+  }
+  metrics_window_last_ns = now;
+  metrics_window_last_requests = requests;
+  unsigned short *regs = metrics_window_regs;
+  metrics_set_u32(regs + 0, requests);
+  metrics_set_u32(regs + 2, exceptions);
+  metrics_set_u32(regs + 4, frames_discarded);
+  metrics_set_u32(regs + 6, rate);
+  metrics_set_u32(regs + 8, (uint64_t)(metrics_window_latency.get_percentile(50) / ticks_per_ns));
+  metrics_set_u32(regs + 10, (uint64_t)(metrics_window_latency.get_percentile(99) / ticks_per_ns));
+  metrics_set_u32(regs + 12, (uint64_t)(metrics_window_latency.get_max() / ticks_per_ns));
+  metrics_set_u32(regs + 14, bytes_out);
+}
+
+void ModbusMetrics::fill_register_window(unsigned short *regs)
+{
+  uint64_t now = _now_ns();
+  std::lock_guard<std::mutex> guard(metrics_window_mutex);
+  // 两次刷新之间直接回复上一次的结果
+  if (metrics_window_last_ns == 0 || now - metrics_window_last_ns >= MODBUS_METRICS_WINDOW_REFRESH_MS * 1000000ull) {
+    _refresh_window(now);
+  }
+  memcpy(regs, metrics_window_regs, sizeof(metrics_window_regs));
+}
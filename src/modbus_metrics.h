@@ -0,0 +1,254 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_METRICS_H_
+#define _MODBUS_METRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "modbus_histogram.h"
+
+#define MODBUS_METRICS_FC_COUNT       128 // 功能码0x00~0x7F
+#define MODBUS_METRICS_EXP_COUNT      16  // 异常码0x00~0x0F
+#define MODBUS_METRICS_LATENCY_SLOTS  12  // 单独统计延时的功能码个数(含"其它")
+#define MODBUS_METRICS_CACHE_LINE     64
+#define MODBUS_METRICS_LATENCY_SAMPLE 16  // 默认每16个请求统计一次耗时
+#define MODBUS_METRICS_WINDOW_REGS    16  // 统计数据映射到输入寄存器的个数, 见set_register_window
+#define MODBUS_METRICS_WINDOW_REFRESH_MS 100 // 映射到输入寄存器的统计数据的刷新间隔(毫秒)
+
+/* ModbusMetricsSnapshot: 统计数据的快照(所有线程合并后的结果)
+ * 结构比较大(包含多个直方图), 建议在堆上创建
+ */
+struct ModbusMetricsSnapshot {
+  uint64_t requests[MODBUS_METRICS_FC_COUNT];         // 按功能码统计的请求数
+  uint64_t exceptions[MODBUS_METRICS_FC_COUNT];       // 按功能码统计的异常回复数
+  uint64_t exception_codes[MODBUS_METRICS_EXP_COUNT]; // 按异常码统计的异常回复数
+  uint64_t hook_calls[MODBUS_METRICS_FC_COUNT];       // 按功能码统计的额外读写方法(bind_get/bind_set)调用次数
+  uint64_t bytes_in;                                  // 请求的字节数
+  uint64_t bytes_out;                                 // 回复的字节数
+  uint64_t frames_discarded;                          // 因长度错误被丢弃的帧数
+  ModbusHistogram latency[MODBUS_METRICS_LATENCY_SLOTS]; // process_session的耗时, 单位是tick, 见ticks_per_ns
+  double ticks_per_ns;                                // tick和纳秒的换算
+
+  ModbusMetricsSnapshot() { reset(); }
+
+  /* reset: 清空 */
+  void reset(void);
+
+  /* merge: 累加另一个快照 */
+  void merge(const ModbusMetricsSnapshot &other);
+
+  /* get_total_requests: 所有功能码的请求数 */
+  uint64_t get_total_requests(void) const;
+
+  /* get_total_exceptions: 所有功能码的异常回复数 */
+  uint64_t get_total_exceptions(void) const;
+
+  /* get_latency: 获取某个功能码的process_session耗时直方图(单位tick), 未单独统计的功能码归到"其它" */
+  const ModbusHistogram &get_latency(unsigned char func_code) const;
+
+  /* get_latency_ns: 获取某个功能码的process_session耗时百分位(纳秒)
+   * @param func_code: 功能码
+   * @param percentile: 百分位(0~100)
+   */
+  double get_latency_ns(unsigned char func_code, double percentile) const;
+};
+
+/* ModbusMetricsCounters: 只包含计数器的统计(不含直方图), 获取比快照轻得多 */
+struct ModbusMetricsCounters {
+  uint64_t requests;                                  // 所有功能码的请求数
+  uint64_t exceptions;                                // 所有功能码的异常回复数
+  uint64_t exception_codes[MODBUS_METRICS_EXP_COUNT]; // 按异常码统计的异常回复数
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t frames_discarded;
+};
+
+/* ModbusMetricsShard: 每个线程一份的计数器(只有所属线程会写)
+ * 1. 按缓存行对齐, 不同线程的计数器不会伪共享
+ * 2. 计数器是单写者的relaxed原子变量, 写入不需要加锁或原子加, 快照时可以在别的线程安全读取
+ */
+struct alignas(MODBUS_METRICS_CACHE_LINE) ModbusMetricsShard {
+  std::atomic<uint64_t> requests[MODBUS_METRICS_FC_COUNT];
+  std::atomic<uint64_t> exceptions[MODBUS_METRICS_FC_COUNT];
+  std::atomic<uint64_t> exception_codes[MODBUS_METRICS_EXP_COUNT];
+  std::atomic<uint64_t> hook_calls[MODBUS_METRICS_FC_COUNT];
+  std::atomic<uint64_t> bytes_in;
+  std::atomic<uint64_t> bytes_out;
+  std::atomic<uint64_t> frames_discarded;
+  std::atomic<uint64_t> latency_counts[MODBUS_METRICS_LATENCY_SLOTS][MODBUS_HISTOGRAM_BUCKETS];
+  std::atomic<uint64_t> latency_sum[MODBUS_METRICS_LATENCY_SLOTS];
+  std::atomic<uint64_t> latency_min[MODBUS_METRICS_LATENCY_SLOTS];
+  std::atomic<uint64_t> latency_max[MODBUS_METRICS_LATENCY_SLOTS];
+
+  unsigned char current_fc;     // 正在处理的功能码, 用于统计额外读写方法的调用
+  unsigned int sample_countdown; // 距离下一次统计耗时的请求数
+  bool in_use;                  // 线程退出后可以被新线程复用(计数保留)
+  ModbusMetricsShard *next;
+};
+
+/* ModbusMetrics: Modbus TCP处理的统计
+ * 1. 热路径只有几条指令: 取线程局部的分片, 对单写者计数器做relaxed的读-加-写
+ * 2. 计数是精确的; 耗时按采样统计(默认每16个请求一次, 读时间戳本身在虚拟机上也要20ns以上),
+ *    使用时间戳计数器(x86为TSC), 快照时才换算成纳秒
+ * 3. 编译时定义MODBUS_DISABLE_METRICS可以完全去掉热路径的统计
+ */
+class ModbusMetrics
+{
+public:
+  /* now_ticks: 获取当前的tick(用于统计耗时) */
+  static uint64_t now_ticks(void)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return _now_ns();
+#endif
+  }
+
+  /* begin_request: 开始处理一个请求
+   * @param func_code: 功能码
+   * @param bytes_in: 请求的字节数
+   * :return: 开始的tick(不统计耗时的请求为0), 传给end_request
+   */
+  static uint64_t begin_request(unsigned char func_code, int bytes_in)
+  {
+    ModbusMetricsShard *shard = _shard();
+    func_code &= MODBUS_METRICS_FC_COUNT - 1;
+    shard->current_fc = func_code;
+    _inc(shard->requests[func_code], 1);
+    _inc(shard->bytes_in, bytes_in);
+    if (--shard->sample_countdown > 0) return 0;
+    shard->sample_countdown = sample_interval_.load(std::memory_order_relaxed);
+    return now_ticks();
+  }
+
+  /* end_request: 结束处理一个请求
+   * @param func_code: 功能码
+   * @param exp_code: 异常码, 0表示正常
+   * @param bytes_out: 回复的字节数
+   * @param start_ticks: begin_request的返回值
+   */
+  static void end_request(unsigned char func_code, int exp_code, int bytes_out, uint64_t start_ticks)
+  {
+    ModbusMetricsShard *shard = _shard();
+    func_code &= MODBUS_METRICS_FC_COUNT - 1;
+    if (exp_code != 0) {
+      _inc(shard->exceptions[func_code], 1);
+      _inc(shard->exception_codes[exp_code & (MODBUS_METRICS_EXP_COUNT - 1)], 1);
+    }
+    _inc(shard->bytes_out, bytes_out);
+    shard->current_fc = 0;
+    if (start_ticks == 0) return;
+    uint64_t ticks = now_ticks() - start_ticks;
+    int slot = get_latency_slot(func_code);
+    _inc(shard->latency_counts[slot][ModbusHistogram::get_bucket_index(ticks)], 1);
+    _inc(shard->latency_sum[slot], ticks);
+    if (ticks < shard->latency_min[slot].load(std::memory_order_relaxed)) shard->latency_min[slot].store(ticks, std::memory_order_relaxed);
+    if (ticks > shard->latency_max[slot].load(std::memory_order_relaxed)) shard->latency_max[slot].store(ticks, std::memory_order_relaxed);
+  }
+
+  /* on_hook_call: 调用了一次额外读写方法, 计到当前正在处理的功能码上 */
+  static void on_hook_call(void)
+  {
+    ModbusMetricsShard *shard = _shard();
+    _inc(shard->hook_calls[shard->current_fc], 1);
+  }
+
+  /* on_frame_discarded: 丢弃了一个长度错误的帧 */
+  static void on_frame_discarded(void)
+  {
+    _inc(_shard()->frames_discarded, 1);
+  }
+
+  /* set_latency_sample_interval: 设置每多少个请求统计一次耗时, 1表示每个请求都统计
+   * 对之后新的采样周期生效
+   */
+  static void set_latency_sample_interval(unsigned int interval) { sample_interval_.store(interval > 0 ? interval : 1, std::memory_order_relaxed); }
+
+  /* snapshot: 合并所有线程的计数器, 生成快照(不影响热路径)
+   * @param snap: 快照
+   */
+  static void snapshot(ModbusMetricsSnapshot *snap);
+
+  /* get_counters: 合并所有线程的计数器(不含直方图)
+   * @param counters: 计数器
+   */
+  static void get_counters(ModbusMetricsCounters *counters);
+
+  /* get_diagnostics: 获取诊断计数器(0x08功能码), 即get_counters减去上一次clear_diagnostics时的值
+   * @param counters: 计数器
+   */
+  static void get_diagnostics(ModbusMetricsCounters *counters);
+
+  /* clear_diagnostics: 清零诊断计数器(0x08功能码的0x0A子功能), 不影响get_counters和snapshot */
+  static void clear_diagnostics(void);
+
+  /* set_register_window: 把统计数据映射到一段输入寄存器, 0x04读到这段输入寄存器时回复统计数据
+   * 统计数据只覆盖在回复里, 不写入寄存器, 也不调用额外绑定的方法; 距离上一次刷新超过MODBUS_METRICS_WINDOW_REFRESH_MS时才重新合并
+   * 16个输入寄存器, 每两个寄存器为一个32位无符号数(高16位在前):
+   *   [0]请求数 [2]异常回复数 [4]丢弃的帧数 [6]每秒请求数(两次刷新之间的平均)
+   *   [8]耗时p50(ns) [10]耗时p99(ns) [12]耗时最大值(ns) [14]回复的字节数
+   * @param addr: 起始地址, 小于0表示不映射(默认)
+   */
+  static void set_register_window(int addr) { window_addr_.store(addr, std::memory_order_relaxed); }
+
+  /* get_register_window: 获取统计数据映射的起始地址, 小于0表示不映射 */
+  static int get_register_window(void) { return window_addr_.load(std::memory_order_relaxed); }
+
+  /* fill_register_window: 获取映射到输入寄存器的统计数据
+   * 按间隔刷新, 使用预先分配的缓冲区, 不申请内存
+   * @param regs: MODBUS_METRICS_WINDOW_REGS个寄存器
+   */
+  static void fill_register_window(unsigned short *regs);
+
+  /* get_latency_slot: 功能码对应的延时统计分组, 0表示"其它" */
+  static int get_latency_slot(unsigned char func_code)
+  {
+    static const unsigned char slots[0x18] = {
+      0, 1, 2, 3, 4, 5, 6, 0, 11, 0, 0, 0, 0, 0, 0, 7,
+      8, 0, 0, 0, 0, 0, 9, 10
+    };
+    return func_code < 0x18 ? slots[func_code] : 0;
+  }
+
+private:
+  static void _inc(std::atomic<uint64_t> &counter, uint64_t val)
+  {
+    // 单写者, 不需要原子加(lock前缀), relaxed读写即可保证读者不会读到撕裂的值
+    counter.store(counter.load(std::memory_order_relaxed) + val, std::memory_order_relaxed);
+  }
+  static ModbusMetricsShard *_shard(void)
+  {
+    ModbusMetricsShard *shard = tls_shard_;
+    return shard != NULL ? shard : _acquire_shard();
+  }
+  static ModbusMetricsShard *_acquire_shard(void);
+  static uint64_t _now_ns(void);
+  static double _ticks_per_ns(void);
+  static void _refresh_window(uint64_t now);
+
+  static thread_local ModbusMetricsShard *tls_shard_;
+  static std::atomic<unsigned int> sample_interval_;
+  static std::atomic<int> window_addr_;
+};
+
+#ifndef MODBUS_DISABLE_METRICS
+#define MODBUS_METRICS_BEGIN(func_code, bytes_in) uint64_t modbus_metrics_start_ = ModbusMetrics::begin_request(func_code, bytes_in)
+#define MODBUS_METRICS_END(func_code, exp_code, bytes_out) ModbusMetrics::end_request(func_code, exp_code, bytes_out, modbus_metrics_start_)
+#define MODBUS_METRICS_HOOK_CALL() ModbusMetrics::on_hook_call()
+#define MODBUS_METRICS_FRAME_DISCARDED() ModbusMetrics::on_frame_discarded()
+#else
+#define MODBUS_METRICS_BEGIN(func_code, bytes_in)
+#define MODBUS_METRICS_END(func_code, exp_code, bytes_out)
+#define MODBUS_METRICS_HOOK_CALL()
+#define MODBUS_METRICS_FRAME_DISCARDED()
+#endif
+
+#endif // _MODBUS_METRICS_H_
@@ -0,0 +1,410 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include "modbus_persist.h"
+#include "modbus_log.h"
+
+#define PERSIST_SNAPSHOT_MAGIC  0x4E53424D // "MBSN"
+#define PERSIST_JOURNAL_MAGIC   0x524A424D // "MBJR"
+#define PERSIST_VERSION         1
+#define PERSIST_MAX_RECORD_COUNT 0xFFFF
+
+#pragma pack(1)
+// 快照文件头, 后面紧跟线圈数据(coil_count字节, 按2字节对齐), 再跟保持寄存器数据(reg_count * 2字节)
+struct persist_snapshot_header {
+  unsigned int magic;
+  unsigned int version;
+  unsigned int coil_start_addr;
+  unsigned int coil_count;
+  unsigned int reg_start_addr;
+  unsigned int reg_count;
+  unsigned int checksum;  // 数据部分的校验和
+  unsigned int reserved;
+};
+
+// 日志记录头, 后面紧跟count个数据, 按4字节对齐
+struct persist_record_header {
+  unsigned int magic;
+  unsigned char type;
+  unsigned char reserved;
+  unsigned short count;
+  unsigned int addr;
+  unsigned int checksum;  // 记录头(不含checksum) + 数据的校验和
+};
+#pragma pack()
+
+static unsigned int fnv1a(const unsigned char *data, long length, unsigned int hash = 2166136261u)
+{
+  for (long i = 0; i < length; i++) {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static int elem_size(unsigned char type)
+{
+  return type == PERSIST_HOLDING_REGS ? 2 : 1;
+}
+
+static int write_all(int fd, const unsigned char *data, long length)
+{
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+    if (n < 0) return PERSIST_IO_ERROR;
+    data += n;
+    length -= n;
+  }
+  return PERSIST_NONE;
+}
+
+static unsigned int record_checksum(const persist_record_header *header, const unsigned char *data, int data_size)
+{
+  unsigned int hash = fnv1a((const unsigned char *)header, sizeof(persist_record_header) - sizeof(unsigned int));
+  return fnv1a(data, data_size, hash);
+}
+
+ModbusPersist::ModbusPersist(const char *snapshot_path, const char *journal_path, int sync_interval_ms)
+: sync_interval_ms_(sync_interval_ms)
+{
+  snapshot_path_ = new char[strlen(snapshot_path) + 1];
+  strcpy(snapshot_path_, snapshot_path);
+  journal_path_ = new char[strlen(journal_path) + 1];
+  strcpy(journal_path_, journal_path);
+  journal_fd_ = -1;
+  journal_size_ = 0;
+  buf_size_ = 64 * 1024;
+  buf_length_ = 0;
+  buf_ = new unsigned char[buf_size_];
+  flush_buf_size_ = buf_size_;
+  flush_buf_ = new unsigned char[flush_buf_size_];
+  flushing_ = false;
+  error_ = PERSIST_NONE;
+  running_ = false;
+  sync_thread_ = NULL;
+}
+
+ModbusPersist::~ModbusPersist()
+{
+  close();
+  delete[] snapshot_path_;
+  delete[] journal_path_;
+  delete[] buf_;
+  delete[] flush_buf_;
+}
+
+int ModbusPersist::open(void)
+{
+  if (journal_fd_ >= 0) return PERSIST_NONE;
+  journal_fd_ = ::open(journal_path_, O_RDWR | O_CREAT | O_APPEND, 0644);
+  if (journal_fd_ < 0) return PERSIST_OPEN_ERROR;
+  // 截断末尾不完整的记录
+  long valid_size = 0;
+  _replay_journal(NULL, NULL, &valid_size);
+  if (ftruncate(journal_fd_, valid_size) != 0) {
+    ::close(journal_fd_);
+    journal_fd_ = -1;
+    return PERSIST_IO_ERROR;
+  }
+  journal_size_ = valid_size;
+  if (sync_interval_ms_ > 0) {
+    running_ = true;
+    sync_thread_ = new std::thread(&ModbusPersist::_sync_loop, this);
+  }
+  return PERSIST_NONE;
+}
+
+void ModbusPersist::close(void)
+{
+  if (sync_thread_ != NULL) {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    sync_thread_->join();
+    delete sync_thread_;
+    sync_thread_ = NULL;
+  }
+  if (journal_fd_ >= 0) {
+    sync();
+    ::close(journal_fd_);
+    journal_fd_ = -1;
+  }
+}
+
+int ModbusPersist::append(unsigned char type, int addr, const void *data, int count)
+{
+  if (journal_fd_ < 0) return PERSIST_NOT_OPEN;
+  const unsigned char *src = (const unsigned char *)data;
+  int size = elem_size(type);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (count > 0) {
+    int n = count > PERSIST_MAX_RECORD_COUNT ? PERSIST_MAX_RECORD_COUNT : count;
+    int data_size = n * size;
+    int record_size = sizeof(persist_record_header) + ((data_size + 3) & ~3);
+    if (buf_length_ + record_size > buf_size_) {
+      int new_size = buf_size_ * 2;
+      while (new_size < buf_length_ + record_size) new_size *= 2;
+      unsigned char *old = buf_;
+      buf_ = new unsigned char[new_size];
+      memcpy(buf_, old, buf_length_);
+      delete[] old;
+      buf_size_ = new_size;
+    }
+    persist_record_header *header = (persist_record_header *)(buf_ + buf_length_);
+    header->magic = PERSIST_JOURNAL_MAGIC;
+    header->type = type;
+    header->reserved = 0;
+    header->count = n;
+    header->addr = addr;
+    unsigned char *record_data = buf_ + buf_length_ + sizeof(persist_record_header);
+    memcpy(record_data, src, data_size);
+    memset(record_data + data_size, 0, record_size - sizeof(persist_record_header) - data_size);
+    header->checksum = record_checksum(header, record_data, data_size);
+    buf_length_ += record_size;
+    src += data_size;
+    addr += n;
+    count -= n;
+  }
+  if (sync_interval_ms_ <= 0) {
+    return _flush_locked(lock);
+  }
+  return error_;
+}
+
+int ModbusPersist::sync(void)
+{
+  if (journal_fd_ < 0) return PERSIST_NOT_OPEN;
+  std::unique_lock<std::mutex> lock(mutex_);
+  return _flush_locked(lock);
+}
+
+int ModbusPersist::_flush_locked(std::unique_lock<std::mutex> &lock)
+{
+  // 同一时间只允许一个刷盘, 刷盘期间释放锁, append继续写入另一个缓冲区
+  while (flushing_) flush_cond_.wait(lock);
+  if (buf_length_ == 0) return PERSIST_NONE;
+  unsigned char *tmp = flush_buf_;
+  int tmp_size = flush_buf_size_;
+  flush_buf_ = buf_;
+  flush_buf_size_ = buf_size_;
+  buf_ = tmp;
+  buf_size_ = tmp_size;
+  int length = buf_length_;
+  buf_length_ = 0;
+  flushing_ = true;
+  bool retry = error_ != PERSIST_NONE;
+  lock.unlock();
+
+  int code = PERSIST_NONE;
+  // 上次失败时截断没有成功, 先去掉末尾写了一半的记录
+  if (retry && ftruncate(journal_fd_, journal_size_) != 0) code = PERSIST_IO_ERROR;
+  if (code == PERSIST_NONE) code = write_all(journal_fd_, flush_buf_, length);
+  if (code == PERSIST_NONE && fdatasync(journal_fd_) != 0) code = PERSIST_IO_ERROR;
+  if (code != PERSIST_NONE) {
+    // 写了一半的记录留在日志里时, 之后追加的记录都会在恢复时被丢弃; 截断失败时下次刷盘前再截断
+    int ret = ftruncate(journal_fd_, journal_size_);
+    (void)ret;
+  }
+
+  lock.lock();
+  if (code == PERSIST_NONE) {
+    journal_size_ += length;
+  }
+  else {
+    // 没落盘的记录放回缓冲区的开头, 刷盘期间append的记录接在后面
+    if (flush_buf_size_ < length + buf_length_) {
+      int new_size = flush_buf_size_ * 2;
+      while (new_size < length + buf_length_) new_size *= 2;
+      unsigned char *buf = new unsigned char[new_size];
+      memcpy(buf, flush_buf_, length);
+      delete[] flush_buf_;
+      flush_buf_ = buf;
+      flush_buf_size_ = new_size;
+    }
+    memcpy(flush_buf_ + length, buf_, buf_length_);
+    unsigned char *tmp = buf_;
+    int tmp_size = buf_size_;
+    buf_ = flush_buf_;
+    buf_size_ = flush_buf_size_;
+    flush_buf_ = tmp;
+    flush_buf_size_ = tmp_size;
+    buf_length_ += length;
+  }
+  error_ = code;
+  flushing_ = false;
+  flush_cond_.notify_all();
+  return code;
+}
+
+void ModbusPersist::_sync_loop(void)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (running_) {
+    cond_.wait_for(lock, std::chrono::milliseconds(sync_interval_ms_));
+    if (buf_length_ > 0) {
+      bool failed = error_ != PERSIST_NONE;
+      int code = _flush_locked(lock);
+      if (code != PERSIST_NONE) {
+        MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_ERROR, 1000, 1, "Modbus persist journal flush failed, %d bytes pending, code=%d, path=%s", buf_length_, code, journal_path_);
+      }
+      else if (failed) {
+        MODBUS_LOG_INFO("Modbus persist journal flush recovered, path=%s", journal_path_);
+      }
+    }
+  }
+}
+
+long ModbusPersist::get_journal_size(void)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return journal_size_;
+}
+
+int ModbusPersist::get_error(void)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return error_;
+}
+
+int ModbusPersist::_replay_journal(ModbusPersistApply apply, void *arg, long *valid_size)
+{
+  *valid_size = 0;
+  int fd = ::open(journal_path_, O_RDONLY);
+  if (fd < 0) return PERSIST_NONE;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return PERSIST_NONE;
+  }
+  unsigned char *map = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) return PERSIST_IO_ERROR;
+
+  long offset = 0;
+  while (offset + (long)sizeof(persist_record_header) <= st.st_size) {
+    const persist_record_header *header = (const persist_record_header *)(map + offset);
+    if (header->magic != PERSIST_JOURNAL_MAGIC) break;
+    int data_size = header->count * elem_size(header->type);
+    long record_size = sizeof(persist_record_header) + ((data_size + 3) & ~3);
+    if (offset + record_size > st.st_size) break;
+    const unsigned char *data = map + offset + sizeof(persist_record_header);
+    if (record_checksum(header, data, data_size) != header->checksum) break;
+    if (apply != NULL) apply(arg, header->type, header->addr, data, header->count);
+    offset += record_size;
+  }
+  *valid_size = offset;
+  munmap(map, st.st_size);
+  return PERSIST_NONE;
+}
+
+int ModbusPersist::restore(ModbusPersistApply apply, void *arg)
+{
+  int fd = ::open(snapshot_path_, O_RDONLY);
+  if (fd >= 0) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (long)sizeof(persist_snapshot_header)) {
+      ::close(fd);
+      return PERSIST_FORMAT_ERROR;
+    }
+    unsigned char *map = (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return PERSIST_IO_ERROR;
+    const persist_snapshot_header *header = (const persist_snapshot_header *)map;
+    long coil_size = (header->coil_count + 1) & ~1;
+    long data_size = coil_size + (long)header->reg_count * 2;
+    const unsigned char *data = map + sizeof(persist_snapshot_header);
+    if (header->magic != PERSIST_SNAPSHOT_MAGIC || header->version != PERSIST_VERSION
+      || (long)sizeof(persist_snapshot_header) + data_size > st.st_size
+      || fnv1a(data, data_size) != header->checksum) {
+      munmap(map, st.st_size);
+      return PERSIST_FORMAT_ERROR;
+    }
+    if (header->coil_count > 0)
+      apply(arg, PERSIST_COIL_BITS, header->coil_start_addr, data, header->coil_count);
+    if (header->reg_count > 0)
+      apply(arg, PERSIST_HOLDING_REGS, header->reg_start_addr, data + coil_size, header->reg_count);
+    munmap(map, st.st_size);
+  }
+  long valid_size = 0;
+  return _replay_journal(apply, arg, &valid_size);
+}
+
+int ModbusPersist::checkpoint(ModbusPersistGather gather, void *arg)
+{
+  if (journal_fd_ < 0) return PERSIST_NOT_OPEN;
+  std::unique_lock<std::mutex> lock(mutex_);
+  // 先把已有的记录落盘, 快照写失败时日志仍然完整
+  int code = _flush_locked(lock);
+  if (code != PERSIST_NONE) return code;
+  while (flushing_) flush_cond_.wait(lock);
+
+  persist_snapshot_header header;
+  memset(&header, 0, sizeof(header));
+  int coil_start = 0, reg_start = 0;
+  int coil_count = gather(arg, PERSIST_COIL_BITS, NULL, &coil_start);
+  int reg_count = gather(arg, PERSIST_HOLDING_REGS, NULL, &reg_start);
+  long coil_size = (coil_count + 1) & ~1;
+  long data_size = coil_size + (long)reg_count * 2;
+  unsigned char *data = new unsigned char[data_size > 0 ? data_size : 1];
+  memset(data, 0, data_size);
+  if (coil_count > 0) gather(arg, PERSIST_COIL_BITS, data, &coil_start);
+  if (reg_count > 0) gather(arg, PERSIST_HOLDING_REGS, data + coil_size, &reg_start);
+  header.magic = PERSIST_SNAPSHOT_MAGIC;
+  header.version = PERSIST_VERSION;
+  header.coil_start_addr = coil_start;
+  header.coil_count = coil_count;
+  header.reg_start_addr = reg_start;
+  header.reg_count = reg_count;
+  header.checksum = fnv1a(data, data_size);
+
+  // 先写临时文件再rename, 保证快照文件始终是完整的
+  int len = strlen(snapshot_path_);
+  char *tmp_path = new char[len + 5];
+  memcpy(tmp_path, snapshot_path_, len);
+  memcpy(tmp_path + len, ".tmp", 5);
+  int fd = ::open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    code = PERSIST_OPEN_ERROR;
+  }
+  else {
+    code = write_all(fd, (const unsigned char *)&header, sizeof(header));
+    if (code == PERSIST_NONE) code = write_all(fd, data, data_size);
+    if (code == PERSIST_NONE && fdatasync(fd) != 0) code = PERSIST_IO_ERROR;
+    ::close(fd);
+    if (code == PERSIST_NONE && rename(tmp_path, snapshot_path_) != 0) code = PERSIST_IO_ERROR;
+  }
+  if (code == PERSIST_NONE) {
+    // 同步快照所在目录, 保证rename落盘
+    char *dir_path = new char[len + 2];
+    strcpy(dir_path, snapshot_path_);
+    char *slash = strrchr(dir_path, '/');
+    if (slash == NULL) strcpy(dir_path, ".");
+    else if (slash == dir_path) slash[1] = '\0';
+    else slash[0] = '\0';
+    int dir_fd = ::open(dir_path, O_RDONLY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      ::close(dir_fd);
+    }
+    delete[] dir_path;
+    if (ftruncate(journal_fd_, 0) != 0 || fdatasync(journal_fd_) != 0) code = PERSIST_IO_ERROR;
+    else journal_size_ = 0;
+  }
+  delete[] tmp_path;
+  delete[] data;
+  return code;
+}
@@ -0,0 +1,137 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_PERSIST_H_
+#define _MODBUS_PERSIST_H_
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+enum ModbusPersistCode {
+  PERSIST_NONE = 0,             // 正常
+  PERSIST_OPEN_ERROR = -10,     // 文件打开失败
+  PERSIST_IO_ERROR = -11,       // 文件读写失败
+  PERSIST_FORMAT_ERROR = -12,   // 文件格式错误
+  PERSIST_NOT_OPEN = -13        // 日志未打开
+};
+
+enum ModbusPersistType {
+  PERSIST_COIL_BITS = 0x01,     // 线圈状态寄存器, 每个值1个字节
+  PERSIST_HOLDING_REGS = 0x03   // 保持寄存器, 每个值2个字节(本机字节序)
+};
+
+/* ModbusPersistApply: 恢复数据时的回调
+ * @param arg: 注册回调时传入的参数
+ * @param type: 数据类型, 见ModbusPersistType
+ * @param addr: 起始地址
+ * @param data: 数据(线圈为uchar数组, 保持寄存器为ushort数组)
+ * @param count: 数据个数
+ */
+typedef void (*ModbusPersistApply)(void *arg, unsigned char type, int addr, const void *data, int count);
+
+/* ModbusPersistGather: 生成快照时的回调, 由调用者把当前的寄存器数据填入快照
+ * @param arg: 注册回调时传入的参数
+ * @param type: 数据类型, 见ModbusPersistType
+ * @param data: 要填充的数据区域, 为NULL时只需要返回起始地址和个数
+ * @param start_addr: 返回起始地址
+ * :return: 数据个数
+ */
+typedef int (*ModbusPersistGather)(void *arg, unsigned char type, void *data, int *start_addr);
+
+/* ModbusPersist: 线圈状态寄存器和保持寄存器的持久化
+ * 1. 快照文件: 二进制格式(文件头 + 线圈数据 + 保持寄存器数据), 恢复时通过mmap直接映射
+ * 2. 日志文件: 追加写的写操作记录(地址区间 + 写入后的值), 恢复时在快照基础上重放
+ * 3. 组提交: append只拷贝到内存缓冲区(微秒级), 由后台线程按间隔批量write + fdatasync
+ * 4. 刷盘失败时截掉日志末尾写了一半的记录, 没落盘的记录放回缓冲区等下次重试;
+ *    在重新刷盘成功之前append/sync返回PERSIST_IO_ERROR(记录仍然会放入缓冲区)
+ */
+class ModbusPersist
+{
+public:
+  /* ModbusPersist: 构造持久化实例
+   * @param snapshot_path: 快照文件路径
+   * @param journal_path: 日志文件路径
+   * @param sync_interval_ms: 组提交的刷盘间隔(毫秒), 小于等于0表示每次append都同步刷盘
+   */
+  ModbusPersist(const char *snapshot_path, const char *journal_path, int sync_interval_ms = 10);
+  ~ModbusPersist();
+
+  /* open: 打开(或创建)日志文件并启动后台刷盘线程
+   * 日志末尾如果有不完整的记录(比如掉电时写了一半)会被截断
+   * :return: 成功返回0
+   */
+  int open(void);
+
+  /* close: 刷盘并关闭日志文件, 停止后台刷盘线程 */
+  void close(void);
+
+  /* append: 追加一条写操作记录, 只拷贝到内存缓冲区, 不等待刷盘
+   * @param type: 数据类型, 见ModbusPersistType
+   * @param addr: 起始地址
+   * @param data: 写入后的值
+   * @param count: 数据个数
+   * :return: 成功返回0, 之前的刷盘失败且还没有重试成功时返回PERSIST_IO_ERROR
+   */
+  int append(unsigned char type, int addr, const void *data, int count);
+
+  /* sync: 立即把缓冲区的记录写入日志文件并fdatasync
+   * :return: 成功返回0
+   */
+  int sync(void);
+
+  /* restore: 从快照(mmap)和日志恢复数据, 一般在程序启动后、处理请求前调用
+   * @param apply: 恢复数据的回调, 先以快照数据回调, 再按顺序以日志记录回调
+   * @param arg: 回调参数
+   * :return: 成功返回0, 没有快照和日志时也返回0
+   */
+  int restore(ModbusPersistApply apply, void *arg);
+
+  /* checkpoint: 生成新的快照并清空日志
+   * 期间会阻塞append, 保证快照和日志之间不丢记录
+   * @param gather: 填充快照数据的回调
+   * @param arg: 回调参数
+   * :return: 成功返回0
+   */
+  int checkpoint(ModbusPersistGather gather, void *arg);
+
+  /* get_journal_size: 获取日志文件当前的大小(字节), 可用于决定何时checkpoint */
+  long get_journal_size(void);
+
+  /* get_error: 获取最近一次刷盘的错误码, 刷盘成功后恢复为PERSIST_NONE */
+  int get_error(void);
+
+private:
+  int _flush_locked(std::unique_lock<std::mutex> &lock);
+  int _replay_journal(ModbusPersistApply apply, void *arg, long *valid_size);
+  void _sync_loop(void);
+
+private:
+  char *snapshot_path_;
+  char *journal_path_;
+  int sync_interval_ms_;
+  int journal_fd_;
+  long journal_size_;     // 已经写入日志文件的大小
+
+  unsigned char *buf_;    // 待刷盘的记录缓冲区
+  int buf_size_;
+  int buf_length_;
+  unsigned char *flush_buf_; // 正在刷盘的缓冲区(和buf_交换, 刷盘时不阻塞append)
+  int flush_buf_size_;
+  bool flushing_;
+  int error_;             // 最近一次刷盘的错误码(刷盘成功前一直保留)
+
+  bool running_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::condition_variable flush_cond_;
+  std::thread *sync_thread_;
+};
+
+#endif // _MODBUS_PERSIST_H_
@@ -0,0 +1,182 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <algorithm>
+#include "modbus_poll_plan.h"
+
+namespace ModbusTCP
+{
+  static bool is_bit_func_code(unsigned char func_code)
+  {
+    return func_code == MODBUS_FC_READ_COILS || func_code == MODBUS_FC_READ_DISCRETE_INPUTS;
+  }
+
+  PollPlanner::PollPlanner(const PollCostModel &cost, int max_regs, int max_bits)
+  : cost_(cost)
+  {
+    max_regs_ = (max_regs > 0 && max_regs <= 0x007D) ? max_regs : 0x007D;
+    max_bits_ = (max_bits > 0 && max_bits <= 0x07D0) ? max_bits : 0x07D0;
+    dirty_ = true;
+  }
+
+  PollPlanner::~PollPlanner()
+  {
+  }
+
+  int PollPlanner::add_tag(unsigned char func_code, int addr, int count, void *buf)
+  {
+    if (func_code < MODBUS_FC_READ_COILS || func_code > MODBUS_FC_READ_INPUT_REGS) return CLIENT_INVALID_REQUEST;
+    int limit = is_bit_func_code(func_code) ? max_bits_ : max_regs_;
+    if (count < 1 || count > limit || addr < 0 || addr + count > 0x10000 || buf == NULL) return CLIENT_INVALID_REQUEST;
+    PollTag tag;
+    tag.func_code = func_code;
+    tag.addr = addr;
+    tag.count = count;
+    tag.buf = buf;
+    tag.code = EXP_NONE;
+    tags_.push_back(tag);
+    dirty_ = true;
+    return (int)tags_.size() - 1;
+  }
+
+  void PollPlanner::clear_tags(void)
+  {
+    tags_.clear();
+    dirty_ = true;
+  }
+
+  const PollTag* PollPlanner::get_tag(int tag_id)
+  {
+    if (tag_id < 0 || tag_id >= (int)tags_.size()) return NULL;
+    return &tags_[tag_id];
+  }
+
+  void PollPlanner::set_cost_model(const PollCostModel &cost)
+  {
+    cost_ = cost;
+    dirty_ = true;
+  }
+
+  int PollPlanner::get_request_count(void)
+  {
+    if (dirty_) build();
+    return (int)reqs_.size();
+  }
+
+  const ClientRequest* PollPlanner::get_request(int inx)
+  {
+    if (dirty_) build();
+    if (inx < 0 || inx >= (int)reqs_.size()) return NULL;
+    return &reqs_[inx];
+  }
+
+  void PollPlanner::_plan_func_code(unsigned char func_code)
+  {
+    sorted_.clear();
+    for (int i = 0; i < (int)tags_.size(); i++) {
+      if (tags_[i].func_code == func_code) sorted_.push_back(i);
+    }
+    int n = (int)sorted_.size();
+    if (n == 0) return;
+    std::vector<PollTag> &tags = tags_;
+    std::sort(sorted_.begin(), sorted_.end(), [&tags](int a, int b) {
+      return tags[a].addr != tags[b].addr ? tags[a].addr < tags[b].addr : tags[a].count < tags[b].count;
+    });
+
+    bool is_bit = is_bit_func_code(func_code);
+    int limit = is_bit ? max_bits_ : max_regs_;
+    double unit_cost = is_bit ? cost_.bit_cost : cost_.reg_cost;
+
+    // dp_cost_[j]: 覆盖排序后前j个数据点的最小开销, 每个请求覆盖排序后连续的一段数据点
+    // 从j往前扩展一段, 起始地址递减而结束地址不减, 超过单个请求的限制后就可以停止
+    dp_cost_.assign(n + 1, 0.0);
+    dp_prev_.assign(n + 1, 0);
+    for (int j = 1; j <= n; j++) {
+      int end = 0;
+      dp_cost_[j] = -1;
+      for (int i = j; i >= 1; i--) {
+        const PollTag &tag = tags_[sorted_[i - 1]];
+        end = std::max(end, tag.addr + tag.count);
+        int span = end - tag.addr;
+        if (span > limit) break;
+        double cost = dp_cost_[i - 1] + cost_.request_cost + span * unit_cost;
+        // 开销相同时优先选择更大的合并, 请求数更少
+        if (dp_cost_[j] < 0 || cost <= dp_cost_[j]) {
+          dp_cost_[j] = cost;
+          dp_prev_[j] = i - 1;
+        }
+      }
+    }
+
+    // 回溯得到每个请求覆盖的数据点
+    int first_req = (int)reqs_.size();
+    int count = 0;
+    for (int j = n; j > 0; j = dp_prev_[j]) count++;
+    reqs_.resize(first_req + count);
+    int req_inx = first_req + count - 1;
+    for (int j = n; j > 0; j = dp_prev_[j], req_inx--) {
+      int i = dp_prev_[j];
+      int start = tags_[sorted_[i]].addr;
+      int end = 0;
+      for (int k = i; k < j; k++) {
+        const PollTag &tag = tags_[sorted_[k]];
+        end = std::max(end, tag.addr + tag.count);
+        TagRef ref;
+        ref.tag_id = sorted_[k];
+        ref.req_inx = req_inx;
+        ref.offset = tag.addr - start;
+        refs_.push_back(ref);
+      }
+      reqs_[req_inx] = ClientRequest(func_code, start, end - start, NULL);
+    }
+  }
+
+  int PollPlanner::build(void)
+  {
+    reqs_.clear();
+    refs_.clear();
+    _plan_func_code(MODBUS_FC_READ_COILS);
+    _plan_func_code(MODBUS_FC_READ_DISCRETE_INPUTS);
+    _plan_func_code(MODBUS_FC_READ_HOLDING_REGS);
+    _plan_func_code(MODBUS_FC_READ_INPUT_REGS);
+
+    // 为每个请求分配结果缓冲区(按2字节对齐)
+    req_offsets_.resize(reqs_.size());
+    int total = 0;
+    for (int i = 0; i < (int)reqs_.size(); i++) {
+      req_offsets_[i] = total;
+      int size = is_bit_func_code(reqs_[i].func_code) ? reqs_[i].quantity : reqs_[i].quantity * 2;
+      total += (size + 1) & ~1;
+    }
+    scratch_.resize(total > 0 ? total : 2);
+    for (int i = 0; i < (int)reqs_.size(); i++) {
+      reqs_[i].data = &scratch_[req_offsets_[i]];
+    }
+    dirty_ = false;
+    return (int)reqs_.size();
+  }
+
+  int PollPlanner::poll(Client *client)
+  {
+    if (dirty_) build();
+    if (reqs_.empty()) return EXP_NONE;
+    int code = client->execute(&reqs_[0], (int)reqs_.size());
+    for (int i = 0; i < (int)refs_.size(); i++) {
+      const TagRef &ref = refs_[i];
+      const ClientRequest &req = reqs_[ref.req_inx];
+      PollTag &tag = tags_[ref.tag_id];
+      tag.code = req.code;
+      if (req.code != EXP_NONE) continue;
+      int elem_size = is_bit_func_code(tag.func_code) ? 1 : 2;
+      memcpy(tag.buf, &scratch_[req_offsets_[ref.req_inx] + ref.offset * elem_size], tag.count * elem_size);
+    }
+    return code;
+  }
+}
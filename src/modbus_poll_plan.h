@@ -0,0 +1,118 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_POLL_PLAN_H_
+#define _MODBUS_POLL_PLAN_H_
+
+#include <vector>
+#include "modbus_tcp_client.h"
+
+namespace ModbusTCP
+{
+  /* PollCostModel: 合并请求的开销模型
+   * 一个请求的开销 = request_cost + 读取的寄存器(位)个数 * reg_cost(bit_cost)
+   * 两个区间之间的空隙如果读取的开销小于多发一个请求的开销, 就会合并成一个请求
+   */
+  struct PollCostModel {
+    PollCostModel(double request_cost = 50.0, double reg_cost = 1.0, double bit_cost = 1.0 / 16)
+    : request_cost(request_cost), reg_cost(reg_cost), bit_cost(bit_cost) {}
+
+    double request_cost; // 每个请求的固定开销(一次往返)
+    double reg_cost;     // 每读一个寄存器的开销
+    double bit_cost;     // 每读一个位的开销
+  };
+
+  /* PollTag: 需要轮询的一个数据点
+   * func_code: 0x01/0x02时buf为uchar数组, 0x03/0x04时buf为ushort数组, 数组大小不能小于count
+   */
+  struct PollTag {
+    unsigned char func_code;
+    int addr;
+    int count;
+    void *buf;
+    int code; // 最近一次轮询的结果: 0成功, 大于0为Modbus异常码, 小于0见MODBUS_TCP_CLIENT_CODE
+  };
+
+  /* PollPlanner: 轮询计划
+   * 1. 把需要轮询的数据点按功能码和地址合并成最少(开销最小)的0x01/0x02/0x03/0x04请求
+   *    单个请求不超过125个寄存器/2000个位(和DataService::_read_registers/_read_bits的限制一致)
+   * 2. 计划只在数据点变化后重新生成, 轮询时直接复用
+   * 3. 回复数据存放在预先分配的缓冲区, 轮询后按偏移拷贝到各个数据点的buf, 不会再申请内存
+   */
+  class PollPlanner
+  {
+  public:
+    /* PollPlanner: 构造轮询计划
+     * @param cost: 开销模型
+     * @param max_regs: 单个请求最多的寄存器个数, 不超过125
+     * @param max_bits: 单个请求最多的位个数, 不超过2000
+     */
+    PollPlanner(const PollCostModel &cost = PollCostModel(), int max_regs = 0x007D, int max_bits = 0x07D0);
+    ~PollPlanner();
+
+    /* add_tag: 添加需要轮询的数据点
+     * @param func_code: 0x01/0x02/0x03/0x04
+     * @param addr: 起始地址
+     * @param count: 个数, 不能超过单个请求的限制
+     * @param buf: 存放轮询结果的数组
+     * :return: 成功返回数据点的编号(>=0), 失败返回CLIENT_INVALID_REQUEST
+     */
+    int add_tag(unsigned char func_code, int addr, int count, void *buf);
+
+    /* clear_tags: 清空所有数据点 */
+    void clear_tags(void);
+
+    /* get_tag: 获取数据点(包括最近一次轮询的结果) */
+    const PollTag* get_tag(int tag_id);
+
+    void set_cost_model(const PollCostModel &cost);
+
+    /* build: 生成轮询计划, 数据点变化后poll会自动调用
+     * :return: 生成的请求个数
+     */
+    int build(void);
+
+    /* get_request_count: 获取计划中的请求个数 */
+    int get_request_count(void);
+
+    /* get_request: 获取计划中的请求, 可以用来查看合并的结果 */
+    const ClientRequest* get_request(int inx);
+
+    /* poll: 执行一次轮询, 所有请求在同一个连接上流水线发送
+     * @param client: 已连接的客户端
+     * :return: 同Client::execute
+     */
+    int poll(Client *client);
+
+  private:
+    void _plan_func_code(unsigned char func_code);
+
+  private:
+    struct TagRef {
+      int tag_id;     // 数据点编号
+      int req_inx;    // 所在的请求
+      int offset;     // 在请求结果中的偏移(寄存器或位的个数)
+    };
+
+    PollCostModel cost_;
+    int max_regs_;
+    int max_bits_;
+    bool dirty_;
+    std::vector<PollTag> tags_;
+    std::vector<ClientRequest> reqs_;
+    std::vector<int> req_offsets_;  // 每个请求在结果缓冲区中的偏移(字节)
+    std::vector<TagRef> refs_;
+    std::vector<unsigned char> scratch_; // 所有请求的结果缓冲区
+    std::vector<int> sorted_;       // 排序用
+    std::vector<double> dp_cost_;   // 动态规划用
+    std::vector<int> dp_prev_;
+  };
+}
+
+#endif // _MODBUS_POLL_PLAN_H_
@@ -0,0 +1,129 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <new>
+#include <atomic>
+#include "modbus_pool.h"
+#include "modbus_rt.h"
+
+#define POOL_CLASS_COUNT (MODBUS_POOL_MAX_OBJECT_SIZE / MODBUS_POOL_ALIGN)
+
+static std::atomic<ModbusPool *> pools[POOL_CLASS_COUNT];
+static std::mutex pools_mutex;
+
+ModbusPool::ModbusPool(size_t object_size, int slab_objects)
+{
+  // 空闲时对象的内存用来存放链表指针
+  object_size_ = object_size < sizeof(FreeNode) ? sizeof(FreeNode) : object_size;
+  object_size_ = (object_size_ + sizeof(void *) - 1) / sizeof(void *) * sizeof(void *);
+  slab_objects_ = slab_objects < 1 ? 1 : slab_objects;
+  free_list_ = NULL;
+  free_count_ = 0;
+}
+
+ModbusPool::~ModbusPool()
+{
+  for (int i = 0; i < (int)slabs_.size(); i++) {
+    delete[] slabs_[i];
+  }
+}
+
+int ModbusPool::_add_slab(void)
+{
+  MODBUS_RT_HEAP_CHECK("ModbusPool slab");
+  unsigned char *slab = new (std::nothrow) unsigned char[object_size_ * slab_objects_];
+  if (slab == NULL) return -1;
+  slabs_.push_back(slab);
+  for (int i = slab_objects_ - 1; i >= 0; i--) {
+    FreeNode *node = (FreeNode *)(slab + i * object_size_);
+    node->next = free_list_;
+    free_list_ = node;
+  }
+  free_count_ += slab_objects_;
+  return 0;
+}
+
+void *ModbusPool::alloc(void)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (free_list_ == NULL && _add_slab() != 0) return NULL;
+  FreeNode *node = free_list_;
+  free_list_ = node->next;
+  free_count_--;
+  return node;
+}
+
+void ModbusPool::free(void *ptr)
+{
+  if (ptr == NULL) return;
+  std::lock_guard<std::mutex> guard(mutex_);
+  FreeNode *node = (FreeNode *)ptr;
+  node->next = free_list_;
+  free_list_ = node;
+  free_count_++;
+}
+
+int ModbusPool::reserve(int count)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  while (free_count_ < count) {
+    if (_add_slab() != 0) return -1;
+  }
+  return 0;
+}
+
+int ModbusPool::get_slab_count(void)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return (int)slabs_.size();
+}
+
+int ModbusPool::get_free_count(void)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return free_count_;
+}
+
+int ModbusPool::get_used_count(void)
+{
+  std::lock_guard<std::mutex> guard(mutex_);
+  return (int)slabs_.size() * slab_objects_ - free_count_;
+}
+
+ModbusPool *ModbusPool::get(size_t size)
+{
+  if (size == 0 || size > MODBUS_POOL_MAX_OBJECT_SIZE) return NULL;
+  int index = (int)((size + MODBUS_POOL_ALIGN - 1) / MODBUS_POOL_ALIGN) - 1;
+  ModbusPool *pool = pools[index].load(std::memory_order_acquire);
+  if (pool != NULL) return pool;
+  std::lock_guard<std::mutex> guard(pools_mutex);
+  pool = pools[index].load(std::memory_order_relaxed);
+  if (pool == NULL) {
+    // 进程退出前可能还有对象要释放(比如全局的DataService), 池不销毁
+    pool = new ModbusPool((index + 1) * MODBUS_POOL_ALIGN);
+    pools[index].store(pool, std::memory_order_release);
+  }
+  return pool;
+}
+
+void *ModbusPool::pool_new(size_t size)
+{
+  ModbusPool *pool = get(size);
+  if (pool == NULL) MODBUS_RT_HEAP_CHECK("ModbusPool oversized object");
+  void *ptr = pool != NULL ? pool->alloc() : ::operator new(size);
+  if (ptr == NULL) throw std::bad_alloc();
+  return ptr;
+}
+
+void ModbusPool::pool_delete(void *ptr, size_t size)
+{
+  ModbusPool *pool = get(size);
+  if (pool != NULL) pool->free(ptr);
+  else ::operator delete(ptr);
+}
@@ -0,0 +1,92 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_POOL_H_
+#define _MODBUS_POOL_H_
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+#define MODBUS_POOL_ALIGN           32   // 对象大小按32字节向上取整, 同一取整大小的类型共用一个池
+#define MODBUS_POOL_MAX_OBJECT_SIZE 2048 // 超过这个大小的对象不走池
+#define MODBUS_POOL_SLAB_OBJECTS    64   // 每次向系统申请的对象个数
+
+/* ModbusPool: 固定大小对象的内存池(slab + 空闲链表)
+ * 1. 每次从系统申请一块能放MODBUS_POOL_SLAB_OBJECTS个对象的内存(slab), 切成空闲链表
+ * 2. alloc/free只是从空闲链表弹出/压入一个指针, O(1)
+ * 3. 释放的对象回到空闲链表, slab不会还给系统(连接频繁断开重连时不再反复malloc)
+ * 4. 线程安全
+ * 5. DataFrame/DataSession/DataService/Server的连接通过类的operator new使用,
+ *    编译时定义MODBUS_DISABLE_POOL可以改回直接用系统的new/delete(比如配合内存检查工具)
+ */
+class ModbusPool
+{
+public:
+  /* ModbusPool: 构造内存池
+   * @param object_size: 对象大小
+   * @param slab_objects: 每个slab的对象个数
+   */
+  ModbusPool(size_t object_size, int slab_objects = MODBUS_POOL_SLAB_OBJECTS);
+  ~ModbusPool();
+
+  /* alloc: 申请一个对象的内存
+   * :return: 内存地址, 失败返回NULL
+   */
+  void *alloc(void);
+
+  /* free: 释放alloc申请的内存 */
+  void free(void *ptr);
+
+  /* reserve: 预先申请内存, 保证至少有count个空闲对象
+   * :return: 成功返回0, 失败返回-1
+   */
+  int reserve(int count);
+
+  size_t get_object_size(void) { return object_size_; }
+  int get_slab_count(void);
+  int get_free_count(void);
+  int get_used_count(void);
+
+  /* get: 获取指定大小的对象共用的内存池
+   * @param size: 对象大小
+   * :return: 内存池, size超过MODBUS_POOL_MAX_OBJECT_SIZE时返回NULL
+   */
+  static ModbusPool *get(size_t size);
+
+  /* pool_new/pool_delete: 给类的operator new/delete用, 没有对应的池时使用系统的new/delete */
+  static void *pool_new(size_t size);
+  static void pool_delete(void *ptr, size_t size);
+
+private:
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  int _add_slab(void);
+
+private:
+  size_t object_size_;
+  int slab_objects_;
+  std::mutex mutex_;
+  FreeNode *free_list_;
+  int free_count_;
+  std::vector<unsigned char *> slabs_;
+};
+
+#ifndef MODBUS_DISABLE_POOL
+/* 在类定义里使用, 让这个类的new/delete走内存池 */
+#define MODBUS_POOL_OPERATORS \
+  static void *operator new(size_t size) { return ModbusPool::pool_new(size); } \
+  static void operator delete(void *ptr, size_t size) { ModbusPool::pool_delete(ptr, size); }
+#else
+#define MODBUS_POOL_OPERATORS
+#endif
+
+#endif // _MODBUS_POOL_H_
@@ -0,0 +1,90 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <assert.h>
+#include <alloca.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "modbus_rt.h"
+#include "modbus_pool.h"
+#include "modbus_log.h"
+#include "modbus_tcp_data.h"
+
+thread_local bool ModbusRT::tls_heap_forbidden_ = false;
+std::atomic<uint64_t> ModbusRT::heap_violations_(0);
+
+int ModbusRT::lock_memory(void)
+{
+  // 释放的内存留在进程里, 大块内存也不单独mmap(否则每次申请/释放都会缺页)
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  return mlockall(MCL_CURRENT | MCL_FUTURE) == 0 ? 0 : -1;
+}
+
+void ModbusRT::prefault(void *addr, size_t size)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  if (page <= 0) page = 4096;
+  volatile unsigned char *p = (volatile unsigned char *)addr;
+  for (size_t i = 0; i < size; i += page) {
+    p[i] = p[i];
+  }
+  if (size > 0) p[size - 1] = p[size - 1];
+}
+
+void ModbusRT::prefault_stack(size_t size)
+{
+  // 用alloca在当前栈帧下面占用size字节再逐页写入
+  unsigned char *buf = (unsigned char *)alloca(size);
+  long page = sysconf(_SC_PAGESIZE);
+  if (page <= 0) page = 4096;
+  for (size_t i = 0; i < size; i += page) {
+    ((volatile unsigned char *)buf)[i] = 0;
+  }
+}
+
+int ModbusRT::reserve_sessions(int count)
+{
+  // 所有DataService实例化的大小相同, 用ModbusBaseData的即可
+  ModbusPool *pools[3] = {
+    ModbusPool::get(sizeof(ModbusTCP::DataService<ModbusBaseData>)),
+    ModbusPool::get(sizeof(ModbusTCP::DataSession)),
+    ModbusPool::get(sizeof(ModbusTCP::DataFrame))
+  };
+  int counts[3] = {count, count, count * 2};
+  for (int i = 0; i < 3; i++) {
+    if (pools[i] != NULL && pools[i]->reserve(counts[i]) != 0) return -1;
+  }
+  return 0;
+}
+
+int ModbusRT::enter_realtime(int priority, int cpu)
+{
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return -1;
+  }
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = priority;
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 ? 0 : -1;
+}
+
+void ModbusRT::_on_heap_violation(const char *where)
+{
+  heap_violations_.fetch_add(1, std::memory_order_relaxed);
+  MODBUS_LOG_ERROR("heap allocation in real-time thread: %s", where);
+  assert(!"heap allocation in real-time thread");
+}
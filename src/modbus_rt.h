@@ -0,0 +1,87 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_RT_H_
+#define _MODBUS_RT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#define MODBUS_RT_STACK_PREFAULT  (256 * 1024) // 默认预先访问的栈大小
+
+/* ModbusRT: 软实时模式(在实时控制器的线程里处理请求)
+ * 1. 启动时: reserve_sessions预先申请会话用的内存池对象, lock_memory锁定内存(寄存器、内存池、栈都不会被换出),
+ *    prefault_stack预先访问处理线程的栈, enter_realtime切换到SCHED_FIFO
+ * 2. 初始化完成后在处理线程调用forbid_heap, 之后这个线程里库内部的堆申请(内存池扩容、DataFrame超过260字节、
+ *    Server的发送缓冲区扩容)都会计数并输出错误日志, 没有定义NDEBUG时直接assert
+ * 3. process_session的最坏执行时间: 没有堆申请, 循环次数都受协议限制(读线圈最多2000个, 读寄存器最多125个,
+ *    写线圈最多1968个, 写寄存器最多123个), 栈上的临时数组约3KB; 额外绑定的读写方法是应用程序的代码,
+ *    需要应用程序自己保证, 或者配合写队列(见modbus_write_queue.h)放到控制循环里执行
+ * 4. 统计、跟踪的线程数据在线程第一次使用时申请, forbid_heap之前应先在处理线程里处理一次请求;
+ *    访问热度的线程数据在ModbusHeatmap::enable时按线程数预先申请
+ */
+class ModbusRT
+{
+public:
+  /* lock_memory: 锁定进程当前和以后的所有内存(mlockall), 并关闭malloc把内存还给系统(释放后再申请不会缺页)
+   * 需要CAP_IPC_LOCK权限或者足够的RLIMIT_MEMLOCK
+   * :return: 成功返回0, 失败返回-1(errno为mlockall的错误)
+   */
+  static int lock_memory(void);
+
+  /* prefault: 按页访问一段内存, 让页面提前映射
+   * @param addr: 起始地址
+   * @param size: 大小
+   */
+  static void prefault(void *addr, size_t size);
+
+  /* prefault_stack: 预先访问当前线程的栈
+   * @param size: 大小, 不能超过线程栈的大小
+   */
+  static void prefault_stack(size_t size = MODBUS_RT_STACK_PREFAULT);
+
+  /* reserve_sessions: 预先申请count个连接用到的内存池对象(DataService/DataSession/DataFrame)
+   * :return: 成功返回0
+   */
+  static int reserve_sessions(int count);
+
+  /* enter_realtime: 把当前线程切换到SCHED_FIFO
+   * @param priority: 实时优先级(1~99)
+   * @param cpu: 绑定的CPU, 小于0表示不绑定
+   * :return: 成功返回0, 失败返回-1(比如没有CAP_SYS_NICE权限)
+   */
+  static int enter_realtime(int priority, int cpu = -1);
+
+  /* forbid_heap/allow_heap: 禁止/允许当前线程在库内部申请堆内存 */
+  static void forbid_heap(void) { tls_heap_forbidden_ = true; }
+  static void allow_heap(void) { tls_heap_forbidden_ = false; }
+  static bool is_heap_forbidden(void) { return tls_heap_forbidden_; }
+
+  /* check_heap: 库内部申请堆内存前调用
+   * @param where: 申请的位置, 用于日志
+   */
+  static void check_heap(const char *where)
+  {
+    if (tls_heap_forbidden_) _on_heap_violation(where);
+  }
+
+  /* get_heap_violations: 禁止后仍然申请堆内存的次数(所有线程) */
+  static uint64_t get_heap_violations(void) { return heap_violations_.load(std::memory_order_relaxed); }
+
+private:
+  static void _on_heap_violation(const char *where);
+
+  static thread_local bool tls_heap_forbidden_;
+  static std::atomic<uint64_t> heap_violations_;
+};
+
+#define MODBUS_RT_HEAP_CHECK(where) ModbusRT::check_heap(where)
+
+#endif // _MODBUS_RT_H_
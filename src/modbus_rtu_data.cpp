@@ -0,0 +1,205 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include "modbus_rtu_data_impl.h"
+
+#define CRC16_POLY 0xA001 // 0x8005的反转
+
+namespace ModbusRTU
+{
+  /************************* Codec ***************************/
+
+  /* slicing-by-8的查找表: table[0]是普通的按字节查找表, table[k]为一个字节后面再跟k个0字节时的CRC */
+  struct Crc16Table {
+    unsigned short table[8][256];
+
+    Crc16Table() {
+      for (int i = 0; i < 256; i++) {
+        unsigned short crc = i;
+        for (int j = 0; j < 8; j++) {
+          crc = (crc & 1) ? (crc >> 1) ^ CRC16_POLY : crc >> 1;
+        }
+        table[0][i] = crc;
+      }
+      for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+          table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFF];
+        }
+      }
+    }
+  };
+
+  static const Crc16Table crc16_table;
+
+  unsigned short Codec::crc16(const unsigned char *data, int length)
+  {
+    const unsigned short (*t)[256] = crc16_table.table;
+    unsigned short crc = 0xFFFF;
+    while (length >= 8) {
+      // CRC只有16位, 只和前2个字节异或, 8个字节的查表结果互相独立
+      crc = t[7][(data[0] ^ crc) & 0xFF] ^ t[6][data[1] ^ (crc >> 8)] ^ t[5][data[2]] ^ t[4][data[3]]
+          ^ t[3][data[4]] ^ t[2][data[5]] ^ t[1][data[6]] ^ t[0][data[7]];
+      data += 8;
+      length -= 8;
+    }
+    while (length-- > 0) {
+      crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+  }
+
+  unsigned short Codec::crc16_bytewise(const unsigned char *data, int length)
+  {
+    unsigned short crc = 0xFFFF;
+    for (int i = 0; i < length; i++) {
+      crc = (crc >> 8) ^ crc16_table.table[0][(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+  }
+
+  bool Codec::check_crc(const unsigned char *frame, int length)
+  {
+    if (length < 3) return false;
+    unsigned short crc = crc16(frame, length - 2);
+    return frame[length - 2] == (crc & 0xFF) && frame[length - 1] == (crc >> 8);
+  }
+
+  int Codec::append_crc(unsigned char *frame, int length)
+  {
+    unsigned short crc = crc16(frame, length);
+    frame[length] = crc & 0xFF;
+    frame[length + 1] = crc >> 8;
+    return length + 2;
+  }
+
+  int Codec::to_tcp(const unsigned char *rtu, int length, unsigned short tid, unsigned char *mbap)
+  {
+    // 地址 + 功能码 + CRC至少4字节
+    if (length < 4 || length > MODBUS_RTU_MAX_FRAME_SIZE || !check_crc(rtu, length)) return -1;
+    ModbusTCP::HexData::bin16_to_8(tid, mbap);
+    mbap[2] = 0;
+    mbap[3] = 0;
+    // MBAP的长度为单元标识(RTU地址) + PDU
+    ModbusTCP::HexData::bin16_to_8(length - 2, mbap + 4);
+    memcpy(mbap + 6, rtu, length - 2);
+    return length + 4;
+  }
+
+  int Codec::from_tcp(const unsigned char *mbap, int length, unsigned char *rtu)
+  {
+    if (length < 8 || length > MODBUS_TCP_MAX_FRAME_SIZE) return -1;
+    memcpy(rtu, mbap + 6, length - 6);
+    return append_crc(rtu, length - 6);
+  }
+
+  int Codec::get_request_length(const unsigned char *frame, int length)
+  {
+    if (length < 2) return 2;
+    switch (frame[1]) {
+      case MODBUS_FC_READ_COILS:
+      case MODBUS_FC_READ_DISCRETE_INPUTS:
+      case MODBUS_FC_READ_HOLDING_REGS:
+      case MODBUS_FC_READ_INPUT_REGS:
+      case MODBUS_FC_WRITE_SINGLE_COIL:
+      case MODBUS_FC_WRITE_SINGLE_REG:
+      case MODBUS_FC_DIAGNOSTICS:
+        // 地址 + 功能码 + 4字节 + CRC
+        return 8;
+      case MODBUS_FC_WRITE_MULTIPLE_COILS:
+      case MODBUS_FC_WRITE_MULTIPLE_REGS:
+        // 地址 + 功能码 + 起始地址 + 个数 + 字节数 + 数据 + CRC
+        return length < 7 ? 7 : 9 + frame[6];
+      case MODBUS_FC_READ_FILE_RECORD:
+      case MODBUS_FC_WRITE_FILE_RECORD:
+        // 地址 + 功能码 + 字节数 + 子请求 + CRC
+        return length < 3 ? 3 : 5 + frame[2];
+      case MODBUS_FC_MASK_WRITE_REG:
+        return 10;
+      case MODBUS_FC_WRITE_AND_READ_REGS:
+        // 地址 + 功能码 + 读起始地址 + 读个数 + 写起始地址 + 写个数 + 字节数 + 数据 + CRC
+        return length < 11 ? 11 : 13 + frame[10];
+      default:
+        return -1;
+    }
+  }
+
+  /************************* 串口 ***************************/
+
+  static speed_t _to_speed(int baudrate)
+  {
+    switch (baudrate) {
+      case 1200: return B1200;
+      case 2400: return B2400;
+      case 4800: return B4800;
+      case 9600: return B9600;
+      case 19200: return B19200;
+      case 38400: return B38400;
+      case 57600: return B57600;
+      case 115200: return B115200;
+      case 230400: return B230400;
+      default: return 0;
+    }
+  }
+
+  int open_serial(const char *path, int baudrate, char parity, int stop_bits)
+  {
+    speed_t speed = _to_speed(baudrate);
+    if (speed == 0) return -1;
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) {
+      close(fd);
+      return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(PARENB | PARODD | CSTOPB | CSIZE);
+    tio.c_cflag |= CS8;
+    if (parity == 'E') tio.c_cflag |= PARENB;
+    else if (parity == 'O') tio.c_cflag |= PARENB | PARODD;
+    if (stop_bits == 2) tio.c_cflag |= CSTOPB;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) != 0) {
+      close(fd);
+      return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+  }
+
+  /* 模板类需要特化 */
+  template class DataService<ModbusBaseData>;
+  template class DataService<ModbusStructData>;
+  template class DataService<ModbusBasePtrData>;
+  template class DataService<ModbusStructPtrData>;
+
+  template class DataService<ModbusDataTemplate<modbus_bit_base_data, modbus_reg_base_ptr_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_base_data, modbus_reg_struct_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_base_data, modbus_reg_struct_ptr_data>>;
+
+  template class DataService<ModbusDataTemplate<modbus_bit_base_ptr_data, modbus_reg_base_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_base_ptr_data, modbus_reg_struct_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_base_ptr_data, modbus_reg_struct_ptr_data>>;
+
+  template class DataService<ModbusDataTemplate<modbus_bit_struct_data, modbus_reg_base_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_struct_data, modbus_reg_base_ptr_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_struct_data, modbus_reg_struct_ptr_data>>;
+
+  template class DataService<ModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_base_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_base_ptr_data>>;
+  template class DataService<ModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_struct_data>>;
+} // namespace ModbusRTU
@@ -0,0 +1,167 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_RTU_DATA_H_
+#define _MODBUS_RTU_DATA_H_
+
+#include <stdint.h>
+#include "modbus_tcp_data.h"
+
+#define MODBUS_RTU_MAX_FRAME_SIZE 256 // Modbus RTU一帧最大长度, 地址(1) + PDU(253) + CRC(2)
+#define MODBUS_RTU_BROADCAST_ADDR 0   // 广播地址, 只处理不回复
+
+namespace ModbusRTU
+{
+  /* Codec: RTU帧的编解码
+   * 1. CRC16(多项式0xA001, 初值0xFFFF, 低字节在前)默认用slicing-by-8, 每次查8张表处理8个字节
+   * 2. RTU帧和Modbus TCP帧(MBAP)的互相转换, 用来复用ModbusTCP::DataService的功能码处理, 也可以用于网关
+   */
+  class Codec
+  {
+  public:
+    /* crc16: 计算CRC16(slicing-by-8)
+     * @param data: 数据
+     * @param length: 数据长度
+     * :return: CRC16
+     */
+    static unsigned short crc16(const unsigned char *data, int length);
+
+    /* crc16_bytewise: 计算CRC16(每次查表处理1个字节), 用于对比和校验 */
+    static unsigned short crc16_bytewise(const unsigned char *data, int length);
+
+    /* check_crc: 检查一帧RTU数据最后2个字节的CRC
+     * :return: 正确返回true
+     */
+    static bool check_crc(const unsigned char *frame, int length);
+
+    /* append_crc: 在数据后面追加CRC(低字节在前)
+     * :return: 追加后的长度
+     */
+    static int append_crc(unsigned char *frame, int length);
+
+    /* to_tcp: RTU帧转换为Modbus TCP帧
+     * @param rtu: RTU帧(含CRC)
+     * @param length: RTU帧长度
+     * @param tid: MBAP的事务标识
+     * @param mbap: Modbus TCP帧的缓冲区(至少length+4字节)
+     * :return: Modbus TCP帧的长度, 长度或CRC错误返回-1
+     */
+    static int to_tcp(const unsigned char *rtu, int length, unsigned short tid, unsigned char *mbap);
+
+    /* from_tcp: Modbus TCP帧转换为RTU帧
+     * @param mbap: Modbus TCP帧
+     * @param length: Modbus TCP帧长度
+     * @param rtu: RTU帧的缓冲区(至少length-4字节)
+     * :return: RTU帧的长度(含CRC), 长度错误返回-1
+     */
+    static int from_tcp(const unsigned char *mbap, int length, unsigned char *rtu);
+
+    /* get_request_length: 根据已经收到的部分推算一帧RTU请求的长度
+     * @param frame: 已经收到的数据
+     * @param length: 已经收到的长度
+     * :return: 这一帧的长度, 或者推算长度还需要的最少字节数(大于length), 无法推算的功能码返回-1(只能靠帧间静默分帧)
+     */
+    static int get_request_length(const unsigned char *frame, int length);
+  };
+
+  /* open_serial: 打开串口(或伪终端)并设置为原始模式
+   * @param path: 设备路径, 比如/dev/ttyUSB0
+   * @param baudrate: 波特率
+   * @param parity: 校验位, 'N'/'E'/'O', Modbus RTU默认为'E'
+   * @param stop_bits: 停止位, 1或2
+   * :return: 成功返回非阻塞的文件描述符, 失败返回-1
+   */
+  int open_serial(const char *path, int baudrate, char parity = 'E', int stop_bits = 1);
+
+  /* DataService: Modbus RTU数据处理, 功能码处理复用ModbusTCP::DataService::process_session
+   * 1. 流模式(RTU over TCP): 按功能码推算帧长拆包/粘包, 每帧检查CRC
+   * 2. 串口模式: 额外按帧间静默(t3.5)分帧, 静默时还不完整的帧被丢弃, 无法推算长度的功能码在静默时作为一帧处理
+   * 3. 只回复发给自己地址的请求, 广播(地址0)只处理不回复
+   * 4. 回调的参数为RTU帧(含CRC), 没有回复时不回调
+   */
+  template <class ModbusData>
+  class DataService
+  {
+  public:
+    /* DataService: 构造
+     * @param modbus_data: 寄存器操作实例
+     * @param slave_id: 从站地址(1~247), 为-1时处理所有地址的请求(比如网关)
+     */
+    DataService(ModbusData *modbus_data, int slave_id = 1);
+    ~DataService();
+    MODBUS_POOL_OPERATORS
+
+    /* process_data: 处理收到的数据(流模式, 比如RTU over TCP)
+     * @param data: 收到的数据
+     * @param length: 数据长度
+     * @param callback: 每处理一帧有回复的请求的回调, 参数同ModbusTCP::DataArgCallback, 数据为RTU帧
+     * @param arg: 回调的参数
+     */
+    void process_data(const unsigned char *data, int length, ModbusTCP::DataArgCallback callback, void *arg);
+
+    /* process_data: 处理收到的数据(串口模式)
+     * @param data: 收到的数据
+     * @param length: 数据长度
+     * @param now_us: 收到数据的时间(微秒, 单调时钟)
+     * @param callback: 同上
+     * @param arg: 同上
+     */
+    void process_data(const unsigned char *data, int length, uint64_t now_us, ModbusTCP::DataArgCallback callback, void *arg);
+
+    /* poll: 串口模式下没有收到数据时定期调用, 检查帧间静默
+     * @param now_us: 当前时间(微秒, 单调时钟)
+     * :return: 处理或丢弃了缓冲区里的数据返回1, 否则返回0
+     */
+    int poll(uint64_t now_us, ModbusTCP::DataArgCallback callback, void *arg);
+
+    /* process_frame: 处理一帧完整的RTU请求
+     * @param frame: RTU帧(含CRC)
+     * @param length: 帧长度
+     * @param response: 回复的缓冲区(至少MODBUS_RTU_MAX_FRAME_SIZE字节)
+     * :return: 回复的长度, 没有回复(广播、不是自己的地址)返回0, CRC或长度错误返回-1
+     */
+    int process_frame(const unsigned char *frame, int length, unsigned char *response);
+
+    /* set_baudrate: 设置串口的波特率, 用来计算t3.5(超过19200时固定为1750us) */
+    void set_baudrate(int baudrate);
+
+    /* get_silence_us: 获取帧间静默的时间t3.5(微秒) */
+    unsigned int get_silence_us(void) { return silence_us_; }
+
+    /* set_session_handler: 设置自定义的帧处理方法, 见ModbusTCP::DataService::set_session_handler */
+    void set_session_handler(typename ModbusTCP::DataService<ModbusData>::SessionHandler handler, void *arg);
+
+    /* get_crc_error_count: 获取CRC错误的帧数 */
+    uint64_t get_crc_error_count(void) { return crc_error_count_; }
+
+  private:
+    void _feed(const unsigned char *data, int length, ModbusTCP::DataArgCallback callback, void *arg);
+    void _process_buffer(ModbusTCP::DataArgCallback callback, void *arg);
+    void _discard(const char *reason);
+
+  private:
+    ModbusData *modbus_data_;
+    int slave_id_;
+    unsigned int silence_us_;  // t3.5(微秒)
+    uint64_t last_us_;         // 最近一次收到数据的时间
+    int data_length_;          // 缓冲区内的数据长度
+    unsigned char buf_[MODBUS_RTU_MAX_FRAME_SIZE];     // 缓冲区, 存放不完整的一帧
+    unsigned char res_buf_[MODBUS_RTU_MAX_FRAME_SIZE]; // 回复
+    uint64_t crc_error_count_;
+    ModbusTCP::DataSession *session_;
+    typename ModbusTCP::DataService<ModbusData>::SessionHandler session_handler_;
+    void *session_handler_arg_;
+  };
+}
+
+#ifdef MODBUS_HEADER_ONLY
+#include "modbus_rtu_data_impl.h"
+#endif
+
+#endif // _MODBUS_RTU_DATA_H_
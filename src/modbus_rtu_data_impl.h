@@ -0,0 +1,160 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+/* modbus_rtu_data.h中DataService的实现, 包含方式同modbus_tcp_data_impl.h */
+
+#ifndef _MODBUS_RTU_DATA_IMPL_H_
+#define _MODBUS_RTU_DATA_IMPL_H_
+
+#include <string.h>
+#include "modbus_rtu_data.h"
+#include "modbus_metrics.h"
+#include "modbus_log.h"
+
+#define RTU_DEFAULT_BAUDRATE 9600
+
+namespace ModbusRTU
+{
+  template <class ModbusData>
+  DataService<ModbusData>::DataService(ModbusData *modbus_data, int slave_id)
+  {
+    modbus_data_ = modbus_data;
+    slave_id_ = slave_id;
+    last_us_ = 0;
+    data_length_ = 0;
+    crc_error_count_ = 0;
+    session_ = new ModbusTCP::DataSession();
+    session_handler_ = NULL;
+    session_handler_arg_ = NULL;
+    set_baudrate(RTU_DEFAULT_BAUDRATE);
+  }
+
+  template <class ModbusData>
+  DataService<ModbusData>::~DataService()
+  {
+    if (session_ != NULL) {
+      delete session_;
+      session_ = NULL;
+    }
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::set_baudrate(int baudrate)
+  {
+    // 一个字符11位(起始位+8数据位+校验位+停止位), 波特率超过19200时规范建议固定为1750us
+    if (baudrate > 19200 || baudrate <= 0) silence_us_ = 1750;
+    else silence_us_ = (unsigned int)(11 * 3.5 * 1000000 / baudrate);
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::set_session_handler(typename ModbusTCP::DataService<ModbusData>::SessionHandler handler, void *arg)
+  {
+    session_handler_ = handler;
+    session_handler_arg_ = arg;
+  }
+
+  template <class ModbusData>
+  int DataService<ModbusData>::process_frame(const unsigned char *frame, int length, unsigned char *response)
+  {
+    unsigned char mbap[MODBUS_TCP_MAX_FRAME_SIZE];
+    int mbap_len = Codec::to_tcp(frame, length, 0, mbap);
+    if (mbap_len < 0) {
+      crc_error_count_++;
+      MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_WARN, 1000, 10, "Modbus rtu frame crc or length is wrong, discard it, len=%d", length);
+      MODBUS_METRICS_FRAME_DISCARDED();
+      return -1;
+    }
+    unsigned char addr = frame[0];
+    if (slave_id_ >= 0 && addr != slave_id_ && addr != MODBUS_RTU_BROADCAST_ADDR) return 0;
+    session_->set_request_data(mbap, mbap_len);
+    if (session_handler_ != NULL) {
+      session_handler_(session_, modbus_data_, session_handler_arg_);
+    }
+    else {
+      ModbusTCP::DataService<ModbusData>::process_session(session_, modbus_data_);
+    }
+    if (addr == MODBUS_RTU_BROADCAST_ADDR) return 0;
+    int res_len = Codec::from_tcp(session_->get_response_data(), session_->get_response_length(), response);
+    return res_len < 0 ? 0 : res_len;
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::process_data(const unsigned char *data, int length, ModbusTCP::DataArgCallback callback, void *arg)
+  {
+    _feed(data, length, callback, arg);
+    // 没有静默可以判断时, 无法推算长度的帧以这次收到的数据为结尾
+    if (data_length_ > 0 && Codec::get_request_length(buf_, data_length_) < 0) _process_buffer(callback, arg);
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::process_data(const unsigned char *data, int length, uint64_t now_us, ModbusTCP::DataArgCallback callback, void *arg)
+  {
+    poll(now_us, callback, arg);
+    last_us_ = now_us;
+    _feed(data, length, callback, arg);
+  }
+
+  template <class ModbusData>
+  int DataService<ModbusData>::poll(uint64_t now_us, ModbusTCP::DataArgCallback callback, void *arg)
+  {
+    if (data_length_ == 0 || now_us - last_us_ <= silence_us_) return 0;
+    if (Codec::get_request_length(buf_, data_length_) < 0) _process_buffer(callback, arg);
+    else _discard("Modbus rtu frame is incomplete at the inter-frame silence, discard it");
+    return 1;
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::_feed(const unsigned char *data, int length, ModbusTCP::DataArgCallback callback, void *arg)
+  {
+    int offset = 0;
+    while (offset < length) {
+      int need = Codec::get_request_length(buf_, data_length_);
+      if (need < 0) {
+        // 无法推算长度, 先全部放到缓冲区, 等静默或这次数据的结尾
+        int remain = length - offset;
+        if (data_length_ + remain > MODBUS_RTU_MAX_FRAME_SIZE) {
+          _discard("Modbus rtu frame is too long, discard it");
+          return;
+        }
+        memcpy(buf_ + data_length_, data + offset, remain);
+        data_length_ += remain;
+        return;
+      }
+      if (need > MODBUS_RTU_MAX_FRAME_SIZE) {
+        _discard("Modbus rtu byte count is wrong, discard this part of data");
+        return;
+      }
+      int n = need - data_length_;
+      if (n > length - offset) n = length - offset;
+      memcpy(buf_ + data_length_, data + offset, n);
+      data_length_ += n;
+      offset += n;
+      // 头部收完后长度可能变长, 再推算一次
+      if (data_length_ == need && Codec::get_request_length(buf_, data_length_) == need) _process_buffer(callback, arg);
+    }
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::_process_buffer(ModbusTCP::DataArgCallback callback, void *arg)
+  {
+    int res_len = process_frame(buf_, data_length_, res_buf_);
+    if (res_len > 0 && callback != NULL) callback(buf_, data_length_, res_buf_, res_len, arg);
+    data_length_ = 0;
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::_discard(const char *reason)
+  {
+    MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_WARN, 1000, 10, "%s, len=%d", reason, data_length_);
+    MODBUS_METRICS_FRAME_DISCARDED();
+    data_length_ = 0;
+  }
+}
+
+#endif // _MODBUS_RTU_DATA_IMPL_H_
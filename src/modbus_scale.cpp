@@ -0,0 +1,250 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <math.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "modbus_scale.h"
+
+/* 逐个转换, 和SIMD的运算顺序保持一致: 乘加 -> NaN置0 -> 先限上限再限下限 -> 按当前舍入模式取整 */
+template <typename T>
+static void _encode_scalar(const T *values, int count, T gain, T offset, T lo, T hi, unsigned short *regs)
+{
+  for (int i = 0; i < count; i++) {
+    T val = values[i] * gain + offset;
+    if (val != val) val = 0;
+    val = val < hi ? val : hi;
+    val = val > lo ? val : lo;
+    regs[i] = (unsigned short)lrint((double)val);
+  }
+}
+
+template <typename T>
+static void _decode_scalar(const unsigned short *regs, int count, bool is_signed, T offset, T inv_gain, T *values)
+{
+  for (int i = 0; i < count; i++) {
+    int raw = is_signed ? (int)(short)regs[i] : (int)regs[i];
+    values[i] = ((T)raw - offset) * inv_gain;
+  }
+}
+
+#if defined(__SSE2__)
+/* 4个int32(已经限幅)转换为4个16位寄存器: 无符号的先减32768再有符号饱和打包, 打包后再把最高位翻回来 */
+static inline void _store_regs(__m128i raw, bool is_signed, unsigned short *regs)
+{
+  if (!is_signed) raw = _mm_sub_epi32(raw, _mm_set1_epi32(32768));
+  __m128i packed = _mm_packs_epi32(raw, raw);
+  if (!is_signed) packed = _mm_xor_si128(packed, _mm_set1_epi16((short)0x8000));
+  _mm_storel_epi64((__m128i *)regs, packed);
+}
+
+/* 4个16位寄存器扩展为4个int32 */
+static inline __m128i _load_regs(const unsigned short *regs, bool is_signed)
+{
+  __m128i x = _mm_loadl_epi64((const __m128i *)regs);
+  if (is_signed) return _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+  return _mm_unpacklo_epi16(x, _mm_setzero_si128());
+}
+
+static inline __m128d _clamp_pd(__m128d x, __m128d lo, __m128d hi)
+{
+  x = _mm_and_pd(x, _mm_cmpord_pd(x, x));
+  return _mm_max_pd(_mm_min_pd(x, hi), lo);
+}
+
+static int _encode_block(const double *values, int count, double gain, double offset, double lo, double hi, bool is_signed, unsigned short *regs)
+{
+  __m128d g = _mm_set1_pd(gain), o = _mm_set1_pd(offset), l = _mm_set1_pd(lo), h = _mm_set1_pd(hi);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128d a = _clamp_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(values + i), g), o), l, h);
+    __m128d b = _clamp_pd(_mm_add_pd(_mm_mul_pd(_mm_loadu_pd(values + i + 2), g), o), l, h);
+    _store_regs(_mm_unpacklo_epi64(_mm_cvtpd_epi32(a), _mm_cvtpd_epi32(b)), is_signed, regs + i);
+  }
+  return i;
+}
+
+static int _encode_block(const float *values, int count, float gain, float offset, float lo, float hi, bool is_signed, unsigned short *regs)
+{
+  __m128 g = _mm_set1_ps(gain), o = _mm_set1_ps(offset), l = _mm_set1_ps(lo), h = _mm_set1_ps(hi);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + i), g), o);
+    x = _mm_and_ps(x, _mm_cmpord_ps(x, x));
+    x = _mm_max_ps(_mm_min_ps(x, h), l);
+    _store_regs(_mm_cvtps_epi32(x), is_signed, regs + i);
+  }
+  return i;
+}
+
+static int _decode_block(const unsigned short *regs, int count, bool is_signed, double offset, double inv_gain, double *values)
+{
+  __m128d o = _mm_set1_pd(offset), inv = _mm_set1_pd(inv_gain);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i raw = _load_regs(regs + i, is_signed);
+    _mm_storeu_pd(values + i, _mm_mul_pd(_mm_sub_pd(_mm_cvtepi32_pd(raw), o), inv));
+    _mm_storeu_pd(values + i + 2, _mm_mul_pd(_mm_sub_pd(_mm_cvtepi32_pd(_mm_srli_si128(raw, 8)), o), inv));
+  }
+  return i;
+}
+
+static int _decode_block(const unsigned short *regs, int count, bool is_signed, float offset, float inv_gain, float *values)
+{
+  __m128 o = _mm_set1_ps(offset), inv = _mm_set1_ps(inv_gain);
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_cvtepi32_ps(_load_regs(regs + i, is_signed));
+    _mm_storeu_ps(values + i, _mm_mul_ps(_mm_sub_ps(x, o), inv));
+  }
+  return i;
+}
+#else
+template <typename T>
+static int _encode_block(const T *values, int count, T gain, T offset, T lo, T hi, bool is_signed, unsigned short *regs) { return 0; }
+template <typename T>
+static int _decode_block(const unsigned short *regs, int count, bool is_signed, T offset, T inv_gain, T *values) { return 0; }
+#endif
+
+template <typename T>
+static int _encode(const ModbusScale *scale, const T *values, int count, unsigned short *regs, bool simd)
+{
+  if (count < 0) return -1;
+  T gain = (T)scale->gain, offset = (T)scale->offset;
+  T lo = scale->is_signed ? -32768 : 0;
+  T hi = scale->is_signed ? 32767 : 65535;
+  int done = simd ? _encode_block(values, count, gain, offset, lo, hi, scale->is_signed, regs) : 0;
+  _encode_scalar(values + done, count - done, gain, offset, lo, hi, regs + done);
+  return 0;
+}
+
+template <typename T>
+static int _decode(const ModbusScale *scale, const unsigned short *regs, int count, T *values, bool simd)
+{
+  if (count < 0 || scale->gain == 0 || !isfinite(scale->gain)) return -1;
+  T offset = (T)scale->offset, inv_gain = (T)(1.0 / scale->gain);
+  int done = simd ? _decode_block(regs, count, scale->is_signed, offset, inv_gain, values) : 0;
+  _decode_scalar(regs + done, count - done, scale->is_signed, offset, inv_gain, values + done);
+  return 0;
+}
+
+int ModbusScale::encode(const double *values, int count, unsigned short *regs) const
+{
+  return _encode(this, values, count, regs, true);
+}
+
+int ModbusScale::encode(const float *values, int count, unsigned short *regs) const
+{
+  return _encode(this, values, count, regs, true);
+}
+
+int ModbusScale::decode(const unsigned short *regs, int count, double *values) const
+{
+  return _decode(this, regs, count, values, true);
+}
+
+int ModbusScale::decode(const unsigned short *regs, int count, float *values) const
+{
+  return _decode(this, regs, count, values, true);
+}
+
+int ModbusScale::encode_scalar(const double *values, int count, unsigned short *regs) const
+{
+  return _encode(this, values, count, regs, false);
+}
+
+int ModbusScale::decode_scalar(const unsigned short *regs, int count, double *values) const
+{
+  return _decode(this, regs, count, values, false);
+}
+
+/**************** ModbusScaleTable *****************/
+
+ModbusScaleTable::ModbusScaleTable()
+{
+  ranges_ = NULL;
+  range_count_ = 0;
+  range_capacity_ = 0;
+}
+
+ModbusScaleTable::~ModbusScaleTable()
+{
+  for (int i = 0; i < range_count_; i++) {
+    delete[] ranges_[i].values;
+  }
+  if (ranges_ != NULL) delete[] ranges_;
+}
+
+int ModbusScaleTable::_lower_bound(int inx)
+{
+  // 第一个结束位置大于inx的区间
+  int low = 0;
+  int high = range_count_;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (ranges_[mid].inx + ranges_[mid].count <= inx) low = mid + 1;
+    else high = mid;
+  }
+  return low;
+}
+
+int ModbusScaleTable::add(int inx, int count, const ModbusScale &scale)
+{
+  if (inx < 0 || count < 1 || scale.gain == 0) return -1;
+  int pos = _lower_bound(inx);
+  if (pos < range_count_ && ranges_[pos].inx < inx + count) return -1;
+
+  if (range_count_ == range_capacity_) {
+    int capacity = range_capacity_ > 0 ? range_capacity_ * 2 : 4;
+    Range *ranges = new Range[capacity];
+    for (int i = 0; i < range_count_; i++) ranges[i] = ranges_[i];
+    if (ranges_ != NULL) delete[] ranges_;
+    ranges_ = ranges;
+    range_capacity_ = capacity;
+  }
+  for (int i = range_count_; i > pos; i--) ranges_[i] = ranges_[i - 1];
+  Range &range = ranges_[pos];
+  range.inx = inx;
+  range.count = count;
+  range.scale = scale;
+  range.values = new double[count];
+  memset(range.values, 0, count * sizeof(double));
+  range_count_++;
+  return 0;
+}
+
+ModbusScaleTable::Range *ModbusScaleTable::find(int inx)
+{
+  int pos = _lower_bound(inx);
+  if (pos < range_count_ && ranges_[pos].inx <= inx) return &ranges_[pos];
+  return NULL;
+}
+
+bool ModbusScaleTable::covers(int inx, int count)
+{
+  int end = inx + count;
+  for (int pos = _lower_bound(inx); inx < end; pos++) {
+    if (pos >= range_count_ || ranges_[pos].inx > inx) return false;
+    inx = ranges_[pos].inx + ranges_[pos].count;
+  }
+  return true;
+}
+
+void ModbusScaleTable::decode(int inx, const unsigned short *regs, int count)
+{
+  int end = inx + count;
+  for (int pos = _lower_bound(inx); pos < range_count_ && ranges_[pos].inx < end; pos++) {
+    Range &range = ranges_[pos];
+    int lo = range.inx > inx ? range.inx : inx;
+    int hi = range.inx + range.count < end ? range.inx + range.count : end;
+    range.scale.decode(regs + (lo - inx), hi - lo, range.values + (lo - range.inx));
+  }
+}
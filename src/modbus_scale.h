@@ -0,0 +1,101 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_SCALE_H_
+#define _MODBUS_SCALE_H_
+
+/* ModbusScale: 工程量(float/double)和16位寄存器原始值的线性转换
+ * 1. 写入: raw = round(value * gain + offset), 限幅到int16(-32768~32767)或uint16(0~65535), NaN写入0
+ * 2. 读取: value = (raw - offset) / gain, raw按有符号或无符号解释
+ * 3. 按数组批量转换, x86上用SSE2每次处理2个double或4个float, 其它平台逐个转换, 两者结果一致
+ * 4. 舍入使用当前的浮点舍入模式(默认四舍六入五成双)
+ */
+struct ModbusScale {
+  double gain;     // 增益
+  double offset;   // 偏移
+  bool is_signed;  // 寄存器是否为有符号数(int16)
+
+  ModbusScale(double gain = 1.0, double offset = 0.0, bool is_signed = false)
+  : gain(gain), offset(offset), is_signed(is_signed) {}
+
+  /* encode: 工程量数组转换为寄存器数组
+   * @param values: 工程量数组
+   * @param count: 个数
+   * @param regs: 寄存器数组, 大小不能小于count
+   * :return: 成功返回0, 参数错误返回-1
+   */
+  int encode(const double *values, int count, unsigned short *regs) const;
+  int encode(const float *values, int count, unsigned short *regs) const;
+
+  /* decode: 寄存器数组转换为工程量数组
+   * @param regs: 寄存器数组
+   * @param count: 个数
+   * @param values: 工程量数组, 大小不能小于count
+   * :return: 成功返回0, 参数错误(包括gain为0)返回-1
+   */
+  int decode(const unsigned short *regs, int count, double *values) const;
+  int decode(const unsigned short *regs, int count, float *values) const;
+
+  /* encode_scalar/decode_scalar: 逐个转换(不用SIMD), 用于对比和校验 */
+  int encode_scalar(const double *values, int count, unsigned short *regs) const;
+  int decode_scalar(const unsigned short *regs, int count, double *values) const;
+};
+
+/* ModbusScaleTable: 一组寄存器(保持寄存器或输入寄存器)按区间的线性转换表, 见ModbusDataTemplate::set_holding_scale
+ * 1. 区间按起始下标排序, 互不重叠, 查找用二分
+ * 2. 每个区间保存解码后的工程量(double), 寄存器写入后由decode批量更新, 读取时不再转换
+ * 3. 添加区间时申请内存, 转换时没有内存申请; 和寄存器一样, 多个线程同时读写需要调用者自己加锁
+ */
+class ModbusScaleTable
+{
+public:
+  struct Range {
+    int inx;            // 起始下标(相对寄存器的起始地址)
+    int count;          // 寄存器个数
+    ModbusScale scale;
+    double *values;     // 解码后的工程量
+  };
+
+  ModbusScaleTable();
+  ~ModbusScaleTable();
+
+  /* add: 添加一个区间, 解码后的工程量初始为0
+   * @param inx: 起始下标
+   * @param count: 寄存器个数
+   * @param scale: 线性转换的参数
+   * :return: 成功返回0, 参数错误(包括gain为0)或者和已有的区间重叠返回-1
+   */
+  int add(int inx, int count, const ModbusScale &scale);
+
+  /* find: 查找包含下标inx的区间, 没有返回NULL */
+  Range *find(int inx);
+
+  /* covers: [inx, inx + count)是否全部在区间内(可以跨多个相邻的区间) */
+  bool covers(int inx, int count);
+
+  /* decode: 把写入后的寄存器原始数据批量解码到和[inx, inx + count)重叠的区间
+   * @param inx: regs[0]对应的下标
+   * @param regs: 寄存器原始数据
+   * @param count: 个数
+   */
+  void decode(int inx, const unsigned short *regs, int count);
+
+  /* get_range_count: 获取区间数 */
+  int get_range_count(void) { return range_count_; }
+
+private:
+  int _lower_bound(int inx);
+
+private:
+  Range *ranges_;     // 按起始下标排序
+  int range_count_;
+  int range_capacity_;
+};
+
+#endif // _MODBUS_SCALE_H_
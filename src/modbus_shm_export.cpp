@@ -0,0 +1,296 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "modbus_shm_export.h"
+#include "modbus_log.h"
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "shared memory needs lock-free atomics");
+
+static inline int _value_size(int type)
+{
+  return type == SHM_COIL_BITS || type == SHM_INPUT_BITS ? 1 : 2;
+}
+
+/************************* ModbusShmExport ***************************/
+
+ModbusShmExport::ModbusShmExport(const char *path)
+{
+  path_ = strdup(path);
+  header_ = NULL;
+  map_size_ = 0;
+  publishing_ = false;
+}
+
+ModbusShmExport::~ModbusShmExport()
+{
+  close();
+  free(path_);
+}
+
+int ModbusShmExport::open(const int start_addrs[MODBUS_SHM_TABLES], const int counts[MODBUS_SHM_TABLES])
+{
+  close();
+  ModbusShmTable tables[MODBUS_SHM_TABLES];
+  // 文件头按缓存行对齐, 后面依次是四张表的页
+  size_t size = (sizeof(ModbusShmHeader) + 63) / 64 * 64;
+  for (int i = 0; i < MODBUS_SHM_TABLES; i++) {
+    if (counts[i] < 0 || start_addrs[i] < 0) return -1;
+    int per_page = MODBUS_SHM_PAGE_BYTES / _value_size(i);
+    tables[i].start_addr = start_addrs[i];
+    tables[i].count = counts[i];
+    tables[i].value_size = _value_size(i);
+    tables[i].page_count = (counts[i] + per_page - 1) / per_page;
+    tables[i].offset = size;
+    size += (size_t)tables[i].page_count * sizeof(ModbusShmPage);
+  }
+
+  unlink(path_);
+  int fd = ::open(path_, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    MODBUS_LOG_ERROR("open shm export %s failed", path_);
+    return -1;
+  }
+  if (ftruncate(fd, size) != 0) {
+    MODBUS_LOG_ERROR("resize shm export %s failed", path_);
+    ::close(fd);
+    return -1;
+  }
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    MODBUS_LOG_ERROR("mmap shm export %s failed", path_);
+    return -1;
+  }
+
+  // ftruncate扩展的部分为0, 序号和代数都从0开始
+  header_ = (ModbusShmHeader *)addr;
+  map_size_ = size;
+  header_->version = MODBUS_SHM_VERSION;
+  header_->page_bytes = MODBUS_SHM_PAGE_BYTES;
+  header_->page_size = sizeof(ModbusShmPage);
+  header_->total_size = size;
+  memcpy(header_->tables, tables, sizeof(tables));
+  header_->magic.store(MODBUS_SHM_MAGIC, std::memory_order_release);
+  publishing_ = false;
+  return 0;
+}
+
+void ModbusShmExport::close(void)
+{
+  if (header_ == NULL) return;
+  commit();
+  munmap(header_, map_size_);
+  header_ = NULL;
+  map_size_ = 0;
+}
+
+ModbusShmPage *ModbusShmExport::_page(int type, int page_no)
+{
+  return (ModbusShmPage *)((char *)header_ + header_->tables[type].offset) + page_no;
+}
+
+int ModbusShmExport::publish(int type, int inx, const void *data, int count)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return -1;
+  const ModbusShmTable &table = header_->tables[type];
+  int per_page = MODBUS_SHM_PAGE_BYTES / table.value_size;
+  if (inx < 0 || count < 0 || inx % per_page != 0 || inx + count > (int)table.count) return -1;
+
+  const unsigned char *src = (const unsigned char *)data;
+  int changed = 0;
+  for (int done = 0; done < count; done += per_page) {
+    int bytes = (count - done < per_page ? count - done : per_page) * table.value_size;
+    ModbusShmPage *page = _page(type, (inx + done) / per_page);
+    // 只有发布者写共享内存, 可以直接比较
+    if (memcmp(page->data, src + done * table.value_size, bytes) == 0) continue;
+    if (!publishing_) {
+      header_->generation.store(header_->generation.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      publishing_ = true;
+    }
+    uint32_t seq = page->seq.load(std::memory_order_relaxed);
+    page->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(page->data, src + done * table.value_size, bytes);
+    page->seq.store(seq + 2, std::memory_order_release);
+    changed++;
+  }
+  return changed;
+}
+
+void ModbusShmExport::commit(void)
+{
+  if (header_ == NULL || !publishing_) return;
+  header_->generation.store(header_->generation.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  publishing_ = false;
+}
+
+int ModbusShmExport::get_values_per_page(int type)
+{
+  if (type < 0 || type >= MODBUS_SHM_TABLES) return -1;
+  return MODBUS_SHM_PAGE_BYTES / _value_size(type);
+}
+
+uint64_t ModbusShmExport::get_generation(void)
+{
+  return header_ != NULL ? header_->generation.load(std::memory_order_acquire) : 0;
+}
+
+/************************* ModbusShmReader ***************************/
+
+ModbusShmReader::ModbusShmReader()
+{
+  header_ = NULL;
+  map_size_ = 0;
+}
+
+ModbusShmReader::~ModbusShmReader()
+{
+  close();
+}
+
+int ModbusShmReader::open(const char *path)
+{
+  close();
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return -1;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ModbusShmHeader)) {
+    ::close(fd);
+    return -1;
+  }
+  void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) return -1;
+
+  const ModbusShmHeader *header = (const ModbusShmHeader *)addr;
+  bool valid = header->magic.load(std::memory_order_acquire) == MODBUS_SHM_MAGIC && header->version == MODBUS_SHM_VERSION
+    && header->page_bytes == MODBUS_SHM_PAGE_BYTES && header->page_size == sizeof(ModbusShmPage)
+    && header->total_size <= (uint64_t)st.st_size;
+  for (int i = 0; valid && i < MODBUS_SHM_TABLES; i++) {
+    const ModbusShmTable &table = header->tables[i];
+    valid = table.value_size == (uint32_t)_value_size(i)
+      && table.offset + (uint64_t)table.page_count * sizeof(ModbusShmPage) <= header->total_size
+      && (uint64_t)table.page_count * (MODBUS_SHM_PAGE_BYTES / table.value_size) >= table.count;
+  }
+  if (!valid) {
+    munmap(addr, st.st_size);
+    return -1;
+  }
+  header_ = header;
+  map_size_ = st.st_size;
+  return 0;
+}
+
+void ModbusShmReader::close(void)
+{
+  if (header_ == NULL) return;
+  munmap((void *)header_, map_size_);
+  header_ = NULL;
+  map_size_ = 0;
+}
+
+int ModbusShmReader::get_start_addr(int type)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return -1;
+  return header_->tables[type].start_addr;
+}
+
+int ModbusShmReader::get_count(int type)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return -1;
+  return header_->tables[type].count;
+}
+
+uint64_t ModbusShmReader::get_generation(void)
+{
+  return header_ != NULL ? header_->generation.load(std::memory_order_acquire) : 0;
+}
+
+const ModbusShmPage *ModbusShmReader::_page(int type, int page_no)
+{
+  return (const ModbusShmPage *)((const char *)header_ + header_->tables[type].offset) + page_no;
+}
+
+/* 按页拷贝, 每页用顺序锁检查: 序号为奇数(正在写)或者拷贝前后不一致就重新拷贝这一页 */
+int ModbusShmReader::_copy(int type, int inx, int count, unsigned char *dst)
+{
+  int value_size = header_->tables[type].value_size;
+  int per_page = MODBUS_SHM_PAGE_BYTES / value_size;
+  while (count > 0) {
+    int offset = inx % per_page;
+    int n = per_page - offset < count ? per_page - offset : count;
+    const ModbusShmPage *page = _page(type, inx / per_page);
+    int spins = 0;
+    while (true) {
+      uint32_t seq = page->seq.load(std::memory_order_acquire);
+      if ((seq & 1) == 0) {
+        memcpy(dst, page->data + offset * value_size, n * value_size);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (page->seq.load(std::memory_order_relaxed) == seq) break;
+      }
+      if (++spins > MODBUS_SHM_MAX_SPINS) return -1;
+      if ((spins & 63) == 0) sched_yield();
+    }
+    dst += n * value_size;
+    inx += n;
+    count -= n;
+  }
+  return 0;
+}
+
+int ModbusShmReader::read(int type, int addr, int count, void *values)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return -1;
+  int inx = addr - (int)header_->tables[type].start_addr;
+  if (count < 0 || inx < 0 || inx + count > (int)header_->tables[type].count) return -1;
+  return _copy(type, inx, count, (unsigned char *)values);
+}
+
+int ModbusShmReader::read_snapshot(int type, int addr, int count, void *values, uint64_t *generation, int max_retries)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return -1;
+  int inx = addr - (int)header_->tables[type].start_addr;
+  if (count < 0 || inx < 0 || inx + count > (int)header_->tables[type].count) return -1;
+  for (int i = 0; i <= max_retries; i++) {
+    uint64_t gen = header_->generation.load(std::memory_order_acquire);
+    if ((gen & 1) == 0 && _copy(type, inx, count, (unsigned char *)values) == 0) {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (header_->generation.load(std::memory_order_relaxed) == gen) {
+        if (generation != NULL) *generation = gen;
+        return 0;
+      }
+    }
+    sched_yield();
+  }
+  return -1;
+}
+
+const unsigned char *ModbusShmReader::get_page(int type, int page_no, uint32_t *seq)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return NULL;
+  if (page_no < 0 || page_no >= (int)header_->tables[type].page_count) return NULL;
+  const ModbusShmPage *page = _page(type, page_no);
+  *seq = page->seq.load(std::memory_order_acquire);
+  return page->data;
+}
+
+bool ModbusShmReader::check_page(int type, int page_no, uint32_t seq)
+{
+  if (header_ == NULL || type < 0 || type >= MODBUS_SHM_TABLES) return false;
+  if (page_no < 0 || page_no >= (int)header_->tables[type].page_count) return false;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return (seq & 1) == 0 && _page(type, page_no)->seq.load(std::memory_order_relaxed) == seq;
+}
@@ -0,0 +1,173 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_SHM_EXPORT_H_
+#define _MODBUS_SHM_EXPORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#define MODBUS_SHM_MAGIC      0x4D425348 // "MBSH"
+#define MODBUS_SHM_VERSION    1
+#define MODBUS_SHM_PAGE_BYTES 128        // 每页的数据字节数(64个寄存器或128个线圈)
+#define MODBUS_SHM_TABLES     4
+#define MODBUS_SHM_MAX_SPINS  100000     // 读者等待一页写完的最多次数(发布者在写入时退出的情况)
+
+enum ModbusShmType {
+  SHM_COIL_BITS = 0,    // 线圈状态寄存器, 每个值1个字节(0/1)
+  SHM_INPUT_BITS = 1,   // 离散输入寄存器, 每个值1个字节(0/1)
+  SHM_HOLDING_REGS = 2, // 保持寄存器, 每个值2个字节(本机字节序)
+  SHM_INPUT_REGS = 3    // 输入寄存器, 每个值2个字节(本机字节序)
+};
+
+/* 共享内存的布局: 文件头 + 每张表的页数组, 所有偏移都相对于映射的起始地址 */
+struct ModbusShmTable {
+  uint32_t start_addr;  // 起始地址
+  uint32_t count;       // 个数
+  uint32_t value_size;  // 每个值的字节数
+  uint32_t page_count;  // 页数
+  uint64_t offset;      // 第一页的偏移
+};
+
+struct ModbusShmHeader {
+  std::atomic<uint32_t> magic;      // 布局写完后最后写入, 读者以此判断是否可用
+  uint32_t version;
+  uint32_t page_bytes;              // 每页的数据字节数
+  uint32_t page_size;               // 每页占用的字节数(序号 + 数据)
+  std::atomic<uint64_t> generation; // 发布的代数, 发布期间为奇数, 发布完成后为偶数
+  uint64_t total_size;              // 映射的总大小
+  ModbusShmTable tables[MODBUS_SHM_TABLES];
+};
+
+/* 每页一个顺序锁: 写入前序号加1(奇数), 写完再加1(偶数), 序号和数据不在同一个缓存行 */
+struct ModbusShmPage {
+  std::atomic<uint32_t> seq;
+  char pad[60];
+  unsigned char data[MODBUS_SHM_PAGE_BYTES];
+};
+
+/* ModbusShmExport: 把寄存器的值发布到共享内存, 监控工具从另一个进程只读映射, 不需要经过Modbus TCP
+ * 1. 由ModbusDataTemplate::set_shm_export创建布局, publish_shm_export发布(一般在控制循环或者服务器线程周期调用)
+ * 2. 发布时逐页和共享内存里的值比较, 只有变化了的页才加锁写入, 没有变化时读者不会重试
+ * 3. 只能有一个发布者
+ */
+class ModbusShmExport
+{
+public:
+  /* ModbusShmExport: 构造导出实例
+   * @param path: 共享内存文件路径, 一般在/dev/shm下
+   */
+  ModbusShmExport(const char *path);
+  ~ModbusShmExport();
+
+  /* open: 创建共享内存文件并建立布局, 所有的值初始为0
+   * 已有的文件先删除再创建, 已经映射了旧文件的读者不受影响(需要重新open才能看到新的)
+   * @param start_addrs: 四张表的起始地址, 顺序见ModbusShmType
+   * @param counts: 四张表的个数
+   * :return: 成功返回0, 失败返回-1
+   */
+  int open(const int start_addrs[MODBUS_SHM_TABLES], const int counts[MODBUS_SHM_TABLES]);
+
+  /* close: 解除映射(文件保留, 读者已经建立的映射仍然可用) */
+  void close(void);
+
+  /* publish: 发布一张表里的一段值
+   * @param type: 表, 见ModbusShmType
+   * @param inx: 起始下标(相对于起始地址), 必须是每页的值个数的整数倍
+   * @param data: 值的数组
+   * @param count: 个数
+   * :return: 写入的页数(变化了的页), 参数错误返回-1
+   */
+  int publish(int type, int inx, const void *data, int count);
+
+  /* commit: 结束一次发布, 有页变化时代数加1(变为偶数) */
+  void commit(void);
+
+  /* get_values_per_page: 每页的值个数 */
+  int get_values_per_page(int type);
+
+  /* get_generation: 获取当前的代数 */
+  uint64_t get_generation(void);
+
+private:
+  ModbusShmPage *_page(int type, int page_no);
+
+private:
+  char *path_;
+  ModbusShmHeader *header_;
+  size_t map_size_;
+  bool publishing_; // 这次发布是否已经有页变化(代数为奇数)
+};
+
+/* ModbusShmReader: 只读映射导出的共享内存, 在监控工具的进程里使用
+ * 1. read按页用顺序锁保证每页的一致性, 发布很频繁时也不会阻塞发布者
+ * 2. read_snapshot在两次读到相同的偶数代数之间拷贝, 保证整段(跨页)一致
+ * 3. get_page/check_page可以不拷贝, 直接在映射的内存上处理完再检查序号
+ */
+class ModbusShmReader
+{
+public:
+  ModbusShmReader();
+  ~ModbusShmReader();
+
+  /* open: 只读映射共享内存文件
+   * :return: 成功返回0, 文件不存在、格式或版本不对返回-1
+   */
+  int open(const char *path);
+
+  /* close: 解除映射 */
+  void close(void);
+
+  /* get_start_addr/get_count: 获取一张表的起始地址和个数 */
+  int get_start_addr(int type);
+  int get_count(int type);
+
+  /* get_generation: 获取当前的代数(奇数表示正在发布) */
+  uint64_t get_generation(void);
+
+  /* read: 读取一段值, 每页内一致
+   * @param type: 表, 见ModbusShmType
+   * @param addr: 起始地址
+   * @param count: 个数
+   * @param values: 存储值的数组(线圈为uchar, 寄存器为ushort), 大小不能小于count
+   * :return: 成功返回0, 地址非法返回-1
+   */
+  int read(int type, int addr, int count, void *values);
+
+  /* read_snapshot: 读取一段值, 整段一致(和同一次发布的结果相同)
+   * @param generation: 输出快照对应的代数, 可以为NULL
+   * @param max_retries: 发布期间的最多重试次数
+   * :return: 成功返回0, 地址非法或者重试次数用完返回-1
+   */
+  int read_snapshot(int type, int addr, int count, void *values, uint64_t *generation = NULL, int max_retries = 1000);
+
+  /* get_page: 获取一页数据在映射里的地址(不拷贝)
+   * @param type: 表
+   * @param page_no: 页号, 每页的值个数为MODBUS_SHM_PAGE_BYTES / 值的字节数
+   * @param seq: 输出页的序号, 处理完数据后交给check_page检查
+   * :return: 数据的地址, 页号非法返回NULL; 正在写入时也返回地址, 由check_page判断
+   */
+  const unsigned char *get_page(int type, int page_no, uint32_t *seq);
+
+  /* check_page: 检查get_page之后这一页有没有被改写
+   * :return: 数据一致返回true, 需要重新读取返回false
+   */
+  bool check_page(int type, int page_no, uint32_t seq);
+
+private:
+  const ModbusShmPage *_page(int type, int page_no);
+  int _copy(int type, int inx, int count, unsigned char *dst);
+
+private:
+  const ModbusShmHeader *header_;
+  size_t map_size_;
+};
+
+#endif // _MODBUS_SHM_EXPORT_H_
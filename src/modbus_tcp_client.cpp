@@ -0,0 +1,474 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "modbus_tcp_client.h"
+
+#define CLIENT_FRAME_MAX_SIZE 260
+#define CLIENT_RX_BUF_SIZE (64 * 1024)
+#define CLIENT_NO_DEADLINE UINT64_MAX
+
+namespace ModbusTCP
+{
+  static uint64_t client_now_ms(void)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+  /* client_deadline: 超时对应的截止时间, 超时为负数时一直等待 */
+  static uint64_t client_deadline(int timeout_ms)
+  {
+    return timeout_ms < 0 ? CLIENT_NO_DEADLINE : client_now_ms() + timeout_ms;
+  }
+
+  /* client_poll: 等待fd可读/可写直到截止时间, 被信号打断时按剩余时间继续等待
+   * @param fd: socket
+   * @param events: POLLIN/POLLOUT
+   * @param deadline_ms: 截止时间(client_now_ms), 已经过了也会检查一次
+   * :return: 就绪返回1, 超时返回0, 出错返回-1
+   */
+  static int client_poll(int fd, short events, uint64_t deadline_ms)
+  {
+    while (true) {
+      int wait_ms = -1;
+      if (deadline_ms != CLIENT_NO_DEADLINE) {
+        uint64_t now = client_now_ms();
+        wait_ms = deadline_ms > now ? (int)(deadline_ms - now) : 0;
+      }
+      struct pollfd pfd = { fd, events, 0 };
+      int ret = poll(&pfd, 1, wait_ms);
+      if (ret < 0 && errno == EINTR) continue;
+      return ret;
+    }
+  }
+
+  Client::Client(int max_inflight, unsigned char unit_id)
+  : unit_id_(unit_id)
+  {
+    fd_ = -1;
+    timeout_ms_ = 3000;
+    max_inflight_ = 1;
+    while (max_inflight_ < max_inflight && max_inflight_ < 0x8000) max_inflight_ <<= 1;
+    slots_ = new InflightSlot[max_inflight_];
+    for (int i = 0; i < max_inflight_; i++) {
+      slots_[i].req_inx = -1;
+      slots_[i].tid = 0;
+      slots_[i].gen = 0;
+    }
+    frame_ = new DataFrame(CLIENT_FRAME_MAX_SIZE);
+    tx_buf_ = new unsigned char[max_inflight_ * CLIENT_FRAME_MAX_SIZE];
+    tx_length_ = 0;
+    // 接收缓冲区至少能放下所有在途请求的回复
+    rx_buf_size_ = max_inflight_ * CLIENT_FRAME_MAX_SIZE * 2;
+    if (rx_buf_size_ < CLIENT_RX_BUF_SIZE) rx_buf_size_ = CLIENT_RX_BUF_SIZE;
+    rx_buf_ = new unsigned char[rx_buf_size_];
+    rx_length_ = 0;
+  }
+
+  Client::~Client()
+  {
+    disconnect();
+    delete[] slots_;
+    delete frame_;
+    delete[] tx_buf_;
+    delete[] rx_buf_;
+  }
+
+  int Client::connect(const char *ip, int port, int timeout_ms)
+  {
+    disconnect();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1) return CLIENT_INVALID_REQUEST;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return CLIENT_SOCKET_ERROR;
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int ret = ::connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (ret < 0 && errno == EINPROGRESS) {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      if (client_poll(fd, POLLOUT, client_deadline(timeout_ms)) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+        ret = 0;
+      }
+    }
+    if (ret < 0) {
+      close(fd);
+      return CLIENT_SOCKET_ERROR;
+    }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    fd_ = fd;
+    rx_length_ = 0;
+    return EXP_NONE;
+  }
+
+  void Client::disconnect(void)
+  {
+    if (fd_ >= 0) {
+      close(fd_);
+      fd_ = -1;
+    }
+    rx_length_ = 0;
+  }
+
+  int Client::_encode(ClientRequest *req, unsigned short tid, DataFrame *frame)
+  {
+    unsigned char mbap[8] = { 0 };
+    HexData::bin16_to_8(tid, mbap);
+    mbap[6] = unit_id_;
+    mbap[7] = req->func_code;
+    frame->set_raw_data(mbap, 8);
+    if (req->raw_pdu != NULL) {
+      if (req->raw_pdu_length < 1 || req->raw_pdu_length > 253) return CLIENT_INVALID_REQUEST;
+      frame->add_pdu_data((void *)(req->raw_pdu + 1), req->raw_pdu_length - 1);
+      frame->update_mbap_length();
+      return EXP_NONE;
+    }
+    unsigned char tmp[4];
+    HexData::bin16_to_8(req->addr, tmp);
+    switch (req->func_code) {
+      case MODBUS_FC_READ_COILS:
+      case MODBUS_FC_READ_DISCRETE_INPUTS:
+      case MODBUS_FC_READ_HOLDING_REGS:
+      case MODBUS_FC_READ_INPUT_REGS: {
+        int max_quantity = req->func_code <= MODBUS_FC_READ_DISCRETE_INPUTS ? 0x07D0 : 0x007D;
+        if (req->quantity < 1 || req->quantity > max_quantity) return CLIENT_INVALID_REQUEST;
+        HexData::bin16_to_8(req->quantity, tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        break;
+      }
+      case MODBUS_FC_WRITE_SINGLE_COIL:
+        HexData::bin16_to_8(((unsigned char *)req->data)[0] ? 0xFF00 : 0x0000, tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        break;
+      case MODBUS_FC_WRITE_SINGLE_REG:
+        HexData::bin16_to_8(((unsigned short *)req->data)[0], tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        break;
+      case MODBUS_FC_WRITE_MULTIPLE_COILS: {
+        if (req->quantity < 1 || req->quantity > 0x07B0) return CLIENT_INVALID_REQUEST;
+        HexData::bin16_to_8(req->quantity, tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        unsigned char byte_count = (req->quantity + 7) / 8;
+        frame->add_pdu_data(&byte_count, 1);
+        unsigned char bytes[0x07B0 / 8] = { 0 };
+        unsigned char *bits = (unsigned char *)req->data;
+        for (int i = 0; i < req->quantity; i++) {
+          if (bits[i]) bytes[i / 8] |= (1 << (i % 8));
+        }
+        frame->add_pdu_data(bytes, byte_count);
+        break;
+      }
+      case MODBUS_FC_WRITE_MULTIPLE_REGS: {
+        if (req->quantity < 1 || req->quantity > 0x007B) return CLIENT_INVALID_REQUEST;
+        HexData::bin16_to_8(req->quantity, tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        unsigned char byte_count = req->quantity * 2;
+        frame->add_pdu_data(&byte_count, 1);
+        unsigned short *regs = (unsigned short *)req->data;
+        for (int i = 0; i < req->quantity; i++) {
+          HexData::bin16_to_8(regs[i], tmp);
+          frame->add_pdu_data(tmp, 2);
+        }
+        break;
+      }
+      case MODBUS_FC_MASK_WRITE_REG: {
+        unsigned short *masks = (unsigned short *)req->data;
+        frame->add_pdu_data(tmp, 2);
+        HexData::bin16_to_8(masks[0], tmp);
+        HexData::bin16_to_8(masks[1], tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        break;
+      }
+      case MODBUS_FC_WRITE_AND_READ_REGS: {
+        if (req->quantity < 1 || req->quantity > 0x007D || req->w_quantity < 1 || req->w_quantity > 0x0079)
+          return CLIENT_INVALID_REQUEST;
+        HexData::bin16_to_8(req->quantity, tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        HexData::bin16_to_8(req->w_addr, tmp);
+        HexData::bin16_to_8(req->w_quantity, tmp + 2);
+        frame->add_pdu_data(tmp, 4);
+        unsigned char byte_count = req->w_quantity * 2;
+        frame->add_pdu_data(&byte_count, 1);
+        for (int i = 0; i < req->w_quantity; i++) {
+          HexData::bin16_to_8(req->w_data[i], tmp);
+          frame->add_pdu_data(tmp, 2);
+        }
+        break;
+      }
+      default:
+        return CLIENT_INVALID_REQUEST;
+    }
+    frame->update_mbap_length();
+    return EXP_NONE;
+  }
+
+  int Client::_decode(ClientRequest *req, const unsigned char *res, int length)
+  {
+    const unsigned char *pdu = res + 7;
+    int pdu_length = length - 7;
+    if (pdu_length < 2) return CLIENT_INVALID_RESPONSE;
+    if (req->raw_response != NULL) {
+      req->raw_response->set_raw_data((unsigned char *)res, length);
+      return EXP_NONE;
+    }
+    if (pdu[0] == (req->func_code | 0x80)) return pdu[1];
+    if (pdu[0] != req->func_code) return CLIENT_INVALID_RESPONSE;
+    switch (req->func_code) {
+      case MODBUS_FC_READ_COILS:
+      case MODBUS_FC_READ_DISCRETE_INPUTS: {
+        int byte_count = pdu[1];
+        if (byte_count != (req->quantity + 7) / 8 || pdu_length < 2 + byte_count) return CLIENT_INVALID_RESPONSE;
+        unsigned char *bits = (unsigned char *)req->data;
+        for (int i = 0; i < req->quantity; i++) {
+          bits[i] = (pdu[2 + i / 8] >> (i % 8)) & 0x01;
+        }
+        break;
+      }
+      case MODBUS_FC_READ_HOLDING_REGS:
+      case MODBUS_FC_READ_INPUT_REGS:
+      case MODBUS_FC_WRITE_AND_READ_REGS: {
+        int byte_count = pdu[1];
+        if (byte_count != req->quantity * 2 || pdu_length < 2 + byte_count) return CLIENT_INVALID_RESPONSE;
+        unsigned short *regs = (unsigned short *)req->data;
+        for (int i = 0; i < req->quantity; i++) {
+          regs[i] = HexData::bin8_to_u16((unsigned char *)pdu + 2 + i * 2);
+        }
+        break;
+      }
+      default:
+        // 写操作的回复是请求的回显, 不需要解析
+        break;
+    }
+    return EXP_NONE;
+  }
+
+  int Client::_send(const unsigned char *data, int length, uint64_t deadline_ms)
+  {
+    while (length > 0) {
+      ssize_t n = send(fd_, data, length, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          int ret = client_poll(fd_, POLLOUT, deadline_ms);
+          if (ret < 0) return CLIENT_SOCKET_ERROR;
+          if (ret == 0) return CLIENT_TIMEOUT;
+          continue;
+        }
+        return CLIENT_SOCKET_ERROR;
+      }
+      data += n;
+      length -= n;
+    }
+    return EXP_NONE;
+  }
+
+  void Client::_fail_inflight(ClientRequest *reqs, int code)
+  {
+    for (int i = 0; i < max_inflight_; i++) {
+      if (slots_[i].req_inx >= 0) {
+        reqs[slots_[i].req_inx].code = code;
+        slots_[i].req_inx = -1;
+      }
+    }
+  }
+
+  int Client::execute(ClientRequest *reqs, int count)
+  {
+    if (fd_ < 0) {
+      for (int i = 0; i < count; i++) reqs[i].code = CLIENT_NOT_CONNECTED;
+      return CLIENT_NOT_CONNECTED;
+    }
+    int next = 0;     // 下一个要发送的请求
+    int inflight = 0; // 在途的请求数
+    int free_slot = 0;
+    while (next < count || inflight > 0) {
+      // 填满发送窗口, 一次send发送; 每个请求从发送时开始计算超时
+      tx_length_ = 0;
+      uint64_t deadline_ms = client_deadline(timeout_ms_);
+      while (next < count && inflight < max_inflight_) {
+        while (slots_[free_slot].req_inx >= 0) free_slot = (free_slot + 1) & (max_inflight_ - 1);
+        InflightSlot *slot = &slots_[free_slot];
+        // 事务标识的低位就是槽位号, 收到回复时可以直接定位槽位
+        unsigned short tid = (unsigned short)(slot->gen++ * max_inflight_ + free_slot);
+        int code = _encode(&reqs[next], tid, frame_);
+        if (code != EXP_NONE) {
+          reqs[next++].code = code;
+          continue;
+        }
+        memcpy(tx_buf_ + tx_length_, frame_->raw_data, frame_->data_length);
+        tx_length_ += frame_->data_length;
+        slot->req_inx = next++;
+        slot->tid = tid;
+        slot->deadline_ms = deadline_ms;
+        inflight++;
+      }
+      if (tx_length_ > 0) {
+        int code = _send(tx_buf_, tx_length_, deadline_ms);
+        if (code != EXP_NONE) {
+          _fail_inflight(reqs, code);
+          for (; next < count; next++) reqs[next].code = code;
+          disconnect();
+          return code;
+        }
+      }
+      if (inflight == 0) break;
+
+      // 接收回复, 每收到一帧就释放对应的槽位; 最多等到最早发送的请求超时
+      deadline_ms = CLIENT_NO_DEADLINE;
+      for (int i = 0; i < max_inflight_; i++) {
+        if (slots_[i].req_inx >= 0 && slots_[i].deadline_ms < deadline_ms) deadline_ms = slots_[i].deadline_ms;
+      }
+      int ret = client_poll(fd_, POLLIN, deadline_ms);
+      if (ret < 0) {
+        _fail_inflight(reqs, CLIENT_SOCKET_ERROR);
+        for (; next < count; next++) reqs[next].code = CLIENT_SOCKET_ERROR;
+        disconnect();
+        return CLIENT_SOCKET_ERROR;
+      }
+      if (ret == 0) {
+        // 已经收到的部分回复保留在接收缓冲区, 收完后按事务标识丢弃, 否则剩下的部分会被当作新的帧头解析
+        _fail_inflight(reqs, CLIENT_TIMEOUT);
+        for (; next < count; next++) reqs[next].code = CLIENT_TIMEOUT;
+        return CLIENT_TIMEOUT;
+      }
+      ssize_t n = recv(fd_, rx_buf_ + rx_length_, rx_buf_size_ - rx_length_, 0);
+      if (n <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+        _fail_inflight(reqs, CLIENT_SOCKET_ERROR);
+        for (; next < count; next++) reqs[next].code = CLIENT_SOCKET_ERROR;
+        disconnect();
+        return CLIENT_SOCKET_ERROR;
+      }
+      rx_length_ += n;
+      int offset = 0;
+      while (rx_length_ - offset >= 7) {
+        unsigned char *frame = rx_buf_ + offset;
+        int len = HexData::bin8_to_u16(frame + 4);
+        if (len < 2 || len > 254) {
+          // 回复的数据有误, 无法再确定帧边界
+          _fail_inflight(reqs, CLIENT_INVALID_RESPONSE);
+          for (; next < count; next++) reqs[next].code = CLIENT_INVALID_RESPONSE;
+          disconnect();
+          return CLIENT_INVALID_RESPONSE;
+        }
+        if (rx_length_ - offset < len + 6) break;
+        unsigned short tid = HexData::bin8_to_u16(frame);
+        InflightSlot *slot = &slots_[tid & (max_inflight_ - 1)];
+        // 事务标识匹配不上的是之前超时的请求的回复, 直接丢弃
+        if (slot->req_inx >= 0 && slot->tid == tid) {
+          ClientRequest *req = &reqs[slot->req_inx];
+          req->code = _decode(req, frame, len + 6);
+          slot->req_inx = -1;
+          inflight--;
+        }
+        offset += len + 6;
+      }
+      if (offset > 0) {
+        memmove(rx_buf_, rx_buf_ + offset, rx_length_ - offset);
+        rx_length_ -= offset;
+      }
+    }
+    return EXP_NONE;
+  }
+
+  int Client::_execute_one(ClientRequest *req)
+  {
+    int code = execute(req, 1);
+    return code != EXP_NONE ? code : req->code;
+  }
+
+  int Client::read_coil_bits(int addr, int quantity, unsigned char *bits)
+  {
+    ClientRequest req(MODBUS_FC_READ_COILS, addr, quantity, bits);
+    return _execute_one(&req);
+  }
+
+  int Client::read_input_bits(int addr, int quantity, unsigned char *bits)
+  {
+    ClientRequest req(MODBUS_FC_READ_DISCRETE_INPUTS, addr, quantity, bits);
+    return _execute_one(&req);
+  }
+
+  int Client::read_holding_registers(int addr, int quantity, unsigned short *regs)
+  {
+    ClientRequest req(MODBUS_FC_READ_HOLDING_REGS, addr, quantity, regs);
+    return _execute_one(&req);
+  }
+
+  int Client::read_input_registers(int addr, int quantity, unsigned short *regs)
+  {
+    ClientRequest req(MODBUS_FC_READ_INPUT_REGS, addr, quantity, regs);
+    return _execute_one(&req);
+  }
+
+  int Client::write_single_coil_bit(int addr, unsigned char bit)
+  {
+    ClientRequest req(MODBUS_FC_WRITE_SINGLE_COIL, addr, 1, &bit);
+    return _execute_one(&req);
+  }
+
+  int Client::write_single_holding_register(int addr, unsigned short reg)
+  {
+    ClientRequest req(MODBUS_FC_WRITE_SINGLE_REG, addr, 1, &reg);
+    return _execute_one(&req);
+  }
+
+  int Client::write_coil_bits(int addr, unsigned char *bits, int quantity)
+  {
+    ClientRequest req(MODBUS_FC_WRITE_MULTIPLE_COILS, addr, quantity, bits);
+    return _execute_one(&req);
+  }
+
+  int Client::write_holding_registers(int addr, unsigned short *regs, int quantity)
+  {
+    ClientRequest req(MODBUS_FC_WRITE_MULTIPLE_REGS, addr, quantity, regs);
+    return _execute_one(&req);
+  }
+
+  int Client::mask_write_holding_register(int addr, unsigned short and_mask, unsigned short or_mask)
+  {
+    unsigned short masks[2] = { and_mask, or_mask };
+    ClientRequest req(MODBUS_FC_MASK_WRITE_REG, addr, 1, masks);
+    return _execute_one(&req);
+  }
+
+  int Client::write_and_read_holding_registers(int w_addr, unsigned short *w_regs, int w_quantity, int r_addr, int r_quantity, unsigned short *r_regs)
+  {
+    ClientRequest req(MODBUS_FC_WRITE_AND_READ_REGS, r_addr, r_quantity, r_regs);
+    req.w_addr = w_addr;
+    req.w_quantity = w_quantity;
+    req.w_data = w_regs;
+    return _execute_one(&req);
+  }
+
+  int Client::transact(const unsigned char *pdu, int pdu_length, DataFrame *response)
+  {
+    ClientRequest req(pdu_length > 0 ? pdu[0] : 0);
+    req.raw_pdu = pdu;
+    req.raw_pdu_length = pdu_length;
+    req.raw_response = response;
+    return _execute_one(&req);
+  }
+}
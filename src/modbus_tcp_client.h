@@ -0,0 +1,145 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_TCP_CLIENT_H_
+#define _MODBUS_TCP_CLIENT_H_
+
+#include "modbus_tcp_data.h"
+
+namespace ModbusTCP
+{
+  enum MODBUS_TCP_CLIENT_CODE {
+    CLIENT_NOT_CONNECTED = -20,     // 未连接
+    CLIENT_SOCKET_ERROR = -21,      // Socket错误(连接断开等)
+    CLIENT_TIMEOUT = -22,           // 等待回复超时
+    CLIENT_INVALID_RESPONSE = -23,  // 回复数据格式错误
+    CLIENT_INVALID_REQUEST = -24    // 请求参数错误(不支持的功能码或数量超限)
+  };
+
+  /* ClientRequest: 客户端的一个请求
+   * 0x01/0x02: data为uchar数组, 存放读取到的quantity个位
+   * 0x03/0x04: data为ushort数组, 存放读取到的quantity个寄存器
+   * 0x05: data为uchar数组, 要写入的1个位
+   * 0x06: data为ushort数组, 要写入的1个寄存器
+   * 0x0F: data为uchar数组, 要写入的quantity个位
+   * 0x10: data为ushort数组, 要写入的quantity个寄存器
+   * 0x16: data为ushort数组, {and_mask, or_mask}
+   * 0x17: addr/quantity/data为读, w_addr/w_quantity/w_data为写
+   * 透传: raw_pdu不为NULL时直接发送raw_pdu(功能码+数据), 完整的回复帧存放到raw_response, 不做解析
+   */
+  struct ClientRequest {
+    ClientRequest(unsigned char func_code = 0, int addr = 0, int quantity = 0, void *data = NULL)
+    : func_code(func_code), addr(addr), quantity(quantity), data(data)
+    , w_addr(0), w_quantity(0), w_data(NULL)
+    , raw_pdu(NULL), raw_pdu_length(0), raw_response(NULL), code(EXP_NONE) {}
+
+    unsigned char func_code;
+    int addr;
+    int quantity;
+    void *data;
+    int w_addr;
+    int w_quantity;
+    unsigned short *w_data;
+    const unsigned char *raw_pdu;
+    int raw_pdu_length;
+    DataFrame *raw_response;
+    int code; // 执行结果: 0成功, 大于0为Modbus异常码, 小于0见MODBUS_TCP_CLIENT_CODE
+  };
+
+  /* Client: Modbus TCP客户端(主站)
+   * 1. 请求的编码使用DataFrame/HexData, 和DataService共用同一套帧格式
+   * 2. 同一个连接上可以同时有多个请求在途(流水线), 通过MBAP事务标识匹配回复
+   * 3. 非线程安全, 多线程使用需要调用者加锁
+   */
+  class Client
+  {
+  public:
+    /* Client: 构造客户端
+     * @param max_inflight: 同一个连接上最多同时在途的请求数, 会向上取整为2的幂
+     * @param unit_id: MBAP中的单元标识
+     */
+    Client(int max_inflight = 16, unsigned char unit_id = 0x01);
+    ~Client();
+
+    /* connect: 连接服务器
+     * @param ip: 服务器IP
+     * @param port: 服务器端口
+     * @param timeout_ms: 连接超时(毫秒)
+     * :return: 成功返回0
+     */
+    int connect(const char *ip, int port = 502, int timeout_ms = 3000);
+
+    /* disconnect: 断开连接 */
+    void disconnect(void);
+
+    bool is_connected(void) { return fd_ >= 0; }
+
+    /* set_timeout: 设置等待回复的超时(毫秒), 默认3000; 每个请求从发送时开始计算, 被信号打断不算超时, 负数表示一直等待 */
+    void set_timeout(int timeout_ms) { timeout_ms_ = timeout_ms; }
+
+    void set_unit_id(unsigned char unit_id) { unit_id_ = unit_id; }
+
+    /* execute: 批量执行请求, 最多max_inflight个请求同时在途
+     * 每个请求的结果存放在各自的code里, 回复的顺序不要求和请求的顺序一致
+     * @param reqs: 请求数组
+     * @param count: 请求个数
+     * :return: 通信成功返回0(单个请求的Modbus异常看各自的code), 通信失败返回MODBUS_TCP_CLIENT_CODE
+     */
+    int execute(ClientRequest *reqs, int count);
+
+    /* 单个请求的同步接口, 返回值同ClientRequest::code */
+    int read_coil_bits(int addr, int quantity, unsigned char *bits);
+    int read_input_bits(int addr, int quantity, unsigned char *bits);
+    int read_holding_registers(int addr, int quantity, unsigned short *regs);
+    int read_input_registers(int addr, int quantity, unsigned short *regs);
+    int write_single_coil_bit(int addr, unsigned char bit);
+    int write_single_holding_register(int addr, unsigned short reg);
+    int write_coil_bits(int addr, unsigned char *bits, int quantity);
+    int write_holding_registers(int addr, unsigned short *regs, int quantity);
+    int mask_write_holding_register(int addr, unsigned short and_mask, unsigned short or_mask);
+    int write_and_read_holding_registers(int w_addr, unsigned short *w_regs, int w_quantity, int r_addr, int r_quantity, unsigned short *r_regs);
+
+    /* transact: 透传一个PDU(功能码+数据), 用于代理转发
+     * @param pdu: 请求的PDU
+     * @param pdu_length: PDU长度
+     * @param response: 存放完整的回复帧(MBAP + PDU), 回复中的Modbus异常也原样返回
+     * :return: 通信成功返回0, 否则返回MODBUS_TCP_CLIENT_CODE
+     */
+    int transact(const unsigned char *pdu, int pdu_length, DataFrame *response);
+
+  private:
+    int _execute_one(ClientRequest *req);
+    int _encode(ClientRequest *req, unsigned short tid, DataFrame *frame);
+    int _decode(ClientRequest *req, const unsigned char *res, int length);
+    int _send(const unsigned char *data, int length, uint64_t deadline_ms);
+    void _fail_inflight(ClientRequest *reqs, int code);
+
+  private:
+    struct InflightSlot {
+      int req_inx;          // 对应的请求下标, -1表示空闲
+      unsigned short tid;   // 事务标识
+      unsigned short gen;   // 该槽位的使用次数, 用来生成事务标识
+      uint64_t deadline_ms; // 等待回复的截止时间
+    };
+
+    int fd_;
+    int timeout_ms_;
+    unsigned char unit_id_;
+    int max_inflight_;
+    InflightSlot *slots_;
+    DataFrame *frame_;        // 编码请求用
+    unsigned char *tx_buf_;   // 一次性发送多个请求
+    int tx_length_;
+    unsigned char *rx_buf_;   // 接收缓冲区(可能包含多帧或不完整的帧)
+    int rx_buf_size_;
+    int rx_length_;
+  };
+}
+
+#endif // _MODBUS_TCP_CLIENT_H_
@@ -8,7 +8,9 @@
  */
 
 #include <string.h>
-#include "modbus_tcp_data.h"
+#include "modbus_tcp_data_impl.h"
+#include "modbus_log.h"
+#include "modbus_rt.h"
 
 namespace ModbusTCP
 {
@@ -16,8 +18,14 @@ namespace ModbusTCP
 
   DataFrame::DataFrame(int buf_size) : buf_size_(buf_size)
   {
-    if (buf_size_ < 12) buf_size_ = 12;
-    raw_data = new unsigned char[buf_size_];
+    if (buf_size_ <= MODBUS_TCP_MAX_FRAME_SIZE) {
+      buf_size_ = MODBUS_TCP_MAX_FRAME_SIZE;
+      raw_data = inline_buf_;
+    }
+    else {
+      MODBUS_RT_HEAP_CHECK("DataFrame buffer");
+      raw_data = new unsigned char[buf_size_];
+    }
     memset(raw_data, 0, buf_size_);
     pdu_data = raw_data + 7;
     data_length = 0;
@@ -25,7 +33,7 @@ namespace ModbusTCP
   
   DataFrame::~DataFrame()
   {
-    if (raw_data != NULL) {
+    if (raw_data != NULL && raw_data != inline_buf_) {
       delete[] raw_data;
       raw_data = NULL;
       pdu_data = NULL;
@@ -53,13 +61,14 @@ namespace ModbusTCP
   void DataFrame::resize_pdu_buf(int pdu_size)
   {
     if (pdu_size <= buf_size_ - 7) return;
+    MODBUS_RT_HEAP_CHECK("DataFrame resize");
     unsigned char *old = raw_data;
     buf_size_ = pdu_size + 7;
     raw_data = new unsigned char[buf_size_];
     memset(raw_data, 0, buf_size_);
     pdu_data = raw_data + 7;
     memcpy(raw_data, old, data_length);
-    if (old != NULL) {
+    if (old != NULL && old != inline_buf_) {
       delete[] old;
     }
   }
@@ -72,9 +81,10 @@ namespace ModbusTCP
   void DataFrame::set_code(unsigned char code)
   {
     if (code == EXP_NONE) return;
-    printf("func_code=%d, code=%d\n", pdu_data[0], code);
-    memset(pdu_data, 0, buf_size_ - 7);
-    pdu_data[0] = pdu_data[0] + 0x80;
+    unsigned char func_code = pdu_data[0];
+    MODBUS_LOG_DEBUG("exception response, func_code=0x%02X, code=%d", func_code, code);
+    // 异常回复只有功能码和异常码, 后面的数据不会发送, 不需要清零
+    pdu_data[0] = func_code + 0x80;
     pdu_data[1] = code;
     data_length = 7 + 2;
   }
@@ -104,6 +114,11 @@ namespace ModbusTCP
     request->set_raw_data(data, length);
   }
 
+  void DataSession::set_response_data(unsigned char *data, int length)
+  {
+    response->set_raw_data(data, length);
+  }
+
   const unsigned char* DataSession::get_request_data(void)
   {
     return request->raw_data;
@@ -124,396 +139,6 @@ namespace ModbusTCP
     return response->data_length;
   }
 
-  /************************* DataService ***************************/
-  
-  template <class ModbusData>
-  DataService<ModbusData>::DataService(ModbusData *modbus_data)
-  {
-    data_length_ = 0;
-    buf_ = new unsigned char[512];
-    modbus_data_ = modbus_data;
-    session_ = new DataSession();
-  }
-
-  template <class ModbusData>
-  DataService<ModbusData>::~DataService()
-  {
-    if (buf_ != NULL) {
-      delete[] buf_;
-      buf_ = NULL;
-    }
-    if (session_ != NULL) {
-      delete session_;
-      session_ = NULL;
-    }
-  }
-
-  template <class ModbusData>
-  void DataService<ModbusData>::process_data(unsigned char *data, int length, void(*callback)(const unsigned char*, const int, const unsigned char*, const int), bool is_checked)
-  {
-    if (is_checked) {
-      session_->set_request_data(data, length);
-      process_session(session_, modbus_data_);
-      callback(session_->get_request_data(), session_->get_request_length(), session_->get_response_data(), session_->get_response_length());
-      return;
-    }
-
-    if (data_length_ + length < 7) {
-      // 长度不够
-      memcpy(buf_ + data_length_, data, length);
-      data_length_ += length;
-      return; 
-    }
-
-    int len = 0;
-    int remain = length;
-    int cpy_inx = 0;
-    while (1) {
-      if (data_length_ + remain < 7) {
-        // 长度不够
-        memcpy(buf_ + data_length_, data + cpy_inx, remain);
-        data_length_ += remain;
-        return;
-      }
-      if (data_length_ < 7) {
-        memcpy(buf_ + data_length_, data + cpy_inx, 7 - data_length_);
-        cpy_inx += 7 - data_length_;
-        remain = length - cpy_inx;
-        data_length_ = 7;
-      }
-      len = HexData::bin8_to_u16(buf_ + 4);
-      if (len > 254) {
-        // Modbus TCP一帧数据最多260字节
-        printf("Modbus tcp data length is wrong, discard this part of data and clear the buffer, len=%d\n", len);
-        data_length_ = 0;
-        return;
-      }
-      if (data_length_ + remain < len + 6) {
-        // 数据长度不够
-        memcpy(buf_ + data_length_, data + cpy_inx, remain);
-        data_length_ += remain;
-        return; 
-      }
-      memcpy(buf_ + data_length_, data + cpy_inx, len + 6 - data_length_);
-      session_->set_request_data(buf_, len + 6);
-      process_session(session_, modbus_data_);
-      callback(session_->get_request_data(), session_->get_request_length(), session_->get_response_data(), session_->get_response_length());
-      cpy_inx += len + 6 - data_length_;
-      remain = length - cpy_inx;
-      data_length_ = 0;
-      if (remain == 0) return;      
-    }
-  }
-
-  // template <class ModbusData>
-  // void DataService<ModbusData>::process_data(unsigned char *data, int length, void(*callback)(DataSession *), bool is_checked)
-  // {
-  //   if (is_checked) {
-  //     session_->set_request_data(data, length);
-  //     process_session(session_, modbus_data_);
-  //     callback(session_);
-  //     return;
-  //   }
-
-  //   if (data_length_ + length < 7) {
-  //     // 长度不够
-  //     memcpy(buf_ + data_length_, data, length);
-  //     data_length_ += length;
-  //     return; 
-  //   }
-
-  //   int len = 0;
-  //   int remain = length;
-  //   int cpy_inx = 0;
-  //   while (1) {
-  //     if (data_length_ + remain < 7) {
-  //       // 长度不够
-  //       memcpy(buf_ + data_length_, data + cpy_inx, remain);
-  //       data_length_ += remain;
-  //       return;
-  //     }
-  //     if (data_length_ < 7) {
-  //       memcpy(buf_ + data_length_, data + cpy_inx, 7 - data_length_);
-  //       cpy_inx += 7 - data_length_;
-  //       remain = length - cpy_inx;
-  //       data_length_ = 7;
-  //     }
-  //     len = HexData::bin8_to_u16(buf_ + 4);
-  //     if (len > 254) {
-  //       // Modbus TCP一帧数据最多260字节
-  //       printf("Modbus tcp data length is wrong, discard this part of data and clear the buffer, len=%d\n", len);
-  //       data_length_ = 0;
-  //       return;
-  //     }
-  //     if (data_length_ + remain < len + 6) {
-  //       // 数据长度不够
-  //       memcpy(buf_ + data_length_, data + cpy_inx, remain);
-  //       data_length_ += remain;
-  //       return; 
-  //     }
-  //     memcpy(buf_ + data_length_, data + cpy_inx, len + 6 - data_length_);
-  //     session_->set_request_data(buf_, len + 6);
-  //     process_session(session_, modbus_data_);
-  //     callback(session_);
-  //     cpy_inx += len + 6 - data_length_;
-  //     remain = length - cpy_inx;
-  //     data_length_ = 0;
-  //     if (remain == 0) return;      
-  //   }
-  // }
-
-  template <class ModbusData>
-  void DataService<ModbusData>::process_session(DataSession *session, ModbusData *modbus_data)
-  {
-    session->response->set_raw_data(session->request->raw_data, 8);
-    // check modbus tcp data length
-    int len = HexData::bin8_to_u16(session->request->raw_data + 4) + 6;
-    if (session->request->data_length < 8 || len > 260 || session->request->data_length < len) {
-      // data_length_ < MABP(7) + FUNC_CODE(1)
-      session->response->set_code(EXP_ILLEGAL_DATA_VALUE);
-      session->response->update_mbap_length();
-      return;
-    }
-    int code = EXP_NONE;
-    switch (session->request->pdu_data[0]) {
-      case MODBUS_FC_READ_COILS:  // 0x01
-      case MODBUS_FC_READ_DISCRETE_INPUTS: // 0x02
-        code = _read_bits(session, modbus_data);
-        break;
-      case MODBUS_FC_READ_HOLDING_REGS:  // 0x03
-      case MODBUS_FC_READ_INPUT_REGS:    // 0x04
-        code = _read_registers(session, modbus_data);
-        break;
-      case MODBUS_FC_WRITE_SINGLE_COIL: // 0x05
-        code = _write_single_coil_bit(session, modbus_data);
-        break;
-      case MODBUS_FC_WRITE_SINGLE_REG: // 0x06
-        code = _write_single_holding_register(session, modbus_data);
-        break;
-      case MODBUS_FC_WRITE_MULTIPLE_COILS:  // 0x0F
-        code = _write_multiple_coil_bits(session, modbus_data);
-        break;
-      case MODBUS_FC_WRITE_MULTIPLE_REGS:  // 0x10
-        code = _write_multiple_holding_registers(session, modbus_data);
-        break;
-      case MODBUS_FC_MASK_WRITE_REG: // 0x16
-        code = _mask_write_holding_register(session, modbus_data);
-        break;
-      case MODBUS_FC_WRITE_AND_READ_REGS: // 0x17
-        code = _write_and_read_multiple_holding_registers(session, modbus_data);
-        break;
-      
-      default:
-        code = EXP_ILLEGAL_FUNCTION;
-        break;
-    }
-    session->response->set_code(code);
-    session->response->update_mbap_length();
-  }
-
-  /* 0x01/0x02 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_read_bits(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
-    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    int code = EXP_ILLEGAL_DATA_VALUE;
-    if (quantity >= 0x0001 && quantity <= 0x07D0) {
-      unsigned char *bits = new unsigned char[quantity];
-      if (session->request->pdu_data[0] == MODBUS_FC_READ_COILS) {
-        code = modbus_data->read_coil_bits(start_addr, quantity, bits);
-      }
-      else {
-        code = modbus_data->read_input_bits(start_addr, quantity, bits);
-      }
-      if (code == EXP_NONE) {
-        int byte_size = (quantity + 7) / 8;
-        session->response->resize_pdu_buf(byte_size + 2);
-        unsigned char *data = new unsigned char[byte_size]{0};
-        for (int i = 0; i < quantity; i++) {
-          if (bits[i]) {
-            data[i / 8] = data[i / 8] | (1 << (i % 8));
-          }
-        }
-        session->response->add_pdu_data(&byte_size, 1);
-        session->response->add_pdu_data(data, byte_size);
-        delete[] data;
-      }
-      delete[] bits;
-    }
-    return code;
-  }
-
-  /* 0x03/0x04 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_read_registers(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
-    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    int code = EXP_ILLEGAL_DATA_VALUE;
-    if (quantity >= 0x0001 && quantity <= 0x007D) {
-      unsigned short *regs = new unsigned short[quantity];
-      if (session->request->pdu_data[0] == MODBUS_FC_READ_HOLDING_REGS) {
-        code = modbus_data->read_holding_registers(start_addr, quantity, regs);
-      }
-      else {
-        code = modbus_data->read_input_registers(start_addr, quantity, regs);
-      }
-      if (code == EXP_NONE) {
-        unsigned char byte_size = quantity * 2;
-        session->response->resize_pdu_buf(byte_size + 2);
-        session->response->add_pdu_data(&byte_size, 1);
-        unsigned char tmp[2];
-        for (int i = 0; i < quantity; i++) {
-          HexData::bin16_to_8(regs[i], tmp);
-          session->response->add_pdu_data(tmp, 2);
-        }
-      }
-      delete[] regs;
-    }
-    return code;
-  }
-
-  /* 0x05 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_write_single_coil_bit(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
-    int bit_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    int bit_val = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    int code = EXP_ILLEGAL_DATA_VALUE;
-    if (bit_val == 0x0000 || bit_val == 0xFF00) {
-      unsigned char bits[1] = {bit_val == 0xFF00};
-      code = modbus_data->write_coil_bits(bit_addr, bits, 1);
-      if (code == EXP_NONE) {
-        session->response->add_pdu_data(&session->request->pdu_data[1], 4);
-      }
-    }
-    return code;
-  }
-
-  /* 0x06 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_write_single_holding_register(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
-    int reg_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    unsigned short reg_val = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    unsigned short regs[1] = {reg_val};
-    int code = modbus_data->write_holding_registers(reg_addr, regs, 1);
-    if (code == EXP_NONE) {
-      session->response->add_pdu_data(&session->request->pdu_data[1], 4);
-    }
-    return code;
-  }
-
-  /* 0x0F */
-  template <class ModbusData>
-  int DataService<ModbusData>::_write_multiple_coil_bits(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 13) return EXP_ILLEGAL_DATA_VALUE;
-    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    int byte_count = session->request->pdu_data[5];
-    bool quantity_ok = quantity >= 0x0001 && quantity <= 0x07B0;
-    bool byte_count_ok = byte_count >= (quantity + 7) / 8;
-    bool pdu_len_ok = (session->request->data_length - 7 - 6) >= byte_count;
-    int code = EXP_ILLEGAL_DATA_VALUE;
-    if (quantity_ok && byte_count_ok && pdu_len_ok) {
-      unsigned char *bits = new unsigned char[quantity] { 0 };
-      for (int i = 0; i < quantity; i++) {
-        unsigned char bit_val = session->request->pdu_data[i / 8 + 6];
-        bits[i] = (bool)(bit_val & (1 << (i % 8)));
-      }
-      code = modbus_data->write_coil_bits(start_addr, bits, quantity);
-      delete[] bits;
-      if (code == EXP_NONE) {
-        session->response->add_pdu_data(&session->request->pdu_data[1], 4);
-      }
-    }
-    return code;
-  }
-
-  /* 0x10 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_write_multiple_holding_registers(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 13) return EXP_ILLEGAL_DATA_VALUE;
-    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    int byte_count = session->request->pdu_data[5];
-    bool quantity_ok = quantity >= 0x0001 && quantity <= 0x007B;
-    bool byte_count_ok = byte_count == quantity * 2;
-    bool pdu_len_ok = (session->request->data_length - 7 - 6) >= byte_count;
-    int code = EXP_ILLEGAL_DATA_VALUE;
-    if (quantity_ok && byte_count_ok && pdu_len_ok) {
-      unsigned short *regs = new unsigned short[quantity] { 0 };
-      for (int i = 0; i < quantity; i++) {
-        regs[i] = HexData::bin8_to_u16(session->request->pdu_data + i * 2 + 6);
-      }
-      code = modbus_data->write_holding_registers(start_addr, regs, quantity);
-      delete[] regs;
-      if (code == EXP_NONE) {
-        session->response->add_pdu_data(&session->request->pdu_data[1], 4);
-      }
-    }
-    return code;
-  }
-
-  /* 0x16 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_mask_write_holding_register(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 14) return EXP_ILLEGAL_DATA_VALUE;
-    int ref_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    unsigned short and_mask = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    unsigned short or_mask = HexData::bin8_to_u16(session->request->pdu_data + 5);
-    int code = modbus_data->mask_write_holding_register(ref_addr, and_mask, or_mask);
-    if (code == EXP_NONE) {
-      session->response->add_pdu_data(&session->request->pdu_data[1], 6);
-    }
-    return code;
-  }
-
-  /* 0x17 */
-  template <class ModbusData>
-  int DataService<ModbusData>::_write_and_read_multiple_holding_registers(DataSession *session, ModbusData *modbus_data)
-  {
-    if (session->request->data_length < 17) return EXP_ILLEGAL_DATA_VALUE;
-    int r_start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
-    int r_quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
-    int w_start_addr = HexData::bin8_to_u16(session->request->pdu_data + 5);
-    int w_quantity = HexData::bin8_to_u16(session->request->pdu_data + 7);
-    int byte_count = session->request->pdu_data[9];
-    bool r_quantity_ok = r_quantity >= 0x0001 && r_quantity <= 0x007D;
-    bool w_quantity_ok = w_quantity >= 0x0001 && w_quantity <= 0x0079;
-    bool byte_count_ok = byte_count == w_quantity * 2;
-    bool pdu_len_ok = (session->request->data_length - 7 - 10) >= byte_count;
-    int code = EXP_ILLEGAL_DATA_VALUE;
-    if (r_quantity_ok && w_quantity_ok && byte_count_ok && pdu_len_ok) {
-      unsigned short *r_regs = new unsigned short[r_quantity];
-      unsigned short *w_regs = new unsigned short[w_quantity];
-      for (int i = 0; i < w_quantity; i++) {
-        w_regs[i] = HexData::bin8_to_u16(session->request->pdu_data + i * 2 + 10);
-      }
-      code = modbus_data->write_and_read_holding_registers(w_start_addr, w_regs, w_quantity, r_start_addr, r_quantity, r_regs);
-      if (code == EXP_NONE) {
-        unsigned char byte_size = r_quantity * 2;
-        session->response->resize_pdu_buf(byte_size + 2);
-        session->response->add_pdu_data(&byte_size, 1);
-        unsigned char tmp[2];
-        for (int i = 0; i < r_quantity; i++) {
-          HexData::bin16_to_8(r_regs[i], tmp);
-          session->response->add_pdu_data(tmp, 2);
-        }
-      }
-      delete[] r_regs;
-      delete[] w_regs;
-    }
-    return code;
-  }
   /* 模板类需要特化 */
   template class DataService<ModbusBaseData>;
   template class DataService<ModbusStructData>;
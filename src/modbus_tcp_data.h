@@ -11,6 +11,9 @@
 #define _MODBUS_TCP_H_
 
 #include "modbus_data.h"
+#include "modbus_pool.h"
+
+#define MODBUS_TCP_MAX_FRAME_SIZE 260 // Modbus TCP一帧最大长度, MBAP(7) + PDU(253)
 
 namespace ModbusTCP
 {
@@ -22,11 +25,28 @@ namespace ModbusTCP
     EXP_SLAVE_DEVICE_FAILURE = 0x04,
     EXP_ACKNOWLEDGE = 0x05,
     EXP_SLAVE_DEVICE_BUSY = 0x06,
+    EXP_NEGATIVE_ACKNOWLEDGE = 0x07,
     EXP_MEMORY_PRAITY_ERROR = 0x08,
     EXP_GATEWAY_PATH_UNAVAILABLE = 0x0A,
     EXP_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND = 0x0B
   };
 
+  /* 0x08(诊断)功能码的子功能, 计数器由ModbusMetrics提供 */
+  enum MODBUS_DIAG_SUB_FUNC {
+    DIAG_RETURN_QUERY_DATA = 0x00,              // 原样返回请求数据
+    DIAG_RETURN_DIAGNOSTIC_REGISTER = 0x02,     // 诊断寄存器(固定为0)
+    DIAG_CLEAR_COUNTERS = 0x0A,                 // 诊断计数器清零
+    DIAG_BUS_MESSAGE_COUNT = 0x0B,              // 收到的帧数(含丢弃的帧)
+    DIAG_BUS_COMM_ERROR_COUNT = 0x0C,           // 因长度错误丢弃的帧数
+    DIAG_BUS_EXCEPTION_ERROR_COUNT = 0x0D,      // 异常回复数
+    DIAG_SERVER_MESSAGE_COUNT = 0x0E,           // 处理的请求数
+    DIAG_SERVER_NO_RESPONSE_COUNT = 0x0F,       // 没有回复的请求数(固定为0)
+    DIAG_SERVER_NAK_COUNT = 0x10,               // 回复异常码0x07的次数
+    DIAG_SERVER_BUSY_COUNT = 0x11,              // 回复异常码0x06的次数
+    DIAG_BUS_CHARACTER_OVERRUN_COUNT = 0x12,    // 字符溢出次数(固定为0)
+    DIAG_CLEAR_OVERRUN_COUNTER = 0x14           // 溢出计数清零
+  };
+
   class HexData
   {
   public:
@@ -42,11 +62,15 @@ namespace ModbusTCP
     }
   };
 
+  /* DataFrame: 一帧Modbus TCP数据
+   * 不超过MODBUS_TCP_MAX_FRAME_SIZE的数据放在对象内部的缓冲区, 超过时才申请堆内存
+   */
   class DataFrame
   {
   public:
     DataFrame(int buf_size = 12);
     ~DataFrame();
+    MODBUS_POOL_OPERATORS
 
     void set_raw_data(unsigned char *data, int length);
     void add_pdu_data(void *data, int length);
@@ -60,6 +84,7 @@ namespace ModbusTCP
     unsigned char *pdu_data; // PDU数据
   private:
     int buf_size_; // 预分配的缓冲区大小
+    unsigned char inline_buf_[MODBUS_TCP_MAX_FRAME_SIZE]; // 对象内部的缓冲区
   };
 
   class DataSession
@@ -69,8 +94,10 @@ namespace ModbusTCP
   public:
     DataSession(int req_buf_size = 12, int res_buf_size = 12);
     ~DataSession();
+    MODBUS_POOL_OPERATORS
 
     void set_request_data(unsigned char *data, int length);
+    void set_response_data(unsigned char *data, int length);
     const unsigned char* get_request_data(void);
     const unsigned char* get_response_data(void);
     const int get_request_length(void);
@@ -81,12 +108,21 @@ namespace ModbusTCP
     DataFrame *response;
   };
 
+  /* 每处理一帧完整的Modbus TCP数据的回调，参数分别表示完整的请求数据，请求长度，回复数据，回复长度 */
+  typedef void (*DataCallback)(const unsigned char*, const int, const unsigned char*, const int);
+  /* 同DataCallback, 最后一个参数为调用process_data时传入的arg */
+  typedef void (*DataArgCallback)(const unsigned char*, const int, const unsigned char*, const int, void*);
+
   template <class ModbusData>
   class DataService
   {
   public:
+    /* 自定义的帧处理方法, 替代默认的process_session(比如代理转发), 最后一个参数为设置时传入的arg */
+    typedef void (*SessionHandler)(DataSession*, ModbusData*, void*);
+
     DataService(ModbusData *modbus_data);
     ~DataService();
+    MODBUS_POOL_OPERATORS
     
     /* process_data: 处理接收到的数据
      * @param data: 接收到的数据
@@ -95,6 +131,29 @@ namespace ModbusTCP
      * @param is_checked: 是否是完整的一帧Modbus TCP请求数据，如果为false，函数内部会做处理(检查、拆包等)
      */
     void process_data(unsigned char *data, int length, void(*callback)(const unsigned char*, const int, const unsigned char*, const int), bool is_checked = false);
+
+    /* process_data: 处理接收到的数据
+     * @param data: 接收到的数据
+     * @param length: 数据长度
+     * @param callback: 每处理一帧完整的Modbus TCP数据的回调，参数同上, 最后一个参数为arg
+     * @param arg: 回调的参数(比如连接的上下文)
+     * @param is_checked: 是否是完整的一帧Modbus TCP请求数据，如果为false，函数内部会做处理(检查、拆包等)
+     */
+    void process_data(unsigned char *data, int length, DataArgCallback callback, void *arg, bool is_checked = false);
+
+    /* set_session_handler: 设置自定义的帧处理方法, 为NULL时使用默认的process_session
+     * @param handler: 帧处理方法
+     * @param arg: 帧处理方法的参数
+     */
+    void set_session_handler(SessionHandler handler, void *arg);
+
+    /* get_pending_length: 缓冲区内不完整的一帧的长度(等待后续数据) */
+    int get_pending_length(void) { return data_length_; }
+
+    /* discard_pending: 丢弃缓冲区内不完整的一帧(比如对方发了半帧后一直不发剩下的部分)
+     * :return: 丢弃的字节数
+     */
+    int discard_pending(void);
     
     // /* process_data: 处理接收到的数据
     //  * @param data: 接收到的数据
@@ -106,6 +165,9 @@ namespace ModbusTCP
     
     static void process_session(DataSession *session, ModbusData *modbus_data);
   private:
+    void _process_data(unsigned char *data, int length, DataCallback callback, DataArgCallback arg_callback, void *arg, bool is_checked);
+    void _handle_session(DataCallback callback, DataArgCallback arg_callback, void *arg);
+
     // 0x01/0x02
     static int _read_bits(DataSession *session, ModbusData *modbus_data);
     // 0x03/0x04
@@ -114,10 +176,16 @@ namespace ModbusTCP
     static int _write_single_coil_bit(DataSession *session, ModbusData *modbus_data);
     // 0x06
     static int _write_single_holding_register(DataSession *session, ModbusData *modbus_data);
+    // 0x08
+    static int _diagnostics(DataSession *session, ModbusData *modbus_data);
     // 0x0F
     static int _write_multiple_coil_bits(DataSession *session, ModbusData *modbus_data);
     // 0x10
     static int _write_multiple_holding_registers(DataSession *session, ModbusData *modbus_data);
+    // 0x14
+    static int _read_file_record(DataSession *session, ModbusData *modbus_data);
+    // 0x15
+    static int _write_file_record(DataSession *session, ModbusData *modbus_data);
     // 0x16
     static int _mask_write_holding_register(DataSession *session, ModbusData *modbus_data);
     // 0x17
@@ -125,10 +193,16 @@ namespace ModbusTCP
   
   private:
     int data_length_;     // 缓冲区内的数据长度
-    unsigned char *buf_;  // 缓冲区
+    unsigned char buf_[MODBUS_TCP_MAX_FRAME_SIZE]; // 缓冲区, 存放不完整的一帧
     ModbusData *modbus_data_; // 寄存器操作实例
     DataSession *session_;
+    SessionHandler session_handler_;
+    void *session_handler_arg_;
   };
 }
 
+#ifdef MODBUS_HEADER_ONLY
+#include "modbus_tcp_data_impl.h"
+#endif
+
 #endif // _MODBUS_TCP_H_
\ No newline at end of file
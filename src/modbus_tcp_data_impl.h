@@ -0,0 +1,641 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+/* modbus_tcp_data.h中DataService的实现
+ * 1. 默认由modbus_tcp_data.cpp包含并特化常用的组合, 编译进静态库
+ * 2. 定义MODBUS_HEADER_ONLY时由modbus_tcp_data.h包含, 功能码处理和寄存器的读写在同一个编译单元, 可以内联
+ */
+
+#ifndef _MODBUS_TCP_DATA_IMPL_H_
+#define _MODBUS_TCP_DATA_IMPL_H_
+
+#include <string.h>
+#include "modbus_tcp_data.h"
+#include "modbus_metrics.h"
+#include "modbus_log.h"
+#include "modbus_trace.h"
+#include "modbus_file_bank.h"
+
+namespace ModbusTCP
+{
+  /************************* DataService ***************************/
+  
+  template <class ModbusData>
+  DataService<ModbusData>::DataService(ModbusData *modbus_data)
+  {
+    data_length_ = 0;
+    modbus_data_ = modbus_data;
+    session_ = new DataSession();
+    session_handler_ = NULL;
+    session_handler_arg_ = NULL;
+  }
+
+  template <class ModbusData>
+  DataService<ModbusData>::~DataService()
+  {
+    if (session_ != NULL) {
+      delete session_;
+      session_ = NULL;
+    }
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::process_data(unsigned char *data, int length, void(*callback)(const unsigned char*, const int, const unsigned char*, const int), bool is_checked)
+  {
+    _process_data(data, length, callback, NULL, NULL, is_checked);
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::process_data(unsigned char *data, int length, DataArgCallback callback, void *arg, bool is_checked)
+  {
+    _process_data(data, length, NULL, callback, arg, is_checked);
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::set_session_handler(SessionHandler handler, void *arg)
+  {
+    session_handler_ = handler;
+    session_handler_arg_ = arg;
+  }
+
+  template <class ModbusData>
+  int DataService<ModbusData>::discard_pending(void)
+  {
+    int length = data_length_;
+    if (length > 0) {
+      MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_WARN, 1000, 10, "Modbus tcp frame is incomplete for too long, discard %d bytes", length);
+      MODBUS_METRICS_FRAME_DISCARDED();
+      data_length_ = 0;
+    }
+    return length;
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::_handle_session(DataCallback callback, DataArgCallback arg_callback, void *arg)
+  {
+    if (session_handler_ != NULL) {
+      session_handler_(session_, modbus_data_, session_handler_arg_);
+    }
+    else {
+      process_session(session_, modbus_data_);
+    }
+    if (arg_callback != NULL) {
+      arg_callback(session_->get_request_data(), session_->get_request_length(), session_->get_response_data(), session_->get_response_length(), arg);
+    }
+    else {
+      callback(session_->get_request_data(), session_->get_request_length(), session_->get_response_data(), session_->get_response_length());
+    }
+  }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::_process_data(unsigned char *data, int length, DataCallback callback, DataArgCallback arg_callback, void *arg, bool is_checked)
+  {
+    if (is_checked) {
+      session_->set_request_data(data, length);
+      _handle_session(callback, arg_callback, arg);
+      return;
+    }
+
+    MODBUS_TRACE_BEGIN(frame);
+    if (data_length_ + length < 7) {
+      // 长度不够
+      memcpy(buf_ + data_length_, data, length);
+      data_length_ += length;
+      return; 
+    }
+
+    int len = 0;
+    int remain = length;
+    int cpy_inx = 0;
+    while (1) {
+      if (data_length_ + remain < 7) {
+        // 长度不够
+        memcpy(buf_ + data_length_, data + cpy_inx, remain);
+        data_length_ += remain;
+        return;
+      }
+      if (data_length_ < 7) {
+        memcpy(buf_ + data_length_, data + cpy_inx, 7 - data_length_);
+        cpy_inx += 7 - data_length_;
+        remain = length - cpy_inx;
+        data_length_ = 7;
+      }
+      len = HexData::bin8_to_u16(buf_ + 4);
+      if (len > 254 || len < 2) {
+        // Modbus TCP一帧数据最多260字节, 长度字段至少包含单元标识和功能码
+        MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_WARN, 1000, 10, "Modbus tcp data length is wrong, discard this part of data and clear the buffer, len=%d", len);
+        MODBUS_METRICS_FRAME_DISCARDED();
+        data_length_ = 0;
+        return;
+      }
+      if (data_length_ + remain < len + 6) {
+        // 数据长度不够
+        memcpy(buf_ + data_length_, data + cpy_inx, remain);
+        data_length_ += remain;
+        return; 
+      }
+      memcpy(buf_ + data_length_, data + cpy_inx, len + 6 - data_length_);
+      session_->set_request_data(buf_, len + 6);
+      MODBUS_TRACE_END(frame, TRACE_PHASE_FRAME, buf_, len + 6);
+      _handle_session(callback, arg_callback, arg);
+      MODBUS_TRACE_RESTART(frame);
+      cpy_inx += len + 6 - data_length_;
+      remain = length - cpy_inx;
+      data_length_ = 0;
+      if (remain == 0) return;      
+    }
+  }
+
+  // template <class ModbusData>
+  // void DataService<ModbusData>::process_data(unsigned char *data, int length, void(*callback)(DataSession *), bool is_checked)
+  // {
+  //   if (is_checked) {
+  //     session_->set_request_data(data, length);
+  //     process_session(session_, modbus_data_);
+  //     callback(session_);
+  //     return;
+  //   }
+
+  //   if (data_length_ + length < 7) {
+  //     // 长度不够
+  //     memcpy(buf_ + data_length_, data, length);
+  //     data_length_ += length;
+  //     return; 
+  //   }
+
+  //   int len = 0;
+  //   int remain = length;
+  //   int cpy_inx = 0;
+  //   while (1) {
+  //     if (data_length_ + remain < 7) {
+  //       // 长度不够
+  //       memcpy(buf_ + data_length_, data + cpy_inx, remain);
+  //       data_length_ += remain;
+  //       return;
+  //     }
+  //     if (data_length_ < 7) {
+  //       memcpy(buf_ + data_length_, data + cpy_inx, 7 - data_length_);
+  //       cpy_inx += 7 - data_length_;
+  //       remain = length - cpy_inx;
+  //       data_length_ = 7;
+  //     }
+  //     len = HexData::bin8_to_u16(buf_ + 4);
+  //     if (len > 254) {
+  //       // Modbus TCP一帧数据最多260字节
+  //       printf("Modbus tcp data length is wrong, discard this part of data and clear the buffer, len=%d\n", len);
+  //       data_length_ = 0;
+  //       return;
+  //     }
+  //     if (data_length_ + remain < len + 6) {
+  //       // 数据长度不够
+  //       memcpy(buf_ + data_length_, data + cpy_inx, remain);
+  //       data_length_ += remain;
+  //       return; 
+  //     }
+  //     memcpy(buf_ + data_length_, data + cpy_inx, len + 6 - data_length_);
+  //     session_->set_request_data(buf_, len + 6);
+  //     process_session(session_, modbus_data_);
+  //     callback(session_);
+  //     cpy_inx += len + 6 - data_length_;
+  //     remain = length - cpy_inx;
+  //     data_length_ = 0;
+  //     if (remain == 0) return;      
+  //   }
+  // }
+
+  template <class ModbusData>
+  void DataService<ModbusData>::process_session(DataSession *session, ModbusData *modbus_data)
+  {
+    unsigned char func_code = session->request->data_length >= 8 ? session->request->pdu_data[0] : 0;
+    MODBUS_METRICS_BEGIN(func_code, session->request->data_length);
+    MODBUS_TRACE_BEGIN(dispatch);
+    session->response->set_raw_data(session->request->raw_data, 8);
+    // check modbus tcp data length
+    int len = HexData::bin8_to_u16(session->request->raw_data + 4) + 6;
+    if (session->request->data_length < 8 || len > 260 || session->request->data_length < len) {
+      // data_length_ < MABP(7) + FUNC_CODE(1)
+      session->response->set_code(EXP_ILLEGAL_DATA_VALUE);
+      session->response->update_mbap_length();
+      MODBUS_METRICS_END(func_code, EXP_ILLEGAL_DATA_VALUE, session->response->data_length);
+      MODBUS_TRACE_END(dispatch, TRACE_PHASE_DISPATCH, session->request->raw_data, session->request->data_length);
+      return;
+    }
+    int code = EXP_NONE;
+    switch (func_code) {
+      case MODBUS_FC_READ_COILS:  // 0x01
+      case MODBUS_FC_READ_DISCRETE_INPUTS: // 0x02
+        code = _read_bits(session, modbus_data);
+        break;
+      case MODBUS_FC_READ_HOLDING_REGS:  // 0x03
+      case MODBUS_FC_READ_INPUT_REGS:    // 0x04
+        code = _read_registers(session, modbus_data);
+        break;
+      case MODBUS_FC_WRITE_SINGLE_COIL: // 0x05
+        code = _write_single_coil_bit(session, modbus_data);
+        break;
+      case MODBUS_FC_WRITE_SINGLE_REG: // 0x06
+        code = _write_single_holding_register(session, modbus_data);
+        break;
+      case MODBUS_FC_DIAGNOSTICS: // 0x08
+        code = _diagnostics(session, modbus_data);
+        break;
+      case MODBUS_FC_WRITE_MULTIPLE_COILS:  // 0x0F
+        code = _write_multiple_coil_bits(session, modbus_data);
+        break;
+      case MODBUS_FC_WRITE_MULTIPLE_REGS:  // 0x10
+        code = _write_multiple_holding_registers(session, modbus_data);
+        break;
+      case MODBUS_FC_READ_FILE_RECORD: // 0x14
+        code = _read_file_record(session, modbus_data);
+        break;
+      case MODBUS_FC_WRITE_FILE_RECORD: // 0x15
+        code = _write_file_record(session, modbus_data);
+        break;
+      case MODBUS_FC_MASK_WRITE_REG: // 0x16
+        code = _mask_write_holding_register(session, modbus_data);
+        break;
+      case MODBUS_FC_WRITE_AND_READ_REGS: // 0x17
+        code = _write_and_read_multiple_holding_registers(session, modbus_data);
+        break;
+      
+      default:
+        code = EXP_ILLEGAL_FUNCTION;
+        break;
+    }
+    session->response->set_code(code);
+    session->response->update_mbap_length();
+    MODBUS_METRICS_END(func_code, code, session->response->data_length);
+    MODBUS_TRACE_END(dispatch, TRACE_PHASE_DISPATCH, session->request->raw_data, session->request->data_length);
+  }
+
+  /* 0x01/0x02 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_read_bits(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
+    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    int code = EXP_ILLEGAL_DATA_VALUE;
+    if (quantity >= 0x0001 && quantity <= 0x07D0) {
+      unsigned char bits[0x07D0];
+      MODBUS_TRACE_BEGIN(hook);
+      if (session->request->pdu_data[0] == MODBUS_FC_READ_COILS) {
+        code = modbus_data->read_coil_bits(start_addr, quantity, bits);
+      }
+      else {
+        code = modbus_data->read_input_bits(start_addr, quantity, bits);
+      }
+      MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+      if (code == EXP_NONE) {
+        MODBUS_TRACE_BEGIN(encode);
+        int byte_size = (quantity + 7) / 8;
+        session->response->resize_pdu_buf(byte_size + 2);
+        unsigned char data[0x07D0 / 8];
+        memset(data, 0, byte_size);
+        for (int i = 0; i < quantity; i++) {
+          if (bits[i]) {
+            data[i / 8] = data[i / 8] | (1 << (i % 8));
+          }
+        }
+        session->response->add_pdu_data(&byte_size, 1);
+        session->response->add_pdu_data(data, byte_size);
+        MODBUS_TRACE_END(encode, TRACE_PHASE_ENCODE, session->request->raw_data, session->request->data_length);
+      }
+    }
+    return code;
+  }
+
+  /* 0x03/0x04 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_read_registers(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
+    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    int code = EXP_ILLEGAL_DATA_VALUE;
+    if (quantity >= 0x0001 && quantity <= 0x007D) {
+      unsigned short regs[0x007D];
+      MODBUS_TRACE_BEGIN(hook);
+      if (session->request->pdu_data[0] == MODBUS_FC_READ_HOLDING_REGS) {
+        code = modbus_data->read_holding_registers(start_addr, quantity, regs);
+      }
+      else {
+        code = modbus_data->read_input_registers(start_addr, quantity, regs);
+        int window = ModbusMetrics::get_register_window();
+        if (code == EXP_NONE && window >= 0 && start_addr < window + MODBUS_METRICS_WINDOW_REGS && start_addr + quantity > window) {
+          // 读到统计数据映射的输入寄存器, 用统计数据覆盖回复(不写入寄存器)
+          unsigned short stats[MODBUS_METRICS_WINDOW_REGS];
+          ModbusMetrics::fill_register_window(stats);
+          int begin = start_addr > window ? start_addr : window;
+          int end = start_addr + quantity < window + MODBUS_METRICS_WINDOW_REGS ? start_addr + quantity : window + MODBUS_METRICS_WINDOW_REGS;
+          for (int i = begin; i < end; i++) regs[i - start_addr] = stats[i - window];
+        }
+      }
+      MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+      if (code == EXP_NONE) {
+        MODBUS_TRACE_BEGIN(encode);
+        unsigned char byte_size = quantity * 2;
+        session->response->resize_pdu_buf(byte_size + 2);
+        session->response->add_pdu_data(&byte_size, 1);
+        unsigned char tmp[2];
+        for (int i = 0; i < quantity; i++) {
+          HexData::bin16_to_8(regs[i], tmp);
+          session->response->add_pdu_data(tmp, 2);
+        }
+        MODBUS_TRACE_END(encode, TRACE_PHASE_ENCODE, session->request->raw_data, session->request->data_length);
+      }
+    }
+    return code;
+  }
+
+  /* 0x05 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_write_single_coil_bit(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
+    int bit_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    int bit_val = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    int code = EXP_ILLEGAL_DATA_VALUE;
+    if (bit_val == 0x0000 || bit_val == 0xFF00) {
+      unsigned char bits[1] = {bit_val == 0xFF00};
+      MODBUS_TRACE_BEGIN(hook);
+      code = modbus_data->write_coil_bits(bit_addr, bits, 1);
+      MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+      if (code == EXP_NONE) {
+        session->response->add_pdu_data(&session->request->pdu_data[1], 4);
+      }
+    }
+    return code;
+  }
+
+  /* 0x06 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_write_single_holding_register(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
+    int reg_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    unsigned short reg_val = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    unsigned short regs[1] = {reg_val};
+    MODBUS_TRACE_BEGIN(hook);
+    int code = modbus_data->write_holding_registers(reg_addr, regs, 1);
+    MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+    if (code == EXP_NONE) {
+      session->response->add_pdu_data(&session->request->pdu_data[1], 4);
+    }
+    return code;
+  }
+
+  /* 0x08 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_diagnostics(DataSession *session, ModbusData *modbus_data)
+  {
+    (void)modbus_data;
+    if (session->request->data_length < 12) return EXP_ILLEGAL_DATA_VALUE;
+    int sub_func = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    if (sub_func == DIAG_RETURN_QUERY_DATA || sub_func == DIAG_CLEAR_COUNTERS || sub_func == DIAG_CLEAR_OVERRUN_COUNTER) {
+      // 原样返回子功能和数据
+      if (sub_func == DIAG_CLEAR_COUNTERS) ModbusMetrics::clear_diagnostics();
+      int length = session->request->data_length - 8;
+      session->response->resize_pdu_buf(length + 1);
+      session->response->add_pdu_data(&session->request->pdu_data[1], length);
+      return EXP_NONE;
+    }
+    ModbusMetricsCounters counters;
+    ModbusMetrics::get_diagnostics(&counters);
+    uint64_t val = 0;
+    switch (sub_func) {
+      case DIAG_RETURN_DIAGNOSTIC_REGISTER:
+      case DIAG_SERVER_NO_RESPONSE_COUNT:
+      case DIAG_BUS_CHARACTER_OVERRUN_COUNT:
+        val = 0;
+        break;
+      case DIAG_BUS_MESSAGE_COUNT:
+        val = counters.requests + counters.frames_discarded;
+        break;
+      case DIAG_BUS_COMM_ERROR_COUNT:
+        val = counters.frames_discarded;
+        break;
+      case DIAG_BUS_EXCEPTION_ERROR_COUNT:
+        val = counters.exceptions;
+        break;
+      case DIAG_SERVER_MESSAGE_COUNT:
+        val = counters.requests;
+        break;
+      case DIAG_SERVER_NAK_COUNT:
+        val = counters.exception_codes[EXP_NEGATIVE_ACKNOWLEDGE];
+        break;
+      case DIAG_SERVER_BUSY_COUNT:
+        val = counters.exception_codes[EXP_SLAVE_DEVICE_BUSY];
+        break;
+      default:
+        return EXP_ILLEGAL_FUNCTION;
+    }
+    // 计数器为16位, 超出后回绕
+    unsigned char tmp[4];
+    HexData::bin16_to_8(sub_func, tmp);
+    HexData::bin16_to_8((unsigned short)val, tmp + 2);
+    session->response->add_pdu_data(tmp, 4);
+    return EXP_NONE;
+  }
+
+  /* 0x0F */
+  template <class ModbusData>
+  int DataService<ModbusData>::_write_multiple_coil_bits(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 13) return EXP_ILLEGAL_DATA_VALUE;
+    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    int byte_count = session->request->pdu_data[5];
+    bool quantity_ok = quantity >= 0x0001 && quantity <= 0x07B0;
+    bool byte_count_ok = byte_count >= (quantity + 7) / 8;
+    bool pdu_len_ok = (session->request->data_length - 7 - 6) >= byte_count;
+    int code = EXP_ILLEGAL_DATA_VALUE;
+    if (quantity_ok && byte_count_ok && pdu_len_ok) {
+      unsigned char bits[0x07B0];
+      for (int i = 0; i < quantity; i++) {
+        unsigned char bit_val = session->request->pdu_data[i / 8 + 6];
+        bits[i] = (bool)(bit_val & (1 << (i % 8)));
+      }
+      MODBUS_TRACE_BEGIN(hook);
+      code = modbus_data->write_coil_bits(start_addr, bits, quantity);
+      MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+      if (code == EXP_NONE) {
+        session->response->add_pdu_data(&session->request->pdu_data[1], 4);
+      }
+    }
+    return code;
+  }
+
+  /* 0x10 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_write_multiple_holding_registers(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 13) return EXP_ILLEGAL_DATA_VALUE;
+    int start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    int quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    int byte_count = session->request->pdu_data[5];
+    bool quantity_ok = quantity >= 0x0001 && quantity <= 0x007B;
+    bool byte_count_ok = byte_count == quantity * 2;
+    bool pdu_len_ok = (session->request->data_length - 7 - 6) >= byte_count;
+    int code = EXP_ILLEGAL_DATA_VALUE;
+    if (quantity_ok && byte_count_ok && pdu_len_ok) {
+      unsigned short regs[0x007B];
+      for (int i = 0; i < quantity; i++) {
+        regs[i] = HexData::bin8_to_u16(session->request->pdu_data + i * 2 + 6);
+      }
+      MODBUS_TRACE_BEGIN(hook);
+      code = modbus_data->write_holding_registers(start_addr, regs, quantity);
+      MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+      if (code == EXP_NONE) {
+        session->response->add_pdu_data(&session->request->pdu_data[1], 4);
+      }
+    }
+    return code;
+  }
+
+  /* 0x14 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_read_file_record(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 9) return EXP_ILLEGAL_DATA_VALUE;
+    unsigned char *pdu = session->request->pdu_data;
+    int byte_count = pdu[1];
+    // 每个子请求7字节: 引用类型(1) + 文件号(2) + 记录号(2) + 记录数(2)
+    if (byte_count < 0x07 || byte_count > 0xF5 || byte_count % 7 != 0 || session->request->data_length - 9 < byte_count) return EXP_ILLEGAL_DATA_VALUE;
+    int count = byte_count / 7;
+    // 先检查所有的子请求, 都合法时才读取, 回复(功能码 + 长度 + 每个子回复的长度和引用类型 + 数据)不能超过一帧
+    int res_len = 0;
+    for (int i = 0; i < count; i++) {
+      unsigned char *sub = pdu + 2 + i * 7;
+      int quantity = HexData::bin8_to_u16(sub + 5);
+      if (sub[0] != MODBUS_FILE_REF_TYPE || quantity < 1) return EXP_ILLEGAL_DATA_VALUE;
+      res_len += 2 + quantity * 2;
+      if (res_len > 0xF5) return EXP_ILLEGAL_DATA_VALUE;
+      int code = modbus_data->check_file_records(HexData::bin8_to_u16(sub + 1), HexData::bin8_to_u16(sub + 3), quantity);
+      if (code != EXP_NONE) return code;
+    }
+    unsigned char data[0xF5 + 1];
+    unsigned short regs[0xF5 / 2];
+    int offset = 1;
+    data[0] = res_len;
+    MODBUS_TRACE_BEGIN(hook);
+    for (int i = 0; i < count; i++) {
+      unsigned char *sub = pdu + 2 + i * 7;
+      int quantity = HexData::bin8_to_u16(sub + 5);
+      int code = modbus_data->read_file_records(HexData::bin8_to_u16(sub + 1), HexData::bin8_to_u16(sub + 3), quantity, regs);
+      if (code != EXP_NONE) return code;
+      data[offset] = 1 + quantity * 2;
+      data[offset + 1] = MODBUS_FILE_REF_TYPE;
+      for (int j = 0; j < quantity; j++) {
+        HexData::bin16_to_8(regs[j], data + offset + 2 + j * 2);
+      }
+      offset += 2 + quantity * 2;
+    }
+    MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+    session->response->add_pdu_data(data, offset);
+    return EXP_NONE;
+  }
+
+  /* 0x15 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_write_file_record(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 9) return EXP_ILLEGAL_DATA_VALUE;
+    unsigned char *pdu = session->request->pdu_data;
+    int byte_count = pdu[1];
+    if (byte_count < 0x09 || byte_count > 0xFB || session->request->data_length - 9 < byte_count) return EXP_ILLEGAL_DATA_VALUE;
+    // 每个子请求: 引用类型(1) + 文件号(2) + 记录号(2) + 记录数(2) + 数据(记录数 * 2)
+    // 先检查所有的子请求, 都合法时才写入, 不会只写入一部分
+    int end = 2 + byte_count;
+    int offset = 2;
+    while (offset < end) {
+      unsigned char *sub = pdu + offset;
+      if (end - offset < 7 || sub[0] != MODBUS_FILE_REF_TYPE) return EXP_ILLEGAL_DATA_VALUE;
+      int quantity = HexData::bin8_to_u16(sub + 5);
+      if (quantity < 1 || offset + 7 + quantity * 2 > end) return EXP_ILLEGAL_DATA_VALUE;
+      int code = modbus_data->check_file_records(HexData::bin8_to_u16(sub + 1), HexData::bin8_to_u16(sub + 3), quantity);
+      if (code != EXP_NONE) return code;
+      offset += 7 + quantity * 2;
+    }
+    unsigned short regs[0xFB / 2];
+    MODBUS_TRACE_BEGIN(hook);
+    offset = 2;
+    while (offset < end) {
+      unsigned char *sub = pdu + offset;
+      int quantity = HexData::bin8_to_u16(sub + 5);
+      for (int i = 0; i < quantity; i++) {
+        regs[i] = HexData::bin8_to_u16(sub + 7 + i * 2);
+      }
+      int code = modbus_data->write_file_records(HexData::bin8_to_u16(sub + 1), HexData::bin8_to_u16(sub + 3), regs, quantity);
+      if (code != EXP_NONE) return code;
+      offset += 7 + quantity * 2;
+    }
+    MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+    // 回复和请求相同
+    session->response->add_pdu_data(&pdu[1], 1 + byte_count);
+    return EXP_NONE;
+  }
+
+  /* 0x16 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_mask_write_holding_register(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 14) return EXP_ILLEGAL_DATA_VALUE;
+    int ref_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    unsigned short and_mask = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    unsigned short or_mask = HexData::bin8_to_u16(session->request->pdu_data + 5);
+    MODBUS_TRACE_BEGIN(hook);
+    int code = modbus_data->mask_write_holding_register(ref_addr, and_mask, or_mask);
+    MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+    if (code == EXP_NONE) {
+      session->response->add_pdu_data(&session->request->pdu_data[1], 6);
+    }
+    return code;
+  }
+
+  /* 0x17 */
+  template <class ModbusData>
+  int DataService<ModbusData>::_write_and_read_multiple_holding_registers(DataSession *session, ModbusData *modbus_data)
+  {
+    if (session->request->data_length < 17) return EXP_ILLEGAL_DATA_VALUE;
+    int r_start_addr = HexData::bin8_to_u16(session->request->pdu_data + 1);
+    int r_quantity = HexData::bin8_to_u16(session->request->pdu_data + 3);
+    int w_start_addr = HexData::bin8_to_u16(session->request->pdu_data + 5);
+    int w_quantity = HexData::bin8_to_u16(session->request->pdu_data + 7);
+    int byte_count = session->request->pdu_data[9];
+    bool r_quantity_ok = r_quantity >= 0x0001 && r_quantity <= 0x007D;
+    bool w_quantity_ok = w_quantity >= 0x0001 && w_quantity <= 0x0079;
+    bool byte_count_ok = byte_count == w_quantity * 2;
+    bool pdu_len_ok = (session->request->data_length - 7 - 10) >= byte_count;
+    int code = EXP_ILLEGAL_DATA_VALUE;
+    if (r_quantity_ok && w_quantity_ok && byte_count_ok && pdu_len_ok) {
+      unsigned short r_regs[0x007D];
+      unsigned short w_regs[0x0079];
+      for (int i = 0; i < w_quantity; i++) {
+        w_regs[i] = HexData::bin8_to_u16(session->request->pdu_data + i * 2 + 10);
+      }
+      MODBUS_TRACE_BEGIN(hook);
+      code = modbus_data->write_and_read_holding_registers(w_start_addr, w_regs, w_quantity, r_start_addr, r_quantity, r_regs);
+      MODBUS_TRACE_END(hook, TRACE_PHASE_HOOK, session->request->raw_data, session->request->data_length);
+      if (code == EXP_NONE) {
+        unsigned char byte_size = r_quantity * 2;
+        session->response->resize_pdu_buf(byte_size + 2);
+        session->response->add_pdu_data(&byte_size, 1);
+        unsigned char tmp[2];
+        for (int i = 0; i < r_quantity; i++) {
+          HexData::bin16_to_8(r_regs[i], tmp);
+          session->response->add_pdu_data(tmp, 2);
+        }
+      }
+    }
+    return code;
+  }
+}
+
+#endif // _MODBUS_TCP_DATA_IMPL_H_
@@ -0,0 +1,278 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <chrono>
+#include "modbus_tcp_proxy.h"
+
+namespace ModbusTCP
+{
+  Proxy::Proxy(ModbusBaseData *mirror, const char *upstream_ip, int upstream_port, int listen_port, const char *listen_ip)
+  : mirror_(mirror), upstream_port_(upstream_port)
+  {
+    strncpy(upstream_ip_, upstream_ip, sizeof(upstream_ip_) - 1);
+    upstream_ip_[sizeof(upstream_ip_) - 1] = '\0';
+    write_gen_ = 0;
+    upstream_timeout_ms_ = 1000;
+    poll_interval_ms_ = 100;
+    server_ = new Server<ModbusBaseData>(mirror, listen_port, listen_ip);
+    server_->set_session_handler(_session_handler, this);
+    poll_client_ = new Client(16);
+    forward_client_ = new Client(1);
+    forward_response_ = new DataFrame(260);
+    mirror_session_ = new DataSession(260, 260);
+    forward_jobs_.reserve(16);
+    forward_batch_.reserve(16);
+    running_ = false;
+    poll_thread_ = NULL;
+    forward_thread_ = NULL;
+    poll_count_ = 0;
+    forward_count_ = 0;
+  }
+
+  Proxy::~Proxy()
+  {
+    stop();
+    delete server_;
+    delete poll_client_;
+    delete forward_client_;
+    delete forward_response_;
+    delete mirror_session_;
+    for (int i = 0; i < (int)ranges_.size(); i++) {
+      delete[] ranges_[i].buf;
+    }
+  }
+
+  int Proxy::add_poll_range(unsigned char func_code, int addr, int count)
+  {
+    if (func_code < MODBUS_FC_READ_COILS || func_code > MODBUS_FC_READ_INPUT_REGS || count < 1) return CLIENT_INVALID_REQUEST;
+    bool is_bit = func_code <= MODBUS_FC_READ_DISCRETE_INPUTS;
+    int limit = is_bit ? 0x07D0 : 0x007D;
+    while (count > 0) {
+      PollRange range;
+      range.func_code = func_code;
+      range.addr = addr;
+      range.count = count > limit ? limit : count;
+      range.valid = false;
+      range.buf = new unsigned char[range.count * (is_bit ? 1 : 2)];
+      range.tag_id = planner_.add_tag(func_code, range.addr, range.count, range.buf);
+      if (range.tag_id < 0) {
+        delete[] range.buf;
+        return range.tag_id;
+      }
+      ranges_.push_back(range);
+      addr += range.count;
+      count -= range.count;
+    }
+    return EXP_NONE;
+  }
+
+  int Proxy::start(void)
+  {
+    if (server_->start() != 0) return -1;
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      running_ = true;
+    }
+    poll_thread_ = new std::thread(&Proxy::_poll_loop, this);
+    forward_thread_ = new std::thread(&Proxy::_forward_loop, this);
+    return 0;
+  }
+
+  void Proxy::run(void)
+  {
+    server_->run();
+  }
+
+  void Proxy::stop(void)
+  {
+    {
+      std::lock_guard<std::mutex> guard(mutex_);
+      running_ = false;
+    }
+    cond_.notify_all();
+    forward_cond_.notify_all();
+    server_->stop();
+    if (poll_thread_ != NULL) {
+      poll_thread_->join();
+      delete poll_thread_;
+      poll_thread_ = NULL;
+    }
+    if (forward_thread_ != NULL) {
+      forward_thread_->join();
+      delete forward_thread_;
+      forward_thread_ = NULL;
+    }
+  }
+
+  int Proxy::_connect(Client *client)
+  {
+    client->set_timeout(upstream_timeout_ms_);
+    if (client->is_connected()) return EXP_NONE;
+    return client->connect(upstream_ip_, upstream_port_, upstream_timeout_ms_);
+  }
+
+  void Proxy::_poll_loop(void)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+      std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + std::chrono::milliseconds(poll_interval_ms_);
+      lock.unlock();
+      uint64_t write_gen;
+      {
+        std::lock_guard<std::mutex> guard(mirror_mutex_);
+        write_gen = write_gen_;
+      }
+      // 访问上游期间不持有任何锁, 转发和下游的读请求不受影响
+      int code = _connect(poll_client_);
+      if (code == EXP_NONE) code = planner_.poll(poll_client_);
+      _apply_poll(code, write_gen);
+      if (code == EXP_NONE) poll_count_++;
+      lock.lock();
+      cond_.wait_until(lock, next, [this]() { return !running_; });
+    }
+  }
+
+  void Proxy::_apply_poll(int code, uint64_t write_gen)
+  {
+    // 一个周期的结果在同一次加锁内写入, 下游读到的是同一个周期的值
+    std::lock_guard<std::mutex> guard(mirror_mutex_);
+    bool written = write_gen_ != write_gen;
+    for (int i = 0; i < (int)ranges_.size(); i++) {
+      PollRange &range = ranges_[i];
+      if (code != EXP_NONE || planner_.get_tag(range.tag_id)->code != EXP_NONE) {
+        // 轮询失败的区间不再由镜像寄存器回复
+        range.valid = false;
+        continue;
+      }
+      switch (range.func_code) {
+        case MODBUS_FC_READ_COILS:
+          // 轮询期间有转发的写操作时, 读到的可能是写之前的值, 保留镜像寄存器里写入的值
+          if (written) continue;
+          mirror_->write_coil_bits(range.addr, range.buf, range.count);
+          break;
+        case MODBUS_FC_READ_DISCRETE_INPUTS:
+          mirror_->write_input_bits(range.addr, range.buf, range.count);
+          break;
+        case MODBUS_FC_READ_HOLDING_REGS:
+          if (written) continue;
+          mirror_->write_holding_registers(range.addr, (unsigned short *)range.buf, range.count);
+          break;
+        case MODBUS_FC_READ_INPUT_REGS:
+          mirror_->write_input_registers(range.addr, (unsigned short *)range.buf, range.count);
+          break;
+      }
+      range.valid = true;
+    }
+  }
+
+  bool Proxy::_is_cached(unsigned char *req, int len)
+  {
+    unsigned char func_code = req[7];
+    if (func_code < MODBUS_FC_READ_COILS || func_code > MODBUS_FC_READ_INPUT_REGS) return false;
+    // 请求本身非法时由镜像寄存器按默认方式回复异常
+    if (len < 12) return true;
+    int addr = HexData::bin8_to_u16(req + 8);
+    int count = HexData::bin8_to_u16(req + 10);
+    int limit = func_code <= MODBUS_FC_READ_DISCRETE_INPUTS ? 0x07D0 : 0x007D;
+    if (count < 1 || count > limit) return true;
+    // 请求的每个地址都要落在最近一次轮询成功的区间内(可以跨相邻的区间)
+    int end = addr + count;
+    while (addr < end) {
+      int i = 0;
+      for (; i < (int)ranges_.size(); i++) {
+        const PollRange &range = ranges_[i];
+        if (range.valid && range.func_code == func_code && range.addr <= addr && addr < range.addr + range.count) break;
+      }
+      if (i == (int)ranges_.size()) return false;
+      addr = ranges_[i].addr + ranges_[i].count;
+    }
+    return true;
+  }
+
+  void Proxy::_session_handler(DataSession *session, ModbusBaseData *mirror, void *arg)
+  {
+    Proxy *self = (Proxy *)arg;
+    unsigned char *req = (unsigned char *)session->get_request_data();
+    int req_len = session->get_request_length();
+    int len = req_len >= 7 ? HexData::bin8_to_u16(req + 4) + 6 : 0;
+    {
+      std::lock_guard<std::mutex> guard(self->mirror_mutex_);
+      if (req_len < 8 || len > MODBUS_TCP_MAX_FRAME_SIZE || req_len < len || self->_is_cached(req, len)) {
+        // 缓存的读请求由镜像寄存器回复, 帧格式错误时按默认方式回复异常
+        DataService<ModbusBaseData>::process_session(session, mirror);
+        return;
+      }
+    }
+    // 转发给上游, 回复由转发线程交回事件循环线程
+    uint64_t token = self->server_->defer_response();
+    if (token == 0) return;
+    std::lock_guard<std::mutex> guard(self->mutex_);
+    self->forward_jobs_.push_back(ForwardJob());
+    ForwardJob &job = self->forward_jobs_.back();
+    job.token = token;
+    job.length = len;
+    memcpy(job.req, req, len);
+    self->forward_cond_.notify_one();
+  }
+
+  void Proxy::_forward_loop(void)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      forward_cond_.wait(lock, [this]() { return !running_ || !forward_jobs_.empty(); });
+      if (!running_) break;
+      // 两个数组交换使用, 稳定后不再申请内存
+      forward_batch_.swap(forward_jobs_);
+      lock.unlock();
+      for (int i = 0; i < (int)forward_batch_.size(); i++) {
+        _forward(&forward_batch_[i]);
+      }
+      forward_batch_.clear();
+      lock.lock();
+    }
+  }
+
+  void Proxy::_forward(ForwardJob *job)
+  {
+    unsigned char *req = job->req;
+    int len = job->length;
+    int code = _connect(forward_client_);
+    if (code == EXP_NONE) {
+      forward_client_->set_unit_id(req[6]);
+      code = forward_client_->transact(req + 7, len - 7, forward_response_);
+    }
+    forward_count_++;
+    unsigned char res[MODBUS_TCP_MAX_FRAME_SIZE];
+    int res_len;
+    memcpy(res, req, 7);
+    if (code != EXP_NONE) {
+      // 上游不可达或者超时
+      res[7] = req[7] | 0x80;
+      res[8] = code == CLIENT_TIMEOUT ? EXP_GATEWAY_TARGET_DEVICE_FAILED_TO_RESPOND : EXP_GATEWAY_PATH_UNAVAILABLE;
+      HexData::bin16_to_8(3, res + 4);
+      res_len = 9;
+    }
+    else {
+      // 回复上游的PDU, MBAP的事务标识保持下游请求的
+      int res_pdu_len = forward_response_->data_length - 7;
+      memcpy(res + 7, forward_response_->pdu_data, res_pdu_len);
+      HexData::bin16_to_8(res_pdu_len + 1, res + 4);
+      res_len = 7 + res_pdu_len;
+      if (!(res[7] & 0x80) && (req[7] < MODBUS_FC_READ_COILS || req[7] > MODBUS_FC_READ_INPUT_REGS)) {
+        // 上游写成功, 先更新镜像寄存器再回复, 下游收到回复后马上可以读到写入的值
+        std::lock_guard<std::mutex> guard(mirror_mutex_);
+        mirror_session_->set_request_data(req, len);
+        DataService<ModbusBaseData>::process_session(mirror_session_, mirror_);
+        write_gen_++;
+      }
+    }
+    server_->post_response(job->token, res, res_len);
+  }
+}
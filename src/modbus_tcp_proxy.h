@@ -0,0 +1,134 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_TCP_PROXY_H_
+#define _MODBUS_TCP_PROXY_H_
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include "modbus_tcp_server.h"
+#include "modbus_poll_plan.h"
+
+namespace ModbusTCP
+{
+  /* Proxy: 带缓存的Modbus TCP代理(网关)
+   * 1. 对下游(HMI等)是Modbus TCP服务器, 帧处理和DataService一致
+   * 2. 后台线程按固定周期轮询上游设备, 一个周期的结果在镜像锁内一起写入镜像寄存器(mirror)
+   * 3. 下游的读请求(0x01/0x02/0x03/0x04)完全落在最近一次轮询成功的区间内时直接由镜像寄存器回复,
+   *    否则(没有轮询的地址、上游不可达等)转发给上游, 不会回复上游没有给出的值
+   * 4. 其它请求(写操作等)转发给上游, 上游回复成功后先更新镜像寄存器再回复下游
+   * 5. 转发由单独的线程和单独的上游连接完成, 事件循环线程不等待上游(见Server::defer_response),
+   *    等待上游回复期间只暂停发出请求的下游连接, 其它下游连接照常由镜像寄存器回复
+   * 这样N个HMI轮询同一个PLC, PLC只需要应付代理的一路轮询
+   */
+  class Proxy
+  {
+  public:
+    /* Proxy: 构造代理
+     * @param mirror: 镜像寄存器, 地址范围需要覆盖所有的轮询区间
+     * @param upstream_ip: 上游设备IP
+     * @param upstream_port: 上游设备端口
+     * @param listen_port: 代理的监听端口, 为0时由系统分配
+     * @param listen_ip: 代理的监听地址
+     */
+    Proxy(ModbusBaseData *mirror, const char *upstream_ip, int upstream_port = 502, int listen_port = 502, const char *listen_ip = "0.0.0.0");
+    ~Proxy();
+
+    /* add_poll_range: 添加需要轮询(缓存)的区间, 需要在start之前调用
+     * @param func_code: 0x01/0x02/0x03/0x04
+     * @param addr: 起始地址
+     * @param count: 个数, 超过单个请求限制的区间会被拆分
+     * :return: 成功返回0
+     */
+    int add_poll_range(unsigned char func_code, int addr, int count);
+
+    /* set_poll_interval: 设置轮询上游的周期(毫秒), 默认100 */
+    void set_poll_interval(int interval_ms) { poll_interval_ms_ = interval_ms; }
+
+    /* set_upstream_timeout: 设置等待上游回复的超时(毫秒), 默认1000 */
+    void set_upstream_timeout(int timeout_ms) { upstream_timeout_ms_ = timeout_ms; }
+
+    /* start: 开始监听并启动后台轮询线程
+     * :return: 成功返回0
+     */
+    int start(void);
+
+    /* run: 运行下游的事件循环, 直到调用stop */
+    void run(void);
+
+    /* stop: 停止事件循环、轮询线程和转发线程(可以在别的线程调用) */
+    void stop(void);
+
+    /* get_port: 获取代理实际监听的端口 */
+    int get_port(void) { return server_->get_port(); }
+
+    /* get_poll_count: 获取成功轮询上游的次数 */
+    unsigned long get_poll_count(void) { return poll_count_; }
+
+    /* get_forward_count: 获取转发给上游的请求数 */
+    unsigned long get_forward_count(void) { return forward_count_; }
+
+  private:
+    struct PollRange {
+      unsigned char func_code;
+      int addr;
+      int count;
+      int tag_id;
+      unsigned char *buf;
+      bool valid;        // 最近一次轮询是否成功(镜像寄存器里的值是否可以回复给下游)
+    };
+
+    struct ForwardJob {
+      uint64_t token;    // Server::defer_response返回的标识
+      int length;
+      unsigned char req[MODBUS_TCP_MAX_FRAME_SIZE];
+    };
+
+    static void _session_handler(DataSession *session, ModbusBaseData *mirror, void *arg);
+    bool _is_cached(unsigned char *req, int len);
+    void _forward(ForwardJob *job);
+    void _forward_loop(void);
+    void _poll_loop(void);
+    void _apply_poll(int code, uint64_t write_gen);
+    int _connect(Client *client);
+
+  private:
+    ModbusBaseData *mirror_;
+    std::mutex mirror_mutex_;     // 镜像寄存器和区间的状态, 事件循环、轮询、转发线程共用, 持有期间不访问网络
+    uint64_t write_gen_;          // 转发成功的写操作的次数, 轮询期间有写操作时不使用这个周期读到的可写寄存器
+    Server<ModbusBaseData> *server_;
+    char upstream_ip_[64];
+    int upstream_port_;
+    std::atomic<int> upstream_timeout_ms_;
+    int poll_interval_ms_;
+
+    Client *poll_client_;         // 轮询用的上游连接, 只在轮询线程使用
+    Client *forward_client_;      // 转发用的上游连接, 只在转发线程使用
+    PollPlanner planner_;
+    std::vector<PollRange> ranges_;
+    DataFrame *forward_response_; // 转发时存放上游的回复
+    DataSession *mirror_session_; // 转发成功后更新镜像寄存器用
+    std::vector<ForwardJob> forward_jobs_;  // 等待转发的请求(每个下游连接最多一个)
+    std::vector<ForwardJob> forward_batch_; // 转发线程正在处理的请求
+
+    bool running_;
+    std::mutex mutex_;            // running_和forward_jobs_
+    std::condition_variable cond_;
+    std::condition_variable forward_cond_;
+    std::thread *poll_thread_;
+    std::thread *forward_thread_;
+    std::atomic<unsigned long> poll_count_;
+    std::atomic<unsigned long> forward_count_;
+  };
+}
+
+#endif // _MODBUS_TCP_PROXY_H_
@@ -0,0 +1,35 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include "modbus_tcp_server_impl.h"
+
+namespace ModbusTCP
+{
+  /* 模板类需要特化 */
+  template class Server<ModbusBaseData>;
+  template class Server<ModbusStructData>;
+  template class Server<ModbusBasePtrData>;
+  template class Server<ModbusStructPtrData>;
+
+  template class Server<ModbusDataTemplate<modbus_bit_base_data, modbus_reg_base_ptr_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_base_data, modbus_reg_struct_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_base_data, modbus_reg_struct_ptr_data>>;
+
+  template class Server<ModbusDataTemplate<modbus_bit_base_ptr_data, modbus_reg_base_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_base_ptr_data, modbus_reg_struct_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_base_ptr_data, modbus_reg_struct_ptr_data>>;
+
+  template class Server<ModbusDataTemplate<modbus_bit_struct_data, modbus_reg_base_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_struct_data, modbus_reg_base_ptr_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_struct_data, modbus_reg_struct_ptr_data>>;
+
+  template class Server<ModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_base_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_base_ptr_data>>;
+  template class Server<ModbusDataTemplate<modbus_bit_struct_ptr_data, modbus_reg_struct_data>>;
+}
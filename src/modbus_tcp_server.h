@@ -0,0 +1,223 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_TCP_SERVER_H_
+#define _MODBUS_TCP_SERVER_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "modbus_tcp_data.h"
+#include "modbus_timer_wheel.h"
+
+namespace ModbusTCP
+{
+  /* Server: Modbus TCP服务器
+   * 1. 单线程epoll事件循环, 每个连接一个DataService(处理粘包)
+   * 2. 回复先放到连接的发送缓冲区, socket不可写时等待EPOLLOUT再发送
+   * 3. ModbusData指Modbus数据操作类(非静态), 和DataService<ModbusData>一致
+   * 4. 连接、DataService及其DataSession/DataFrame都从ModbusPool申请, 频繁断开重连不会反复malloc
+   * 5. 公平调度: 收到的数据先放到连接的接收缓冲区, 每轮事件循环按赤字轮询(DRR)逐个连接处理完整的帧,
+   *    每个连接每轮最多处理max_frames帧, 且处理的字节数(请求+回复)不超过累计的额度(quantum);
+   *    一个客户端流水线发送大量请求时, 其它客户端的请求仍然在下一轮被处理
+   * 6. 背压: 连接待发送的回复超过tx_limit字节时, 暂停处理和读取这个连接, 直到对方把回复收走
+   * 7. 超时: 空闲连接和不完整的帧由时间轮(ModbusTimerWheel)处理, 每轮事件循环只取一次时间,
+   *    收到数据时只记录时间, 不操作定时器, 到期时再检查是否真的空闲
+   * 8. 延后回复: 自定义的帧处理方法可以通过defer_response把回复交给别的线程(比如转发给上游),
+   *    由post_response交回事件循环线程发送, 等待期间只暂停这个连接;
+   *    回复的标识包含连接在槽位表中的下标, 查找连接不需要遍历连接链表
+   */
+  template <class ModbusData>
+  class Server
+  {
+  public:
+    /* Server: 构造服务器
+     * @param modbus_data: 寄存器操作实例
+     * @param port: 监听端口, 为0时由系统分配(通过get_port获取)
+     * @param ip: 监听地址
+     */
+    Server(ModbusData *modbus_data, int port = 502, const char *ip = "0.0.0.0");
+    ~Server();
+
+    /* start: 创建socket并开始监听
+     * :return: 成功返回0, 失败返回-1
+     */
+    int start(void);
+
+    /* run: 运行事件循环, 直到调用stop */
+    void run(void);
+
+    /* run_once: 处理一次事件
+     * @param timeout_ms: 等待事件的超时(毫秒)
+     * :return: 处理的事件个数, 出错返回-1
+     */
+    int run_once(int timeout_ms);
+
+    /* stop: 停止事件循环(可以在别的线程调用) */
+    void stop(void);
+
+    /* get_port: 获取实际监听的端口 */
+    int get_port(void) { return port_; }
+
+    /* get_connection_count: 获取当前的连接数 */
+    int get_connection_count(void) { return conn_count_; }
+
+    /* set_session_handler: 设置所有连接的自定义帧处理方法, 见DataService::set_session_handler */
+    void set_session_handler(typename DataService<ModbusData>::SessionHandler handler, void *arg);
+
+    /* set_fairness: 设置公平调度的参数
+     * @param max_frames: 每个连接每轮最多处理的帧数
+     * @param quantum: 每个连接每轮增加的额度(请求+回复的字节数)
+     */
+    void set_fairness(int max_frames, int quantum);
+
+    /* set_tx_limit: 设置背压的阈值
+     * @param bytes: 连接待发送的回复超过这个字节数时暂停处理和读取这个连接
+     */
+    void set_tx_limit(int bytes);
+
+    /* get_throttled_count: 获取因为背压暂停连接的次数 */
+    uint64_t get_throttled_count(void) { return throttled_count_; }
+
+    /* set_idle_timeout: 设置空闲连接的超时, 对之后建立的连接生效
+     * @param ms: 超过这个时间(毫秒)没有收到数据的连接被关闭, 为0时不关闭
+     */
+    void set_idle_timeout(unsigned int ms) { idle_timeout_ms_ = ms; }
+
+    /* set_frame_timeout: 设置不完整的帧的超时
+     * @param ms: 收到一帧的一部分后超过这个时间(毫秒)还没收完时丢弃这部分数据, 为0时不丢弃
+     */
+    void set_frame_timeout(unsigned int ms) { frame_timeout_ms_ = ms; }
+
+    /* defer_response: 在自定义的帧处理方法(set_session_handler)里调用, 当前这一帧的回复稍后由post_response给出
+     * 1. 帧处理方法设置的回复被忽略
+     * 2. 回复给出之前不再处理这个连接后面的帧, 回复的顺序和请求一致, 其它连接不受影响
+     * :return: 回复的标识(交给post_response), 不在事件循环线程的帧处理方法里调用时返回0
+     */
+    uint64_t defer_response(void);
+
+    /* post_response: 给出defer_response延后的回复(可以在别的线程调用)
+     * 回复放到队列里并唤醒事件循环, 由事件循环线程写入连接的发送缓冲区; 连接已经关闭时丢弃
+     * @param token: defer_response返回的标识
+     * @param data: 完整的回复(MBAP + PDU)
+     * @param length: 回复长度, 不超过MODBUS_TCP_MAX_FRAME_SIZE
+     * :return: 成功返回0, 参数错误返回-1
+     */
+    int post_response(uint64_t token, const unsigned char *data, int length);
+
+    /* get_timer_wheel: 获取事件循环的时间轮
+     * 自定义的帧处理方法(set_session_handler)等在事件循环线程里运行的代码可以用它添加自己的超时
+     */
+    ModbusTimerWheel *get_timer_wheel(void) { return &timers_; }
+
+    /* get_idle_closed_count: 获取因为空闲超时关闭的连接数 */
+    uint64_t get_idle_closed_count(void) { return idle_closed_count_; }
+
+    /* get_frame_expired_count: 获取因为超时丢弃的不完整的帧数 */
+    uint64_t get_frame_expired_count(void) { return frame_expired_count_; }
+
+  private:
+    struct Connection {
+      int fd;
+      DataService<ModbusData> *service;
+      unsigned char *tx_buf;  // 待发送的回复
+      int tx_size;
+      int tx_length;
+      int tx_offset;
+      unsigned char *rx_buf;  // 收到但还没有处理的数据
+      int rx_length;
+      int rx_offset;
+      int deficit;            // DRR的剩余额度(字节)
+      unsigned int events;    // 当前注册的epoll事件
+      bool want_write;        // 是否在等待EPOLLOUT
+      bool ready;             // 是否在就绪链表中(有完整的帧等待处理)
+      int client_id;          // 访问热度统计的客户端id, 见ModbusHeatmap
+      uint64_t id;            // 连接的标识, 延后回复用(高32位为序号, 低32位为槽位下标)
+      int slot;               // 在slots_中的下标
+      bool deferred;          // 是否在等待延后的回复
+      bool closing;           // 是否等本轮的事件处理完再关闭
+      uint64_t last_active_ms; // 最近一次收到数据的时间
+      ModbusTimer idle_timer;  // 空闲超时
+      ModbusTimer frame_timer; // 不完整的帧的超时
+      Server *server;
+      Connection *prev;       // 连接链表
+      Connection *next;
+      Connection *ready_prev; // 就绪链表
+      Connection *ready_next;
+      Connection *closing_next; // 待关闭链表
+      MODBUS_POOL_OPERATORS
+    };
+
+    struct DeferredResponse {
+      uint64_t token;
+      int length;
+      unsigned char data[MODBUS_TCP_MAX_FRAME_SIZE];
+    };
+
+    void _accept(void);
+    void _read(Connection *conn);
+    int _serve(Connection *conn);
+    void _schedule(void);
+    int _next_frame_length(Connection *conn);
+    bool _is_throttled(Connection *conn) { return conn->tx_length - conn->tx_offset >= tx_limit_; }
+    void _push_ready(Connection *conn);
+    void _remove_ready(Connection *conn);
+    int _flush(Connection *conn);
+    void _close(Connection *conn);
+    void _close_later(Connection *conn);
+    void _close_pending(void);
+    void _update_events(Connection *conn);
+    void _update_frame_timer(Connection *conn);
+    void _drain_deferred(void);
+    static uint64_t _now_ms(void);
+    static void _on_idle_timer(ModbusTimer *timer, void *arg);
+    static void _on_frame_timer(ModbusTimer *timer, void *arg);
+    static void _on_response(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len, void *arg);
+
+  private:
+    ModbusData *modbus_data_;
+    char ip_[64];
+    int port_;
+    int listen_fd_;
+    int epoll_fd_;
+    int wake_fd_;           // eventfd, 用来在别的线程唤醒事件循环
+    std::atomic<bool> running_;
+    int conn_count_;
+    Connection *conns_;     // 所有连接的链表头
+    Connection *ready_head_; // 有完整的帧等待处理的连接(按轮询顺序)
+    Connection *ready_tail_;
+    int max_frames_;        // 每个连接每轮最多处理的帧数
+    int quantum_;           // 每个连接每轮增加的额度(字节)
+    int tx_limit_;          // 背压的阈值(字节)
+    uint64_t throttled_count_;
+    ModbusTimerWheel timers_;
+    uint64_t now_ms_;       // 本轮事件循环的时间(毫秒)
+    unsigned int idle_timeout_ms_;
+    unsigned int frame_timeout_ms_;
+    uint64_t idle_closed_count_;
+    uint64_t frame_expired_count_;
+    ModbusPool rx_pool_;    // 连接的接收缓冲区
+    typename DataService<ModbusData>::SessionHandler session_handler_;
+    void *session_handler_arg_;
+    uint64_t next_conn_id_;
+    std::vector<Connection *> slots_; // 按槽位下标查找连接, 关闭的连接对应NULL
+    std::vector<int> free_slots_;     // 空闲的槽位下标
+    Connection *closing_;   // 等本轮的事件处理完再关闭的连接
+    Connection *serving_;   // 正在处理帧的连接
+    std::mutex deferred_mutex_;
+    std::vector<DeferredResponse> deferred_;      // 别的线程交回的回复
+    std::vector<DeferredResponse> deferred_swap_; // 事件循环线程正在处理的回复
+  };
+}
+
+#ifdef MODBUS_HEADER_ONLY
+#include "modbus_tcp_server_impl.h"
+#endif
+
+#endif // _MODBUS_TCP_SERVER_H_
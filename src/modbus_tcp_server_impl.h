@@ -0,0 +1,629 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+/* modbus_tcp_server.h中Server的实现, 包含方式同modbus_tcp_data_impl.h */
+
+#ifndef _MODBUS_TCP_SERVER_IMPL_H_
+#define _MODBUS_TCP_SERVER_IMPL_H_
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include "modbus_tcp_server.h"
+#include "modbus_heatmap.h"
+#include "modbus_log.h"
+#include "modbus_metrics.h"
+#include "modbus_rt.h"
+
+#define SERVER_MAX_EVENTS 64
+#define SERVER_RECV_BUF_SIZE 4096
+#define SERVER_DEFAULT_MAX_FRAMES 16     // 每个连接每轮最多处理的帧数
+#define SERVER_DEFAULT_QUANTUM 1024      // 每个连接每轮增加的额度(字节)
+#define SERVER_DEFAULT_TX_LIMIT 65536    // 待发送的回复超过这个字节数时暂停这个连接
+#define SERVER_TIMER_TICK_MS 10          // 时间轮的精度(毫秒)
+#define SERVER_HEAT_CLIENT_UNKNOWN -2    // 连接还没有注册访问热度的客户端
+
+namespace ModbusTCP
+{
+  template <class ModbusData>
+  Server<ModbusData>::Server(ModbusData *modbus_data, int port, const char *ip)
+  : modbus_data_(modbus_data), port_(port), timers_(SERVER_TIMER_TICK_MS, _now_ms()), rx_pool_(SERVER_RECV_BUF_SIZE, 16)
+  {
+    strncpy(ip_, ip, sizeof(ip_) - 1);
+    ip_[sizeof(ip_) - 1] = '\0';
+    listen_fd_ = -1;
+    epoll_fd_ = -1;
+    wake_fd_ = -1;
+    running_ = false;
+    conn_count_ = 0;
+    conns_ = NULL;
+    ready_head_ = NULL;
+    ready_tail_ = NULL;
+    max_frames_ = SERVER_DEFAULT_MAX_FRAMES;
+    quantum_ = SERVER_DEFAULT_QUANTUM;
+    tx_limit_ = SERVER_DEFAULT_TX_LIMIT;
+    throttled_count_ = 0;
+    now_ms_ = timers_.get_now();
+    idle_timeout_ms_ = 0;
+    frame_timeout_ms_ = 0;
+    idle_closed_count_ = 0;
+    frame_expired_count_ = 0;
+    session_handler_ = NULL;
+    session_handler_arg_ = NULL;
+    next_conn_id_ = 1;
+    serving_ = NULL;
+    closing_ = NULL;
+  }
+
+  template <class ModbusData>
+  Server<ModbusData>::~Server()
+  {
+    while (conns_ != NULL) {
+      _close(conns_);
+    }
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::set_session_handler(typename DataService<ModbusData>::SessionHandler handler, void *arg)
+  {
+    session_handler_ = handler;
+    session_handler_arg_ = arg;
+  }
+
+  template <class ModbusData>
+  uint64_t Server<ModbusData>::defer_response(void)
+  {
+    if (serving_ == NULL) return 0;
+    serving_->deferred = true;
+    return serving_->id;
+  }
+
+  template <class ModbusData>
+  int Server<ModbusData>::post_response(uint64_t token, const unsigned char *data, int length)
+  {
+    if (token == 0 || length <= 0 || length > MODBUS_TCP_MAX_FRAME_SIZE) return -1;
+    {
+      std::lock_guard<std::mutex> guard(deferred_mutex_);
+      deferred_.push_back(DeferredResponse());
+      DeferredResponse &res = deferred_.back();
+      res.token = token;
+      res.length = length;
+      memcpy(res.data, data, length);
+    }
+    if (wake_fd_ >= 0) {
+      uint64_t val = 1;
+      ssize_t ret = write(wake_fd_, &val, sizeof(val));
+      (void)ret;
+    }
+    return 0;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_drain_deferred(void)
+  {
+    {
+      // 两个数组交换使用, 稳定后不再申请内存
+      std::lock_guard<std::mutex> guard(deferred_mutex_);
+      deferred_swap_.swap(deferred_);
+    }
+    for (int i = 0; i < (int)deferred_swap_.size(); i++) {
+      DeferredResponse &res = deferred_swap_[i];
+      uint32_t slot = (uint32_t)res.token;
+      if (slot >= slots_.size()) continue;
+      Connection *conn = slots_[slot];
+      // 连接已经关闭(槽位可能已经给了新的连接)
+      if (conn == NULL || conn->id != res.token || conn->closing || !conn->deferred) continue;
+      conn->deferred = false;
+      _on_response(NULL, 0, res.data, res.length, conn);
+      // 发送回复, 还有完整的帧时放回就绪链表;
+      // 在events的处理过程中调用, 后面可能还有这个连接的事件, 不能在这里关闭
+      if (_flush(conn) < 0) _close_later(conn);
+    }
+    deferred_swap_.clear();
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::set_fairness(int max_frames, int quantum)
+  {
+    max_frames_ = max_frames < 1 ? 1 : max_frames;
+    quantum_ = quantum < 1 ? 1 : quantum;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::set_tx_limit(int bytes)
+  {
+    // 至少能放下一个最大的回复, 否则连接会一直暂停
+    tx_limit_ = bytes < MODBUS_TCP_MAX_FRAME_SIZE ? MODBUS_TCP_MAX_FRAME_SIZE : bytes;
+  }
+
+  template <class ModbusData>
+  int Server<ModbusData>::start(void)
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    if (inet_pton(AF_INET, ip_, &addr.sin_addr) != 1) return -1;
+
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) return -1;
+    int opt = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (bind(listen_fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd_, 128) != 0) {
+      close(listen_fd_);
+      listen_fd_ = -1;
+      return -1;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listen_fd_, (struct sockaddr *)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev;
+    // data.ptr为NULL表示监听socket, 为this表示唤醒事件, 其它为连接
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    running_ = true;
+    return 0;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::run(void)
+  {
+    while (running_) {
+      if (run_once(1000) < 0) break;
+    }
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::stop(void)
+  {
+    running_ = false;
+    if (wake_fd_ >= 0) {
+      uint64_t val = 1;
+      ssize_t ret = write(wake_fd_, &val, sizeof(val));
+      (void)ret;
+    }
+  }
+
+  template <class ModbusData>
+  int Server<ModbusData>::run_once(int timeout_ms)
+  {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    // 还有连接的帧没处理完时不等待, 有定时器时最多等到最早的定时器到期
+    int next_timeout = timers_.get_next_timeout();
+    if (next_timeout >= 0 && (timeout_ms < 0 || next_timeout < timeout_ms)) timeout_ms = next_timeout;
+    int n = epoll_wait(epoll_fd_, events, SERVER_MAX_EVENTS, ready_head_ != NULL ? 0 : timeout_ms);
+    if (n < 0) return errno == EINTR ? 0 : -1;
+    now_ms_ = _now_ms();
+    // 没有定时器时只是更新时间轮的时间, 让本轮添加的定时器从现在算起;
+    // 否则等本轮的事件处理完再回调到期的定时器, 避免关闭events里还没处理的连接
+    if (timers_.get_pending_count() == 0) timers_.advance(now_ms_);
+    for (int i = 0; i < n; i++) {
+      void *ptr = events[i].data.ptr;
+      if (ptr == NULL) {
+        _accept();
+      }
+      else if (ptr == this) {
+        uint64_t val;
+        ssize_t ret = read(wake_fd_, &val, sizeof(val));
+        (void)ret;
+        _drain_deferred();
+      }
+      else {
+        Connection *conn = (Connection *)ptr;
+        if (conn->closing) continue;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          _close(conn);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT) {
+          if (_flush(conn) < 0) {
+            _close(conn);
+            continue;
+          }
+        }
+        if (events[i].events & EPOLLIN) {
+          _read(conn);
+        }
+      }
+    }
+    _close_pending();
+    _schedule();
+    timers_.advance(now_ms_);
+    return n;
+  }
+
+  template <class ModbusData>
+  uint64_t Server<ModbusData>::_now_ms(void)
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_accept(void)
+  {
+    while (1) {
+      int fd = accept4(listen_fd_, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) return;
+      int nodelay = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+      unsigned char *rx_buf = (unsigned char *)rx_pool_.alloc();
+      if (rx_buf == NULL) {
+        close(fd);
+        continue;
+      }
+      Connection *conn = new Connection();
+      conn->fd = fd;
+      conn->service = new DataService<ModbusData>(modbus_data_);
+      if (session_handler_ != NULL) conn->service->set_session_handler(session_handler_, session_handler_arg_);
+      conn->tx_size = 0;
+      conn->tx_length = 0;
+      conn->tx_offset = 0;
+      conn->tx_buf = NULL;
+      conn->rx_buf = rx_buf;
+      conn->rx_length = 0;
+      conn->rx_offset = 0;
+      conn->deficit = 0;
+      conn->events = EPOLLIN;
+      conn->want_write = false;
+      conn->ready = false;
+      conn->client_id = SERVER_HEAT_CLIENT_UNKNOWN;
+      if (!free_slots_.empty()) {
+        conn->slot = free_slots_.back();
+        free_slots_.pop_back();
+      }
+      else {
+        conn->slot = (int)slots_.size();
+        slots_.push_back(NULL);
+      }
+      // 序号区分先后使用同一个槽位的连接, 旧连接的回复不会发给新连接
+      conn->id = (next_conn_id_++ << 32) | (uint32_t)conn->slot;
+      conn->deferred = false;
+      conn->closing = false;
+      conn->last_active_ms = now_ms_;
+      conn->server = this;
+      ModbusTimerWheel::init_timer(&conn->idle_timer, _on_idle_timer, conn);
+      ModbusTimerWheel::init_timer(&conn->frame_timer, _on_frame_timer, conn);
+      conn->prev = NULL;
+      conn->next = NULL;
+      conn->ready_prev = NULL;
+      conn->ready_next = NULL;
+      conn->closing_next = NULL;
+      struct epoll_event ev;
+      ev.events = conn->events;
+      ev.data.ptr = conn;
+      if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        free_slots_.push_back(conn->slot);
+        delete conn->service;
+        delete conn;
+        rx_pool_.free(rx_buf);
+        close(fd);
+        continue;
+      }
+      conn->next = conns_;
+      if (conns_ != NULL) conns_->prev = conn;
+      conns_ = conn;
+      slots_[conn->slot] = conn;
+      conn_count_++;
+      if (idle_timeout_ms_ > 0) timers_.schedule(&conn->idle_timer, idle_timeout_ms_);
+    }
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_on_response(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len, void *arg)
+  {
+    (void)req;
+    (void)req_len;
+    Connection *conn = (Connection *)arg;
+    // 回复由post_response给出
+    if (conn->deferred) return;
+    if (conn->tx_length + res_len > conn->tx_size) {
+      // 先把已发送的部分移走, 不够再扩容
+      if (conn->tx_offset > 0) {
+        memmove(conn->tx_buf, conn->tx_buf + conn->tx_offset, conn->tx_length - conn->tx_offset);
+        conn->tx_length -= conn->tx_offset;
+        conn->tx_offset = 0;
+      }
+      if (conn->tx_length + res_len > conn->tx_size) {
+        int new_size = conn->tx_size > 0 ? conn->tx_size * 2 : SERVER_RECV_BUF_SIZE;
+        while (new_size < conn->tx_length + res_len) new_size *= 2;
+        MODBUS_RT_HEAP_CHECK("Server tx buffer");
+        unsigned char *buf = new unsigned char[new_size];
+        if (conn->tx_buf != NULL) {
+          memcpy(buf, conn->tx_buf, conn->tx_length);
+          delete[] conn->tx_buf;
+        }
+        conn->tx_buf = buf;
+        conn->tx_size = new_size;
+      }
+    }
+    memcpy(conn->tx_buf + conn->tx_length, res, res_len);
+    conn->tx_length += res_len;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_read(Connection *conn)
+  {
+    // 每个事件只recv一次(水平触发, 没读完的下一轮再读), 数据留在接收缓冲区由_schedule处理
+    int space = SERVER_RECV_BUF_SIZE - conn->rx_length;
+    if (space > 0) {
+      ssize_t n = recv(conn->fd, conn->rx_buf + conn->rx_length, space, 0);
+      if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        // 对方关闭或出错
+        _close(conn);
+        return;
+      }
+      if (n > 0) {
+        conn->rx_length += n;
+        // 只记录时间, 空闲定时器到期时再检查
+        conn->last_active_ms = now_ms_;
+      }
+    }
+    if (_next_frame_length(conn) != 0) _push_ready(conn);
+    _update_frame_timer(conn);
+    _update_events(conn);
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_update_frame_timer(Connection *conn)
+  {
+    if (frame_timeout_ms_ == 0) return;
+    if (conn->rx_length > conn->rx_offset && _next_frame_length(conn) == 0) {
+      // 从收到不完整的帧开始计时, 收到后续的部分不重新计时
+      if (!ModbusTimerWheel::is_pending(&conn->frame_timer)) timers_.schedule(&conn->frame_timer, frame_timeout_ms_);
+    }
+    else {
+      timers_.cancel(&conn->frame_timer);
+    }
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_on_idle_timer(ModbusTimer *timer, void *arg)
+  {
+    Connection *conn = (Connection *)arg;
+    Server *server = conn->server;
+    uint64_t idle = server->now_ms_ - conn->last_active_ms;
+    if (idle < server->idle_timeout_ms_ || conn->deferred) {
+      // 期间收到过数据或者在等待延后的回复, 按剩下的时间重新计时
+      server->timers_.schedule(timer, idle < server->idle_timeout_ms_ ? server->idle_timeout_ms_ - (unsigned int)idle : server->idle_timeout_ms_);
+      return;
+    }
+    MODBUS_LOG_WARN("Modbus tcp connection is idle for %llu ms, close it, fd=%d", (unsigned long long)idle, conn->fd);
+    server->idle_closed_count_++;
+    server->_close(conn);
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_on_frame_timer(ModbusTimer *timer, void *arg)
+  {
+    Connection *conn = (Connection *)arg;
+    Server *server = conn->server;
+    if (server->_is_throttled(conn)) {
+      // 背压时没有读取, 不算对方的超时
+      server->timers_.schedule(timer, server->frame_timeout_ms_);
+      return;
+    }
+    MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_WARN, 1000, 10, "Modbus tcp frame is incomplete for too long, discard %d bytes, fd=%d", conn->rx_length - conn->rx_offset, conn->fd);
+    MODBUS_METRICS_FRAME_DISCARDED();
+    server->frame_expired_count_++;
+    conn->rx_length = 0;
+    conn->rx_offset = 0;
+    conn->service->discard_pending();
+    server->_update_events(conn);
+  }
+
+  template <class ModbusData>
+  int Server<ModbusData>::_next_frame_length(Connection *conn)
+  {
+    int remain = conn->rx_length - conn->rx_offset;
+    if (remain < 7) return 0;
+    int len = HexData::bin8_to_u16(conn->rx_buf + conn->rx_offset + 4);
+    // 长度错误时把剩下的数据都交给DataService, 由它丢弃并记录
+    if (len > 254 || len < 2) return remain;
+    if (remain < len + 6) return 0;
+    return len + 6;
+  }
+
+  template <class ModbusData>
+  int Server<ModbusData>::_serve(Connection *conn)
+  {
+    conn->deficit += quantum_;
+    int frames = 0;
+    int len = 0;
+    if (conn->client_id == SERVER_HEAT_CLIENT_UNKNOWN && ModbusHeatmap::is_enabled()) {
+      // 开启统计后第一次处理时注册, 开启前建立的连接也能统计;
+      // 按对方的IP统计访问热度, 重连后仍然计到同一个客户端
+      struct sockaddr_in peer;
+      socklen_t peer_len = sizeof(peer);
+      char name[INET_ADDRSTRLEN] = "unknown";
+      if (getpeername(conn->fd, (struct sockaddr *)&peer, &peer_len) == 0) inet_ntop(AF_INET, &peer.sin_addr, name, sizeof(name));
+      conn->client_id = ModbusHeatmap::register_client(name);
+    }
+    MODBUS_HEATMAP_SET_CLIENT(conn->client_id);
+    serving_ = conn;
+    while (frames < max_frames_ && conn->deficit > 0 && !_is_throttled(conn) && !conn->deferred) {
+      len = _next_frame_length(conn);
+      if (len == 0) break;
+      int tx_before = conn->tx_length - conn->tx_offset;
+      conn->service->process_data(conn->rx_buf + conn->rx_offset, len, _on_response, conn);
+      conn->rx_offset += len;
+      // 额度按请求和回复的字节数扣除, 大请求的连接每轮处理的帧更少
+      conn->deficit -= len + (conn->tx_length - conn->tx_offset - tx_before);
+      frames++;
+    }
+    serving_ = NULL;
+    MODBUS_HEATMAP_SET_CLIENT(-1);
+    if (conn->rx_offset > 0) {
+      // 剩下的不完整的帧移到开头, 接收缓冲区总能放下一个完整的帧
+      memmove(conn->rx_buf, conn->rx_buf + conn->rx_offset, conn->rx_length - conn->rx_offset);
+      conn->rx_length -= conn->rx_offset;
+      conn->rx_offset = 0;
+    }
+    _update_frame_timer(conn);
+    if (_flush(conn) < 0) return -1;
+    if (conn->deferred || _next_frame_length(conn) == 0) {
+      // 没有完整的帧了或者在等待延后的回复, 额度不累积(DRR)
+      conn->deficit = 0;
+      return 0;
+    }
+    if (_is_throttled(conn)) {
+      // 背压: 等EPOLLOUT把回复发出去再继续
+      throttled_count_++;
+      return 0;
+    }
+    return 1;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_schedule(void)
+  {
+    // 一轮: 就绪链表上的每个连接处理一次, 还有帧的连接放到链表末尾等下一轮
+    Connection *last = ready_tail_;
+    while (ready_head_ != NULL) {
+      Connection *conn = ready_head_;
+      bool is_last = conn == last;
+      _remove_ready(conn);
+      int ret = _serve(conn);
+      if (ret < 0) _close(conn);
+      else {
+        if (ret > 0) _push_ready(conn);
+        _update_events(conn);
+      }
+      if (is_last) break;
+    }
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_push_ready(Connection *conn)
+  {
+    if (conn->ready) return;
+    conn->ready = true;
+    conn->ready_next = NULL;
+    conn->ready_prev = ready_tail_;
+    if (ready_tail_ != NULL) ready_tail_->ready_next = conn;
+    else ready_head_ = conn;
+    ready_tail_ = conn;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_remove_ready(Connection *conn)
+  {
+    if (!conn->ready) return;
+    if (conn->ready_prev != NULL) conn->ready_prev->ready_next = conn->ready_next;
+    else ready_head_ = conn->ready_next;
+    if (conn->ready_next != NULL) conn->ready_next->ready_prev = conn->ready_prev;
+    else ready_tail_ = conn->ready_prev;
+    conn->ready_prev = NULL;
+    conn->ready_next = NULL;
+    conn->ready = false;
+  }
+
+  template <class ModbusData>
+  int Server<ModbusData>::_flush(Connection *conn)
+  {
+    while (conn->tx_offset < conn->tx_length) {
+      ssize_t n = send(conn->fd, conn->tx_buf + conn->tx_offset, conn->tx_length - conn->tx_offset, MSG_NOSIGNAL);
+      if (n > 0) {
+        conn->tx_offset += n;
+        continue;
+      }
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        conn->want_write = true;
+        if (!_is_throttled(conn) && !conn->deferred && _next_frame_length(conn) != 0) _push_ready(conn);
+        _update_events(conn);
+        return 0;
+      }
+      return -1;
+    }
+    conn->tx_offset = 0;
+    conn->tx_length = 0;
+    conn->want_write = false;
+    // 背压解除或者延后的回复发出后继续处理已经收到的帧
+    if (!conn->deferred && _next_frame_length(conn) != 0) _push_ready(conn);
+    _update_events(conn);
+    return 0;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_update_events(Connection *conn)
+  {
+    // 背压时或者接收缓冲区满时不再读取(对方的发送会被TCP窗口挡住)
+    unsigned int events = 0;
+    if (!_is_throttled(conn) && conn->rx_length < SERVER_RECV_BUF_SIZE) events |= EPOLLIN;
+    if (conn->want_write) events |= EPOLLOUT;
+    if (conn->events == events) return;
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = conn;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->events = events;
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_close_later(Connection *conn)
+  {
+    if (conn->closing) return;
+    conn->closing = true;
+    conn->closing_next = closing_;
+    closing_ = conn;
+    // 不再处理这个连接的帧
+    _remove_ready(conn);
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_close_pending(void)
+  {
+    while (closing_ != NULL) {
+      Connection *conn = closing_;
+      closing_ = conn->closing_next;
+      _close(conn);
+    }
+  }
+
+  template <class ModbusData>
+  void Server<ModbusData>::_close(Connection *conn)
+  {
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    _remove_ready(conn);
+    timers_.cancel(&conn->idle_timer);
+    timers_.cancel(&conn->frame_timer);
+    delete conn->service;
+    if (conn->tx_buf != NULL) delete[] conn->tx_buf;
+    if (conn->rx_buf != NULL) rx_pool_.free(conn->rx_buf);
+    if (conn->prev != NULL) conn->prev->next = conn->next;
+    else conns_ = conn->next;
+    if (conn->next != NULL) conn->next->prev = conn->prev;
+    slots_[conn->slot] = NULL;
+    free_slots_.push_back(conn->slot);
+    delete conn;
+    conn_count_--;
+  }
+}
+
+#endif // _MODBUS_TCP_SERVER_IMPL_H_
@@ -0,0 +1,187 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include "modbus_timer_wheel.h"
+
+#define WHEEL_SIZE (1 << MODBUS_TIMER_WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_MAX_TICKS ((1ULL << (MODBUS_TIMER_WHEEL_BITS * MODBUS_TIMER_WHEEL_LEVELS)) - 1)
+
+ModbusTimerWheel::ModbusTimerWheel(unsigned int tick_ms, uint64_t now_ms)
+{
+  tick_ms_ = tick_ms < 1 ? 1 : tick_ms;
+  now_ms_ = now_ms;
+  current_tick_ = now_ms / tick_ms_ + 1;
+  pending_count_ = 0;
+  for (int level = 0; level < MODBUS_TIMER_WHEEL_LEVELS; level++) {
+    for (int i = 0; i < WHEEL_SIZE; i++) {
+      slots_[level][i].prev = &slots_[level][i];
+      slots_[level][i].next = &slots_[level][i];
+    }
+  }
+}
+
+void ModbusTimerWheel::init_timer(ModbusTimer *timer, ModbusTimerCallback callback, void *arg)
+{
+  timer->prev = NULL;
+  timer->next = NULL;
+  timer->expire = 0;
+  timer->callback = callback;
+  timer->arg = arg;
+}
+
+void ModbusTimerWheel::_link(ModbusTimer *head, ModbusTimer *timer)
+{
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+void ModbusTimerWheel::_unlink(ModbusTimer *timer)
+{
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->prev = NULL;
+  timer->next = NULL;
+}
+
+void ModbusTimerWheel::_add(ModbusTimer *timer)
+{
+  // 按离到期还有多少个tick放到对应的层, 远的放在高层, 到时候再逐层下放
+  int64_t ticks = (int64_t)(timer->expire - current_tick_);
+  ModbusTimer *head;
+  if (ticks < 0) {
+    head = &slots_[0][current_tick_ & WHEEL_MASK];
+  }
+  else {
+    if ((uint64_t)ticks > WHEEL_MAX_TICKS) {
+      timer->expire = current_tick_ + WHEEL_MAX_TICKS;
+      ticks = WHEEL_MAX_TICKS;
+    }
+    int level = 0;
+    while (level < MODBUS_TIMER_WHEEL_LEVELS - 1 && (uint64_t)ticks >= (1ULL << (MODBUS_TIMER_WHEEL_BITS * (level + 1)))) level++;
+    head = &slots_[level][(timer->expire >> (MODBUS_TIMER_WHEEL_BITS * level)) & WHEEL_MASK];
+  }
+  _link(head, timer);
+}
+
+void ModbusTimerWheel::schedule(ModbusTimer *timer, unsigned int timeout_ms)
+{
+  if (is_pending(timer)) cancel(timer);
+  timer->expire = (now_ms_ + timeout_ms + tick_ms_ - 1) / tick_ms_;
+  _add(timer);
+  pending_count_++;
+}
+
+void ModbusTimerWheel::cancel(ModbusTimer *timer)
+{
+  if (!is_pending(timer)) return;
+  _unlink(timer);
+  pending_count_--;
+}
+
+int ModbusTimerWheel::_cascade(int level, int index)
+{
+  ModbusTimer *head = &slots_[level][index];
+  ModbusTimer list;
+  if (head->next == head) return index;
+  list.next = head->next;
+  list.prev = head->prev;
+  list.next->prev = &list;
+  list.prev->next = &list;
+  head->next = head;
+  head->prev = head;
+  while (list.next != &list) {
+    ModbusTimer *timer = list.next;
+    _unlink(timer);
+    _add(timer);
+  }
+  return index;
+}
+
+int ModbusTimerWheel::advance(uint64_t now_ms)
+{
+  if (now_ms < now_ms_) return 0;
+  now_ms_ = now_ms;
+  uint64_t target = now_ms / tick_ms_;
+  if (pending_count_ == 0) {
+    current_tick_ = target + 1;
+    return 0;
+  }
+  int count = 0;
+  while (current_tick_ <= target) {
+    int index = (int)(current_tick_ & WHEEL_MASK);
+    if (index == 0) {
+      // 低层转完一圈, 把高层对应的槽下放
+      for (int level = 1; level < MODBUS_TIMER_WHEEL_LEVELS; level++) {
+        if (_cascade(level, (int)((current_tick_ >> (MODBUS_TIMER_WHEEL_BITS * level)) & WHEEL_MASK)) != 0) break;
+      }
+    }
+    ModbusTimer *head = &slots_[0][index];
+    current_tick_++;
+    if (head->next == head) continue;
+    // 先移到临时链表, 回调里取消同一批的定时器时直接从临时链表摘除
+    ModbusTimer list;
+    list.next = head->next;
+    list.prev = head->prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    head->next = head;
+    head->prev = head;
+    while (list.next != &list) {
+      ModbusTimer *timer = list.next;
+      _unlink(timer);
+      pending_count_--;
+      count++;
+      timer->callback(timer, timer->arg);
+    }
+    if (pending_count_ == 0) {
+      current_tick_ = target + 1;
+      break;
+    }
+  }
+  return count;
+}
+
+uint64_t ModbusTimerWheel::_next_expire_tick(void)
+{
+  // 第0层: 从current_tick_开始的64个槽正好是接下来的64个tick(过期的放在当前槽)
+  for (int i = 0; i < WHEEL_SIZE; i++) {
+    ModbusTimer *head = &slots_[0][(current_tick_ + i) & WHEEL_MASK];
+    if (head->next != head) return current_tick_ + i;
+  }
+  // 高层: 槽里的定时器在这个槽下放时才可能到期, 下放的时间就是等待的上限;
+  // 第level层的定时器至少在下一个块, 最早的不早于已经找到的时就不用再看更高层
+  uint64_t next = UINT64_MAX;
+  for (int level = 1; level < MODBUS_TIMER_WHEEL_LEVELS; level++) {
+    int shift = MODBUS_TIMER_WHEEL_BITS * level;
+    uint64_t block = current_tick_ >> shift;
+    if (((block + 1) << shift) >= next) break;
+    for (int i = 1; i <= WHEEL_SIZE; i++) {
+      ModbusTimer *head = &slots_[level][(block + i) & WHEEL_MASK];
+      if (head->next != head) {
+        if (((block + i) << shift) < next) next = (block + i) << shift;
+        break;
+      }
+    }
+  }
+  return next;
+}
+
+int ModbusTimerWheel::get_next_timeout(void)
+{
+  if (pending_count_ == 0) return -1;
+  uint64_t next_ms = _next_expire_tick() * tick_ms_;
+  if (next_ms <= now_ms_) return 0;
+  return next_ms - now_ms_ > INT_MAX ? INT_MAX : (int)(next_ms - now_ms_);
+}
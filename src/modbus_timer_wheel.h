@@ -0,0 +1,97 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_TIMER_WHEEL_H_
+#define _MODBUS_TIMER_WHEEL_H_
+
+#include <stdint.h>
+
+#define MODBUS_TIMER_WHEEL_BITS   6  // 每层2^6=64个槽
+#define MODBUS_TIMER_WHEEL_LEVELS 4  // 4层, 最长2^24个tick, 超过的按最长处理
+
+struct ModbusTimer;
+typedef void (*ModbusTimerCallback)(ModbusTimer *timer, void *arg);
+
+/* ModbusTimer: 定时器节点, 嵌在使用者的结构体里(比如服务器的连接), 定时器轮本身不申请内存 */
+struct ModbusTimer {
+  ModbusTimer *prev;
+  ModbusTimer *next;
+  uint64_t expire;      // 到期的tick
+  ModbusTimerCallback callback;
+  void *arg;
+};
+
+/* ModbusTimerWheel: 分层时间轮
+ * 1. 添加/取消定时器都是O(1)的链表操作, 没有系统调用和内存申请
+ * 2. advance由事件循环调用, 传入当前时间(毫秒, 一般每轮事件循环取一次), 到期的定时器在advance里回调
+ * 3. 精度为一个tick, 到期时间向上取整到tick
+ * 4. 回调里可以添加/取消任意定时器(包括同一批到期的)
+ * 5. 非线程安全, 只在事件循环的线程里使用
+ */
+class ModbusTimerWheel
+{
+public:
+  /* ModbusTimerWheel: 构造时间轮
+   * @param tick_ms: 每个tick的毫秒数
+   * @param now_ms: 当前时间(毫秒)
+   */
+  ModbusTimerWheel(unsigned int tick_ms = 10, uint64_t now_ms = 0);
+
+  /* init_timer: 初始化定时器节点(使用前调用一次)
+   * @param timer: 定时器
+   * @param callback: 到期时的回调
+   * @param arg: 回调的参数
+   */
+  static void init_timer(ModbusTimer *timer, ModbusTimerCallback callback, void *arg);
+
+  /* schedule: 添加定时器, 已经添加的会先取消
+   * @param timer: 定时器
+   * @param timeout_ms: 从最近一次advance的时间算起的超时(毫秒)
+   */
+  void schedule(ModbusTimer *timer, unsigned int timeout_ms);
+
+  /* cancel: 取消定时器, 没有添加时什么也不做 */
+  void cancel(ModbusTimer *timer);
+
+  /* is_pending: 定时器是否已添加且还没到期 */
+  static bool is_pending(const ModbusTimer *timer) { return timer->next != 0; }
+
+  /* advance: 推进时间并回调到期的定时器
+   * @param now_ms: 当前时间(毫秒)
+   * :return: 到期的定时器个数
+   */
+  int advance(uint64_t now_ms);
+
+  /* get_next_timeout: 事件循环等待的最长时间(毫秒), 即到最早的定时器到期(高层的定时器按下放的时间算)为止,
+   * 没有定时器时返回-1
+   */
+  int get_next_timeout(void);
+
+  /* get_pending_count: 已添加的定时器个数 */
+  int get_pending_count(void) { return pending_count_; }
+
+  /* get_now: 最近一次advance的时间(毫秒) */
+  uint64_t get_now(void) { return now_ms_; }
+
+private:
+  void _add(ModbusTimer *timer);
+  int _cascade(int level, int index);
+  uint64_t _next_expire_tick(void);
+  static void _link(ModbusTimer *head, ModbusTimer *timer);
+  static void _unlink(ModbusTimer *timer);
+
+private:
+  unsigned int tick_ms_;
+  uint64_t now_ms_;
+  uint64_t current_tick_;  // 下一个要处理的tick
+  int pending_count_;
+  ModbusTimer slots_[MODBUS_TIMER_WHEEL_LEVELS][1 << MODBUS_TIMER_WHEEL_BITS]; // 每个槽是一个双向循环链表的表头
+};
+
+#endif // _MODBUS_TIMER_WHEEL_H_
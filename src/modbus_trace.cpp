@@ -0,0 +1,184 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <mutex>
+#include "modbus_trace.h"
+#include "modbus_log.h"
+
+#define TRACE_CLOCK_SYNC_MASK 0x3FF // 每1024条记录同步一次tick和时间的对应关系
+
+struct ModbusTraceRing {
+  ModbusTraceHeader *header;
+  ModbusTraceRecord *records;
+  uint32_t mask;
+  size_t map_size;
+  ModbusTraceRing *next;
+};
+
+std::atomic<bool> ModbusTrace::enabled_(false);
+thread_local ModbusTraceRing *ModbusTrace::tls_ring_ = NULL;
+
+// 创建缓冲区失败的线程记为trace_failed_ring, 同一次enable内不再重试(不再加锁和open)
+static ModbusTraceRing trace_failed_ring;
+static thread_local unsigned int trace_failed_generation = 0;
+static std::atomic<unsigned int> trace_generation(1);
+static std::atomic<bool> trace_failure_reported(false);
+
+static std::mutex trace_mutex;
+static ModbusTraceRing *trace_rings = NULL;
+static char trace_dir[256] = MODBUS_TRACE_DEFAULT_DIR;
+static unsigned int trace_capacity = MODBUS_TRACE_DEFAULT_RECORDS;
+
+static uint64_t trace_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trace_sync_clock(ModbusTraceHeader *header)
+{
+  header->last_ticks = ModbusMetrics::now_ticks();
+  header->last_ns = trace_now_ns();
+}
+
+/* 进程启动时检查环境变量, 进程退出时同步所有缓冲区的时钟 */
+struct ModbusTraceAutoStart {
+  ModbusTraceAutoStart() {
+    const char *dir = getenv("MODBUS_TRACE_DIR");
+    if (dir != NULL && dir[0] != '\0') ModbusTrace::enable(dir);
+  }
+  ~ModbusTraceAutoStart() {
+    ModbusTrace::disable();
+  }
+};
+static ModbusTraceAutoStart trace_auto_start;
+
+void ModbusTrace::enable(const char *dir, unsigned int capacity)
+{
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  if (dir != NULL) {
+    strncpy(trace_dir, dir, sizeof(trace_dir) - 1);
+    trace_dir[sizeof(trace_dir) - 1] = '\0';
+  }
+  unsigned int cap = 1;
+  while (cap < capacity && cap < 0x40000000) cap <<= 1;
+  trace_capacity = cap;
+  // 目录等可能已经改变, 之前失败的线程重新尝试, 失败时重新报告
+  trace_generation.fetch_add(1, std::memory_order_relaxed);
+  trace_failure_reported.store(false, std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void ModbusTrace::disable(void)
+{
+  enabled_.store(false, std::memory_order_relaxed);
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  for (ModbusTraceRing *ring = trace_rings; ring != NULL; ring = ring->next) {
+    trace_sync_clock(ring->header);
+  }
+}
+
+/* trace_fail: 记住当前线程创建缓冲区失败, 只报告一次
+ * @param what: 失败的操作
+ * @param path: 跟踪文件
+ * :return: NULL
+ */
+static ModbusTraceRing *trace_fail(const char *what, const char *path)
+{
+  int err = errno;
+  trace_failed_generation = trace_generation.load(std::memory_order_relaxed);
+  if (!trace_failure_reported.exchange(true, std::memory_order_relaxed)) {
+    MODBUS_LOG_ERROR("%s trace file %s failed: %s, threads that fail skip tracing until the next enable", what, path, strerror(err));
+  }
+  return &trace_failed_ring;
+}
+
+ModbusTraceRing *ModbusTrace::_ring(void)
+{
+  if (tls_ring_ != NULL) {
+    if (tls_ring_ != &trace_failed_ring) return tls_ring_;
+    if (trace_failed_generation == trace_generation.load(std::memory_order_relaxed)) return NULL;
+  }
+  std::lock_guard<std::mutex> guard(trace_mutex);
+  uint32_t thread_id = (uint32_t)syscall(SYS_gettid);
+  char path[320];
+  snprintf(path, sizeof(path), "%s/modbus_trace.%d.%u.bin", trace_dir, (int)getpid(), thread_id);
+  size_t map_size = sizeof(ModbusTraceHeader) + (size_t)trace_capacity * sizeof(ModbusTraceRecord);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    tls_ring_ = trace_fail("open", path);
+    return NULL;
+  }
+  if (ftruncate(fd, map_size) != 0) {
+    tls_ring_ = trace_fail("resize", path);
+    close(fd);
+    unlink(path);
+    return NULL;
+  }
+  void *addr = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    tls_ring_ = trace_fail("mmap", path);
+    close(fd);
+    unlink(path);
+    return NULL;
+  }
+  close(fd);
+
+  ModbusTraceRing *ring = new ModbusTraceRing();
+  ring->header = (ModbusTraceHeader *)addr;
+  ring->records = (ModbusTraceRecord *)((unsigned char *)addr + sizeof(ModbusTraceHeader));
+  ring->mask = trace_capacity - 1;
+  ring->map_size = map_size;
+  ring->header->magic = MODBUS_TRACE_MAGIC;
+  ring->header->version = MODBUS_TRACE_VERSION;
+  ring->header->record_size = sizeof(ModbusTraceRecord);
+  ring->header->capacity = trace_capacity;
+  ring->header->base_ticks = ModbusMetrics::now_ticks();
+  ring->header->base_ns = trace_now_ns();
+  ring->header->last_ticks = ring->header->base_ticks;
+  ring->header->last_ns = ring->header->base_ns;
+  ring->header->write_index = 0;
+  ring->header->pid = getpid();
+  ring->header->thread_id = thread_id;
+  ring->next = trace_rings;
+  trace_rings = ring;
+  tls_ring_ = ring;
+  return ring;
+}
+
+void ModbusTrace::record(int phase, uint64_t start_ticks, const unsigned char *frame, int length)
+{
+  uint64_t end_ticks = ModbusMetrics::now_ticks();
+  ModbusTraceRing *ring = _ring();
+  if (ring == NULL) return;
+  uint64_t index = ring->header->write_index;
+  ModbusTraceRecord *rec = &ring->records[index & ring->mask];
+  uint64_t duration = end_ticks - start_ticks;
+  rec->start_ticks = start_ticks;
+  rec->duration_ticks = duration > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)duration;
+  rec->phase = phase;
+  rec->transaction_id = length >= 2 ? (frame[0] << 8) + frame[1] : 0;
+  rec->func_code = length >= 8 ? frame[7] : 0;
+  rec->addr = length >= 10 ? (frame[8] << 8) + frame[9] : 0;
+  rec->quantity = length >= 12 ? (frame[10] << 8) + frame[11] : 0;
+  // 写完记录再更新索引, 读的一方不会读到一半的记录(同一线程内按序, 其它进程读时以索引为准)
+  std::atomic_thread_fence(std::memory_order_release);
+  ring->header->write_index = index + 1;
+  if ((index & TRACE_CLOCK_SYNC_MASK) == 0) trace_sync_clock(ring->header);
+}
@@ -0,0 +1,108 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_TRACE_H_
+#define _MODBUS_TRACE_H_
+
+#include <stdint.h>
+#include <atomic>
+#include "modbus_metrics.h"
+
+#define MODBUS_TRACE_MAGIC          0x5254424D // "MBTR"
+#define MODBUS_TRACE_VERSION        1
+#define MODBUS_TRACE_DEFAULT_DIR    "/dev/shm"
+#define MODBUS_TRACE_DEFAULT_RECORDS 65536     // 每个线程的环形缓冲区记录数(2的幂)
+
+enum ModbusTracePhase {
+  TRACE_PHASE_FRAME = 1,    // 拆包/粘包: 从收到数据到一帧完整
+  TRACE_PHASE_DISPATCH = 2, // process_session整体(包含下面两项)
+  TRACE_PHASE_HOOK = 3,     // 寄存器读写(包括额外绑定的读写方法)
+  TRACE_PHASE_ENCODE = 4    // 生成回复
+};
+
+#pragma pack(1)
+/* ModbusTraceHeader: 跟踪文件头(64字节), 后面紧跟capacity条记录 */
+struct ModbusTraceHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t capacity;
+  uint64_t base_ticks;      // 创建时的tick和时间(CLOCK_MONOTONIC, 纳秒), 用于换算
+  uint64_t base_ns;
+  uint64_t last_ticks;      // 最近一次同步的tick和时间
+  uint64_t last_ns;
+  uint64_t write_index;     // 已写入的记录总数(环形覆盖, 最新的capacity条有效)
+  uint32_t pid;
+  uint32_t thread_id;
+};
+
+/* ModbusTraceRecord: 跟踪记录(32字节) */
+struct ModbusTraceRecord {
+  uint64_t start_ticks;     // 开始的tick(x86为TSC)
+  uint32_t duration_ticks;  // 耗时
+  uint16_t transaction_id;  // MBAP的事务标识
+  uint16_t addr;            // 起始地址
+  uint16_t quantity;        // 个数
+  uint8_t func_code;
+  uint8_t phase;            // ModbusTracePhase
+  uint8_t reserved[12];
+};
+#pragma pack()
+
+struct ModbusTraceRing;
+
+/* ModbusTrace: process_session的跟踪点
+ * 1. 运行时开关: 关闭时每个跟踪点只有一次原子读; 编译时定义MODBUS_DISABLE_TRACE可以完全去掉
+ * 2. 每个线程一个基于文件的mmap环形缓冲区(<dir>/modbus_trace.<pid>.<tid>.bin), 进程崩溃后也可以读取
+ * 3. 设置环境变量MODBUS_TRACE_DIR(目录)可以在不改代码的情况下开启
+ * 4. 用bench/modbus_trace_dump.cpp离线生成按功能码和阶段的耗时统计
+ */
+class ModbusTrace
+{
+public:
+  /* enable: 开启跟踪
+   * @param dir: 跟踪文件所在目录, 为NULL时使用/dev/shm
+   * @param capacity: 每个线程的记录数(向上取整为2的幂)
+   */
+  static void enable(const char *dir = NULL, unsigned int capacity = MODBUS_TRACE_DEFAULT_RECORDS);
+
+  /* disable: 关闭跟踪(已有的跟踪文件保留) */
+  static void disable(void);
+
+  /* is_enabled: 是否开启了跟踪 */
+  static bool is_enabled(void) { return enabled_.load(std::memory_order_relaxed); }
+
+  /* record: 写一条记录(由跟踪点调用)
+   * @param phase: 阶段, 见ModbusTracePhase
+   * @param start_ticks: 开始的tick
+   * @param frame: 请求帧(MBAP开始), 用于取事务标识、功能码、地址和个数
+   * @param length: 请求帧的长度
+   */
+  static void record(int phase, uint64_t start_ticks, const unsigned char *frame, int length);
+
+private:
+  static ModbusTraceRing *_ring(void);
+
+  static std::atomic<bool> enabled_;
+  static thread_local ModbusTraceRing *tls_ring_;
+};
+
+#ifndef MODBUS_DISABLE_TRACE
+#define MODBUS_TRACE_BEGIN(name) uint64_t modbus_trace_##name##_ = ModbusTrace::is_enabled() ? ModbusMetrics::now_ticks() : 0
+#define MODBUS_TRACE_RESTART(name) modbus_trace_##name##_ = ModbusTrace::is_enabled() ? ModbusMetrics::now_ticks() : 0
+#define MODBUS_TRACE_END(name, phase, frame, length) do { \
+  if (modbus_trace_##name##_ != 0) ModbusTrace::record(phase, modbus_trace_##name##_, frame, length); \
+} while (0)
+#else
+#define MODBUS_TRACE_BEGIN(name)
+#define MODBUS_TRACE_RESTART(name)
+#define MODBUS_TRACE_END(name, phase, frame, length)
+#endif
+
+#endif // _MODBUS_TRACE_H_
@@ -0,0 +1,136 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "modbus_typed.h"
+
+static inline unsigned short _bswap16(unsigned short val)
+{
+  return (unsigned short)((val << 8) | (val >> 8));
+}
+
+/* 寄存器按值的高位字在前(ABCD)时的字顺序是否反转, 每个寄存器内是否交换字节 */
+static inline bool _word_swap(int order) { return order == MODBUS_ORDER_CDAB || order == MODBUS_ORDER_DCBA; }
+static inline bool _byte_swap(int order) { return order == MODBUS_ORDER_BADC || order == MODBUS_ORDER_DCBA; }
+
+static bool _check_args(int count, int words, int order)
+{
+  return count >= 0 && (words == 2 || words == 4) && order >= MODBUS_ORDER_ABCD && order <= MODBUS_ORDER_CDAB;
+}
+
+/* 逐个值转换: 先把值拆成从高到低的16位字, 再按字节顺序排列 */
+static void _encode_scalar(const unsigned char *src, int count, int words, int order, unsigned short *regs)
+{
+  bool word_swap = _word_swap(order);
+  bool byte_swap = _byte_swap(order);
+  unsigned short w[4];
+  for (int i = 0; i < count; i++) {
+    if (words == 2) {
+      uint32_t val;
+      memcpy(&val, src, 4);
+      w[0] = val >> 16;
+      w[1] = val & 0xFFFF;
+    }
+    else {
+      uint64_t val;
+      memcpy(&val, src, 8);
+      for (int j = 0; j < 4; j++) w[j] = (val >> (48 - j * 16)) & 0xFFFF;
+    }
+    for (int j = 0; j < words; j++) {
+      unsigned short reg = w[word_swap ? words - 1 - j : j];
+      regs[j] = byte_swap ? _bswap16(reg) : reg;
+    }
+    src += words * 2;
+    regs += words;
+  }
+}
+
+static void _decode_scalar(const unsigned short *regs, int count, int words, int order, unsigned char *dst)
+{
+  bool word_swap = _word_swap(order);
+  bool byte_swap = _byte_swap(order);
+  unsigned short w[4];
+  for (int i = 0; i < count; i++) {
+    for (int j = 0; j < words; j++) {
+      w[word_swap ? words - 1 - j : j] = byte_swap ? _bswap16(regs[j]) : regs[j];
+    }
+    if (words == 2) {
+      uint32_t val = ((uint32_t)w[0] << 16) | w[1];
+      memcpy(dst, &val, 4);
+    }
+    else {
+      uint64_t val = 0;
+      for (int j = 0; j < 4; j++) val = (val << 16) | w[j];
+      memcpy(dst, &val, 8);
+    }
+    regs += words;
+    dst += words * 2;
+  }
+}
+
+/* 小端的机器上, 值在内存里的16位字是低位字在前, 正好是CDAB;
+ * 所以ABCD/BADC需要在每个值内反转字的顺序, BADC/DCBA需要交换每个字的两个字节, 两种操作都是自己的逆, 编码解码相同
+ * 返回已经处理的值的个数, 剩下不足16字节的部分由调用者逐个处理
+ */
+static int _shuffle_block(const unsigned char *src, int count, int words, int order, unsigned char *dst)
+{
+#if defined(__SSE2__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  bool word_reverse = !_word_swap(order);
+  bool byte_swap = _byte_swap(order);
+  int per_block = 16 / (words * 2);
+  int blocks = count / per_block;
+  for (int i = 0; i < blocks; i++) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(src + i * 16));
+    if (word_reverse) {
+      if (words == 2) {
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2, 3, 0, 1));
+      }
+      else {
+        x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+        x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+      }
+    }
+    if (byte_swap) x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    _mm_storeu_si128((__m128i *)(dst + i * 16), x);
+  }
+  return blocks * per_block;
+#else
+  return 0;
+#endif
+}
+
+int ModbusTyped::encode(const void *values, int count, int words, int order, unsigned short *regs)
+{
+  if (!_check_args(count, words, order)) return -1;
+  const unsigned char *src = (const unsigned char *)values;
+  int done = _shuffle_block(src, count, words, order, (unsigned char *)regs);
+  _encode_scalar(src + done * words * 2, count - done, words, order, regs + done * words);
+  return 0;
+}
+
+int ModbusTyped::decode(const unsigned short *regs, int count, int words, int order, void *values)
+{
+  if (!_check_args(count, words, order)) return -1;
+  unsigned char *dst = (unsigned char *)values;
+  int done = _shuffle_block((const unsigned char *)regs, count, words, order, dst);
+  _decode_scalar(regs + done * words, count - done, words, order, dst + done * words * 2);
+  return 0;
+}
+
+int ModbusTyped::encode_scalar(const void *values, int count, int words, int order, unsigned short *regs)
+{
+  if (!_check_args(count, words, order)) return -1;
+  _encode_scalar((const unsigned char *)values, count, words, order, regs);
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_TYPED_H_
+#define _MODBUS_TYPED_H_
+
+/* 多寄存器类型(32位和64位)在寄存器里的字节顺序
+ * 以32位的值0xAABBCCDD为例(A为最高字节), 两个寄存器的值分别为:
+ */
+enum ModbusWordOrder {
+  MODBUS_ORDER_ABCD = 0, // 0xAABB 0xCCDD, 大端, Modbus标准
+  MODBUS_ORDER_DCBA = 1, // 0xDDCC 0xBBAA, 小端
+  MODBUS_ORDER_BADC = 2, // 0xBBAA 0xDDCC, 字内字节交换
+  MODBUS_ORDER_CDAB = 3  // 0xCCDD 0xAABB, 字交换
+};
+
+/* ModbusTyped: 多寄存器类型(float/int32/uint32/double/int64/uint64)和寄存器数组的互相转换
+ * 1. 只和值的位宽(2个或4个寄存器)、字节顺序有关, 和具体的类型无关, 按位拷贝, 不做数值转换
+ * 2. 每种字节顺序都是对每个值的字节重排, x86上用SSE2每次处理16字节, 其它平台逐个值处理
+ */
+class ModbusTyped
+{
+public:
+  /* encode: 把值的数组转换为寄存器数组
+   * @param values: 值的数组
+   * @param count: 值的个数
+   * @param words: 每个值占用的寄存器数, 2或4
+   * @param order: 字节顺序, 见ModbusWordOrder
+   * @param regs: 寄存器数组, 大小不能小于count * words
+   * :return: 成功返回0, 参数错误返回-1
+   */
+  static int encode(const void *values, int count, int words, int order, unsigned short *regs);
+
+  /* decode: 把寄存器数组转换为值的数组(参数同encode)
+   * :return: 成功返回0, 参数错误返回-1
+   */
+  static int decode(const unsigned short *regs, int count, int words, int order, void *values);
+
+  /* encode_scalar: 逐个值转换(不用SIMD), 用于对比和校验 */
+  static int encode_scalar(const void *values, int count, int words, int order, unsigned short *regs);
+};
+
+#endif // _MODBUS_TYPED_H_
@@ -0,0 +1,106 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_UDP_SERVER_H_
+#define _MODBUS_UDP_SERVER_H_
+
+#include <atomic>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "modbus_tcp_data.h"
+
+#define MODBUS_UDP_BATCH_SIZE 64 // 每次recvmmsg/sendmmsg最多处理的报文数
+
+namespace ModbusTCP
+{
+  /* UdpServer: Modbus UDP服务器(帧格式和Modbus TCP相同, 一个报文就是一帧)
+   * 1. 单线程epoll事件循环, 用recvmmsg一次接收多个报文, 处理后用sendmmsg一次发送所有的回复
+   * 2. 每个报文按完整的一帧处理(同process_data的is_checked=true), 不需要拆包, 但会检查MBAP的长度和报文长度一致
+   * 3. 收发缓冲区在构造时分配好, 处理请求时没有内存申请
+   * 4. ModbusData指Modbus数据操作类(非静态), 和DataService<ModbusData>一致
+   */
+  template <class ModbusData>
+  class UdpServer
+  {
+  public:
+    /* UdpServer: 构造服务器
+     * @param modbus_data: 寄存器操作实例
+     * @param port: 监听端口, 为0时由系统分配(通过get_port获取)
+     * @param ip: 监听地址
+     */
+    UdpServer(ModbusData *modbus_data, int port = 502, const char *ip = "0.0.0.0");
+    ~UdpServer();
+
+    /* start: 创建socket并绑定
+     * @param rcvbuf: socket的接收缓冲区大小(字节), 为0时使用系统默认值
+     * :return: 成功返回0, 失败返回-1
+     */
+    int start(int rcvbuf = 0);
+
+    /* run: 运行事件循环, 直到调用stop */
+    void run(void);
+
+    /* run_once: 处理一次事件
+     * @param timeout_ms: 等待事件的超时(毫秒)
+     * :return: 处理的报文数, 出错返回-1
+     */
+    int run_once(int timeout_ms);
+
+    /* stop: 停止事件循环(可以在别的线程调用) */
+    void stop(void);
+
+    /* get_port: 获取实际监听的端口 */
+    int get_port(void) { return port_; }
+
+    /* set_session_handler: 设置自定义的帧处理方法, 见DataService::set_session_handler */
+    void set_session_handler(typename DataService<ModbusData>::SessionHandler handler, void *arg);
+
+    /* get_datagram_count: 获取收到的报文数 */
+    uint64_t get_datagram_count(void) { return datagram_count_; }
+
+    /* get_discarded_count: 获取因为长度错误丢弃的报文数 */
+    uint64_t get_discarded_count(void) { return discarded_count_; }
+
+    /* get_send_failed_count: 获取发送失败(比如socket发送缓冲区满)丢弃的回复数 */
+    uint64_t get_send_failed_count(void) { return send_failed_count_; }
+
+  private:
+    int _recv_batch(void);
+    void _send_batch(void);
+    static void _on_response(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len, void *arg);
+
+  private:
+    ModbusData *modbus_data_;
+    char ip_[64];
+    int port_;
+    int fd_;
+    int epoll_fd_;
+    int wake_fd_;           // eventfd, 用来在别的线程唤醒事件循环
+    std::atomic<bool> running_;
+    DataService<ModbusData> *service_;
+    int current_;           // 正在处理的报文在这一批里的序号
+    int tx_count_;          // 这一批待发送的回复数
+    uint64_t datagram_count_;
+    uint64_t discarded_count_;
+    uint64_t send_failed_count_;
+    struct sockaddr_in addrs_[MODBUS_UDP_BATCH_SIZE];  // 请求的来源地址
+    struct iovec rx_iovs_[MODBUS_UDP_BATCH_SIZE];
+    struct iovec tx_iovs_[MODBUS_UDP_BATCH_SIZE];
+    struct mmsghdr rx_msgs_[MODBUS_UDP_BATCH_SIZE];
+    struct mmsghdr tx_msgs_[MODBUS_UDP_BATCH_SIZE];
+    unsigned char rx_bufs_[MODBUS_UDP_BATCH_SIZE][MODBUS_TCP_MAX_FRAME_SIZE];
+    unsigned char tx_bufs_[MODBUS_UDP_BATCH_SIZE][MODBUS_TCP_MAX_FRAME_SIZE];
+  };
+}
+
+#ifdef MODBUS_HEADER_ONLY
+#include "modbus_udp_server_impl.h"
+#endif
+
+#endif // _MODBUS_UDP_SERVER_H_
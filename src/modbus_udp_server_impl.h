@@ -0,0 +1,227 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+/* modbus_udp_server.h中UdpServer的实现, 包含方式同modbus_tcp_data_impl.h */
+
+#ifndef _MODBUS_UDP_SERVER_IMPL_H_
+#define _MODBUS_UDP_SERVER_IMPL_H_
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "modbus_udp_server.h"
+#include "modbus_log.h"
+#include "modbus_metrics.h"
+
+#define UDP_MAX_BATCHES_PER_TURN 16 // 每轮事件循环最多接收的批数, 避免stop不能及时生效
+
+namespace ModbusTCP
+{
+  template <class ModbusData>
+  UdpServer<ModbusData>::UdpServer(ModbusData *modbus_data, int port, const char *ip)
+  : modbus_data_(modbus_data), port_(port)
+  {
+    strncpy(ip_, ip, sizeof(ip_) - 1);
+    ip_[sizeof(ip_) - 1] = '\0';
+    fd_ = -1;
+    epoll_fd_ = -1;
+    wake_fd_ = -1;
+    running_ = false;
+    service_ = new DataService<ModbusData>(modbus_data);
+    current_ = 0;
+    tx_count_ = 0;
+    datagram_count_ = 0;
+    discarded_count_ = 0;
+    send_failed_count_ = 0;
+    memset(rx_msgs_, 0, sizeof(rx_msgs_));
+    memset(tx_msgs_, 0, sizeof(tx_msgs_));
+    for (int i = 0; i < MODBUS_UDP_BATCH_SIZE; i++) {
+      rx_iovs_[i].iov_base = rx_bufs_[i];
+      rx_iovs_[i].iov_len = MODBUS_TCP_MAX_FRAME_SIZE;
+      rx_msgs_[i].msg_hdr.msg_iov = &rx_iovs_[i];
+      rx_msgs_[i].msg_hdr.msg_iovlen = 1;
+      rx_msgs_[i].msg_hdr.msg_name = &addrs_[i];
+      tx_iovs_[i].iov_base = tx_bufs_[i];
+      tx_iovs_[i].iov_len = 0;
+      tx_msgs_[i].msg_hdr.msg_iov = &tx_iovs_[i];
+      tx_msgs_[i].msg_hdr.msg_iovlen = 1;
+    }
+  }
+
+  template <class ModbusData>
+  UdpServer<ModbusData>::~UdpServer()
+  {
+    if (epoll_fd_ >= 0) close(epoll_fd_);
+    if (fd_ >= 0) close(fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+    delete service_;
+  }
+
+  template <class ModbusData>
+  void UdpServer<ModbusData>::set_session_handler(typename DataService<ModbusData>::SessionHandler handler, void *arg)
+  {
+    service_->set_session_handler(handler, arg);
+  }
+
+  template <class ModbusData>
+  int UdpServer<ModbusData>::start(int rcvbuf)
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port_);
+    if (inet_pton(AF_INET, ip_, &addr.sin_addr) != 1) return -1;
+
+    fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) return -1;
+    int opt = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    // 突发的请求先堆在接收缓冲区里, 高频轮询时建议调大
+    if (rcvbuf > 0) setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+      close(fd_);
+      fd_ = -1;
+      return -1;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(fd_, (struct sockaddr *)&addr, &len);
+    port_ = ntohs(addr.sin_port);
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev;
+    // data.ptr为NULL表示数据socket, 为this表示唤醒事件
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd_, &ev);
+    ev.events = EPOLLIN;
+    ev.data.ptr = this;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    running_ = true;
+    return 0;
+  }
+
+  template <class ModbusData>
+  void UdpServer<ModbusData>::run(void)
+  {
+    while (running_) {
+      if (run_once(1000) < 0) break;
+    }
+  }
+
+  template <class ModbusData>
+  void UdpServer<ModbusData>::stop(void)
+  {
+    running_ = false;
+    if (wake_fd_ >= 0) {
+      uint64_t val = 1;
+      ssize_t ret = write(wake_fd_, &val, sizeof(val));
+      (void)ret;
+    }
+  }
+
+  template <class ModbusData>
+  int UdpServer<ModbusData>::run_once(int timeout_ms)
+  {
+    struct epoll_event events[2];
+    int n = epoll_wait(epoll_fd_, events, 2, timeout_ms);
+    if (n < 0) return errno == EINTR ? 0 : -1;
+    bool readable = false;
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.ptr == this) {
+        uint64_t val;
+        ssize_t ret = read(wake_fd_, &val, sizeof(val));
+        (void)ret;
+      }
+      else {
+        readable = true;
+      }
+    }
+    int count = 0;
+    if (readable) {
+      for (int i = 0; i < UDP_MAX_BATCHES_PER_TURN; i++) {
+        int ret = _recv_batch();
+        count += ret;
+        // 不满一批说明接收缓冲区已经读空了
+        if (ret < MODBUS_UDP_BATCH_SIZE) break;
+      }
+    }
+    return count;
+  }
+
+  template <class ModbusData>
+  int UdpServer<ModbusData>::_recv_batch(void)
+  {
+    for (int i = 0; i < MODBUS_UDP_BATCH_SIZE; i++) {
+      rx_msgs_[i].msg_hdr.msg_namelen = sizeof(addrs_[i]);
+      rx_msgs_[i].msg_hdr.msg_flags = 0;
+    }
+    int n = recvmmsg(fd_, rx_msgs_, MODBUS_UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (n <= 0) return 0;
+    tx_count_ = 0;
+    for (int i = 0; i < n; i++) {
+      datagram_count_++;
+      unsigned char *data = rx_bufs_[i];
+      int length = rx_msgs_[i].msg_len;
+      // 一个报文就是一帧: 长度字段必须和报文长度一致, 超过一帧最大长度的报文会被截断
+      if ((rx_msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) || length < 8 || HexData::bin8_to_u16(data + 4) + 6 != length) {
+        discarded_count_++;
+        MODBUS_LOG_RATELIMIT(MODBUS_LOG_LEVEL_WARN, 1000, 10, "Modbus udp datagram length is wrong, discard it, len=%d", length);
+        MODBUS_METRICS_FRAME_DISCARDED();
+        continue;
+      }
+      current_ = i;
+      service_->process_data(data, length, _on_response, this, true);
+    }
+    _send_batch();
+    return n;
+  }
+
+  template <class ModbusData>
+  void UdpServer<ModbusData>::_on_response(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len, void *arg)
+  {
+    (void)req;
+    (void)req_len;
+    UdpServer *server = (UdpServer *)arg;
+    if (res_len <= 0 || res_len > MODBUS_TCP_MAX_FRAME_SIZE) return;
+    int slot = server->tx_count_++;
+    memcpy(server->tx_bufs_[slot], res, res_len);
+    server->tx_iovs_[slot].iov_len = res_len;
+    server->tx_msgs_[slot].msg_hdr.msg_name = &server->addrs_[server->current_];
+    server->tx_msgs_[slot].msg_hdr.msg_namelen = server->rx_msgs_[server->current_].msg_hdr.msg_namelen;
+  }
+
+  template <class ModbusData>
+  void UdpServer<ModbusData>::_send_batch(void)
+  {
+    int sent = 0;
+    while (sent < tx_count_) {
+      int ret = sendmmsg(fd_, tx_msgs_ + sent, tx_count_ - sent, MSG_DONTWAIT);
+      if (ret > 0) {
+        sent += ret;
+        continue;
+      }
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        // 发送缓冲区满: UDP不重发, 剩下的回复丢弃, 由客户端超时重试
+        send_failed_count_ += tx_count_ - sent;
+        break;
+      }
+      // 单个报文发送失败(比如对方端口不可达), 跳过它继续发送后面的
+      send_failed_count_++;
+      sent++;
+    }
+    tx_count_ = 0;
+  }
+}
+
+#endif // _MODBUS_UDP_SERVER_IMPL_H_
@@ -0,0 +1,145 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#include <string.h>
+#include "modbus_write_queue.h"
+
+struct ModbusWriteSlot {
+  std::atomic<uint64_t> seq;  // 环形缓冲区的序号(Vyukov有界队列)
+  ModbusWriteRecord rec;
+};
+
+ModbusWriteQueue::ModbusWriteQueue(unsigned int capacity)
+{
+  unsigned int size = 1;
+  while (size < capacity && size < 0x40000000) size <<= 1;
+  mask_ = size - 1;
+  slots_ = new ModbusWriteSlot[size];
+  for (unsigned int i = 0; i < size; i++) {
+    slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+  tail_.store(0, std::memory_order_relaxed);
+  head_.store(0, std::memory_order_relaxed);
+  rejected_.store(0, std::memory_order_relaxed);
+}
+
+ModbusWriteQueue::~ModbusWriteQueue()
+{
+  if (slots_ != NULL) {
+    delete[] slots_;
+    slots_ = NULL;
+  }
+}
+
+int ModbusWriteQueue::_reserve(int count, uint64_t *pos)
+{
+  if (count < 1 || (unsigned int)count > mask_ + 1) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return -1;
+  }
+  uint64_t cur = tail_.load(std::memory_order_relaxed);
+  while (1) {
+    // 读者按顺序释放槽位, 最后一个槽位空闲说明前面的也都空闲
+    uint64_t last = cur + count - 1;
+    uint64_t seq = slots_[last & mask_].seq.load(std::memory_order_acquire);
+    int64_t diff = (int64_t)seq - (int64_t)last;
+    if (diff == 0) {
+      if (tail_.compare_exchange_weak(cur, cur + count, std::memory_order_relaxed)) break;
+    }
+    else if (diff < 0) {
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      return -1;
+    }
+    else {
+      cur = tail_.load(std::memory_order_relaxed);
+    }
+  }
+  *pos = cur;
+  return 0;
+}
+
+void ModbusWriteQueue::_commit(uint64_t pos)
+{
+  slots_[pos & mask_].seq.store(pos + 1, std::memory_order_release);
+}
+
+int ModbusWriteQueue::push_coil_bits(int addr, const unsigned char *bits, int quantity)
+{
+  int count = (quantity + MODBUS_WRITE_QUEUE_MAX_BITS - 1) / MODBUS_WRITE_QUEUE_MAX_BITS;
+  uint64_t pos;
+  if (_reserve(count, &pos) != 0) return -1;
+  for (int i = 0; i < count; i++) {
+    ModbusWriteRecord &rec = slots_[(pos + i) & mask_].rec;
+    int offset = i * MODBUS_WRITE_QUEUE_MAX_BITS;
+    int n = quantity - offset < MODBUS_WRITE_QUEUE_MAX_BITS ? quantity - offset : MODBUS_WRITE_QUEUE_MAX_BITS;
+    rec.type = WRITE_QUEUE_COIL_BITS;
+    rec.addr = addr + offset;
+    rec.quantity = n;
+    memset(rec.bits, 0, (n + 7) / 8);
+    for (int j = 0; j < n; j++) {
+      if (bits[offset + j]) rec.bits[j >> 3] |= 1 << (j & 7);
+    }
+    _commit(pos + i);
+  }
+  return 0;
+}
+
+int ModbusWriteQueue::push_holding_registers(int addr, const unsigned short *regs, int quantity)
+{
+  int count = (quantity + MODBUS_WRITE_QUEUE_MAX_REGS - 1) / MODBUS_WRITE_QUEUE_MAX_REGS;
+  uint64_t pos;
+  if (_reserve(count, &pos) != 0) return -1;
+  for (int i = 0; i < count; i++) {
+    ModbusWriteRecord &rec = slots_[(pos + i) & mask_].rec;
+    int offset = i * MODBUS_WRITE_QUEUE_MAX_REGS;
+    int n = quantity - offset < MODBUS_WRITE_QUEUE_MAX_REGS ? quantity - offset : MODBUS_WRITE_QUEUE_MAX_REGS;
+    rec.type = WRITE_QUEUE_HOLDING_REGS;
+    rec.addr = addr + offset;
+    rec.quantity = n;
+    memcpy(rec.regs, regs + offset, n * sizeof(unsigned short));
+    _commit(pos + i);
+  }
+  return 0;
+}
+
+int ModbusWriteQueue::push_mask_holding_register(int addr, unsigned short and_mask, unsigned short or_mask)
+{
+  uint64_t pos;
+  if (_reserve(1, &pos) != 0) return -1;
+  ModbusWriteRecord &rec = slots_[pos & mask_].rec;
+  rec.type = WRITE_QUEUE_MASK_HOLDING_REG;
+  rec.addr = addr;
+  rec.quantity = 1;
+  rec.regs[0] = and_mask;
+  rec.regs[1] = or_mask;
+  _commit(pos);
+  return 0;
+}
+
+bool ModbusWriteQueue::pop(ModbusWriteRecord *rec)
+{
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  ModbusWriteSlot *slot = &slots_[head & mask_];
+  if (slot->seq.load(std::memory_order_acquire) != head + 1) return false;
+  // 只拷贝用到的部分
+  int size = slot->rec.type == WRITE_QUEUE_COIL_BITS ? (slot->rec.quantity + 7) / 8 : slot->rec.quantity * 2;
+  if (slot->rec.type == WRITE_QUEUE_MASK_HOLDING_REG) size = 4;
+  memcpy(rec, &slot->rec, (size_t)((unsigned char *)&slot->rec.regs - (unsigned char *)&slot->rec) + size);
+  slot->seq.store(head + mask_ + 1, std::memory_order_release);
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+unsigned int ModbusWriteQueue::get_size(void)
+{
+  // 先读head(acquire, 之后读到的tail不会比它旧): 先读tail时可能读到比它新的head
+  uint64_t head = head_.load(std::memory_order_acquire);
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  return tail > head ? (unsigned int)(tail - head) : 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Software License Agreement (MIT License)
+ *
+ * Copyright (c) 2022, Vinman, Inc.
+ * All rights reserved.
+ *
+ * Author: Vinman <vinman.cub@gmail.com>
+ */
+
+#ifndef _MODBUS_WRITE_QUEUE_H_
+#define _MODBUS_WRITE_QUEUE_H_
+
+#include <stdint.h>
+#include <atomic>
+
+#define MODBUS_WRITE_QUEUE_MAX_REGS   123  // 每条记录最多的保持寄存器个数(0x10功能码的上限)
+#define MODBUS_WRITE_QUEUE_MAX_BITS   1968 // 每条记录最多的线圈个数(0x0F功能码的上限)
+
+enum ModbusWriteQueueType {
+  WRITE_QUEUE_COIL_BITS = 0x01,       // 写线圈, bits按位存放(低位在前)
+  WRITE_QUEUE_HOLDING_REGS = 0x03,    // 写保持寄存器
+  WRITE_QUEUE_MASK_HOLDING_REG = 0x16 // 掩码写保持寄存器, regs[0]为and_mask, regs[1]为or_mask
+};
+
+/* ModbusWriteRecord: 写队列中的一条记录(256字节) */
+struct ModbusWriteRecord {
+  unsigned char type;   // ModbusWriteQueueType
+  unsigned char reserved;
+  unsigned short addr;  // 起始地址
+  unsigned short quantity;
+  union {
+    unsigned short regs[MODBUS_WRITE_QUEUE_MAX_REGS];
+    unsigned char bits[MODBUS_WRITE_QUEUE_MAX_BITS / 8];
+  };
+
+  /* get_bit: 获取第i个线圈的值(0/1) */
+  unsigned char get_bit(int i) const { return (bits[i >> 3] >> (i & 7)) & 1; }
+};
+
+struct ModbusWriteSlot;
+
+/* ModbusWriteQueue: 网络线程到控制循环的写请求队列(有界, 无锁, 多写者单读者)
+ * 1. ModbusDataTemplate绑定队列后, 写线圈/保持寄存器的请求只检查地址并写入队列, 马上回复客户端,
+ *    不会在网络线程调用额外绑定的写方法(bind_set), 网络线程也不会因为应用程序的代码阻塞
+ * 2. 控制循环在自己的周期边界调用ModbusDataTemplate::drain_write_queue, 在控制线程里执行写操作,
+ *    额外绑定的写方法不再需要加锁
+ * 3. 队列满时写请求回复异常码0x06(从站设备忙)
+ * 4. 超过单条记录上限的写操作拆成多条记录, 一次性申请(要么全部写入, 要么都不写入)
+ */
+class ModbusWriteQueue
+{
+public:
+  /* ModbusWriteQueue: 构造队列
+   * @param capacity: 记录条数(向上取整为2的幂)
+   */
+  ModbusWriteQueue(unsigned int capacity = 256);
+  ~ModbusWriteQueue();
+
+  /* push_coil_bits: 写线圈的请求入队(可以多个线程同时调用)
+   * @param addr: 起始地址
+   * @param bits: 线圈的值(每个值1个字节)
+   * @param quantity: 个数
+   * :return: 成功返回0, 队列满返回-1
+   */
+  int push_coil_bits(int addr, const unsigned char *bits, int quantity);
+
+  /* push_holding_registers: 写保持寄存器的请求入队(可以多个线程同时调用)
+   * :return: 成功返回0, 队列满返回-1
+   */
+  int push_holding_registers(int addr, const unsigned short *regs, int quantity);
+
+  /* push_mask_holding_register: 掩码写保持寄存器的请求入队(出队时再读-改-写)
+   * :return: 成功返回0, 队列满返回-1
+   */
+  int push_mask_holding_register(int addr, unsigned short and_mask, unsigned short or_mask);
+
+  /* pop: 取出一条记录(只能在一个线程调用)
+   * @param rec: 记录
+   * :return: 有记录返回true
+   */
+  bool pop(ModbusWriteRecord *rec);
+
+  /* get_size: 队列中的记录条数(近似值) */
+  unsigned int get_size(void);
+
+  unsigned int get_capacity(void) { return mask_ + 1; }
+
+  /* get_rejected_count: 因队列满被拒绝的写请求数 */
+  uint64_t get_rejected_count(void) { return rejected_.load(std::memory_order_relaxed); }
+
+private:
+  int _reserve(int count, uint64_t *pos);
+  void _commit(uint64_t pos);
+
+private:
+  ModbusWriteSlot *slots_;
+  unsigned int mask_;
+  alignas(64) std::atomic<uint64_t> tail_;  // 写者申请的位置
+  alignas(64) std::atomic<uint64_t> head_;  // 只有读者修改, get_size可以在其它线程读
+  std::atomic<uint64_t> rejected_;
+};
+
+#endif // _MODBUS_WRITE_QUEUE_H_
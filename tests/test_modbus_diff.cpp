@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_data.h"
+#include "modbus_diff.h"
+#include "modbus_persist.h"
+
+static int get_calls = 0;
+static int set_calls = 0;
+
+unsigned short get_reg(unsigned short val)
+{
+  get_calls++;
+  return val;
+}
+
+int set_reg(unsigned short val)
+{
+  set_calls++;
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+  // 变化区间的查找和逐个比较的结果一致(覆盖16字节的边界和尾部)
+  unsigned short old_regs[50], new_regs[50];
+  unsigned char old_bits[50], new_bits[50];
+  srand(1);
+  int mismatched = 0;
+  for (int round = 0; round < 1000; round++) {
+    for (int i = 0; i < 50; i++) {
+      old_regs[i] = new_regs[i] = rand();
+      old_bits[i] = rand() & 1;
+      // 线圈的新值非0为1
+      new_bits[i] = old_bits[i] ? 1 + rand() % 255 : 0;
+    }
+    for (int i = 0; i < 3; i++) {
+      new_regs[rand() % 50] ^= 1 << (rand() % 16);
+      int inx = rand() % 50;
+      new_bits[inx] = !old_bits[inx];
+    }
+    int start = rand() % 50;
+    int expect = start;
+    while (expect < 50 && old_regs[expect] == new_regs[expect]) expect++;
+    if (ModbusDiff::find_changed(old_regs, new_regs, 50, start) != expect) mismatched++;
+    expect = start;
+    while (expect < 50 && old_regs[expect] != new_regs[expect]) expect++;
+    if (ModbusDiff::find_unchanged(old_regs, new_regs, 50, start) != expect) mismatched++;
+    expect = start;
+    while (expect < 50 && old_bits[expect] == (new_bits[expect] ? 1 : 0)) expect++;
+    if (ModbusDiff::find_changed(old_bits, new_bits, 50, start) != expect) mismatched++;
+  }
+  printf("find_changed mismatched: %d\n", mismatched);
+
+  // 写入时不调用额外绑定的读方法, 只对变化了的寄存器调用额外绑定的写方法
+  ModbusStructData modbus_data(10, 10, 10, 10);
+  for (int i = 0; i < 10; i++) {
+    modbus_data.get_holding_register_struct(i)->bind_get(get_reg);
+    modbus_data.get_holding_register_struct(i)->bind_set(set_reg);
+  }
+  unsigned short regs[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+  modbus_data.write_holding_registers(0, regs, 10);
+  printf("first write: get=%d set=%d\n", get_calls, set_calls);
+  get_calls = set_calls = 0;
+  regs[3] = 40;
+  regs[7] = 80;
+  modbus_data.write_holding_registers(0, regs, 10);
+  printf("two changed: get=%d set=%d\n", get_calls, set_calls);
+  get_calls = set_calls = 0;
+  modbus_data.mask_write_holding_register(0, 0x00F0, 0x0005);
+  modbus_data.mask_write_holding_register(1, 0xFFFF, 0x0000);
+  printf("mask write: get=%d set=%d\n", get_calls, set_calls);
+
+  // 总是写入的模式: 不比较, 每个寄存器都调用写方法
+  get_calls = set_calls = 0;
+  modbus_data.set_write_through(true);
+  modbus_data.write_holding_registers(0, regs, 10);
+  printf("write through: get=%d set=%d\n", get_calls, set_calls);
+  modbus_data.set_write_through(false);
+
+  // 基本型数据结构按整段比较, 持久化只记录变化了的区间
+  const char *snapshot_path = "/tmp/test_modbus_diff.snap";
+  const char *journal_path = "/tmp/test_modbus_diff.journal";
+  remove(snapshot_path);
+  remove(journal_path);
+  {
+    ModbusBaseData base_data(100, 10, 100, 10);
+    ModbusPersist persist(snapshot_path, journal_path, 0);
+    persist.open();
+    base_data.set_persist(&persist);
+    unsigned short w_regs[100] = {0};
+    for (int i = 0; i < 100; i++) w_regs[i] = i;
+    base_data.write_holding_registers(0, w_regs, 100);
+    long size = persist.get_journal_size();
+    base_data.write_holding_registers(0, w_regs, 100);
+    printf("same values journal growth: %ld\n", persist.get_journal_size() - size);
+    w_regs[50] = 500;
+    base_data.write_holding_registers(0, w_regs, 100);
+    long one = persist.get_journal_size() - size;
+    size = persist.get_journal_size();
+    w_regs[10] = 100;
+    w_regs[90] = 900;
+    base_data.write_holding_registers(0, w_regs, 100);
+    printf("journal growth: one changed=%ld, two changed=%ld\n", one, persist.get_journal_size() - size);
+    unsigned short r_regs[3];
+    base_data.read_holding_registers(49, 3, r_regs);
+    printf("holding regs 49~51: %d %d %d\n", r_regs[0], r_regs[1], r_regs[2]);
+
+    unsigned char w_bits[20] = {0};
+    w_bits[3] = 7;
+    base_data.write_coil_bits(0, w_bits, 20);
+    size = persist.get_journal_size();
+    w_bits[3] = 1;
+    base_data.write_coil_bits(0, w_bits, 20);
+    unsigned char r_bits[5];
+    base_data.read_coil_bits(0, 5, r_bits);
+    printf("coil bits: %d %d %d %d %d, same values journal growth: %ld\n", r_bits[0], r_bits[1], r_bits[2], r_bits[3], r_bits[4],
+      persist.get_journal_size() - size);
+    persist.close();
+  }
+  remove(snapshot_path);
+  remove(journal_path);
+  return 0;
+}
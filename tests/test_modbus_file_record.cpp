@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "modbus_tcp_data.h"
+#include "modbus_file_bank.h"
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+// 生成0x15的请求, subs为{文件号, 记录号, 记录数}, 每个子请求的数据为regs里连续的部分
+static int build_write_request(unsigned char *req, const int (*subs)[3], int count, const unsigned short *regs)
+{
+  unsigned char head[8] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, MODBUS_FC_WRITE_FILE_RECORD};
+  memcpy(req, head, 8);
+  int offset = 9;
+  for (int i = 0; i < count; i++) {
+    req[offset] = MODBUS_FILE_REF_TYPE;
+    ModbusTCP::HexData::bin16_to_8(subs[i][0], req + offset + 1);
+    ModbusTCP::HexData::bin16_to_8(subs[i][1], req + offset + 3);
+    ModbusTCP::HexData::bin16_to_8(subs[i][2], req + offset + 5);
+    for (int j = 0; j < subs[i][2]; j++) ModbusTCP::HexData::bin16_to_8(*regs++, req + offset + 7 + j * 2);
+    offset += 7 + subs[i][2] * 2;
+  }
+  req[8] = offset - 9;
+  ModbusTCP::HexData::bin16_to_8(offset - 6, req + 4);
+  return offset;
+}
+
+static int build_read_request(unsigned char *req, const int (*subs)[3], int count)
+{
+  unsigned char head[8] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, MODBUS_FC_READ_FILE_RECORD};
+  memcpy(req, head, 8);
+  for (int i = 0; i < count; i++) {
+    unsigned char *sub = req + 9 + i * 7;
+    sub[0] = MODBUS_FILE_REF_TYPE;
+    ModbusTCP::HexData::bin16_to_8(subs[i][0], sub + 1);
+    ModbusTCP::HexData::bin16_to_8(subs[i][1], sub + 3);
+    ModbusTCP::HexData::bin16_to_8(subs[i][2], sub + 5);
+  }
+  req[8] = count * 7;
+  ModbusTCP::HexData::bin16_to_8(3 + count * 7, req + 4);
+  return 9 + count * 7;
+}
+
+int main(int argc, char *arg[])
+{
+  const char *path = "/tmp/test_modbus_file_record.bin";
+  unlink(path);
+  ModbusData *modbus_data = new ModbusData(10, 10, 10, 10);
+  int ret_memory = modbus_data->add_file(1, MODBUS_FILE_MAX_RECORDS);
+  int ret_mmap = modbus_data->add_file(2, 100, path);
+  int ret_duplicate = modbus_data->add_file(1, 10);
+  int ret_too_large = modbus_data->add_file(3, MODBUS_FILE_MAX_RECORDS + 1);
+  printf("add_file: memory=%d mmap=%d duplicate=%d too_large=%d\n", ret_memory, ret_mmap, ret_duplicate, ret_too_large);
+  ModbusTCP::DataSession session(260, 260);
+  unsigned char req[260];
+
+  // 一个请求里写两个文件
+  int write_subs[2][3] = {{1, 0, 3}, {2, 10, 2}};
+  unsigned short values[5] = {11, 12, 13, 21, 22};
+  int len = build_write_request(req, write_subs, 2, values);
+  session.set_request_data(req, len);
+  DataService::process_session(&session, modbus_data);
+  printf("write response equals request: %d\n", session.get_response_length() == len && memcmp(session.get_response_data() + 7, req + 7, len - 7) == 0);
+
+  // 一个请求里读三段
+  int read_subs[3][3] = {{1, 0, 3}, {2, 10, 2}, {2, 0, 1}};
+  len = build_read_request(req, read_subs, 3);
+  session.set_request_data(req, len);
+  DataService::process_session(&session, modbus_data);
+  print_datas<unsigned char>("read response", session.get_response_data() + 7, session.get_response_length() - 7);
+
+  // 有一个子请求越界时整个请求都不执行
+  int bad_subs[2][3] = {{1, 3, 2}, {2, 99, 2}};
+  unsigned short bad_values[4] = {99, 99, 99, 99};
+  len = build_write_request(req, bad_subs, 2, bad_values);
+  session.set_request_data(req, len);
+  DataService::process_session(&session, modbus_data);
+  unsigned short regs[4];
+  modbus_data->read_file_records(1, 3, 2, regs);
+  print_datas<unsigned char>("out of range response", session.get_response_data() + 7, session.get_response_length() - 7);
+  print_datas<unsigned short>("records not written", regs, 2);
+  int missing_subs[1][3] = {{5, 0, 1}};
+  len = build_read_request(req, missing_subs, 1);
+  session.set_request_data(req, len);
+  DataService::process_session(&session, modbus_data);
+  print_datas<unsigned char>("missing file response", session.get_response_data() + 7, session.get_response_length() - 7);
+  len = build_read_request(req, read_subs, 1);
+  req[9] = 0x05;
+  session.set_request_data(req, len);
+  DataService::process_session(&session, modbus_data);
+  print_datas<unsigned char>("bad reference type response", session.get_response_data() + 7, session.get_response_length() - 7);
+
+  // 推送一个20000字节的参数块, 每个请求写122个记录
+  static unsigned short block[MODBUS_FILE_MAX_RECORDS];
+  for (int i = 0; i < MODBUS_FILE_MAX_RECORDS; i++) block[i] = i * 7;
+  int requests = 0;
+  for (int record = 0; record < MODBUS_FILE_MAX_RECORDS; record += 122) {
+    int sub[1][3] = {{1, record, MODBUS_FILE_MAX_RECORDS - record < 122 ? MODBUS_FILE_MAX_RECORDS - record : 122}};
+    len = build_write_request(req, sub, 1, block + record);
+    session.set_request_data(req, len);
+    DataService::process_session(&session, modbus_data);
+    if (session.get_response_length() == len) requests++;
+  }
+  int count = 0;
+  unsigned short *file = modbus_data->get_file_bank()->get_file(1, &count);
+  printf("block: requests=%d records=%d match=%d\n", requests, count, memcmp(file, block, sizeof(block)) == 0);
+
+  // 映射到磁盘的文件重新打开后内容还在
+  modbus_data->get_file_bank()->sync();
+  delete modbus_data;
+  modbus_data = new ModbusData(10, 10, 10, 10);
+  modbus_data->add_file(2, 100, path);
+  modbus_data->read_file_records(2, 10, 2, regs);
+  print_datas<unsigned short>("mmap file after reopen", regs, 2);
+  delete modbus_data;
+  unlink(path);
+  return 0;
+}
@@ -0,0 +1,58 @@
+// 头文件模式: 在包含头文件之前定义(或者编译时-DMODBUS_HEADER_ONLY)
+#define MODBUS_HEADER_ONLY
+#include <stdio.h>
+#include <iostream>
+#include "modbus_tcp_data.h"
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+/* 自定义的寄存器数据结构: 写入的值限制在0~1000
+ * 静态库里没有这个组合的特化, 只能在头文件模式下使用
+ */
+struct modbus_reg_clamp_data {
+  modbus_reg_clamp_data() { data = 0; }
+  ushort get() { return get_data(); }
+  int set(ushort val) { return set_data(val > 1000 ? 1000 : val); }
+  ushort get_data() { return data; }
+  int set_data(ushort val) { data = val; return 0; }
+  bool is_ptr_struct() { return false; }
+  int bind_data(ushort *val) { return NOT_SUPPORT; }
+private:
+  ushort data;
+};
+
+using ModbusData = ModbusDataTemplate<modbus_bit_base_data, modbus_reg_clamp_data>;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {
+  print_datas<unsigned char>("  response", res, res_len);
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  DataService service(&modbus_data);
+
+  // 写保持寄存器0x00开始的2个: 500, 5000
+  unsigned char write_regs[17] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x0B, 0x01, 0x10, 0x00, 0x00, 0x00, 0x02, 0x04, 0x01, 0xF4, 0x13, 0x88};
+  printf("write 500, 5000:\n");
+  service.process_data(write_regs, 17, callback);
+
+  // 读回来, 第二个被限制为1000
+  unsigned char read_regs[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x02};
+  printf("read:\n");
+  service.process_data(read_regs, 12, callback);
+
+  ushort regs[2];
+  modbus_data.read_holding_registers(0x00, 2, regs);
+  print_datas<ushort>("holding registers", regs, 2);
+  return 0;
+}
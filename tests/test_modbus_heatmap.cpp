@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "modbus_tcp_data.h"
+#include "modbus_tcp_server.h"
+#include "modbus_heatmap.h"
+#include "modbus_rt.h"
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {}
+
+// 模拟一个HMI: 反复轮询同一段保持寄存器, 偶尔写一个设定值
+void hmi(ModbusData *modbus_data, int client_id, int addr, int count)
+{
+  DataService service(modbus_data);
+  ModbusHeatmap::set_current_client(client_id);
+  unsigned char read_regs[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, (unsigned char)addr, 0x00, 0x0A};
+  unsigned char write_reg[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x50, 0x00, 0x01};
+  for (int i = 0; i < count; i++) {
+    service.process_data(read_regs, 12, callback);
+    if (i % 10 == 0) service.process_data(write_reg, 12, callback);
+  }
+  ModbusHeatmap::set_current_client(-1);
+}
+
+// 实时线程: 禁止申请内存, 统计使用enable时预先分配的数据
+void rt_reader(ModbusData *modbus_data, int count)
+{
+  ModbusRT::forbid_heap();
+  unsigned short regs[4];
+  for (int i = 0; i < count; i++) modbus_data->read_holding_registers(0x40, 4, regs);
+  ModbusRT::allow_heap();
+}
+
+// 开启统计前建立的连接, 开启后的请求也要计到这个客户端
+void test_server_connection(ModbusData *modbus_data)
+{
+  ModbusTCP::Server<ModbusData> server(modbus_data, 0, "127.0.0.1");
+  if (server.start() != 0) return;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(server.get_port());
+  connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+  for (int i = 0; i < 10 && server.get_connection_count() == 0; i++) server.run_once(10);
+
+  ModbusHeatmap::enable();
+  unsigned char req[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x60, 0x00, 0x02};
+  unsigned char res[32];
+  send(fd, req, sizeof(req), 0);
+  int res_len = -1;
+  for (int i = 0; i < 10 && res_len <= 0; i++) {
+    server.run_once(10);
+    res_len = recv(fd, res, sizeof(res), MSG_DONTWAIT);
+  }
+  close(fd);
+
+  std::vector<ModbusHeatClient> clients;
+  ModbusHeatmap::get_clients(&clients);
+  for (size_t i = 0; i < clients.size(); i++) {
+    if (strcmp(clients[i].name, "127.0.0.1") != 0) continue;
+    printf("connection before enable: response=%d, client %s holding_regs read requests=%llu\n", res_len, clients[i].name,
+      (unsigned long long)clients[i].requests[HEAT_HOLDING_REGS][HEAT_READ]);
+  }
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+
+  // 关闭时不统计
+  hmi(&modbus_data, -1, 0x00, 10);
+  ModbusHeatmap::enable();
+  int hmi_a = ModbusHeatmap::register_client("192.168.1.20");
+  int hmi_b = ModbusHeatmap::register_client("192.168.1.21");
+  printf("client ids: %d %d, same name again: %d\n", hmi_a, hmi_b, ModbusHeatmap::register_client("192.168.1.20"));
+
+  // 两个线程(两个客户端), 轮询的区间部分重叠
+  std::thread th1(hmi, &modbus_data, hmi_a, 0x00, 1000);
+  std::thread th2(hmi, &modbus_data, hmi_b, 0x05, 500);
+  th1.join();
+  th2.join();
+  // 应用程序直接写输入寄存器, 只计入整体
+  unsigned short regs[4] = {1, 2, 3, 4};
+  modbus_data.write_input_registers(0x20, regs, 4);
+
+  uint64_t counts[MODBUS_HEATMAP_ADDR_COUNT];
+  ModbusHeatmap::get_counts(HEAT_HOLDING_REGS, HEAT_READ, counts);
+  printf("holding register reads: ");
+  for (int i = 0; i < 16; i++) printf("%llu ", (unsigned long long)counts[i]);
+  printf("\n");
+
+  ModbusHeatmap::dump(stdout, 5);
+
+  // 采样: 每10次统计一次, 导出的是估计值
+  ModbusHeatmap::reset();
+  ModbusHeatmap::enable(10);
+  hmi(&modbus_data, hmi_a, 0x00, 1000);
+  std::vector<ModbusHeatRange> ranges;
+  ModbusHeatmap::get_top_ranges(1, &ranges, HEAT_HOLDING_REGS, HEAT_READ);
+  printf("sampled top range: addr=%d, quantity=%d, count=%llu\n", ranges[0].addr, ranges[0].quantity, (unsigned long long)ranges[0].count);
+
+  // enable预先分配两个线程的数据, 实时线程统计时不申请内存
+  ModbusHeatmap::reset();
+  ModbusHeatmap::enable(1, 2);
+  std::thread rt1(rt_reader, &modbus_data, 100);
+  std::thread rt2(rt_reader, &modbus_data, 100);
+  rt1.join();
+  rt2.join();
+  ModbusHeatmap::get_counts(HEAT_HOLDING_REGS, HEAT_READ, counts);
+  printf("rt threads: reads of 0x40=%llu, heap violations=%llu\n", (unsigned long long)counts[0x40],
+    (unsigned long long)ModbusRT::get_heap_violations());
+
+  ModbusHeatmap::disable();
+  test_server_connection(&modbus_data);
+  ModbusHeatmap::disable();
+  return 0;
+}
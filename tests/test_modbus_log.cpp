@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <unistd.h>
+#include "modbus_tcp_data.h"
+#include "modbus_log.h"
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+static std::atomic<int> sink_count(0);
+
+// 自定义的输出方法(在日志的后台线程调用)
+void my_sink(void *arg, int level, uint64_t timestamp_ns, const char *msg, int length)
+{
+  sink_count++;
+  if (sink_count <= 5 || level != MODBUS_LOG_LEVEL_INFO) {
+    printf("[%s][level=%d] %.*s\n", (const char *)arg, level, length, msg);
+  }
+}
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {}
+
+void worker(int id)
+{
+  for (int i = 0; i < 100; i++) {
+    MODBUS_LOG_INFO("worker %d, message %d", id, i);
+  }
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusLog::set_sink(my_sink, (void *)"my_sink");
+
+  // 等级过滤: 默认INFO, DEBUG的日志点不会格式化
+  MODBUS_LOG_DEBUG("this debug message is filtered");
+  MODBUS_LOG_INFO("modbus log level: %d", ModbusLog::get_level());
+
+  // 多个线程同时写日志, 不会阻塞
+  std::thread th1(worker, 1);
+  std::thread th2(worker, 2);
+  th1.join();
+  th2.join();
+  ModbusLog::flush();
+  printf("sink count after workers: %d, dropped: %lu\n", sink_count.load(), (unsigned long)ModbusLog::get_dropped_count());
+
+  // 长度错误的帧, 日志限速为每秒最多10条
+  ModbusData modbus_data(100, 100, 100, 100);
+  DataService service(&modbus_data);
+  unsigned char bad_len[7] = {0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x01};
+  int before = sink_count;
+  for (int i = 0; i < 1000; i++) {
+    service.process_data(bad_len, 7, callback);
+  }
+  ModbusLog::flush();
+  printf("1000 bad frames -> %d log messages\n", sink_count.load() - before);
+
+  // 异常回复不再输出日志(DEBUG等级)
+  unsigned char bad_addr[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x10, 0x00, 0x00, 0x01};
+  before = sink_count;
+  for (int i = 0; i < 1000; i++) {
+    service.process_data(bad_addr, 12, callback);
+  }
+  ModbusLog::flush();
+  printf("1000 exception responses -> %d log messages\n", sink_count.load() - before);
+
+  ModbusLog::set_level(MODBUS_LOG_LEVEL_DEBUG);
+  service.process_data(bad_addr, 12, callback);
+  ModbusLog::stop();
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+#include "modbus_tcp_data.h"
+#include "modbus_metrics.h"
+
+using ModbusData = ModbusStructData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {}
+
+void print_callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {
+  print_datas<unsigned char>("  response", res, res_len);
+}
+
+unsigned short get_reg_0(unsigned short val) { return val + 1; }
+
+void worker(ModbusData *modbus_data, int count)
+{
+  DataService service(modbus_data);
+  // 读保持寄存器0x00开始的10个(0x00绑定了读方法)
+  unsigned char read_regs[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+  // 写单个保持寄存器0x05
+  unsigned char write_reg[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x05, 0x12, 0x34};
+  // 读不存在的地址, 回复异常码0x02
+  unsigned char bad_addr[12] = {0x00, 0x03, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x10, 0x00, 0x00, 0x01};
+  for (int i = 0; i < count; i++) {
+    service.process_data(read_regs, 12, callback);
+    service.process_data(write_reg, 12, callback);
+    if (i % 10 == 0) service.process_data(bad_addr, 12, callback);
+  }
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  modbus_data.get_holding_register_struct(0x00)->bind_get(get_reg_0);
+  // 默认每16个请求统计一次耗时, 这里设为每个请求都统计
+  ModbusMetrics::set_latency_sample_interval(1);
+
+  // 两个线程各自记录到自己的分片, 快照时合并
+  std::thread th1(worker, &modbus_data, 1000);
+  std::thread th2(worker, &modbus_data, 1000);
+  th1.join();
+  th2.join();
+
+  ModbusMetricsSnapshot *snap = new ModbusMetricsSnapshot();
+  ModbusMetrics::snapshot(snap);
+  printf("total requests: %lu, total exceptions: %lu\n", (unsigned long)snap->get_total_requests(), (unsigned long)snap->get_total_exceptions());
+  printf("0x03 requests: %lu, exceptions: %lu, hook calls: %lu\n",
+    (unsigned long)snap->requests[0x03], (unsigned long)snap->exceptions[0x03], (unsigned long)snap->hook_calls[0x03]);
+  printf("0x06 requests: %lu, exceptions: %lu, hook calls: %lu\n",
+    (unsigned long)snap->requests[0x06], (unsigned long)snap->exceptions[0x06], (unsigned long)snap->hook_calls[0x06]);
+  printf("exception code 0x02: %lu\n", (unsigned long)snap->exception_codes[0x02]);
+  printf("bytes in: %lu, bytes out: %lu\n", (unsigned long)snap->bytes_in, (unsigned long)snap->bytes_out);
+  printf("0x03 latency count: %lu\n", (unsigned long)snap->get_latency(0x03).get_count());
+  printf("0x03 latency(ns): p50=%.0f p99=%.0f max=%.0f\n",
+    snap->get_latency_ns(0x03, 50), snap->get_latency_ns(0x03, 99), snap->get_latency_ns(0x03, 100));
+
+  // 多个快照可以合并(比如多个进程上报的数据)
+  ModbusMetricsSnapshot *total = new ModbusMetricsSnapshot();
+  total->merge(*snap);
+  total->merge(*snap);
+  printf("merged total requests: %lu\n", (unsigned long)total->get_total_requests());
+  delete snap;
+  delete total;
+
+  // 0x08诊断功能码, 计数器和上面的统计是同一份
+  DataService service(&modbus_data);
+  unsigned char diag_echo[12] = {0x00, 0x10, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x00, 0xA5, 0x37};
+  unsigned char diag_msg_count[12] = {0x00, 0x11, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x0E, 0x00, 0x00};
+  unsigned char diag_exp_count[12] = {0x00, 0x12, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x0D, 0x00, 0x00};
+  unsigned char diag_clear[12] = {0x00, 0x13, 0x00, 0x00, 0x00, 0x06, 0x01, 0x08, 0x00, 0x0A, 0x00, 0x00};
+  printf("diagnostics 0x00(return query data):\n");
+  service.process_data(diag_echo, 12, print_callback);
+  printf("diagnostics 0x0E(server message count, 16 bits):\n");
+  service.process_data(diag_msg_count, 12, print_callback);
+  printf("diagnostics 0x0D(bus exception error count):\n");
+  service.process_data(diag_exp_count, 12, print_callback);
+  printf("diagnostics 0x0A(clear counters):\n");
+  service.process_data(diag_clear, 12, print_callback);
+  printf("diagnostics 0x0E after clear:\n");
+  service.process_data(diag_msg_count, 12, print_callback);
+
+  // 统计数据映射到输入寄存器0x50~0x5F
+  ModbusMetrics::set_register_window(0x50);
+  unsigned char read_window[12] = {0x00, 0x14, 0x00, 0x00, 0x00, 0x06, 0x01, 0x04, 0x00, 0x50, 0x00, 0x10};
+  printf("read stats window(input registers 0x50~0x5F):\n");
+  service.process_data(read_window, 12, print_callback);
+  // 刷新间隔内再读, 回复的是上一次刷新的结果(请求数不变)
+  printf("read stats window again within refresh interval:\n");
+  service.process_data(read_window, 12, print_callback);
+  // 统计数据只覆盖在回复里, 寄存器本身不变
+  unsigned short regs[2];
+  modbus_data.read_input_registers(0x50, 2, regs);
+  print_datas<unsigned short>("input registers 0x50~0x51", regs, 2);
+  return 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <signal.h>
+#include <iostream>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include "modbus_data.h"
+#include "modbus_persist.h"
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char *arg[])
+{
+  using ModbusData = ModbusStructData;
+
+  const char *snapshot_path = "/tmp/test_modbus_persist.snap";
+  const char *journal_path = "/tmp/test_modbus_persist.journal";
+  remove(snapshot_path);
+  remove(journal_path);
+
+  {
+    // 创建Modbus寄存器并绑定持久化实例, 每10ms组提交一次
+    ModbusData modbus_data(10, 10, 10, 10);
+    ModbusPersist persist(snapshot_path, journal_path, 10);
+    persist.open();
+    modbus_data.set_persist(&persist);
+
+    unsigned short w_regs[4] = {11, 22, 33, 44};
+    modbus_data.write_holding_registers(0x02, w_regs, 4);
+    // 生成快照, 之后的写操作只记录在日志里
+    modbus_data.checkpoint_persist();
+
+    unsigned char w_bits[5] = {1, 0, 1, 1, 1};
+    modbus_data.write_coil_bits(0x00, w_bits, 5);
+    modbus_data.mask_write_holding_register(0x03, 0x00F0, 0x0005);
+    printf("journal size after checkpoint: %ld\n", persist.get_journal_size());
+    // 析构时会把缓冲区的日志刷盘
+  }
+
+  {
+    // 模拟程序重启: 新建Modbus寄存器, 从快照和日志恢复
+    ModbusData modbus_data(10, 10, 10, 10);
+    ModbusPersist persist(snapshot_path, journal_path, 10);
+    modbus_data.set_persist(&persist);
+    int code = modbus_data.restore_persist();
+    persist.open();
+    printf("restore code: %d\n", code);
+
+    unsigned short r_regs[10] = {0};
+    modbus_data.read_holding_registers(0x00, 10, r_regs);
+    print_datas<unsigned short>("holding regs", r_regs, 10);
+
+    unsigned char r_bits[10] = {0};
+    modbus_data.read_coil_bits(0x00, 10, r_bits);
+    print_datas<unsigned char>("coil bits", r_bits, 10);
+  }
+
+  remove(snapshot_path);
+  remove(journal_path);
+
+  {
+    // 模拟磁盘写满: 限制文件大小, 刷盘失败时截掉写了一半的记录, 记录留在缓冲区, 恢复后重新刷盘
+    signal(SIGXFSZ, SIG_IGN);
+    ModbusData modbus_data(10, 10, 10, 10);
+    ModbusPersist persist(snapshot_path, journal_path, 60000);
+    persist.open();
+    modbus_data.set_persist(&persist);
+    unsigned short w_regs[4] = {1, 2, 3, 4};
+    modbus_data.write_holding_registers(0x00, w_regs, 2);
+    printf("sync before limit: %d\n", persist.sync());
+
+    struct rlimit old_limit, limit;
+    getrlimit(RLIMIT_FSIZE, &old_limit);
+    limit = old_limit;
+    limit.rlim_cur = persist.get_journal_size() + 10;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    modbus_data.write_holding_registers(0x02, w_regs + 2, 2);
+    printf("sync over limit: %d\n", persist.sync());
+    struct stat st;
+    stat(journal_path, &st);
+    printf("torn record truncated: %d\n", st.st_size == persist.get_journal_size());
+    unsigned char w_bits[2] = {1, 1};
+    printf("append after failure: %d\n", persist.append(PERSIST_COIL_BITS, 0x00, w_bits, 2));
+
+    setrlimit(RLIMIT_FSIZE, &old_limit);
+    printf("sync after limit removed: %d\n", persist.sync());
+    printf("error after retry: %d\n", persist.get_error());
+  }
+
+  {
+    ModbusData modbus_data(10, 10, 10, 10);
+    ModbusPersist persist(snapshot_path, journal_path, 10);
+    modbus_data.set_persist(&persist);
+    modbus_data.restore_persist();
+    unsigned short r_regs[4] = {0};
+    modbus_data.read_holding_registers(0x00, 4, r_regs);
+    print_datas<unsigned short>("holding regs after retry", r_regs, 4);
+    unsigned char r_bits[2] = {0};
+    modbus_data.read_coil_bits(0x00, 2, r_bits);
+    print_datas<unsigned char>("coil bits after retry", r_bits, 2);
+  }
+
+  remove(snapshot_path);
+  remove(journal_path);
+  return 0;
+}
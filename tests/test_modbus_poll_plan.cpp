@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "modbus_poll_plan.h"
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+static int conn_fd = -1;
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {
+  send(conn_fd, res, res_len, 0);
+}
+
+// 一个最简单的单连接Modbus TCP服务器, 仅用于演示轮询计划
+static void server_handle_(int listen_fd, ModbusData *modbus_data) {
+  DataService service(modbus_data);
+  conn_fd = accept(listen_fd, NULL, NULL);
+  unsigned char buf[1024];
+  while (1) {
+    ssize_t n = recv(conn_fd, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    service.process_data(buf, n, callback);
+  }
+  close(conn_fd);
+}
+
+void print_plan(ModbusTCP::PollPlanner *planner)
+{
+  for (int i = 0; i < planner->get_request_count(); i++) {
+    const ModbusTCP::ClientRequest *req = planner->get_request(i);
+    printf("  request %d: func_code=0x%02X, addr=%d, quantity=%d\n", i, req->func_code, req->addr, req->quantity);
+  }
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(1000, 1000, 1000, 1000);
+  unsigned short regs[1000];
+  for (int i = 0; i < 1000; i++) regs[i] = i;
+  modbus_data.write_input_registers(0x00, regs, 1000);
+  modbus_data.write_holding_registers(0x00, regs, 1000);
+
+  ModbusTCP::PollPlanner planner;
+
+  // 需要轮询的数据点, 地址不连续
+  unsigned short temp[2], pressure[2], flow[4], level[1], setpoint[10], far_away[2];
+  unsigned char alarms[16];
+  planner.add_tag(MODBUS_FC_READ_INPUT_REGS, 10, 2, temp);
+  planner.add_tag(MODBUS_FC_READ_INPUT_REGS, 14, 2, pressure);
+  planner.add_tag(MODBUS_FC_READ_INPUT_REGS, 30, 4, flow);
+  planner.add_tag(MODBUS_FC_READ_INPUT_REGS, 100, 1, level);
+  planner.add_tag(MODBUS_FC_READ_INPUT_REGS, 900, 2, far_away);
+  planner.add_tag(MODBUS_FC_READ_HOLDING_REGS, 200, 10, setpoint);
+  planner.add_tag(MODBUS_FC_READ_COILS, 500, 16, alarms);
+
+  printf("plan with default cost model (7 tags):\n");
+  print_plan(&planner);
+
+  // 请求的固定开销越小, 越倾向于不合并
+  planner.set_cost_model(ModbusTCP::PollCostModel(5.0, 1.0));
+  printf("plan with cheap requests:\n");
+  print_plan(&planner);
+  planner.set_cost_model(ModbusTCP::PollCostModel());
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int opt = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+  listen(listen_fd, 1);
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, (struct sockaddr *)&addr, &len);
+  std::thread th(server_handle_, listen_fd, &modbus_data);
+
+  ModbusTCP::Client client(16);
+  client.connect("127.0.0.1", ntohs(addr.sin_port));
+  // 轮询: 计划已缓存, 回复直接拷贝到各个数据点的buf
+  int code = planner.poll(&client);
+  printf("poll: %d\n", code);
+  print_datas<unsigned short>("temp", temp, 2);
+  print_datas<unsigned short>("pressure", pressure, 2);
+  print_datas<unsigned short>("flow", flow, 4);
+  print_datas<unsigned short>("level", level, 1);
+  print_datas<unsigned short>("far_away", far_away, 2);
+  print_datas<unsigned short>("setpoint", setpoint, 10);
+
+  client.disconnect();
+  th.join();
+  close(listen_fd);
+  return 0;
+}
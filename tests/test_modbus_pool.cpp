@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <iostream>
+#include "modbus_tcp_data.h"
+#include "modbus_pool.h"
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+void print_pool(const char *name, ModbusPool *pool)
+{
+  printf("%s pool: object_size=%d, slabs=%d, used=%d, free=%d\n", name, (int)pool->get_object_size(),
+    pool->get_slab_count(), pool->get_used_count(), pool->get_free_count());
+}
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {
+  print_datas<unsigned char>("  response", res, res_len);
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  unsigned char read_regs[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+
+  // 单独使用内存池
+  ModbusPool pool(100, 4);
+  void *ptrs[6];
+  for (int i = 0; i < 6; i++) ptrs[i] = pool.alloc();
+  print_pool("custom", &pool);
+  for (int i = 0; i < 6; i++) pool.free(ptrs[i]);
+  print_pool("custom", &pool);
+
+  // 模拟HMI每次轮询都重新连接: 每个连接一个DataService
+  for (int i = 0; i < 3; i++) {
+    DataService *service = new DataService(&modbus_data);
+    service->process_data(read_regs, 12, callback);
+    delete service;
+  }
+  print_pool("service", ModbusPool::get(sizeof(DataService)));
+  print_pool("frame", ModbusPool::get(sizeof(ModbusTCP::DataFrame)));
+  int slabs = ModbusPool::get(sizeof(ModbusTCP::DataFrame))->get_slab_count();
+
+  // 重连10000次, 空闲链表上的对象被重复使用, slab数不变
+  for (int i = 0; i < 10000; i++) {
+    DataService *service = new DataService(&modbus_data);
+    delete service;
+  }
+  printf("slabs unchanged after churn: %d\n", ModbusPool::get(sizeof(ModbusTCP::DataFrame))->get_slab_count() == slabs);
+
+  // 同时存在的连接多于一个slab的对象数时再申请slab
+  DataService *services[100];
+  for (int i = 0; i < 100; i++) services[i] = new DataService(&modbus_data);
+  print_pool("frame", ModbusPool::get(sizeof(ModbusTCP::DataFrame)));
+  for (int i = 0; i < 100; i++) delete services[i];
+  print_pool("frame", ModbusPool::get(sizeof(ModbusTCP::DataFrame)));
+
+  // 超过内部缓冲区的帧仍然可以处理(申请堆内存)
+  ModbusTCP::DataFrame frame;
+  unsigned char big[300] = {0};
+  frame.set_raw_data(big, 300);
+  printf("big frame length: %d\n", frame.data_length);
+  return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <iostream>
+#include "modbus_tcp_data.h"
+#include "modbus_rt.h"
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+// 统计处理请求时的堆申请次数
+static bool alloc_counting = false;
+static int alloc_count = 0;
+
+void *operator new(size_t size)
+{
+  if (alloc_counting) alloc_count++;
+  void *p = malloc(size == 0 ? 1 : size);
+  if (p == NULL) throw std::bad_alloc();
+  return p;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(2000, 2000, 200, 200);
+  ModbusTCP::DataSession session(260, 260);
+
+  // 初始化(没有权限时mlockall/SCHED_FIFO会失败, 不影响后面的检查)
+  printf("reserve_sessions: %d\n", ModbusRT::reserve_sessions(4));
+  printf("lock_memory: %s\n", ModbusRT::lock_memory() == 0 ? "ok" : "no permission");
+  ModbusRT::prefault_stack();
+
+  // 每个功能码最大的请求
+  unsigned char read_coils[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x01, 0x00, 0x00, 0x07, 0xD0};
+  unsigned char read_regs[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x7D};
+  unsigned char write_coils[260] = {0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01, 0x0F, 0x00, 0x00, 0x07, 0xB0, 0xF6};
+  for (int i = 0; i < 0xF6; i++) write_coils[13 + i] = 0x55;
+  ModbusTCP::HexData::bin16_to_8(7 + 0xF6, write_coils + 4);
+  unsigned char write_regs[260] = {0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x01, 0x10, 0x00, 0x00, 0x00, 0x7B, 0xF6};
+  for (int i = 0; i < 0x7B; i++) ModbusTCP::HexData::bin16_to_8(i, write_regs + 13 + i * 2);
+  ModbusTCP::HexData::bin16_to_8(7 + 0xF6, write_regs + 4);
+  unsigned char write_read[260] = {0x00, 0x05, 0x00, 0x00, 0x00, 0x00, 0x01, 0x17, 0x00, 0x00, 0x00, 0x7D, 0x00, 0x00, 0x00, 0x79, 0xF2};
+  for (int i = 0; i < 0x79; i++) ModbusTCP::HexData::bin16_to_8(i + 100, write_read + 17 + i * 2);
+  ModbusTCP::HexData::bin16_to_8(11 + 0xF2, write_read + 4);
+  unsigned char *reqs[5] = {read_coils, read_regs, write_coils, write_regs, write_read};
+  int lens[5] = {12, 12, 13 + 0xF6, 13 + 0xF6, 17 + 0xF2};
+
+  // 预热后禁止堆申请
+  for (int i = 0; i < 5; i++) {
+    session.set_request_data(reqs[i], lens[i]);
+    DataService::process_session(&session, &modbus_data);
+  }
+  ModbusRT::forbid_heap();
+  alloc_counting = true;
+  for (int n = 0; n < 1000; n++) {
+    for (int i = 0; i < 5; i++) {
+      session.set_request_data(reqs[i], lens[i]);
+      DataService::process_session(&session, &modbus_data);
+    }
+  }
+  alloc_counting = false;
+  ModbusRT::allow_heap();
+  printf("heap allocations while forbidden: %d, violations: %d\n", alloc_count, (int)ModbusRT::get_heap_violations());
+
+  // 回复仍然正确
+  session.set_request_data(write_read, lens[4]);
+  DataService::process_session(&session, &modbus_data);
+  print_datas<unsigned char>("write and read response head", session.get_response_data(), 15);
+  session.set_request_data(read_coils, 12);
+  DataService::process_session(&session, &modbus_data);
+  printf("read 2000 coils response length: %d\n", session.get_response_length());
+
+  // 没有禁止的线程不受影响
+  ModbusTCP::DataFrame *frame = new ModbusTCP::DataFrame(1024);
+  delete frame;
+  printf("violations after allowed allocation: %d\n", (int)ModbusRT::get_heap_violations());
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include "modbus_data.h"
+#include "modbus_scale.h"
+#include "modbus_tcp_data.h"
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+static void print_values(const char *str, const double *values, int length)
+{
+  printf("%s: ", str);
+  for (int i = 0; i < length; i++) {
+    printf("%g ", values[i]);
+  }
+  printf("\n");
+}
+
+int set_reg(unsigned short val)
+{
+  printf("set_reg: %d\n", val);
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+  // 温度: 0.1度一个单位, 无符号, 限幅到0~65535, NaN写0
+  ModbusScale temp(10.0, 0.0, false);
+  double values[8] = {1.23, 25.06, -5.0, 7000.0, NAN, 6553.5, 0.05, 0.15};
+  unsigned short regs[8];
+  temp.encode(values, 8, regs);
+  print_datas<unsigned short>("unsigned regs", regs, 8);
+  double decoded[8];
+  temp.decode(regs, 8, decoded);
+  print_values("unsigned values", decoded, 8);
+
+  // 有符号, 带偏移: raw = value * 100 - 5000
+  ModbusScale pressure(100.0, -5000.0, true);
+  double p_values[5] = {0.0, 50.0, -300.0, 400.0, 377.675};
+  pressure.encode(p_values, 5, regs);
+  print_datas<short>("signed regs", (short *)regs, 5);
+  pressure.decode(regs, 5, decoded);
+  print_values("signed values", decoded, 5);
+  ModbusScale zero(0.0, 0.0, false);
+  printf("decode with zero gain: %d\n", zero.decode(regs, 5, decoded));
+
+  // SIMD和逐个转换的结果一致(包括超出范围的值和不足4个的尾部)
+  double randoms[37];
+  float randoms_f[37];
+  unsigned short simd[37], scalar[37], simd_f[37];
+  double back[37], back_scalar[37];
+  srand(1);
+  for (int i = 0; i < 37; i++) {
+    randoms[i] = (rand() % 200000 - 100000) / 7.0;
+    randoms_f[i] = (float)randoms[i];
+  }
+  int mismatched = 0;
+  for (int is_signed = 0; is_signed <= 1; is_signed++) {
+    ModbusScale scale(1.5, 123.0, is_signed);
+    for (int count = 0; count <= 37; count++) {
+      scale.encode(randoms, count, simd);
+      scale.encode_scalar(randoms, count, scalar);
+      scale.decode(simd, count, back);
+      scale.decode_scalar(scalar, count, back_scalar);
+      if (memcmp(simd, scalar, count * 2) != 0 || memcmp(back, back_scalar, count * sizeof(double)) != 0) mismatched++;
+      // float的结果和double的结果最多差1(乘加的精度不同)
+      scale.encode(randoms_f, count, simd_f);
+      for (int i = 0; i < count; i++) {
+        if (abs((int)simd_f[i] - (int)simd[i]) > 1) mismatched++;
+      }
+    }
+  }
+  printf("simd vs scalar mismatched: %d\n", mismatched);
+
+  // 基本型数据结构: 直接转换到寄存器的存储
+  ModbusBaseData base_data(10, 10, 10, 10);
+  base_data.write_input_scaled(2, values, 4, temp);
+  base_data.read_input_registers(2, 4, regs);
+  print_datas<unsigned short>("base input regs", regs, 4);
+  float floats[4];
+  base_data.read_input_scaled(2, 4, floats, temp);
+  printf("base input floats: %g %g %g %g\n", floats[0], floats[1], floats[2], floats[3]);
+  printf("illegal address: %d %d\n", base_data.write_input_scaled(8, values, 4, temp), base_data.read_input_scaled(0, 1, floats, zero));
+
+  // 扩展型数据结构: 逐个寄存器写入, 额外绑定的写方法照常调用
+  ModbusStructData struct_data(10, 10, 10, 10);
+  struct_data.get_holding_register_struct(0)->bind_set(set_reg);
+  float setpoints[2] = {12.5f, -1.0f};
+  struct_data.write_holding_scaled(0, setpoints, 2, temp);
+  double r_setpoints[2];
+  struct_data.read_holding_scaled(0, 2, r_setpoints, temp);
+  print_values("struct holding values", r_setpoints, 2);
+
+  // 转换表: 区间保存在寄存器里, 发布和客户端写入时按区间批量转换
+  ModbusBaseData table_data(10, 10, 10, 10);
+  printf("set scales: %d %d %d\n", table_data.set_input_scale(0, 4, temp), table_data.set_input_scale(4, 2, pressure),
+    table_data.set_holding_scale(0, 4, pressure));
+  printf("overlapped / zero gain: %d %d\n", table_data.set_input_scale(3, 2, temp), table_data.set_holding_scale(5, 1, zero));
+  // 发布: 跨两个区间, 每个区间按自己的转换
+  double published[6] = {25.06, -5.0, 7000.0, 0.15, 50.0, -300.0};
+  printf("publish input: %d\n", table_data.write_input_scaled(0, published, 6));
+  table_data.read_input_registers(0, 6, regs);
+  print_datas<short>("table input regs", (short *)regs, 6);
+  table_data.read_input_scaled(0, 6, decoded);
+  print_values("table input values", decoded, 6);
+  printf("not covered: %d %d\n", table_data.write_input_scaled(4, published, 3), table_data.read_holding_scaled(3, 2, decoded));
+
+  // 客户端写入(0x10和0x06)后保持寄存器解码成工程量
+  ModbusTCP::DataSession session;
+  unsigned char fc16[21] = {0x00, 0x01, 0x00, 0x00, 0x00, 15, 0x01, 0x10, 0x00, 0x00, 0x00, 0x04, 8,
+    0x13, 0x88, 0x1B, 0x58, 0x00, 0x00, 0xFF, 0x38}; // 5000 7000 0 -200
+  session.set_request_data(fc16, 21);
+  ModbusTCP::DataService<ModbusBaseData>::process_session(&session, &table_data);
+  table_data.read_holding_scaled(0, 4, decoded);
+  print_values("holding values after 0x10", decoded, 4);
+  unsigned char fc06[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 6, 0x01, 0x06, 0x00, 0x02, 0x27, 0x10}; // 10000
+  session.set_request_data(fc06, 12);
+  ModbusTCP::DataService<ModbusBaseData>::process_session(&session, &table_data);
+  table_data.read_holding_scaled(0, 4, floats);
+  printf("holding floats after 0x06: %g %g %g %g\n", floats[0], floats[1], floats[2], floats[3]);
+  // 应用程序发布的设定值同样解码(限幅后的值)
+  float published_f[2] = {1.5f, 1000.0f};
+  table_data.write_holding_scaled(2, published_f, 2);
+  table_data.read_holding_scaled(2, 2, decoded);
+  print_values("holding values after publish", decoded, 2);
+  return 0;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "modbus_tcp_server.h"
+#include "modbus_tcp_client.h"
+#include "modbus_histogram.h"
+
+using ModbusData = ModbusBaseData;
+using Server = ModbusTCP::Server<ModbusData>;
+
+// 正常的客户端: 每次读1个保持寄存器, 统计每次的延时(微秒)
+static int poll_registers(int port, int count, ModbusHistogram *latency)
+{
+  ModbusTCP::Client client(1);
+  if (client.connect("127.0.0.1", port) != 0) return 0;
+  int ok = 0;
+  unsigned short reg;
+  for (int i = 0; i < count; i++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (client.read_holding_registers(0x00, 1, &reg) == 0) ok++;
+    latency->record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+  return ok;
+}
+
+// 延后回复的帧处理方法: 记下回复的标识, 回复由测试代码给出
+static uint64_t deferred_token = 0;
+static void defer_handler(ModbusTCP::DataSession *session, ModbusData *modbus_data, void *arg)
+{
+  deferred_token = ((Server *)arg)->defer_response();
+}
+
+// 延后的回复交回时对方已经复位连接: 唤醒事件排在这个连接的事件之前, 发送回复失败后连接不能在本轮被重复关闭
+static void test_deferred_reset(ModbusData *modbus_data)
+{
+  Server server(modbus_data, 0, "127.0.0.1");
+  server.set_session_handler(defer_handler, &server);
+  if (server.start() != 0) return;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(server.get_port());
+  connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+  unsigned char req[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+  send(fd, req, sizeof(req), 0);
+  for (int i = 0; i < 100 && deferred_token == 0; i++) server.run_once(10);
+  // 再空转一次, 让epoll就绪链表里不再有这个连接, 之后唤醒事件排在连接的复位事件之前
+  server.run_once(0);
+  printf("deferred reset: connections=%d, deferred=%d\n", server.get_connection_count(), deferred_token != 0);
+
+  unsigned char res[11] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x01, 0x03, 0x02, 0x00, 0x00};
+  server.post_response(deferred_token, res, sizeof(res));
+  struct linger lg = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+  close(fd);
+  usleep(50000);
+  server.run_once(10);
+  printf("deferred reset: connections after reset=%d\n", server.get_connection_count());
+  // 连接关闭后交回的回复被丢弃
+  printf("deferred reset: post after close=%d\n", server.post_response(deferred_token, res, sizeof(res)));
+  server.run_once(10);
+  printf("deferred reset: connections=%d\n", server.get_connection_count());
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(2000, 2000, 100, 100);
+  Server server(&modbus_data, 0, "127.0.0.1");
+  server.set_fairness(16, 1024);
+  server.set_tx_limit(64 * 1024);
+  if (server.start() != 0) {
+    printf("server start failed\n");
+    return -1;
+  }
+  std::thread th(&Server::run, &server);
+
+  ModbusHistogram baseline;
+  int ok = poll_registers(server.get_port(), 200, &baseline);
+  printf("baseline: ok=%d\n", ok);
+
+  // 滥用的客户端: 流水线发送最多20000个读2000个线圈的请求(直到发送缓冲区满), 并且不接收回复
+  int abuser = socket(AF_INET, SOCK_STREAM, 0);
+  int rcvbuf = 4096;
+  setsockopt(abuser, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(server.get_port());
+  connect(abuser, (struct sockaddr *)&addr, sizeof(addr));
+  unsigned char req[12] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x01, 0x00, 0x00, 0x07, 0xD0};
+  int sent = 0;
+  for (int i = 0; i < 20000; i++) {
+    req[0] = i >> 8;
+    req[1] = i & 0xFF;
+    if (send(abuser, req, 12, MSG_DONTWAIT) != 12) break;
+    sent++;
+  }
+  printf("abuser pipelined requests: %d\n", sent > 1000);
+
+  ModbusHistogram loaded;
+  ok = poll_registers(server.get_port(), 200, &loaded);
+  printf("under abuse: ok=%d\n", ok);
+  // 滥用的客户端不接收回复, 待发送的回复超过tx_limit后被暂停
+  for (int i = 0; i < 200 && server.get_throttled_count() == 0; i++) usleep(10000);
+  printf("abuser throttled: %d\n", server.get_throttled_count() > 0);
+  printf("latency(us) baseline p99=%llu max=%llu, under abuse p99=%llu max=%llu\n",
+    (unsigned long long)baseline.get_percentile(99), (unsigned long long)baseline.get_max(),
+    (unsigned long long)loaded.get_percentile(99), (unsigned long long)loaded.get_max());
+
+  // 滥用的客户端开始接收后, 剩下的请求继续被处理
+  unsigned char buf[4096];
+  long received = 0;
+  while (received < (long)sent * 259) {
+    ssize_t n = recv(abuser, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    received += n;
+  }
+  printf("abuser received all responses: %d\n", received == (long)sent * 259);
+  close(abuser);
+
+  server.stop();
+  th.join();
+
+  test_deferred_reset(&modbus_data);
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "modbus_data.h"
+#include "modbus_shm_export.h"
+
+#define SHM_PATH "/tmp/test_modbus_shm_export"
+#define ROUNDS 3000
+
+struct ReaderResult {
+  int reads;
+  int torn_pages;
+  int snapshots;
+  int torn_snapshots;
+  int zero_copy_pages;
+  int torn_zero_copy;
+};
+
+/* 另一个进程只读映射, 发布者每轮把所有保持寄存器写成同一个值, 一致的读取里所有值都相同 */
+static void run_reader(int fd)
+{
+  ReaderResult res;
+  memset(&res, 0, sizeof(res));
+  ModbusShmReader reader;
+  if (reader.open(SHM_PATH) == 0) {
+    int count = reader.get_count(SHM_HOLDING_REGS);
+    int start = reader.get_start_addr(SHM_HOLDING_REGS);
+    unsigned short *regs = new unsigned short[count];
+    while (true) {
+      if (reader.read(SHM_HOLDING_REGS, start, count, regs) == 0) {
+        res.reads++;
+        for (int i = 0; i < count; i += 64) {
+          for (int j = i + 1; j < i + 64 && j < count; j++) {
+            if (regs[j] != regs[i]) { res.torn_pages++; break; }
+          }
+        }
+      }
+      if (reader.read_snapshot(SHM_HOLDING_REGS, start, count, regs) == 0) {
+        res.snapshots++;
+        for (int i = 1; i < count; i++) {
+          if (regs[i] != regs[0]) { res.torn_snapshots++; break; }
+        }
+        if (regs[0] == ROUNDS) break;
+      }
+      uint32_t seq;
+      const unsigned short *page = (const unsigned short *)reader.get_page(SHM_HOLDING_REGS, 1, &seq);
+      bool same = true;
+      for (int j = 1; j < 64; j++) same = same && page[j] == page[0];
+      if (reader.check_page(SHM_HOLDING_REGS, 1, seq)) {
+        res.zero_copy_pages++;
+        if (!same) res.torn_zero_copy++;
+      }
+    }
+    delete[] regs;
+  }
+  if (write(fd, &res, sizeof(res)) != sizeof(res)) exit(1);
+  exit(0);
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusBaseData modbus_data(200, 10, 640, 30, 0, 0, 100, 0);
+  ModbusShmExport shm_export(SHM_PATH);
+  printf("set_shm_export: %d\n", modbus_data.set_shm_export(&shm_export));
+  printf("values per page: coils=%d, regs=%d\n",
+    shm_export.get_values_per_page(SHM_COIL_BITS), shm_export.get_values_per_page(SHM_HOLDING_REGS));
+
+  // 第一次发布只写入非0的页
+  unsigned short regs[640];
+  for (int i = 0; i < 640; i++) regs[i] = i;
+  modbus_data.write_holding_registers(100, regs, 640);
+  uchar bits[3] = { 1, 0, 1 };
+  modbus_data.write_coil_bits(150, bits, 3);
+  int pages = modbus_data.publish_shm_export();
+  printf("first publish: pages=%d, generation=%llu\n", pages, (unsigned long long)shm_export.get_generation());
+  pages = modbus_data.publish_shm_export();
+  printf("unchanged publish: pages=%d, generation=%llu\n", pages, (unsigned long long)shm_export.get_generation());
+  modbus_data.get_holding_register_struct(300)->set(12345);
+  pages = modbus_data.publish_shm_export();
+  printf("one register changed: pages=%d, generation=%llu\n", pages, (unsigned long long)shm_export.get_generation());
+
+  // 读者看到的布局和值
+  ModbusShmReader reader;
+  printf("reader open: %d\n", reader.open(SHM_PATH));
+  printf("holding: start=%d, count=%d\n", reader.get_start_addr(SHM_HOLDING_REGS), reader.get_count(SHM_HOLDING_REGS));
+  unsigned short vals[4];
+  int ret = reader.read(SHM_HOLDING_REGS, 298, 4, vals);
+  printf("read holding 298~301: ret=%d, %d %d %d %d\n", ret, vals[0], vals[1], vals[2], vals[3]);
+  uint64_t generation = 0;
+  ret = reader.read_snapshot(SHM_HOLDING_REGS, 160, 4, vals, &generation);
+  printf("snapshot holding 160~163: ret=%d, generation=%llu, %d %d %d %d\n", ret, (unsigned long long)generation, vals[0], vals[1], vals[2], vals[3]);
+  uchar coils[4];
+  ret = reader.read(SHM_COIL_BITS, 149, 4, coils);
+  printf("read coils 149~152: ret=%d, %d %d %d %d\n", ret, coils[0], coils[1], coils[2], coils[3]);
+  printf("read illegal addr: %d\n", reader.read(SHM_HOLDING_REGS, 99, 1, vals));
+  uint32_t seq;
+  const unsigned short *page = (const unsigned short *)reader.get_page(SHM_HOLDING_REGS, 3, &seq);
+  printf("zero copy page 3: first=%d, check=%d\n", page[0], reader.check_page(SHM_HOLDING_REGS, 3, seq));
+  modbus_data.get_holding_register_struct(100 + 3 * 64)->set(1);
+  modbus_data.publish_shm_export();
+  printf("zero copy page 3 after publish: check=%d\n", reader.check_page(SHM_HOLDING_REGS, 3, seq));
+  reader.close();
+
+  // 另一个进程在发布的同时读取
+  for (int i = 0; i < 640; i++) regs[i] = 0;
+  modbus_data.write_holding_registers(100, regs, 640);
+  modbus_data.publish_shm_export();
+  fflush(stdout);
+  int fds[2];
+  if (pipe(fds) != 0) return 1;
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    run_reader(fds[1]);
+  }
+  close(fds[1]);
+  for (int k = 1; k <= ROUNDS; k++) {
+    for (int i = 0; i < 640; i++) regs[i] = k;
+    modbus_data.write_holding_registers(100, regs, 640);
+    modbus_data.publish_shm_export();
+  }
+  ReaderResult res;
+  memset(&res, 0, sizeof(res));
+  if (read(fds[0], &res, sizeof(res)) != sizeof(res)) printf("reader failed\n");
+  waitpid(pid, NULL, 0);
+  close(fds[0]);
+  printf("concurrent reader: reads=%s, torn_pages=%d, snapshots=%s, torn_snapshots=%d, torn_zero_copy=%d\n",
+    res.reads > 0 ? "ok" : "none", res.torn_pages, res.snapshots > 0 ? "ok" : "none", res.torn_snapshots, res.torn_zero_copy);
+
+  // 其它数据结构按页收集原始数据发布
+  ModbusStructData struct_data(0, 0, 100, 0);
+  ModbusShmExport struct_export("/tmp/test_modbus_shm_export_struct");
+  struct_data.set_shm_export(&struct_export);
+  struct_data.get_holding_register_struct(70)->set(7);
+  printf("struct publish: pages=%d\n", struct_data.publish_shm_export());
+  reader.open("/tmp/test_modbus_shm_export_struct");
+  reader.read(SHM_HOLDING_REGS, 70, 1, vals);
+  printf("struct read 70: %d\n", vals[0]);
+  reader.close();
+
+  struct_data.set_shm_export(NULL);
+  printf("publish after unbind: %d\n", struct_data.publish_shm_export());
+  unlink(SHM_PATH);
+  unlink("/tmp/test_modbus_shm_export_struct");
+  return 0;
+}
@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "modbus_tcp_client.h"
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+enum SlowMode {
+  SLOW_NONE = 0,
+  SLOW_HALF = 1,     // 先发一半回复, 超过客户端的超时后再发剩下的部分
+  SLOW_TRICKLE = 2,  // 每40毫秒发一个字节, 每次都在超时内, 但整个回复超过超时
+  SLOW_DELAY = 3,    // 200毫秒后再回复
+};
+static int conn_fd = -1;
+static int slow_mode = SLOW_NONE;
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {
+  int mode = slow_mode;
+  slow_mode = SLOW_NONE;
+  if (mode == SLOW_HALF) {
+    send(conn_fd, res, res_len / 2, 0);
+    usleep(300 * 1000);
+    send(conn_fd, res + res_len / 2, res_len - res_len / 2, 0);
+    return;
+  }
+  if (mode == SLOW_TRICKLE) {
+    for (int i = 0; i < res_len; i++) {
+      send(conn_fd, res + i, 1, 0);
+      usleep(40 * 1000);
+    }
+    return;
+  }
+  if (mode == SLOW_DELAY) usleep(200 * 1000);
+  send(conn_fd, res, res_len, 0);
+}
+
+static void on_alarm(int sig) {}
+
+// 一个最简单的单连接Modbus TCP服务器, 仅用于演示客户端
+static void server_handle_(int listen_fd, ModbusData *modbus_data) {
+  // 定时信号只发给客户端所在的线程
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGALRM);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+  DataService service(modbus_data);
+  conn_fd = accept(listen_fd, NULL, NULL);
+  unsigned char buf[1024];
+  while (1) {
+    ssize_t n = recv(conn_fd, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    service.process_data(buf, n, callback);
+  }
+  close(conn_fd);
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  unsigned short input_regs[100];
+  for (int i = 0; i < 100; i++) input_regs[i] = i;
+  modbus_data.write_input_registers(0x00, input_regs, 100);
+
+  int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  int opt = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr));
+  listen(listen_fd, 1);
+  socklen_t len = sizeof(addr);
+  getsockname(listen_fd, (struct sockaddr *)&addr, &len);
+  std::thread th(server_handle_, listen_fd, &modbus_data);
+
+  // 同一个连接上最多16个请求同时在途
+  ModbusTCP::Client client(16);
+  int code = client.connect("127.0.0.1", ntohs(addr.sin_port));
+  printf("connect: %d\n", code);
+
+  // 单个请求
+  unsigned short w_regs[5] = {11, 22, 33, 44, 55};
+  code = client.write_holding_registers(0x00, w_regs, 5);
+  printf("write holding registers: %d\n", code);
+  unsigned short r_regs[5] = {0};
+  code = client.read_holding_registers(0x00, 5, r_regs);
+  print_datas<unsigned short>("read holding registers", r_regs, 5);
+
+  // 批量请求: 50个区间的读取在同一个连接上流水线发送, 而不是50次串行的来回
+  unsigned short batch_regs[50][2];
+  ModbusTCP::ClientRequest reqs[51];
+  for (int i = 0; i < 50; i++) {
+    reqs[i] = ModbusTCP::ClientRequest(MODBUS_FC_READ_INPUT_REGS, i * 2, 2, batch_regs[i]);
+  }
+  // 地址越界, 服务器会回复异常码0x02
+  reqs[50] = ModbusTCP::ClientRequest(MODBUS_FC_READ_INPUT_REGS, 99, 2, batch_regs[0]);
+  code = client.execute(reqs, 51);
+  printf("batch execute: %d, last request code: %d\n", code, reqs[50].code);
+  print_datas<unsigned short>("batch[10]", batch_regs[10], 2);
+  print_datas<unsigned short>("batch[49]", batch_regs[49], 2);
+
+  // 超时的请求的回复晚到时, 按事务标识丢弃, 连接上后面的请求不受影响
+  slow_mode = SLOW_HALF;
+  client.set_timeout(100);
+  code = client.read_input_registers(0x10, 2, r_regs);
+  printf("read with timeout: %d\n", code);
+  client.set_timeout(3000);
+  code = client.read_input_registers(0x20, 2, r_regs);
+  printf("read after timeout: %d, connected: %d\n", code, client.is_connected());
+  print_datas<unsigned short>("read after timeout", r_regs, 2);
+
+  // 超时按整个请求计算: 回复一直在断断续续地到达也会超时
+  slow_mode = SLOW_TRICKLE;
+  client.set_timeout(200);
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  code = client.read_input_registers(0x10, 2, r_regs);
+  gettimeofday(&end, NULL);
+  long elapsed_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+  printf("trickled response: %d, within deadline: %d\n", code, elapsed_ms < 400);
+
+  // 等待回复时被信号打断不算超时
+  struct sigaction sa = {};
+  sa.sa_handler = on_alarm;
+  sigaction(SIGALRM, &sa, NULL);
+  struct itimerval timer = {{0, 20000}, {0, 20000}};
+  setitimer(ITIMER_REAL, &timer, NULL);
+  slow_mode = SLOW_DELAY;
+  client.set_timeout(3000);
+  code = client.read_input_registers(0x30, 2, r_regs);
+  timer = {{0, 0}, {0, 0}};
+  setitimer(ITIMER_REAL, &timer, NULL);
+  printf("read with signals: %d\n", code);
+  print_datas<unsigned short>("read with signals", r_regs, 2);
+
+  client.disconnect();
+  th.join();
+  close(listen_fd);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include "modbus_tcp_proxy.h"
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+using ModbusData = ModbusBaseData;
+
+// 上游处理写单个寄存器很慢(比如设备忙)
+static void slow_plc_handler(ModbusTCP::DataSession *session, ModbusData *modbus_data, void *arg)
+{
+  if (session->get_request_data()[7] == MODBUS_FC_WRITE_SINGLE_REG) usleep(150 * 1000);
+  ModbusTCP::DataService<ModbusData>::process_session(session, modbus_data);
+}
+
+int main(int argc, char *arg[])
+{
+  // 上游设备(例如PLC)
+  ModbusData plc_data(100, 100, 100, 100);
+  unsigned short regs[10];
+  for (int i = 0; i < 10; i++) regs[i] = i * 10;
+  plc_data.write_input_registers(0x00, regs, 10);
+  plc_data.write_holding_registers(0x00, regs, 10);
+  unsigned short far_regs[2] = {500, 501};
+  plc_data.write_holding_registers(0x50, far_regs, 2);
+  ModbusTCP::Server<ModbusData> plc(&plc_data, 0, "127.0.0.1");
+  plc.set_session_handler(slow_plc_handler, NULL);
+  if (plc.start() != 0) {
+    printf("plc start failed\n");
+    return -1;
+  }
+  std::thread plc_th(&ModbusTCP::Server<ModbusData>::run, &plc);
+
+  // 代理: 缓存上游的0~9号输入寄存器和保持寄存器
+  ModbusData mirror(100, 100, 100, 100);
+  ModbusTCP::Proxy proxy(&mirror, "127.0.0.1", plc.get_port(), 0, "127.0.0.1");
+  proxy.add_poll_range(MODBUS_FC_READ_INPUT_REGS, 0, 10);
+  proxy.add_poll_range(MODBUS_FC_READ_HOLDING_REGS, 0, 10);
+  proxy.set_poll_interval(20);
+  proxy.set_upstream_timeout(300);
+  if (proxy.start() != 0) {
+    printf("proxy start failed\n");
+    plc.stop();
+    plc_th.join();
+    return -1;
+  }
+  std::thread proxy_th(&ModbusTCP::Proxy::run, &proxy);
+  while (proxy.get_poll_count() == 0) usleep(1000);
+
+  // HMI通过代理访问
+  ModbusTCP::Client hmi(16);
+  hmi.connect("127.0.0.1", proxy.get_port());
+  unsigned short vals[10];
+  int code = hmi.read_input_registers(0x00, 10, vals);
+  printf("read_input_registers via proxy: %d\n", code);
+  print_datas<unsigned short>("vals", vals, 10);
+
+  // 写请求转发给上游, 镜像同时更新
+  unsigned short wvals[3] = {1000, 1001, 1002};
+  code = hmi.write_holding_registers(0x02, wvals, 3);
+  printf("write_holding_registers via proxy: %d\n", code);
+  code = hmi.read_holding_registers(0x00, 10, vals);
+  printf("read_holding_registers via proxy: %d\n", code);
+  print_datas<unsigned short>("vals", vals, 10);
+  plc_data.read_holding_registers(0x00, 10, vals);
+  print_datas<unsigned short>("plc", vals, 10);
+
+  // 没有轮询的地址转发给上游, 回复的是上游的值
+  code = hmi.read_holding_registers(0x50, 2, vals);
+  printf("read uncached via proxy: %d\n", code);
+  print_datas<unsigned short>("vals", vals, 2);
+  // 只有一部分在轮询区间内也转发给上游
+  code = hmi.read_holding_registers(0x08, 4, vals);
+  printf("read partly cached via proxy: %d\n", code);
+  print_datas<unsigned short>("vals", vals, 4);
+  printf("poll_count>0: %d, forward_count: %lu\n", proxy.get_poll_count() > 0, proxy.get_forward_count());
+
+  // 上游处理写操作很慢时, 其它HMI的缓存读请求不受影响
+  std::thread writer([&]() {
+    ModbusTCP::Client slow_hmi(16);
+    slow_hmi.connect("127.0.0.1", proxy.get_port());
+    int ret = slow_hmi.write_single_holding_register(0x01, 1234);
+    printf("slow write via proxy: %d\n", ret);
+    slow_hmi.disconnect();
+  });
+  usleep(50 * 1000);
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+  code = hmi.read_input_registers(0x00, 10, vals);
+  long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+  printf("cached read during slow write: %d, not blocked: %d\n", code, elapsed < 100);
+  writer.join();
+
+  // 上游不可达后, 之前缓存的区间不再由镜像回复
+  plc.stop();
+  plc_th.join();
+  code = ModbusTCP::EXP_NONE;
+  for (int i = 0; i < 100 && code == ModbusTCP::EXP_NONE; i++) {
+    usleep(20 * 1000);
+    code = hmi.read_input_registers(0x00, 10, vals);
+  }
+  printf("read after upstream lost: 0x%02X\n", code);
+
+  hmi.disconnect();
+  proxy.stop();
+  proxy_th.join();
+  return 0;
+}
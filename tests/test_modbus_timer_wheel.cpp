@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "modbus_timer_wheel.h"
+#include "modbus_tcp_server.h"
+
+using ModbusData = ModbusBaseData;
+using Server = ModbusTCP::Server<ModbusData>;
+
+struct TestTimer {
+  ModbusTimer timer;
+  ModbusTimerWheel *wheel;
+  unsigned int timeout;  // 超时(毫秒)
+  uint64_t fired_ms;     // 回调时的时间
+  int fired;
+  TestTimer *cancel;     // 回调里要取消的定时器
+};
+
+static void on_timer(ModbusTimer *timer, void *arg)
+{
+  TestTimer *t = (TestTimer *)arg;
+  t->fired++;
+  t->fired_ms = t->wheel->get_now();
+  if (t->cancel != NULL) t->wheel->cancel(&t->cancel->timer);
+}
+
+static void init_test_timer(TestTimer *t, ModbusTimerWheel *wheel, unsigned int timeout)
+{
+  ModbusTimerWheel::init_timer(&t->timer, on_timer, t);
+  t->wheel = wheel;
+  t->timeout = timeout;
+  t->fired_ms = 0;
+  t->fired = 0;
+  t->cancel = NULL;
+}
+
+// 按tick推进时间, 检查每个定时器都只回调一次, 且在[timeout, timeout + tick]之内
+static int check_timers(ModbusTimerWheel *wheel, TestTimer *timers, int count, uint64_t start, uint64_t end)
+{
+  for (uint64_t now = start; now <= end; now += 10) wheel->advance(now);
+  int errors = 0;
+  for (int i = 0; i < count; i++) {
+    uint64_t elapsed = timers[i].fired_ms - start;
+    if (timers[i].fired != 1 || elapsed < timers[i].timeout || elapsed > timers[i].timeout + 10) errors++;
+  }
+  return errors;
+}
+
+static int connect_server(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  struct timeval tv = {2, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+int main(int argc, char *arg[])
+{
+  // 不同层的定时器(包括超过第一层范围需要下放的)
+  {
+    ModbusTimerWheel wheel(10, 1000);
+    unsigned int timeouts[6] = {0, 5, 100, 700, 50000, 3000000};
+    TestTimer timers[6];
+    for (int i = 0; i < 6; i++) {
+      init_test_timer(&timers[i], &wheel, timeouts[i]);
+      wheel.schedule(&timers[i].timer, timeouts[i]);
+    }
+    printf("levels: pending=%d, next_timeout=%d\n", wheel.get_pending_count(), wheel.get_next_timeout());
+    int errors = check_timers(&wheel, timers, 6, 1000, 1000 + 3000010);
+    printf("levels: errors=%d, pending=%d, next_timeout=%d\n", errors, wheel.get_pending_count(), wheel.get_next_timeout());
+  }
+
+  // 按get_next_timeout等待的事件循环: 不是每个tick都醒, 到期时间也不会推迟
+  {
+    unsigned int timeouts[3] = {200, 700, 50000};
+    for (int i = 0; i < 3; i++) {
+      ModbusTimerWheel wheel(10, 1000);
+      TestTimer t;
+      init_test_timer(&t, &wheel, timeouts[i]);
+      wheel.schedule(&t.timer, timeouts[i]);
+      uint64_t now = 1000;
+      int wakeups = 0;
+      while (t.fired == 0 && wakeups < 10000) {
+        now += wheel.get_next_timeout();
+        wheel.advance(now);
+        wakeups++;
+      }
+      printf("next timeout %u: wakeups=%d, fired after %d ms, next_timeout=%d\n", timeouts[i], wakeups,
+        (int)(t.fired_ms - 1000), wheel.get_next_timeout());
+    }
+  }
+
+  // 取消和在回调里取消同一批到期的定时器
+  {
+    ModbusTimerWheel wheel(10);
+    TestTimer a, b, c;
+    init_test_timer(&a, &wheel, 50);
+    init_test_timer(&b, &wheel, 50);
+    init_test_timer(&c, &wheel, 50);
+    a.cancel = &b;
+    wheel.schedule(&a.timer, 50);
+    wheel.schedule(&b.timer, 50);
+    wheel.schedule(&c.timer, 50);
+    wheel.cancel(&c.timer);
+    wheel.cancel(&c.timer);
+    for (uint64_t now = 0; now <= 100; now += 10) wheel.advance(now);
+    printf("cancel: a=%d b=%d c=%d pending=%d\n", a.fired, b.fired, c.fired, wheel.get_pending_count());
+  }
+
+  // 10万个定时器, 时间跳跃推进
+  {
+    const int count = 100000;
+    ModbusTimerWheel wheel(10);
+    TestTimer *timers = new TestTimer[count];
+    srand(1);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+      init_test_timer(&timers[i], &wheel, rand() % 60000);
+      wheel.schedule(&timers[i].timer, timers[i].timeout);
+    }
+    // 重新添加一半(模拟连接有数据时重新计时)
+    for (int i = 0; i < count; i += 2) wheel.schedule(&timers[i].timer, timers[i].timeout);
+    long schedule_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    int errors = check_timers(&wheel, timers, count, 0, 60010);
+    printf("100k timers: errors=%d, pending=%d\n", errors, wheel.get_pending_count());
+    fprintf(stderr, "schedule: %.1f ns/timer\n", (double)schedule_ns / (count * 1.5));
+    delete[] timers;
+  }
+
+  // 服务器: 不完整的帧超时丢弃, 空闲连接超时关闭
+  ModbusData modbus_data(100, 100, 100, 100);
+  unsigned short regs[2] = {0x1234, 0x5678};
+  modbus_data.write_holding_registers(0, regs, 2);
+  Server server(&modbus_data, 0, "127.0.0.1");
+  server.set_idle_timeout(500);
+  server.set_frame_timeout(100);
+  if (server.start() != 0) {
+    printf("server start failed\n");
+    return -1;
+  }
+  std::thread th(&Server::run, &server);
+
+  int idle_fd = connect_server(server.get_port());
+  int fd = connect_server(server.get_port());
+  unsigned char req[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x02};
+  // 只发半帧, 超时后被丢弃, 之后的请求不受影响
+  send(fd, req, 6, 0);
+  for (int i = 0; i < 100 && server.get_frame_expired_count() == 0; i++) usleep(10000);
+  printf("partial frame expired: %d\n", (int)server.get_frame_expired_count());
+  send(fd, req, 12, 0);
+  unsigned char res[64];
+  ssize_t n = recv(fd, res, sizeof(res), 0);
+  printf("response after expiry: len=%d data=%02X%02X %02X%02X\n", (int)n, res[9], res[10], res[11], res[12]);
+
+  // 一直有请求的连接不会被关闭, 没有数据的连接被关闭
+  for (int i = 0; i < 8; i++) {
+    usleep(100000);
+    send(fd, req, 12, 0);
+    n = recv(fd, res, sizeof(res), 0);
+  }
+  printf("active connection alive: %d\n", n == 13);
+  n = recv(idle_fd, res, sizeof(res), 0);
+  printf("idle connection closed: %d, idle_closed=%d, connections=%d\n", n == 0, (int)server.get_idle_closed_count(), server.get_connection_count());
+  close(idle_fd);
+  close(fd);
+
+  server.stop();
+  th.join();
+  return 0;
+}
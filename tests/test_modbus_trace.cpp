@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "modbus_tcp_data.h"
+#include "modbus_trace.h"
+#include "modbus_log.h"
+
+using ModbusData = ModbusBaseData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+static const char *phase_names[] = {"", "frame", "dispatch", "hook", "encode"};
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {}
+
+void worker(ModbusData *modbus_data, int count)
+{
+  DataService service(modbus_data);
+  // 读保持寄存器0x00开始的10个
+  unsigned char read_regs[12] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+  // 写单个保持寄存器0x05, 分两次收到
+  unsigned char write_reg[12] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x05, 0x12, 0x34};
+  for (int i = 0; i < count; i++) {
+    service.process_data(read_regs, 12, callback);
+    service.process_data(write_reg, 5, callback);
+    service.process_data(write_reg + 5, 7, callback);
+  }
+}
+
+// 统计错误日志的条数
+static int error_logs = 0;
+static void count_sink(void *arg, int level, uint64_t timestamp_ns, const char *msg, int length)
+{
+  if (level == MODBUS_LOG_LEVEL_ERROR) error_logs++;
+  ModbusLog::stderr_sink(arg, level, timestamp_ns, msg, length);
+}
+
+// 读取当前线程的跟踪文件, 打印每个阶段的记录数和前几条记录
+void dump(const char *dir)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/modbus_trace.%d.%d.bin", dir, (int)getpid(), (int)syscall(SYS_gettid));
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    printf("open %s failed\n", path);
+    return;
+  }
+  ModbusTraceHeader header;
+  size_t n = fread(&header, sizeof(header), 1, fp);
+  printf("header: n=%d, magic_ok=%d, capacity=%u, write_index=%llu\n", (int)n, header.magic == MODBUS_TRACE_MAGIC,
+    header.capacity, (unsigned long long)header.write_index);
+  int counts[5] = {0};
+  for (unsigned long long i = 0; i < header.write_index && i < header.capacity; i++) {
+    ModbusTraceRecord rec;
+    if (fread(&rec, sizeof(rec), 1, fp) != 1) break;
+    if (rec.phase <= 4) counts[rec.phase]++;
+    if (i < 8) {
+      printf("  record %llu: phase=%s, transaction_id=%d, func_code=0x%02X, addr=%d, quantity=%d, ticks=%u\n",
+        i, phase_names[rec.phase <= 4 ? rec.phase : 0], rec.transaction_id, rec.func_code, rec.addr, rec.quantity, rec.duration_ticks);
+    }
+  }
+  fclose(fp);
+  for (int i = 1; i <= 4; i++) {
+    printf("phase %s: %d\n", phase_names[i], counts[i]);
+  }
+  unlink(path);
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  const char *dir = "/tmp";
+
+  // 关闭时跟踪点不写记录
+  worker(&modbus_data, 10);
+  printf("enabled: %d\n", ModbusTrace::is_enabled());
+
+  // 目录不存在: 每个线程只尝试一次创建缓冲区, 整个进程只报告一次
+  ModbusLog::set_sink(count_sink, NULL);
+  ModbusTrace::enable("/nonexistent/modbus_trace");
+  worker(&modbus_data, 10);
+  std::thread th(worker, &modbus_data, 10);
+  th.join();
+  ModbusTrace::disable();
+  ModbusLog::flush();
+  printf("missing dir: error logs=%d\n", error_logs);
+
+  // 容量不是2的幂时向上取整(100 -> 128), 重新开启后之前失败的线程重新创建
+  ModbusTrace::enable(dir, 100);
+  printf("enabled: %d\n", ModbusTrace::is_enabled());
+  worker(&modbus_data, 10);
+  ModbusTrace::disable();
+  // 每轮2个请求: 读 = frame + dispatch + hook + encode, 写 = frame + dispatch + hook
+  dump(dir);
+  return 0;
+}
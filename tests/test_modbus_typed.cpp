@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modbus_data.h"
+
+static const char *ORDER_NAMES[] = {"ABCD", "DCBA", "BADC", "CDAB"};
+
+static void print_regs(const char *str, const unsigned short *regs, int length)
+{
+  printf("%s: ", str);
+  for (int i = 0; i < length; i++) {
+    printf("0x%04X ", regs[i]);
+  }
+  printf("\n");
+}
+
+int set_reg(unsigned short val)
+{
+  printf("set_reg: 0x%04X\n", val);
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+  unsigned short regs[8];
+  char name[32];
+
+  // 四种字节顺序
+  float f = 1.5f; // 0x3FC00000
+  uint32_t u32 = 0xAABBCCDD;
+  uint64_t u64 = 0x1122334455667788ULL;
+  for (int order = MODBUS_ORDER_ABCD; order <= MODBUS_ORDER_CDAB; order++) {
+    snprintf(name, sizeof(name), "float %s", ORDER_NAMES[order]);
+    ModbusTyped::encode(&f, 1, 2, order, regs);
+    print_regs(name, regs, 2);
+    snprintf(name, sizeof(name), "uint32 %s", ORDER_NAMES[order]);
+    ModbusTyped::encode(&u32, 1, 2, order, regs);
+    print_regs(name, regs, 2);
+    snprintf(name, sizeof(name), "uint64 %s", ORDER_NAMES[order]);
+    ModbusTyped::encode(&u64, 1, 4, order, regs);
+    print_regs(name, regs, 4);
+  }
+
+  // SIMD和逐个转换的结果一致, 解码后和原来的值一致(覆盖不足16字节的尾部)
+  unsigned char values[37 * 8];
+  unsigned short simd[37 * 4], scalar[37 * 4];
+  unsigned char decoded[37 * 8];
+  srand(1);
+  for (int i = 0; i < (int)sizeof(values); i++) values[i] = rand();
+  int mismatched = 0;
+  for (int words = 2; words <= 4; words += 2) {
+    for (int order = MODBUS_ORDER_ABCD; order <= MODBUS_ORDER_CDAB; order++) {
+      for (int count = 0; count <= 37; count++) {
+        ModbusTyped::encode(values, count, words, order, simd);
+        ModbusTyped::encode_scalar(values, count, words, order, scalar);
+        ModbusTyped::decode(simd, count, words, order, decoded);
+        if (memcmp(simd, scalar, count * words * 2) != 0 || memcmp(decoded, values, count * words * 2) != 0) mismatched++;
+      }
+    }
+  }
+  printf("simd vs scalar mismatched: %d\n", mismatched);
+  printf("bad arguments: words=%d order=%d\n", ModbusTyped::encode(values, 1, 3, 0, regs), ModbusTyped::encode(values, 1, 2, 4, regs));
+
+  // 基本型数据结构: 直接转换到寄存器的存储
+  ModbusBaseData base_data(10, 10, 10, 10);
+  float floats[2] = {1.5f, -2.0f};
+  base_data.write_input_values(2, floats, 2);
+  base_data.read_input_registers(2, 4, regs);
+  print_regs("base input regs", regs, 4);
+  float r_floats[2];
+  base_data.read_input_values(2, 2, r_floats, MODBUS_ORDER_ABCD);
+  printf("base input floats: %g %g\n", r_floats[0], r_floats[1]);
+  int32_t ints[2] = {-1, 0x12345678};
+  base_data.write_holding_values(0, ints, 2, MODBUS_ORDER_CDAB);
+  base_data.read_holding_registers(0, 4, regs);
+  print_regs("base holding int32 CDAB", regs, 4);
+  printf("illegal address: %d %d %d\n", base_data.write_input_values(8, floats, 2), base_data.read_holding_values(-1, 1, r_floats),
+    base_data.write_input_values(0, floats, 1, 5));
+
+  // 扩展型数据结构: 逐个寄存器写入, 额外绑定的写方法照常调用
+  ModbusStructData struct_data(10, 10, 10, 10);
+  struct_data.get_holding_register_struct(1)->bind_set(set_reg);
+  struct_data.get_holding_register_struct(2)->bind_set(set_reg);
+  double dbl = 1.0; // 0x3FF0000000000000
+  struct_data.write_holding_values(1, &dbl, 1);
+  double r_dbl = 0;
+  struct_data.read_holding_values(1, 1, &r_dbl);
+  printf("struct holding double: %g\n", r_dbl);
+
+  // 指针型数据结构: 大于一个分块(256个寄存器)时分多次写入
+  ModbusBasePtrData ptr_data(10, 10, 10, 1000);
+  uint64_t u64s[200];
+  for (int i = 0; i < 200; i++) u64s[i] = 0x0001000200030004ULL * (i + 1);
+  ptr_data.write_input_values(100, u64s, 200, MODBUS_ORDER_DCBA);
+  uint64_t r_u64s[200];
+  ptr_data.read_input_values(100, 200, r_u64s, MODBUS_ORDER_DCBA);
+  ptr_data.read_input_registers(100, 4, regs);
+  print_regs("ptr input uint64 DCBA", regs, 4);
+  printf("ptr input uint64 round trip: %d\n", memcmp(u64s, r_u64s, sizeof(u64s)) == 0);
+  return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "modbus_udp_server.h"
+
+using ModbusData = ModbusBaseData;
+using UdpServer = ModbusTCP::UdpServer<ModbusData>;
+
+static void build_read_request(unsigned char *req, unsigned short tid, unsigned short addr, unsigned short quantity)
+{
+  unsigned char head[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x01, 0x03};
+  memcpy(req, head, 8);
+  ModbusTCP::HexData::bin16_to_8(tid, req);
+  ModbusTCP::HexData::bin16_to_8(addr, req + 8);
+  ModbusTCP::HexData::bin16_to_8(quantity, req + 10);
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  unsigned short regs[4] = {0x0102, 0x0304, 0x0506, 0x0708};
+  modbus_data.write_holding_registers(0, regs, 4);
+  UdpServer server(&modbus_data, 0, "127.0.0.1");
+  if (server.start(4 * 1024 * 1024) != 0) {
+    printf("server start failed\n");
+    return -1;
+  }
+  std::thread th(&UdpServer::run, &server);
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct timeval tv = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(server.get_port());
+  connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+
+  // 单个请求
+  unsigned char req[12];
+  unsigned char res[260];
+  build_read_request(req, 0x1234, 0, 4);
+  send(fd, req, 12, 0);
+  ssize_t n = recv(fd, res, sizeof(res), 0);
+  printf("response: len=%d tid=0x%04X data=", (int)n, ModbusTCP::HexData::bin8_to_u16(res));
+  for (int i = 9; i < n; i++) printf("%02X ", res[i]);
+  printf("\n");
+
+  // 长度字段和报文长度不一致、报文太短的都被丢弃, 不回复
+  unsigned char bad[12];
+  memcpy(bad, req, 12);
+  bad[5] = 0x08;
+  send(fd, bad, 12, 0);
+  send(fd, req, 7, 0);
+  // 在一个报文里放两帧也不行(UDP不拆包)
+  unsigned char two[24];
+  memcpy(two, req, 12);
+  memcpy(two + 12, req, 12);
+  send(fd, two, 24, 0);
+  build_read_request(req, 0x5678, 2, 2);
+  send(fd, req, 12, 0);
+  n = recv(fd, res, sizeof(res), 0);
+  printf("after bad datagrams: tid=0x%04X discarded=%d\n", ModbusTCP::HexData::bin8_to_u16(res), (int)server.get_discarded_count());
+
+  // 流水线: 每次最多64个请求在途, 统计收到的回复和事务标识是否对应
+  const int total = 100000;
+  const int window = 64;
+  int sent = 0, received = 0, mismatched = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  while (received < total) {
+    while (sent < total && sent - received < window) {
+      build_read_request(req, sent & 0xFFFF, sent % 4, 1);
+      if (send(fd, req, 12, 0) != 12) break;
+      sent++;
+    }
+    n = recv(fd, res, sizeof(res), 0);
+    if (n <= 0) break;
+    unsigned short tid = ModbusTCP::HexData::bin8_to_u16(res);
+    if (n != 11 || ModbusTCP::HexData::bin8_to_u16(res + 9) != regs[tid % 4]) mismatched++;
+    received++;
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("pipelined: received=%d mismatched=%d\n", received, mismatched);
+  fprintf(stderr, "%.0f requests/s\n", received / seconds);
+
+  close(fd);
+  server.stop();
+  th.join();
+  printf("datagrams=%d send_failed=%d\n", (int)server.get_datagram_count(), (int)server.get_send_failed_count());
+  return 0;
+}
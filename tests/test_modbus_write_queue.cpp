@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include "modbus_tcp_data.h"
+#include "modbus_write_queue.h"
+
+using ModbusData = ModbusStructData;
+using DataService = ModbusTCP::DataService<ModbusData>;
+
+static std::thread::id control_thread_id;
+static std::atomic<int> set_calls(0);
+static std::atomic<int> set_calls_off_control(0);
+
+template <class T>
+void print_datas(std::string str, const T *data, int length)
+{
+  printf("%s: ", str.c_str());
+  for (int i = 0; i < length; i++) {
+    printf("%d ", data[i]);
+  }
+  printf("\n");
+}
+
+void callback(const unsigned char *req, const int req_len, const unsigned char *res, const int res_len) {
+  print_datas<unsigned char>("  response", res, res_len);
+}
+
+int set_reg(unsigned short val)
+{
+  // 额外绑定的写方法只会在控制线程里调用
+  set_calls++;
+  if (std::this_thread::get_id() != control_thread_id) set_calls_off_control++;
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+  ModbusData modbus_data(100, 100, 100, 100);
+  ModbusWriteQueue queue(4);
+  DataService service(&modbus_data);
+  unsigned short regs[10];
+  unsigned char bits[10];
+
+  modbus_data.set_write_queue(&queue);
+  control_thread_id = std::this_thread::get_id();
+  modbus_data.get_holding_register_struct(0x01)->bind_set(set_reg);
+
+  // 写保持寄存器(0x10)马上回复, 但是在取出队列之前读到的仍然是旧的值
+  printf("write multiple holding registers\n");
+  unsigned char write_regs[19] = {0x00, 0x01, 0x00, 0x00, 0x00, 0x0D, 0x01, 0x10, 0x00, 0x00, 0x00, 0x03, 0x06, 0x00, 0x0A, 0x00, 0x0B, 0x00, 0x0C};
+  service.process_data(write_regs, 19, callback);
+  modbus_data.read_holding_registers(0x00, 3, regs);
+  print_datas<unsigned short>("  before drain", regs, 3);
+  printf("  drained=%d\n", modbus_data.drain_write_queue());
+  modbus_data.read_holding_registers(0x00, 3, regs);
+  print_datas<unsigned short>("  after drain", regs, 3);
+
+  // 写线圈(0x0F) + 掩码写(0x16)
+  printf("write multiple coils + mask write\n");
+  unsigned char write_bits[15] = {0x00, 0x02, 0x00, 0x00, 0x00, 0x09, 0x01, 0x0F, 0x00, 0x00, 0x00, 0x0A, 0x02, 0xCD, 0x01};
+  service.process_data(write_bits, 15, callback);
+  unsigned char mask_write[14] = {0x00, 0x03, 0x00, 0x00, 0x00, 0x08, 0x01, 0x16, 0x00, 0x02, 0x00, 0xF2, 0x00, 0x25};
+  service.process_data(mask_write, 14, callback);
+  printf("  queued=%u, drained=%d\n", queue.get_size(), modbus_data.drain_write_queue());
+  modbus_data.read_coil_bits(0x00, 10, bits);
+  print_datas<unsigned char>("  coils", bits, 10);
+  modbus_data.read_holding_registers(0x02, 1, regs);
+  print_datas<unsigned short>("  reg 0x02", regs, 1);
+
+  // 队列满时回复异常码0x06
+  printf("queue full\n");
+  unsigned char write_reg[12] = {0x00, 0x04, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x05, 0x00, 0x07};
+  for (int i = 0; i < 5; i++) service.process_data(write_reg, 12, callback);
+  printf("  rejected=%d, drained=%d\n", (int)queue.get_rejected_count(), modbus_data.drain_write_queue());
+
+  // 网络线程和控制循环同时运行
+  printf("network thread + control loop\n");
+  ModbusWriteQueue big_queue(64);
+  modbus_data.set_write_queue(&big_queue);
+  set_calls = 0;
+  std::atomic<bool> done(false);
+  std::thread net([&]() {
+    unsigned char req[12] = {0x00, 0x05, 0x00, 0x00, 0x00, 0x06, 0x01, 0x06, 0x00, 0x01, 0x00, 0x00};
+    for (int i = 1; i <= 1000; i++) {
+      req[10] = i >> 8;
+      req[11] = i & 0xFF;
+      // 队列满时(回复0x06)重试, 模拟客户端重发
+      while (1) {
+        ModbusTCP::DataSession session(12, 260);
+        session.set_request_data(req, 12);
+        DataService::process_session(&session, &modbus_data);
+        if (!(session.get_response_data()[7] & 0x80)) break;
+        std::this_thread::yield();
+      }
+    }
+    done = true;
+  });
+  int cycles = 0;
+  while (!done || big_queue.get_size() > 0) {
+    modbus_data.drain_write_queue();
+    cycles++;
+    usleep(100);
+  }
+  net.join();
+  modbus_data.drain_write_queue();
+  modbus_data.read_holding_registers(0x01, 1, regs);
+  printf("  last value=%d, set calls=%d, set calls off control thread=%d, cycles>0=%d\n",
+    regs[0], set_calls.load(), set_calls_off_control.load(), cycles > 0);
+
+  // 解绑后恢复直接写
+  modbus_data.set_write_queue(NULL);
+  regs[0] = 99;
+  modbus_data.write_holding_registers(0x03, regs, 1);
+  modbus_data.read_holding_registers(0x03, 1, regs);
+  printf("direct write after unbind: %d\n", regs[0]);
+  return 0;
+}